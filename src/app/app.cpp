@@ -25,6 +25,7 @@
 #include "app/file_system.h"
 #include "app/gui_xml.h"
 #include "app/i18n/strings.h"
+#include "app/image_swap_manager.h"
 #include "app/ini_file.h"
 #include "app/log.h"
 #include "app/modules.h"
@@ -36,6 +37,8 @@
 #include "app/resource_finder.h"
 #include "app/send_crash.h"
 #include "app/site.h"
+#include "app/startup_tasks.h"
+#include "app/startup_trace.h"
 #include "app/tools/active_tool.h"
 #include "app/tools/tool_box.h"
 #include "app/ui/backup_indicator.h"
@@ -56,7 +59,9 @@
 #include "base/fs.h"
 #include "base/scoped_lock.h"
 #include "base/split_string.h"
+#include "doc/palette.h"
 #include "doc/sprite.h"
+#include "doc/trace_events.h"
 #include "fmt/format.h"
 #include "render/render.h"
 #include "she/display.h"
@@ -85,15 +90,14 @@ using namespace ui;
 
 class App::CoreModules {
 public:
+  // The log file is created first so the background tasks can log
+  // messages from the beginning.
+  LoggerModule m_loggerModule;
   ConfigModule m_configModule;
   Preferences m_preferences;
-};
 
-class App::LoadLanguage {
-public:
-  LoadLanguage(Preferences& pref,
-               Extensions& exts) {
-    Strings::createInstance(pref, exts);
+  CoreModules(const bool createLogInDesktop)
+    : m_loggerModule(createLogInDesktop) {
   }
 };
 
@@ -105,36 +109,55 @@ public:
   typedef app::Context ContextT;
 #endif
 
-  LoggerModule m_loggerModule;
   FileSystemModule m_file_system_module;
-  Extensions m_extensions;
-  // Load main language (after loading the extensions)
-  LoadLanguage m_loadLanguage;
+  // Loaded in a background task (see App::initialize())
+  std::unique_ptr<Extensions> m_extensions;
 #ifdef ENABLE_UI
-  tools::ToolBox m_toolbox;
-  tools::ActiveToolManager m_activeToolManager;
+  // GUI-only modules are created on first use (so they are not
+  // loaded in --batch mode if they aren't needed)
+  std::unique_ptr<tools::ToolBox> m_toolbox;
+  std::unique_ptr<tools::ActiveToolManager> m_activeToolManager;
 #endif
   Commands m_commands;
   ContextT m_context;
 #ifdef ENABLE_UI
-  RecentFiles m_recent_files;
+  std::unique_ptr<RecentFiles> m_recent_files;
   InputChain m_inputChain;
   clipboard::ClipboardManager m_clipboardManager;
 #endif
+  Preferences& m_pref;
   // This is a raw pointer because we want to delete this explicitly.
   app::crash::DataRecovery* m_recovery;
 
-  Modules(const bool createLogInDesktop,
+  Modules(std::unique_ptr<Extensions>&& extensions,
           Preferences& pref)
-    : m_loggerModule(createLogInDesktop)
-    , m_loadLanguage(pref, m_extensions)
-#ifdef ENABLE_UI
-    , m_activeToolManager(&m_toolbox)
-    , m_recent_files(pref.general.recentItems())
-#endif
+    : m_extensions(std::move(extensions))
+    , m_pref(pref)
     , m_recovery(nullptr) {
   }
 
+#ifdef ENABLE_UI
+  tools::ToolBox* toolBox() {
+    if (!m_toolbox) {
+      StartupTrace::Scope trace("ToolBox");
+      m_toolbox.reset(new tools::ToolBox);
+    }
+    return m_toolbox.get();
+  }
+
+  tools::ActiveToolManager* activeToolManager() {
+    if (!m_activeToolManager)
+      m_activeToolManager.reset(new tools::ActiveToolManager(toolBox()));
+    return m_activeToolManager.get();
+  }
+
+  RecentFiles* recentFiles() {
+    if (!m_recent_files)
+      m_recent_files.reset(new RecentFiles(m_pref.general.recentItems()));
+    return m_recent_files.get();
+  }
+#endif
+
   app::crash::DataRecovery* recovery() {
     return m_recovery;
   }
@@ -182,18 +205,14 @@ void App::initialize(const AppOptions& options)
   m_isGui = false;
 #endif
   m_isShell = options.startShell();
-  m_coreModules = new CoreModules;
 
-#ifdef _WIN32
-  if (options.disableWintab() ||
-      !preferences().experimental.loadWintabDriver()) {
-    she::instance()->useWintabAPI(false);
+#ifdef ENABLE_TRACE_EVENTS
+  if (!options.traceEventsFilename().empty()) {
+    doc::trace::start(options.traceEventsFilename());
+    doc::trace::set_thread_name("main");
   }
 #endif
 
-  if (m_isGui)
-    m_uiSystem.reset(new ui::UISystem);
-
   bool createLogInDesktop = false;
   switch (options.verboseLevel()) {
     case AppOptions::kNoVerbose:
@@ -208,13 +227,88 @@ void App::initialize(const AppOptions& options)
       break;
   }
 
+  m_startupTasks.reset(new StartupTasks);
+  {
+    StartupTrace::Scope trace("CoreModules");
+    m_coreModules = new CoreModules(createLogInDesktop);
+  }
+
+  // Extensions and the main language (which can be included in an
+  // extension) are loaded in the background while the UI system is
+  // initialized. Commands need the strings, so we wait them before
+  // creating the modules. (The "strings" task only reads the
+  // language from the preferences.)
+  auto extensions = std::make_shared<std::unique_ptr<Extensions> >();
+  m_startupTasks->run(
+    "extensions", { },
+    [extensions]{ extensions->reset(new Extensions); });
+  m_startupTasks->run(
+    "strings", { "extensions" },
+    [this, extensions]{ Strings::createInstance(preferences(), **extensions); });
+
+#ifdef ENABLE_UI
+  // gui.xml is parsed in the background while the UI system and
+  // the first modules are initialized.
+  if (m_isGui)
+    m_startupTasks->run("gui.xml", { }, []{ GuiXml::instance(); });
+#endif
+
+#ifdef _WIN32
+  if (options.disableWintab() ||
+      !preferences().experimental.loadWintabDriver()) {
+    she::instance()->useWintabAPI(false);
+  }
+#endif
+
+  if (m_isGui) {
+    StartupTrace::Scope trace("UISystem");
+    m_uiSystem.reset(new ui::UISystem);
+  }
+
   // Load modules
-  m_modules = new Modules(createLogInDesktop, preferences());
-  m_legacy = new LegacyModules(isGui() ? REQUIRE_INTERFACE: 0);
+  m_startupTasks->wait("gui.xml");
+  m_startupTasks->wait("strings");
+  {
+    StartupTrace::Scope trace("Modules");
+    m_modules = new Modules(std::move(*extensions), preferences());
+  }
+
+  // Create the file formats in this thread, so they can be used
+  // from the background tasks.
+  FileFormatsManager::instance();
+
+  // Load or create the default palette, or migrate the default
+  // palette from an old format palette to the new one, etc.
+  auto defaultPal = std::make_shared<std::unique_ptr<Palette> >();
+  m_startupTasks->run(
+    "palette", { },
+    [defaultPal]{ defaultPal->reset(read_default_palette()); });
+
 #ifdef ENABLE_UI
-  m_brushes.reset(new AppBrushes);
+  if (isGui()) {
+    // The user brushes are only needed in GUI mode (in --batch mode
+    // they are loaded on demand by App::brushes()). This task runs
+    // after "palette" because both can create the user directory.
+    m_startupTasks->run(
+      "brushes", { "palette" },
+      [this]{ m_brushes.reset(new AppBrushes); });
+
+    // Create the tools now (in --batch mode they are created on
+    // demand by the first command that needs them).
+    m_modules->activeToolManager();
+    m_modules->recentFiles();
+  }
 #endif
 
+  {
+    StartupTrace::Scope trace("LegacyModules");
+    m_legacy = new LegacyModules(isGui() ? REQUIRE_INTERFACE: 0);
+  }
+
+  // Move cold cel images to the swap file (it's created after the
+  // legacy modules because it uses a ui::Timer in GUI mode)
+  m_imageSwap.reset(new ImageSwapManager(&m_modules->m_context, preferences()));
+
   // Data recovery is enabled only in GUI mode
   if (isGui() && preferences().general.dataRecovery())
     m_modules->createDataRecovery();
@@ -222,9 +316,10 @@ void App::initialize(const AppOptions& options)
   if (isPortable())
     LOG("APP: Running in portable mode\n");
 
-  // Load or create the default palette, or migrate the default
-  // palette from an old format palette to the new one, etc.
-  load_default_palette();
+  m_startupTasks->wait("palette");
+  if (*defaultPal)
+    set_default_palette(defaultPal->get());
+  set_current_palette(nullptr, true);
 
 #ifdef ENABLE_UI
   // Initialize GUI interface
@@ -243,7 +338,10 @@ void App::initialize(const AppOptions& options)
     ui::Manager::getDefault()->invalidate();
 
     // Create the main window and show it.
-    m_mainWindow.reset(new MainWindow);
+    {
+      StartupTrace::Scope trace("MainWindow");
+      m_mainWindow.reset(new MainWindow);
+    }
 
     // Default status of the main window.
     app_rebuild_documents_tabs();
@@ -260,9 +358,14 @@ void App::initialize(const AppOptions& options)
   }
 #endif  // ENABLE_UI
 
+  // Wait the rest of background tasks (e.g. brushes)
+  m_startupTasks->waitAll();
+  m_startupTasks.reset();
+
   // Process options
   LOG("APP: Processing options...\n");
   {
+    StartupTrace::Scope trace("CLI");
     std::unique_ptr<CliDelegate> delegate;
     if (options.previewCLI())
       delegate.reset(new PreviewCliDelegate);
@@ -274,6 +377,9 @@ void App::initialize(const AppOptions& options)
   }
 
   she::instance()->finishLaunching();
+
+  if (StartupTrace::isEnabled())
+    StartupTrace::printReport(std::cerr);
 }
 
 void App::run()
@@ -399,6 +505,9 @@ App::~App()
     LOG("APP: Exit\n");
     ASSERT(m_instance == this);
 
+    // Wait the startup tasks (in case that initialize() failed)
+    m_startupTasks.reset();
+
     // Delete file formats.
     FileFormatsManager::destroyInstance();
 
@@ -418,6 +527,8 @@ App::~App()
     m_brushes.reset(nullptr);
 #endif
 
+    m_imageSwap.reset();
+
     delete m_legacy;
     delete m_modules;
     delete m_coreModules;
@@ -428,6 +539,11 @@ App::~App()
     delete GuiXml::instance();
 #endif
 
+#ifdef ENABLE_TRACE_EVENTS
+    // Save the --trace-events file
+    doc::trace::stop();
+#endif
+
     m_instance = NULL;
   }
   catch (const std::exception& e) {
@@ -461,11 +577,22 @@ bool App::isPortable()
   return *is_portable;
 }
 
+#ifdef ENABLE_UI
+AppBrushes& App::brushes()
+{
+  if (m_startupTasks)
+    m_startupTasks->wait("brushes");
+  if (!m_brushes)
+    m_brushes.reset(new AppBrushes);
+  return *m_brushes;
+}
+#endif
+
 tools::ToolBox* App::toolBox() const
 {
   ASSERT(m_modules != NULL);
 #ifdef ENABLE_UI
-  return &m_modules->m_toolbox;
+  return m_modules->toolBox();
 #else
   return nullptr;
 #endif
@@ -474,7 +601,7 @@ tools::ToolBox* App::toolBox() const
 tools::Tool* App::activeTool() const
 {
 #ifdef ENABLE_UI
-  return m_modules->m_activeToolManager.activeTool();
+  return m_modules->activeToolManager()->activeTool();
 #else
   return nullptr;
 #endif
@@ -483,7 +610,7 @@ tools::Tool* App::activeTool() const
 tools::ActiveToolManager* App::activeToolManager() const
 {
 #ifdef ENABLE_UI
-  return &m_modules->m_activeToolManager;
+  return m_modules->activeToolManager();
 #else
   return nullptr;
 #endif
@@ -493,7 +620,7 @@ RecentFiles* App::recentFiles() const
 {
 #ifdef ENABLE_UI
   ASSERT(m_modules != NULL);
-  return &m_modules->m_recent_files;
+  return m_modules->recentFiles();
 #else
   return nullptr;
 #endif
@@ -530,7 +657,7 @@ Preferences& App::preferences() const
 
 Extensions& App::extensions() const
 {
-  return m_modules->m_extensions;
+  return *m_modules->m_extensions;
 }
 
 crash::DataRecovery* App::dataRecovery() const
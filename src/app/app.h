@@ -38,12 +38,14 @@ namespace app {
   class Doc;
   class Extensions;
   class INotificationDelegate;
+  class ImageSwapManager;
   class InputChain;
   class LegacyModules;
   class LoggerModule;
   class MainWindow;
   class Preferences;
   class RecentFiles;
+  class StartupTasks;
   class Timeline;
   class Workspace;
 
@@ -93,10 +95,7 @@ namespace app {
     crash::DataRecovery* dataRecovery() const;
 
 #ifdef ENABLE_UI
-    AppBrushes& brushes() {
-      ASSERT(m_brushes.get());
-      return *m_brushes;
-    }
+    AppBrushes& brushes();
 
     void showNotification(INotificationDelegate* del);
     // This can be called from a non-UI thread.
@@ -112,7 +111,6 @@ namespace app {
 
   private:
     class CoreModules;
-    class LoadLanguage;
     class Modules;
 
     static App* m_instance;
@@ -121,10 +119,13 @@ namespace app {
     CoreModules* m_coreModules;
     Modules* m_modules;
     LegacyModules* m_legacy;
+    std::unique_ptr<ImageSwapManager> m_imageSwap;
     bool m_isGui;
     bool m_isShell;
     std::unique_ptr<MainWindow> m_mainWindow;
     base::paths m_files;
+    // Resources loaded in background threads (only during initialize())
+    std::unique_ptr<StartupTasks> m_startupTasks;
 #ifdef ENABLE_UI
     std::unique_ptr<AppBrushes> m_brushes;
     BackupIndicator* m_backupIndicator;
@@ -68,8 +68,13 @@ AppOptions::AppOptions(int argc, const char* argv[])
   , m_listTags(m_po.add("list-tags").description("List tags of the next given sprite\nor include frame tags in JSON data"))
   , m_listSlices(m_po.add("list-slices").description("List slices of the next given sprite\nor include slices in JSON data"))
   , m_oneFrame(m_po.add("oneframe").description("Load just the first frame"))
+  , m_jobs(m_po.add("jobs").requiresValue("<n>").description("Save up to <n> files at the same time\n(e.g. with --split-layers)"))
   , m_verbose(m_po.add("verbose").mnemonic('v').description("Explain what is being done"))
   , m_debug(m_po.add("debug").description("Extreme verbose mode and\ncopy log to desktop"))
+  , m_startupTrace(m_po.add("startup-trace").description("Print the time spent in each startup step"))
+#ifdef ENABLE_TRACE_EVENTS
+  , m_traceEvents(m_po.add("trace-events").requiresValue("<filename>").description("Save the time spent in commands, renders,\nfile operations, etc. in a chrome://tracing file"))
+#endif
 #ifdef _WIN32
   , m_disableWintab(m_po.add("disable-wintab").description("Don't load wintab32.dll library"))
 #endif
@@ -112,6 +117,18 @@ bool AppOptions::hasExporterParams() const
     m_po.enabled(m_sheet);
 }
 
+bool AppOptions::startupTrace() const
+{
+  return m_po.enabled(m_startupTrace);
+}
+
+#ifdef ENABLE_TRACE_EVENTS
+std::string AppOptions::traceEventsFilename() const
+{
+  return m_po.value_of(m_traceEvents);
+}
+#endif
+
 #ifdef _WIN32
 bool AppOptions::disableWintab() const
 {
@@ -82,8 +82,13 @@ public:
   const Option& listTags() const { return m_listTags; }
   const Option& listSlices() const { return m_listSlices; }
   const Option& oneFrame() const { return m_oneFrame; }
+  const Option& jobs() const { return m_jobs; }
 
   bool hasExporterParams() const;
+  bool startupTrace() const;
+#ifdef ENABLE_TRACE_EVENTS
+  std::string traceEventsFilename() const;
+#endif
 #ifdef _WIN32
   bool disableWintab() const;
 #endif
@@ -140,9 +145,14 @@ private:
   Option& m_listTags;
   Option& m_listSlices;
   Option& m_oneFrame;
+  Option& m_jobs;
 
   Option& m_verbose;
   Option& m_debug;
+  Option& m_startupTrace;
+#ifdef ENABLE_TRACE_EVENTS
+  Option& m_traceEvents;
+#endif
 #ifdef _WIN32
   Option& m_disableWintab;
 #endif
@@ -22,6 +22,7 @@
 #include "app/file/file.h"
 #include "app/filename_formatter.h"
 #include "app/restore_visible_layers.h"
+#include "app/save_file_queue.h"
 #include "app/ui_context.h"
 #include "base/convert_to.h"
 #include "base/fs.h"
@@ -34,10 +35,16 @@
 #include "doc/slice.h"
 #include "render/dithering_algorithm.h"
 
+#include <cerrno>
+#include <cstdlib>
+
 namespace app {
 
 namespace {
 
+// Maximum number of files saved at the same time with --jobs
+const int kMaxJobs = 64;
+
 std::string get_layer_path(const Layer* layer)
 {
   std::string path;
@@ -456,6 +463,21 @@ void CliProcessor::process(Context* ctx)
         else if (opt == &m_options.oneFrame()) {
           cof.oneFrame = true;
         }
+        // --jobs <n>
+        else if (opt == &m_options.jobs()) {
+          const char* str = value.value().c_str();
+          char* end = nullptr;
+          errno = 0;
+          const long jobs = strtol(str, &end, 10);
+          if (end == str || *end != 0 || errno == ERANGE ||
+              jobs < 1 || jobs > kMaxJobs) {
+            throw std::runtime_error(
+              "--jobs needs a number of files to save at the same time\n"
+              "Usage: --jobs <n>\n"
+              "Where <n> is a number between 1 and " + base::convert_to<std::string>(kMaxJobs));
+          }
+          SaveFileQueue::instance()->setMaxJobs(int(jobs));
+        }
       }
       // File names aren't associated to any option
       else {
@@ -466,6 +488,9 @@ void CliProcessor::process(Context* ctx)
       }
     }
 
+    // Wait the files that are being saved in background (--jobs)
+    SaveFileQueue::instance()->waitAll();
+
     if (m_exporter) {
       if (sheetType != SpriteSheetType::None)
         m_exporter->setSpriteSheetType(sheetType);
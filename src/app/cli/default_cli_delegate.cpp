@@ -25,6 +25,7 @@
 #include "doc/palette.h"
 #include "doc/slice.h"
 #include "doc/sprite.h"
+#include "render/task_delegate.h"
 
 #ifdef ENABLE_SCRIPTING
   #include "app/script/app_scripting.h"
@@ -36,6 +37,33 @@
 
 namespace app {
 
+namespace {
+
+// Reports the progress of the sprite sheet in the log (e.g. with
+// --verbose), stdout is used for the sheet data.
+class ExportProgressDelegate : public render::TaskDelegate {
+public:
+  ExportProgressDelegate() : m_percent(-1) { }
+
+  void notifyTaskProgress(double progress) override {
+    const int percent = int(progress * 10) * 10;
+    if (percent != m_percent) {
+      m_percent = percent;
+      LOG("APP: Export sprite sheet: %d%%\n", percent);
+    }
+  }
+
+  // The CLI export cannot be canceled
+  bool continueTask() override {
+    return true;
+  }
+
+private:
+  int m_percent;
+};
+
+} // anonymous namespace
+
 void DefaultCliDelegate::showHelp(const AppOptions& options)
 {
   std::cout
@@ -117,7 +145,14 @@ void DefaultCliDelegate::exportFiles(Context* ctx, DocExporter& exporter)
 {
   LOG("APP: Exporting sheet...\n");
 
+  // As the sprite sheet document isn't used, the texture can be saved
+  // as it's rendered.
+  exporter.setStreamTexture(true);
+
+  ExportProgressDelegate delegate;
+  exporter.setTaskDelegate(&delegate);
   std::unique_ptr<Doc> spriteSheet(exporter.exportSheet(ctx));
+  exporter.setTaskDelegate(nullptr);
 
   // Sprite sheet isn't used, we just delete it.
 
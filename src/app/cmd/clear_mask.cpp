@@ -90,11 +90,14 @@ void ClearMask::clear()
   Mask* mask = doc->mask();
 
   doc::algorithm::fill_selection(image, m_offset, mask, m_bgcolor);
+  image->incrementVersion();
 }
 
 void ClearMask::restore()
 {
-  copy_image(m_dstImage->image(), m_copy.get(), m_boundsX, m_boundsY);
+  Image* image = m_dstImage->image();
+  copy_image(image, m_copy.get(), m_boundsX, m_boundsY);
+  image->incrementVersion();
 }
 
 } // namespace cmd
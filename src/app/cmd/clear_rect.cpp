@@ -72,16 +72,20 @@ void ClearRect::onRedo()
 
 void ClearRect::clear()
 {
-  fill_rect(m_dstImage->image(),
+  Image* image = m_dstImage->image();
+  fill_rect(image,
             m_offsetX, m_offsetY,
             m_offsetX + m_copy->width() - 1,
             m_offsetY + m_copy->height() - 1,
             m_bgcolor);
+  image->incrementVersion();
 }
 
 void ClearRect::restore()
 {
-  copy_image(m_dstImage->image(), m_copy.get(), m_offsetX, m_offsetY);
+  Image* image = m_dstImage->image();
+  copy_image(image, m_copy.get(), m_offsetX, m_offsetY);
+  image->incrementVersion();
 }
 
 } // namespace cmd
@@ -16,15 +16,27 @@
 #include "app/cmd/set_palette.h"
 #include "app/doc.h"
 #include "app/doc_event.h"
+#include "app/task_scheduler.h"
+#include "base/base.h"
 #include "doc/cel.h"
 #include "doc/cels_range.h"
 #include "doc/document.h"
 #include "doc/layer.h"
 #include "doc/palette.h"
+#include "doc/rgbmap.h"
 #include "doc/sprite.h"
 #include "render/quantization.h"
 #include "render/task_delegate.h"
 
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
 namespace app {
 namespace cmd {
 
@@ -32,37 +44,125 @@ using namespace doc;
 
 namespace {
 
-class SuperDelegate : public render::TaskDelegate {
+// Reports the progress of the conversion (from several threads at the
+// same time) to the TaskDelegate given to the command.
+class ProgressDelegate {
 public:
-  SuperDelegate(int ncels, render::TaskDelegate* delegate)
-    : m_ncels(ncels)
-    , m_curCel(0)
+  ProgressDelegate(int ncels, render::TaskDelegate* delegate)
+    : m_progress(ncels, 0.0)
+    , m_total(0.0)
+    , m_canceled(false)
     , m_delegate(delegate) {
   }
 
-  void notifyTaskProgress(double progress) override {
+  // Progress (from 0.0 to 1.0) of the conversion of the i-th cel.
+  void notifyCelProgress(int i, double progress) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_total += progress - m_progress[i];
+    m_progress[i] = progress;
     if (m_delegate)
-      m_delegate->notifyTaskProgress(
-        (progress + m_curCel) / m_ncels);
+      m_delegate->notifyTaskProgress(m_total / m_progress.size());
   }
 
-  bool continueTask() override {
-    if (m_delegate)
-      return m_delegate->continueTask();
-    else
-      return true;
+  void notifyCelDone(int i) {
+    notifyCelProgress(i, 1.0);
   }
 
-  void nextCel() {
-    ++m_curCel;
+  // Asks the delegate if the conversion can continue (before each cel
+  // and after each converted row).
+  bool continueTask() {
+    if (m_canceled)
+      return false;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_delegate && !m_delegate->continueTask())
+      m_canceled = true;
+    return !m_canceled;
+  }
+
+  bool isCanceled() const {
+    return m_canceled;
   }
 
 private:
-  int m_ncels;
-  int m_curCel;
-  TaskDelegate* m_delegate;
+  std::mutex m_mutex;
+  std::vector<double> m_progress;
+  double m_total;
+  std::atomic<bool> m_canceled;
+  render::TaskDelegate* m_delegate;
 };
 
+// Delegate for render::convert_pixel_format() of one cel.
+// continueTask() is called for each pixel, so it doesn't lock the
+// ProgressDelegate (the real delegate is asked for each row).
+class CelDelegate : public render::TaskDelegate {
+public:
+  CelDelegate(ProgressDelegate& progress, int cel)
+    : m_progress(progress)
+    , m_cel(cel) {
+  }
+
+  void notifyTaskProgress(double progress) override {
+    m_progress.notifyCelProgress(m_cel, progress);
+    m_progress.continueTask();
+  }
+
+  bool continueTask() override {
+    return !m_progress.isCanceled();
+  }
+
+private:
+  ProgressDelegate& m_progress;
+  int m_cel;
+};
+
+// Image of a unique cel to be converted.
+struct CelConversion {
+  ImageRef oldImage;
+  const Palette* palette;
+  const RgbMap* rgbmap;
+  bool isBackground;
+  uint64_t hash;
+  // Index of the first cel with the same pixels/palette/background
+  // (or -1 if this is the first one)
+  int duplicateOf;
+  ImageRef newImage;
+};
+
+uint64_t hash_image_pixels(const Image* image)
+{
+  // FNV-1a
+  uint64_t hash = 14695981039346656037ull;
+  auto add = [&hash](uint8_t byte) {
+    hash = (hash ^ byte) * 1099511628211ull;
+  };
+
+  const int rowBytes = image->getRowStrideSize();
+  for (int y=0; y<image->height(); ++y) {
+    const uint8_t* p = image->getPixelAddress(0, y);
+    for (int i=0; i<rowBytes; ++i)
+      add(p[i]);
+  }
+  return hash;
+}
+
+bool same_pixels(const Image* a, const Image* b)
+{
+  if (a->pixelFormat() != b->pixelFormat() ||
+      a->width() != b->width() ||
+      a->height() != b->height() ||
+      a->maskColor() != b->maskColor())
+    return false;
+
+  const int rowBytes = a->getRowStrideSize();
+  for (int y=0; y<a->height(); ++y) {
+    if (std::memcmp(a->getPixelAddress(0, y),
+                    b->getPixelAddress(0, y), rowBytes) != 0)
+      return false;
+  }
+  return true;
+}
+
 } // anonymous namespace
 
 SetPixelFormat::SetPixelFormat(Sprite* sprite,
@@ -77,23 +177,156 @@ SetPixelFormat::SetPixelFormat(Sprite* sprite,
   if (sprite->pixelFormat() == newFormat)
     return;
 
-  SuperDelegate superDel(sprite->uniqueCels().size(), delegate);
-
+  // Linked cels are converted just one time (uniqueCels()), and
+  // different cels with the same image too.
+  std::vector<CelConversion> cels;
+  std::map<const Image*, int> celsByImage;
   for (Cel* cel : sprite->uniqueCels()) {
-    ImageRef old_image = cel->imageRef();
-    ImageRef new_image(
-      render::convert_pixel_format
-      (old_image.get(), nullptr, newFormat,
-       ditheringAlgorithm,
-       ditheringMatrix,
-       sprite->rgbMap(cel->frame()),
-       sprite->palette(cel->frame()),
-       cel->layer()->isBackground(),
-       old_image->maskColor(),
-       &superDel));
-
-    m_seq.add(new cmd::ReplaceImage(sprite, old_image, new_image));
-    superDel.nextCel();
+    if (celsByImage.find(cel->image()) != celsByImage.end())
+      continue;
+    celsByImage[cel->image()] = int(cels.size());
+
+    CelConversion conv;
+    conv.oldImage = cel->imageRef();
+    conv.palette = sprite->palette(cel->frame());
+    conv.rgbmap = nullptr;
+    conv.isBackground = cel->layer()->isBackground();
+    conv.hash = 0;
+    conv.duplicateOf = -1;
+    cels.push_back(conv);
+  }
+
+  // Find cels with the same pixels (e.g. duplicated frames)
+  {
+    TaskGroup group;
+    for (CelConversion& conv : cels) {
+      CelConversion* c = &conv;
+      group.run([c]{ c->hash = hash_image_pixels(c->oldImage.get()); });
+    }
+    group.wait();
+
+    std::unordered_multimap<uint64_t, int> celsByHash;
+    for (int i=0; i<int(cels.size()); ++i) {
+      CelConversion& conv = cels[i];
+      auto range = celsByHash.equal_range(conv.hash);
+      for (auto it=range.first; it!=range.second; ++it) {
+        const CelConversion& other = cels[it->second];
+        if (other.palette == conv.palette &&
+            other.isBackground == conv.isBackground &&
+            same_pixels(other.oldImage.get(), conv.oldImage.get())) {
+          conv.duplicateOf = it->second;
+          break;
+        }
+      }
+      if (conv.duplicateOf < 0)
+        celsByHash.insert(std::make_pair(conv.hash, i));
+    }
+  }
+
+  // Cels (indexes of "cels") converted in each task
+  std::vector<std::vector<int> > tasks;
+
+  // One RgbMap for each palette. Entries of a RgbMap are generated
+  // lazily, so the cels of a palette are converted in one task (one
+  // thread) unless they have more pixels than the map entries, in
+  // that case the map is fully generated and the cels are converted
+  // in parallel.
+  std::map<const Palette*, std::unique_ptr<RgbMap> > rgbmaps;
+  if (newFormat == IMAGE_INDEXED) {
+    std::map<const Palette*, std::vector<int> > celsByPalette;
+    for (int i=0; i<int(cels.size()); ++i) {
+      if (cels[i].duplicateOf < 0)
+        celsByPalette[cels[i].palette].push_back(i);
+    }
+
+    const int maskIndex = (sprite->backgroundLayer() ? -1: sprite->transparentColor());
+    for (const auto& pair : celsByPalette) {
+      std::unique_ptr<RgbMap>& rgbmap = rgbmaps[pair.first];
+      rgbmap.reset(new RgbMap);
+      rgbmap->regenerate(pair.first, maskIndex);
+
+      // The first entry is generated in this thread to initialize
+      // the Palette::findBestfit() tables
+      rgbmap->generateEntries(0, 1);
+
+      std::size_t pixels = 0;
+      for (int i : pair.second) {
+        const Image* image = cels[i].oldImage.get();
+        pixels += std::size_t(image->width()) * image->height();
+        cels[i].rgbmap = rgbmap.get();
+      }
+
+      const int n = rgbmap->size();
+      if (pair.second.size() > 1 && pixels > std::size_t(n)) {
+        const int chunk = 4096;
+        RgbMap* map = rgbmap.get();
+        TaskGroup group;
+        for (int i=1; i<n; i+=chunk)
+          group.run([map, i, n, chunk]{ map->generateEntries(i, MIN(i+chunk, n)); });
+        group.wait();
+
+        for (int i : pair.second)
+          tasks.push_back(std::vector<int>(1, i));
+      }
+      else
+        tasks.push_back(pair.second);
+    }
+  }
+  else {
+    for (int i=0; i<int(cels.size()); ++i) {
+      if (cels[i].duplicateOf < 0)
+        tasks.push_back(std::vector<int>(1, i));
+    }
+  }
+
+  // Convert all cels in parallel
+  ProgressDelegate progress(int(cels.size()), delegate);
+  {
+    CancellationToken token;
+    TaskGroup group(&token);
+    for (const std::vector<int>& task : tasks) {
+      group.run(
+        [&cels, &task, newFormat, ditheringAlgorithm, &ditheringMatrix, &progress, &token]{
+          for (int i : task) {
+            if (!progress.continueTask()) {
+              token.cancel();
+              return;
+            }
+
+            CelConversion* c = &cels[i];
+            CelDelegate celDelegate(progress, i);
+            c->newImage.reset(
+              render::convert_pixel_format
+              (c->oldImage.get(), nullptr, newFormat,
+               ditheringAlgorithm,
+               ditheringMatrix,
+               c->rgbmap,
+               c->palette,
+               c->isBackground,
+               c->oldImage->maskColor(),
+               &celDelegate));
+            if (progress.isCanceled()) {
+              token.cancel();
+              return;
+            }
+            progress.notifyCelDone(i);
+          }
+        });
+    }
+    group.wait();
+  }
+
+  for (int i=0; i<int(cels.size()); ++i) {
+    CelConversion& conv = cels[i];
+    if (conv.duplicateOf >= 0) {
+      // Each cel needs its own image (they can be modified separately)
+      const CelConversion& source = cels[conv.duplicateOf];
+      if (source.newImage)
+        conv.newImage.reset(Image::createCopy(source.newImage.get()));
+      progress.notifyCelDone(i);
+    }
+    if (conv.newImage)
+      m_seq.add(new cmd::ReplaceImage(sprite, conv.oldImage, conv.newImage));
   }
 
   // Set all cels opacity to 100% if we are converting to indexed.
@@ -10,6 +10,7 @@
 
 #include "app/app.h"
 #include "app/commands/command.h"
+#include "app/console.h"
 #include "app/context.h"
 #include "app/context_access.h"
 #include "app/doc.h"
@@ -17,6 +18,7 @@
 #include "app/file/file.h"
 #include "app/file_selector.h"
 #include "app/i18n/strings.h"
+#include "app/job.h"
 #include "app/modules/editors.h"
 #include "app/pref/preferences.h"
 #include "app/restore_visible_layers.h"
@@ -32,6 +34,7 @@
 #include "doc/frame_tag.h"
 #include "doc/layer.h"
 #include "fmt/format.h"
+#include "render/task_delegate.h"
 
 #include "export_sprite_sheet.xml.h"
 
@@ -159,6 +162,46 @@ namespace {
     return true;
   }
 
+  // Executes a step of the sprite sheet generation in a background
+  // thread (rendering the samples/texture), showing its progress
+  // (with a button to cancel it in the GUI).
+  class ExportSpriteSheetJob : public Job,
+                               public render::TaskDelegate {
+  public:
+    typedef bool (DocExporter::*Step)();
+
+    ExportSpriteSheetJob(DocExporter& exporter, Step step)
+      : Job("Export Sprite Sheet")
+      , m_exporter(exporter)
+      , m_step(step)
+      , m_result(false) {
+    }
+
+    // Returns the result of the step (false if it was canceled)
+    bool result() { return m_result && !isCanceled(); }
+
+  private:
+    // Job impl
+    void onJob() override {
+      m_exporter.setTaskDelegate(this);
+      m_result = (m_exporter.*m_step)();
+      m_exporter.setTaskDelegate(nullptr);
+    }
+
+    // render::TaskDelegate impl
+    bool continueTask() override {
+      return !isCanceled();
+    }
+
+    void notifyTaskProgress(double progress) override {
+      jobProgress(progress);
+    }
+
+    DocExporter& m_exporter;
+    Step m_step;
+    bool m_result;
+  };
+
 }
 
 class ExportSpriteSheetWindow : public app::gen::ExportSpriteSheet {
@@ -777,7 +820,34 @@ void ExportSpriteSheetCommand::onExecute(Context* context)
                        (!selLayers.empty() ? &selLayers: nullptr),
                        (!selFrames.empty() ? &selFrames: nullptr));
 
-  std::unique_ptr<Doc> newDocument(exporter.exportSheet(context));
+  std::unique_ptr<Doc> newDocument;
+  {
+    // The document is locked while the sheet is generated in the job
+    // threads (the visibility of its layers is changed to render
+    // them). Commands and files are executed/saved from this thread.
+    ContextWriter writer(context);
+
+    ExportSpriteSheetJob captureJob(exporter, &DocExporter::captureSheet);
+    captureJob.startJob();
+    captureJob.waitJob();
+    if (!captureJob.result()) {
+      if (!captureJob.isCanceled()) {
+        Console console;
+        console.printf("No documents to export");
+      }
+      return;
+    }
+
+    exporter.convertSheet(context);
+
+    ExportSpriteSheetJob renderJob(exporter, &DocExporter::renderSheet);
+    renderJob.startJob();
+    renderJob.waitJob();
+    if (!renderJob.result())
+      return;
+
+    newDocument.reset(exporter.saveSheet(context));
+  }
   if (!newDocument)
     return;
 
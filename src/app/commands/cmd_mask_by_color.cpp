@@ -16,15 +16,19 @@
 #include "app/context.h"
 #include "app/context_access.h"
 #include "app/doc.h"
+#include "app/doc_range.h"
 #include "app/ini_file.h"
 #include "app/modules/editors.h"
 #include "app/modules/gui.h"
 #include "app/transaction.h"
 #include "app/ui/color_bar.h"
 #include "app/ui/color_button.h"
+#include "app/ui/timeline/timeline.h"
+#include "app/util/range_utils.h"
 #include "base/bind.h"
 #include "base/chrono.h"
 #include "base/convert_to.h"
+#include "doc/cel.h"
 #include "doc/image.h"
 #include "doc/mask.h"
 #include "doc/sprite.h"
@@ -35,6 +39,9 @@
 #include "ui/widget.h"
 #include "ui/window.h"
 
+#include <memory>
+#include <vector>
+
 // Uncomment to see the performance of doc::MaskBoundaries ctor
 //#define SHOW_BOUNDARIES_GEN_PERFORMANCE
 
@@ -56,6 +63,7 @@ private:
   void maskPreview(const ContextReader& reader);
 
   Window* m_window; // TODO we cannot use a std::unique_ptr because clone() needs a copy ctor
+  CelList m_cels;   // Cels selected in the timeline (if there are several)
   ColorButton* m_buttonColor;
   CheckBox* m_checkPreview;
   Slider* m_sliderTolerance;
@@ -91,6 +99,13 @@ void MaskByColorCommand::onExecute(Context* context)
   if (!image)
     return;
 
+  m_cels.clear();
+  Timeline* timeline = App::instance()->timeline();
+  if (timeline && timeline->range().enabled()) {
+    Site site = context->activeSite();
+    m_cels = get_unlocked_unique_cels(site.sprite(), timeline->range());
+  }
+
   m_window = new Window(Window::WithTitleBar, "Mask by Color");
   box1 = new Box(VERTICAL);
   box2 = new Box(HORIZONTAL);
@@ -185,6 +200,30 @@ Mask* MaskByColorCommand::generateMask(const Sprite* sprite, const Image* image,
   color = color_utils::color_for_image(m_buttonColor->getColor(), sprite->pixelFormat());
   tolerance = m_sliderTolerance->getValue();
 
+  // With several cels selected in the timeline, the mask selects the
+  // pixels of all of them (calculated at the same time).
+  if (m_cels.size() > 1) {
+    std::vector<std::unique_ptr<Mask> > masks;
+    std::vector<Mask*> maskPtrs;
+    std::vector<const Image*> images;
+    for (const Cel* cel : m_cels) {
+      masks.push_back(std::unique_ptr<Mask>(new Mask));
+      maskPtrs.push_back(masks.back().get());
+      images.push_back(cel->image());
+    }
+
+    Mask::byColor(maskPtrs, images, color, tolerance);
+
+    std::unique_ptr<Mask> mask(new Mask());
+    mask->freeze();
+    for (std::size_t i=0; i<m_cels.size(); ++i) {
+      masks[i]->offsetOrigin(m_cels[i]->x(), m_cels[i]->y());
+      mask->add(*masks[i]);
+    }
+    mask->unfreeze();
+    return mask.release();
+  }
+
   std::unique_ptr<Mask> mask(new Mask());
   mask->byColor(image, color, tolerance);
   mask->offsetOrigin(xpos, ypos);
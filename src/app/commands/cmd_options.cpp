@@ -340,6 +340,11 @@ public:
     locateCrashFolder()->setVisible(false);
 #endif
 
+    // Memory budget
+    limitMemory()->Click.connect(base::Bind<void>(&OptionsWindow::onLimitMemoryCheck, this));
+    limitMemory()->setSelected(m_pref.general.memoryBudget() != 0);
+    onLimitMemoryCheck();
+
     // Undo preferences
     limitUndo()->Click.connect(base::Bind<void>(&OptionsWindow::onLimitUndoCheck, this));
     limitUndo()->setSelected(m_pref.undo.sizeLimit() != 0);
@@ -422,6 +427,10 @@ public:
       warnings += "<<- " + Strings::alerts_restart_by_preferences_save_recovery_data_period();
     }
 
+    int memory_budget_value = memoryBudget()->textInt();
+    memory_budget_value = MID(0, memory_budget_value, 999999);
+    m_pref.general.memoryBudget(memory_budget_value);
+
     m_pref.editor.zoomFromCenterWithWheel(zoomFromCenterWithWheel()->isSelected());
     m_pref.editor.zoomFromCenterWithKeys(zoomFromCenterWithKeys()->isSelected());
     m_pref.editor.showScrollbars(showScrollbars()->isSelected());
@@ -741,6 +750,17 @@ private:
     app::launcher::open_folder(app::main_config_filename());
   }
 
+  void onLimitMemoryCheck() {
+    if (limitMemory()->isSelected()) {
+      memoryBudget()->setEnabled(true);
+      memoryBudget()->setTextf("%d", m_pref.general.memoryBudget());
+    }
+    else {
+      memoryBudget()->setEnabled(false);
+      memoryBudget()->setText(kInfiniteSymbol);
+    }
+  }
+
   void onLimitUndoCheck() {
     if (limitUndo()->isSelected()) {
       undoSizeLimit()->setEnabled(true);
@@ -36,6 +36,8 @@
 #include "fmt/format.h"
 #include "ui/ui.h"
 
+#include <vector>
+
 namespace app {
 
 class RotateJob : public SpriteJob {
@@ -101,26 +103,31 @@ protected:
       }
     }
 
-    // 2) Rotate images
-    int i = 0;
-    for (Cel* cel : m_cels) {
-      Image* image = cel->image();
-      if (image) {
+    // 2) Rotate images (in parallel)
+    std::vector<ImageRef> newImages(m_cels.size());
+    forEachCelInParallel(
+      m_cels,
+      [this, &newImages](int i, Cel* cel) {
+        Image* image = cel->image();
+        if (!image)
+          return;
+
         ImageRef new_image(Image::create(image->pixelFormat(),
             m_angle == 180 ? image->width(): image->height(),
             m_angle == 180 ? image->height(): image->width()));
         new_image->setMaskColor(image->maskColor());
 
         doc::rotate_image(image, new_image.get(), m_angle);
-        api.replaceImage(sprite(), cel->imageRef(), new_image);
-      }
+        newImages[i] = new_image;
+      });
 
-      jobProgress((float)i / m_cels.size());
-      ++i;
+    // cancel all the operation?
+    if (isCanceled())
+      return;        // Transaction destructor will undo all operations
 
-      // cancel all the operation?
-      if (isCanceled())
-        return;        // Transaction destructor will undo all operations
+    for (int i=0; i<int(m_cels.size()); ++i) {
+      if (newImages[i])
+        api.replaceImage(sprite(), m_cels[i]->imageRef(), newImages[i]);
     }
 
     // rotate mask
@@ -17,6 +17,8 @@
 #include "app/console.h"
 #include "app/context_access.h"
 #include "app/doc.h"
+#include "app/doc_access.h"
+#include "app/doc_snapshot.h"
 #include "app/doc_undo.h"
 #include "app/file/file.h"
 #include "app/file/gif_format.h"
@@ -28,6 +30,7 @@
 #include "app/pref/preferences.h"
 #include "app/recent_files.h"
 #include "app/restore_visible_layers.h"
+#include "app/save_file_queue.h"
 #include "app/ui/export_file_window.h"
 #include "app/ui/layer_frame_comboboxes.h"
 #include "app/ui/optional_alert.h"
@@ -181,7 +184,21 @@ void SaveFileBaseCommand::saveDocumentInBackground(
     }
   }
 
-  FileOpROI roi(document, m_slice, m_frameTag,
+  // The file is saved from a snapshot of the document, so the
+  // document doesn't need to be locked while the file is written.
+  std::unique_ptr<DocSnapshot> snapshot;
+  const undo::UndoState* snapshotState = nullptr;
+  try {
+    const DocReader reader(document, 500);
+    snapshot.reset(new DocSnapshot(document));
+    snapshotState = document->undoHistory()->currentState();
+  }
+  catch (const std::exception& ex) {
+    Console::showException(ex);
+    return;
+  }
+
+  FileOpROI roi(snapshot->document(), m_slice, m_frameTag,
                 m_selFrames, m_adjustFramesByFrameTag);
 
   std::unique_ptr<FileOp> fop(
@@ -193,28 +210,61 @@ void SaveFileBaseCommand::saveDocumentInBackground(
   if (!fop)
     return;
 
+  // Keep the format options selected by the user (e.g. JPEG quality)
+  document->setFormatOptions(snapshot->document()->getFormatOptions());
+
+  // Save several files at the same time (--jobs in the command line),
+  // errors are reported when all files are saved.
+  if (!context->isUIAvailable() &&
+      SaveFileQueue::instance()->maxJobs() > 1) {
+    SaveFileQueue::instance()->enqueue(std::move(snapshot), std::move(fop));
+    return;
+  }
+
   SaveFileJob job(fop.get());
   job.showProgressWindow();
 
   if (fop->hasError()) {
     Console console;
     console.printf(fop->error().c_str());
-
-    // We don't know if the file was saved correctly or not. So mark
-    // it as it should be saved again.
-    document->impossibleToBackToSavedState();
   }
-  // If the job was cancelled, mark the document as modified.
-  else if (fop->isStop()) {
-    document->impossibleToBackToSavedState();
+
+  // The document could be modified while the file was being saved,
+  // so we need a lock to change its saved state. The file is already
+  // written, so if other thread has the document locked (e.g. the
+  // backup of the data recovery), we wait it instead of reporting an
+  // error.
+  while (true) {
+    try {
+      DocWriter writer(document, 500);
+
+      // We don't know if the file was saved correctly or not (or the
+      // job was cancelled). So mark it as it should be saved again.
+      if (fop->hasError() || fop->isStop()) {
+        document->impossibleToBackToSavedState();
+        return;
+      }
+
+      if (context->isUIAvailable() && markAsSaved) {
+        // If the document was modified after the snapshot, the file
+        // contains an older state.
+        if (document->undoHistory()->currentState() == snapshotState)
+          document->markAsSaved();
+        else
+          document->impossibleToBackToSavedState();
+
+        document->setFilename(filename);
+        document->incrementVersion();
+      }
+      break;
+    }
+    catch (const CannotWriteDocException&) {
+      // Try again
+    }
   }
-  else if (context->isUIAvailable()) {
+
+  if (context->isUIAvailable()) {
     App::instance()->recentFiles()->addRecentFile(filename);
-    if (markAsSaved) {
-      document->markAsSaved();
-      document->setFilename(filename);
-      document->incrementVersion();
-    }
 #ifdef ENABLE_UI
     StatusBar::instance()
       ->setStatusText(2000, "File <%s> saved.",
@@ -248,12 +298,15 @@ void SaveFileCommand::onExecute(Context* context)
   // If the document is associated to a file in the file-system, we can
   // save it directly without user interaction.
   if (document->isAssociatedToFile()) {
-    const ContextReader reader(context);
-    const Doc* documentReader = reader.document();
+    std::string filename;
+    {
+      const ContextReader reader(context);
+      filename = reader.document()->filename();
+    }
 
     saveDocumentInBackground(
       context, document,
-      documentReader->filename(), true);
+      filename, true);
   }
   // If the document isn't associated to a file, we must to show the
   // save-as dialog to the user to select for first time the file-name
@@ -26,10 +26,14 @@
 #include "doc/layer.h"
 #include "doc/mask.h"
 #include "doc/primitives.h"
+#include "doc/rgbmap.h"
 #include "doc/slice.h"
 #include "doc/sprite.h"
 #include "ui/ui.h"
 
+#include <memory>
+#include <vector>
+
 #include "sprite_size.xml.h"
 
 #define PERC_FORMAT     "%.4g"
@@ -74,51 +78,65 @@ protected:
   void onJob() override {
     DocApi api = writer().document()->getApi(transaction());
 
-    int cels_count = 0;
-    for (Cel* cel : sprite()->uniqueCels()) { // TODO add size() member function to CelsRange
-      (void)cel;
-      ++cels_count;
-    }
-
-    // For each cel...
-    int progress = 0;
-    for (Cel* cel : sprite()->uniqueCels()) {
-      // Get cel's image
-      Image* image = cel->image();
-      if (image && !cel->link()) {
-        // Resize the cel bounds only if it's from a reference layer
-        if (cel->layer()->isReference()) {
-          gfx::RectF newBounds = scale_rect<double>(cel->boundsF());
-          transaction().execute(new cmd::SetCelBoundsF(cel, newBounds));
-        }
-        else {
-          // Change its location
-          api.setCelPosition(sprite(), cel, scale_x(cel->x()), scale_y(cel->y()));
-
-          // Resize the image
-          int w = scale_x(image->width());
-          int h = scale_y(image->height());
-          ImageRef new_image(Image::create(image->pixelFormat(), MAX(1, w), MAX(1, h)));
-          new_image->setMaskColor(image->maskColor());
-
-          doc::algorithm::fixup_image_transparent_colors(image);
-          doc::algorithm::resize_image(
-            image, new_image.get(),
-            m_resize_method,
-            sprite()->palette(cel->frame()),
-            sprite()->rgbMap(cel->frame()),
-            (cel->layer()->isBackground() ? -1: sprite()->transparentColor()));
-
-          api.replaceImage(sprite(), cel->imageRef(), new_image);
+    CelList cels;
+    for (Cel* cel : sprite()->uniqueCels())
+      cels.push_back(cel);
+
+    // Resize the images of all cels in parallel
+    std::vector<ImageRef> newImages(cels.size());
+    forEachCelInParallel(
+      cels,
+      [this, &newImages](int i, Cel* cel) {
+        Image* image = cel->image();
+        if (!image || cel->link() || cel->layer()->isReference())
+          return;
+
+        int w = scale_x(image->width());
+        int h = scale_y(image->height());
+        ImageRef new_image(Image::create(image->pixelFormat(), MAX(1, w), MAX(1, h)));
+        new_image->setMaskColor(image->maskColor());
+
+        // Sprite::rgbMap() cannot be used from several threads, so
+        // each bilinear resize of an indexed image uses its own map
+        std::unique_ptr<RgbMap> rgbmap;
+        if (image->pixelFormat() == IMAGE_INDEXED &&
+            m_resize_method == doc::algorithm::RESIZE_METHOD_BILINEAR) {
+          rgbmap.reset(new RgbMap);
+          rgbmap->regenerate(sprite()->palette(cel->frame()),
+                             (sprite()->backgroundLayer() ? -1: sprite()->transparentColor()));
         }
-      }
-
-      jobProgress((float)progress / cels_count);
-      ++progress;
 
-      // Cancel all the operation?
-      if (isCanceled())
-        return;        // Transaction destructor will undo all operations
+        doc::algorithm::fixup_image_transparent_colors(image);
+        doc::algorithm::resize_image(
+          image, new_image.get(),
+          m_resize_method,
+          sprite()->palette(cel->frame()),
+          rgbmap.get(),
+          (cel->layer()->isBackground() ? -1: sprite()->transparentColor()));
+
+        newImages[i] = new_image;
+      });
+
+    // Cancel all the operation?
+    if (isCanceled())
+      return;        // Transaction destructor will undo all operations
+
+    // Replace the images (and update cels positions/bounds)
+    for (int i=0; i<int(cels.size()); ++i) {
+      Cel* cel = cels[i];
+      if (!cel->image() || cel->link())
+        continue;
+
+      // Resize the cel bounds only if it's from a reference layer
+      if (cel->layer()->isReference()) {
+        gfx::RectF newBounds = scale_rect<double>(cel->boundsF());
+        transaction().execute(new cmd::SetCelBoundsF(cel, newBounds));
+      }
+      else if (newImages[i]) {
+        // Change its location
+        api.setCelPosition(sprite(), cel, scale_x(cel->x()), scale_y(cel->y()));
+        api.replaceImage(sprite(), cel->imageRef(), newImages[i]);
+      }
     }
 
     // Resize mask
@@ -11,7 +11,10 @@
 #include "app/commands/command.h"
 #include "app/commands/params.h"
 #include "app/console.h"
+#include "app/context.h"
+#include "app/doc.h"
 #include "app/i18n/strings.h"
+#include "doc/trace_events.h"
 
 namespace app {
 
@@ -67,6 +70,8 @@ bool Command::isChecked(Context* context)
 
 void Command::execute(Context* context)
 {
+  TRACE_EVENT("command", id(),
+              context->activeDocument() ? context->activeDocument()->id(): doc::NullId);
   onExecute(context);
 }
 
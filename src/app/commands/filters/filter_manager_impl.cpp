@@ -34,6 +34,7 @@
 #include "doc/layer.h"
 #include "doc/mask.h"
 #include "doc/sprite.h"
+#include "doc/trace_events.h"
 #include "filters/filter.h"
 #include "ui/manager.h"
 #include "ui/view.h"
@@ -191,11 +192,17 @@ bool FilterManagerImpl::applyStep()
   }
   ++m_row;
 
+  // The mask is locked (pinned) only while the row is processed, so
+  // it isn't kept pinned if the filter stops before calling end()
+  m_maskBits.unlock();
+
   return true;
 }
 
 void FilterManagerImpl::apply()
 {
+  TRACE_EVENT("filter", m_filter->getName(),
+              m_site.document() ? m_site.document()->id(): doc::NullId);
   bool cancelled = false;
 
   begin();
@@ -235,6 +242,8 @@ void FilterManagerImpl::apply()
 
 void FilterManagerImpl::applyToTarget()
 {
+  TRACE_EVENT("filter", std::string(m_filter->getName()) + " (all cels)",
+              m_site.document() ? m_site.document()->id(): doc::NullId);
   const bool paletteChange = paletteHasChanged();
   bool cancelled = false;
 
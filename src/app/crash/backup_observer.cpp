@@ -28,6 +28,7 @@
 #include "base/chrono.h"
 #include "base/remove_from_container.h"
 #include "base/scoped_lock.h"
+#include "doc/trace_events.h"
 
 #ifdef TEST_BACKUP_INTEGRITY
 #include "ui/system.h"
@@ -105,6 +106,8 @@ void BackupObserver::backgroundThread()
   int waitUntil = normalPeriod;
   int seconds = 0;
 
+  doc::trace::set_thread_name("backup");
+
   while (!m_done) {
     seconds++;
     if (seconds >= waitUntil) {
@@ -116,6 +119,7 @@ void BackupObserver::backgroundThread()
       bool somethingLocked = false;
 
       for (Doc* doc : m_documents) {
+        TRACE_EVENT("backup", "Backup document", doc->id());
         try {
           if (doc->needsBackup()) {
             if (doc->inhibitBackup()) {
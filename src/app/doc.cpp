@@ -31,6 +31,7 @@
 #include "doc/mask_boundaries.h"
 #include "doc/palette.h"
 #include "doc/sprite.h"
+#include "render/onionskin_cache.h"
 
 #include <limits>
 #include <map>
@@ -59,6 +60,10 @@ Doc::Doc(Sprite* sprite)
 Doc::~Doc()
 {
   removeFromContext();
+
+  // Flattened onion skin frames of this document are not needed
+  if (sprite())
+    render::OnionskinCache::instance()->removeSprite(sprite()->id());
 }
 
 void Doc::setContext(Context* ctx)
@@ -219,12 +224,28 @@ void Doc::setFormatOptions(const base::SharedPtr<FormatOptions>& format_options)
 
 void Doc::generateMaskBoundaries(const Mask* mask)
 {
-  m_maskBoundaries.reset();
+  updateMaskBoundaries(mask, nullptr);
+}
+
+void Doc::generateMaskBoundaries(const Mask* mask, const gfx::Rect& modifiedArea)
+{
+  updateMaskBoundaries(mask, &modifiedArea);
+}
+
+void Doc::offsetMaskBoundaries(const gfx::Point& delta)
+{
+  if (m_maskBoundaries)
+    m_maskBoundaries->offset(delta.x, delta.y);
+}
 
+void Doc::updateMaskBoundaries(const Mask* mask, const gfx::Rect* modifiedArea)
+{
   // No mask specified? Use the current one in the document
   if (!mask) {
-    if (!isMaskVisible())       // The mask is hidden
+    if (!isMaskVisible()) {     // The mask is hidden
+      m_maskBoundaries.reset();
       return;                   // Done, without boundaries
+    }
     else
       mask = this->mask();      // Use the document mask
   }
@@ -232,10 +253,20 @@ void Doc::generateMaskBoundaries(const Mask* mask)
   ASSERT(mask);
 
   if (!mask->isEmpty()) {
-    m_maskBoundaries.reset(new MaskBoundaries(mask->bitmap()));
-    m_maskBoundaries->offset(mask->bounds().x,
-                             mask->bounds().y);
+    // The previous boundaries are re-used to calculate only the
+    // segments of the modified areas of the mask.
+    if (!m_maskBoundaries)
+      m_maskBoundaries.reset(new MaskBoundaries);
+    if (modifiedArea)
+      m_maskBoundaries->regenerate(mask->bitmap(),
+                                   mask->bounds().origin(),
+                                   *modifiedArea);
+    else
+      m_maskBoundaries->regenerate(mask->bitmap(),
+                                   mask->bounds().origin());
   }
+  else
+    m_maskBoundaries.reset();
 
   // TODO move this to the exact place where selection is modified.
   notifySelectionChanged();
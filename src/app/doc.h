@@ -21,6 +21,7 @@
 #include "doc/document.h"
 #include "doc/frame.h"
 #include "doc/pixel_format.h"
+#include "gfx/point.h"
 #include "gfx/rect.h"
 #include "obs/observable.h"
 
@@ -127,10 +128,19 @@ namespace app {
 
     void generateMaskBoundaries(const Mask* mask = nullptr);
 
+    // Regenerates the boundaries when only the "modifiedArea" of the
+    // mask (in sprite coordinates) was modified since the last
+    // generateMaskBoundaries() call.
+    void generateMaskBoundaries(const Mask* mask, const gfx::Rect& modifiedArea);
+
     const MaskBoundaries* getMaskBoundaries() const {
      return m_maskBoundaries.get();
     }
 
+    // Moves the current boundaries without regenerating them (e.g.
+    // when the mask is being moved with the mouse).
+    void offsetMaskBoundaries(const gfx::Point& delta);
+
     //////////////////////////////////////////////////////////////////////
     // Extra Cel (it is used to draw pen preview, pixels in movement, etc.)
 
@@ -188,6 +198,7 @@ namespace app {
 
   private:
     void removeFromContext();
+    void updateMaskBoundaries(const Mask* mask, const gfx::Rect* modifiedArea);
 
     Context* m_ctx;
     int m_flags;
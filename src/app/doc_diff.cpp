@@ -127,7 +127,7 @@ DocDiff compare_docs(const Doc* a,
             }
             if (aCel->image() && bCel->image()) {
               if (aCel->image()->bounds() != bCel->image()->bounds() ||
-                  count_diff_between_images(aCel->image(), bCel->image()))
+                  !is_same_image(aCel->image(), bCel->image()))
                 diff.anything = diff.images = true;
             }
             else if (aCel->image() != bCel->image())
@@ -15,9 +15,12 @@
 #include "app/context.h"
 #include "app/doc.h"
 #include "app/file/file.h"
+#include "app/file/png_format.h"
 #include "app/filename_formatter.h"
 #include "app/restore_visible_layers.h"
+#include "app/task_scheduler.h"
 #include "base/convert_to.h"
+#include "base/exception.h"
 #include "base/fs.h"
 #include "base/fstream_path.h"
 #include "base/replace_string.h"
@@ -27,6 +30,7 @@
 #include "doc/cel.h"
 #include "doc/frame_tag.h"
 #include "doc/image.h"
+#include "doc/image_ref.h"
 #include "doc/layer.h"
 #include "doc/palette.h"
 #include "doc/primitives.h"
@@ -34,17 +38,25 @@
 #include "doc/selected_layers.h"
 #include "doc/slice.h"
 #include "doc/sprite.h"
+#include "gfx/clip.h"
 #include "gfx/packing_rects.h"
 #include "gfx/size.h"
 #include "render/dithering_algorithm.h"
 #include "render/ordered_dither.h"
 #include "render/render.h"
+#include "render/task_delegate.h"
 
+#include <condition_variable>
 #include <cstdio>
+#include <exception>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <list>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 using namespace doc;
 
@@ -76,6 +88,102 @@ std::ostream& operator<<(std::ostream& os, const doc::UserData& data)
   return os;
 }
 
+// Maximum memory used by the trimmed samples that were rendered to
+// calculate their bounds, and are re-used to render the texture.
+const int kMaxTrimmedImagesMemSize = 128*1024*1024;
+
+#ifdef ENABLE_SAVE
+
+// Maximum memory used by each strip of the texture when it's streamed
+// to a png file.
+const int kMaxStripMemSize = 32*1024*1024;
+
+// Encodes the strips of a texture in a background thread while the
+// next strip is being rendered. Only one strip can be pending, so two
+// strips are enough to render and encode at the same time.
+class StripWriter {
+public:
+  StripWriter(app::PngStreamEncoder& encoder)
+    : m_encoder(encoder)
+    , m_strip(nullptr)
+    , m_rows(0)
+    , m_done(false)
+    , m_thread([this]{ encodingProc(); }) {
+  }
+
+  ~StripWriter() {
+    stop();
+  }
+
+  // Waits the previous strip to be encoded and starts encoding the
+  // given one.
+  void write(const Image* strip, int rows) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this]{ return !m_strip; });
+    if (m_error)
+      std::rethrow_exception(m_error);
+
+    m_strip = strip;
+    m_rows = rows;
+    m_cv.notify_all();
+  }
+
+  // Waits the last strip to be encoded.
+  void finish() {
+    stop();
+    if (m_error)
+      std::rethrow_exception(m_error);
+  }
+
+private:
+  void stop() {
+    if (!m_thread.joinable())
+      return;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_cv.wait(lock, [this]{ return !m_strip; });
+      m_done = true;
+      m_cv.notify_all();
+    }
+    m_thread.join();
+  }
+
+  void encodingProc() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+      m_cv.wait(lock, [this]{ return m_strip || m_done; });
+      if (!m_strip)
+        break;
+
+      lock.unlock();
+      std::exception_ptr error;
+      try {
+        m_encoder.writeRows(m_strip, m_rows);
+      }
+      catch (...) {
+        error = std::current_exception();
+      }
+      lock.lock();
+
+      if (error && !m_error)
+        m_error = error;
+      m_strip = nullptr;
+      m_cv.notify_all();
+    }
+  }
+
+  app::PngStreamEncoder& m_encoder;
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  const Image* m_strip;
+  int m_rows;
+  bool m_done;
+  std::exception_ptr m_error;
+  std::thread m_thread;
+};
+
+#endif // ENABLE_SAVE
+
 } // anonymous namespace
 
 namespace app {
@@ -102,10 +210,16 @@ public:
   void setTrimmedBounds(const gfx::Rect& bounds) { m_trimmedBounds = bounds; }
   void setInTextureBounds(const gfx::Rect& bounds) { m_inTextureBounds = bounds; }
 
+  // Rendered pixels of the trimmed bounds (if the sample was
+  // rendered to calculate its bounds).
+  const ImageRef& trimmedImage() const { return m_trimmedImage; }
+  void setTrimmedImage(const ImageRef& image) { m_trimmedImage = image; }
+
 private:
   gfx::Size m_originalSize;
   gfx::Rect m_trimmedBounds;
   gfx::Rect m_inTextureBounds;
+  ImageRef m_trimmedImage;
 };
 
 typedef base::SharedPtr<SampleBounds> SampleBoundsPtr;
@@ -201,6 +315,7 @@ public:
   const gfx::Size& originalSize() const { return m_bounds->originalSize(); }
   const gfx::Rect& trimmedBounds() const { return m_bounds->trimmedBounds(); }
   const gfx::Rect& inTextureBounds() const { return m_bounds->inTextureBounds(); }
+  const ImageRef& trimmedImage() const { return m_bounds->trimmedImage(); }
 
   gfx::Size requiredSize() const {
     gfx::Size size = m_bounds->trimmedBounds().size();
@@ -215,6 +330,7 @@ public:
 
   void setTrimmedBounds(const gfx::Rect& bounds) { m_bounds->setTrimmedBounds(bounds); }
   void setInTextureBounds(const gfx::Rect& bounds) { m_bounds->setInTextureBounds(bounds); }
+  void setTrimmedImage(const ImageRef& image) { m_bounds->setTrimmedImage(image); }
 
   bool isDuplicated() const { return m_isDuplicated; }
   bool isEmpty() const { return m_bounds->trimmedBounds().isEmpty(); }
@@ -259,6 +375,34 @@ private:
   List m_samples;
 };
 
+// Bounds of the non-transparent pixels of each cel image, calculated
+// just one time for linked cels (or cels in several samples).
+class DocExporter::OpaqueBoundsCache {
+public:
+  gfx::Rect opaqueBounds(const Cel* cel) {
+    const Image* image = cel->image();
+    Entry& entry = m_entries[image->id()];
+    if (!entry.valid || entry.version != image->version()) {
+      entry.valid = true;
+      entry.version = image->version();
+      if (!algorithm::shrink_bounds(image, entry.bounds,
+                                    image->maskColor()))
+        entry.bounds = gfx::Rect();
+    }
+    if (entry.bounds.isEmpty())
+      return gfx::Rect();
+    return gfx::Rect(entry.bounds).offset(cel->position());
+  }
+
+private:
+  struct Entry {
+    bool valid = false;
+    ObjectVersion version = 0;
+    gfx::Rect bounds;
+  };
+  std::map<ObjectId, Entry> m_entries;
+};
+
 class DocExporter::LayoutSamples {
 public:
   virtual ~LayoutSamples() { }
@@ -392,6 +536,21 @@ public:
   }
 };
 
+// State of the sheet between the steps of DocExporter::exportSheet()
+class DocExporter::Sheet {
+public:
+  Samples samples;
+  PixelFormat pixelFormat = IMAGE_RGB;
+  Palette* palette = nullptr;
+  gfx::Size textureSize;
+  bool stream = false;
+  bool canceled = false;
+  std::unique_ptr<Doc> textureDocument;
+
+  // Error streaming the texture (reported from saveSheet())
+  std::exception_ptr error;
+};
+
 DocExporter::DocExporter()
  : m_dataFormat(DefaultDataFormat)
  , m_textureWidth(0)
@@ -405,61 +564,146 @@ DocExporter::DocExporter()
  , m_listFrameTags(false)
  , m_listLayers(false)
  , m_listSlices(false)
+ , m_streamTexture(false)
+ , m_delegate(nullptr)
+{
+}
+
+DocExporter::~DocExporter()
 {
 }
 
 Doc* DocExporter::exportSheet(Context* ctx)
 {
-  // We output the metadata to std::cout if the user didn't specify a file.
-  std::ofstream fos;
-  std::streambuf* osbuf = nullptr;
-  if (m_dataFilename.empty()) {
-    // Redirect to stdout if we are running in batch mode
-    if (!ctx->isUIAvailable())
-      osbuf = std::cout.rdbuf();
-  }
-  else {
-    fos.open(FSTREAM_PATH(m_dataFilename), std::ios::out);
-    osbuf = fos.rdbuf();
+  if (!captureSheet()) {
+    Console console;
+    console.printf("No documents to export");
+    return nullptr;
   }
-  std::ostream os(osbuf);
+
+  convertSheet(ctx);
+  renderSheet();
+  return saveSheet(ctx);
+}
+
+bool DocExporter::captureSheet()
+{
+  m_sheet.reset(new Sheet);
+  Sheet& sheet = *m_sheet;
 
   // Steps for sheet construction:
   // 1) Capture the samples (each sprite+frame pair)
-  Samples samples;
-  captureSamples(samples);
-  if (samples.empty()) {
-    Console console;
-    console.printf("No documents to export");
-    return nullptr;
+  captureSamples(sheet.samples);
+  if (sheet.samples.empty()) {
+    m_sheet.reset();
+    return false;
   }
 
   // 2) Layout those samples in a texture field.
-  layoutSamples(samples);
+  layoutSamples(sheet.samples);
+
+  sheet.pixelFormat = textureFormat(sheet.samples, &sheet.palette);
+  sheet.textureSize = calculateSheetSize(sheet.samples);
+#ifdef ENABLE_SAVE
+  sheet.stream = (canStreamTexture() &&
+                  (sheet.pixelFormat != IMAGE_INDEXED || sheet.palette));
+#endif
+  return true;
+}
+
+void DocExporter::convertSheet(Context* ctx)
+{
+  if (m_sheet)
+    convertSamples(ctx, m_sheet->samples, m_sheet->pixelFormat);
+}
+
+bool DocExporter::renderSheet()
+{
+  if (!m_sheet)
+    return false;
 
   // 3) Create and render the texture.
-  std::unique_ptr<Doc> textureDocument(
-    createEmptyTexture(samples));
+  Sheet& sheet = *m_sheet;
+#ifdef ENABLE_SAVE
+  if (sheet.stream) {
+    // Render and save the texture strip by strip
+    try {
+      if (!streamTexture(sheet.samples, sheet.pixelFormat,
+                         sheet.palette, sheet.textureSize)) {
+        // Canceled, delete the incomplete file
+        if (base::is_file(m_textureFilename))
+          base::delete_file(m_textureFilename);
+        sheet.canceled = true;
+      }
+    }
+    catch (const std::exception&) {
+      // Delete the incomplete file, the error is thrown from
+      // saveSheet()
+      if (base::is_file(m_textureFilename))
+        base::delete_file(m_textureFilename);
+      sheet.error = std::current_exception();
+    }
+    return !sheet.canceled;
+  }
+#endif
+
+  sheet.textureDocument.reset(
+    createEmptyTexture(sheet.pixelFormat, sheet.palette, sheet.textureSize));
 
-  Sprite* texture = textureDocument->sprite();
+  Sprite* texture = sheet.textureDocument->sprite();
   Image* textureImage = texture->root()->firstLayer()
     ->cel(frame_t(0))->image();
 
-  renderTexture(ctx, samples, textureImage);
+  if (!renderTexture(sheet.samples, textureImage))
+    sheet.canceled = true;
 
-  // Save the metadata.
-  if (osbuf)
-    createDataFile(samples, os, textureImage);
+  return !sheet.canceled;
+}
+
+Doc* DocExporter::saveSheet(Context* ctx)
+{
+  std::unique_ptr<Sheet> sheet(std::move(m_sheet));
+  if (!sheet || sheet->canceled)
+    return nullptr;
+
+  // The data file is not created if the texture cannot be saved
+  if (sheet->error)
+    std::rethrow_exception(sheet->error);
 
   // Save the image files.
-  if (!m_textureFilename.empty()) {
+  Doc* textureDocument = sheet->textureDocument.get();
+  if (textureDocument && !m_textureFilename.empty()) {
     textureDocument->setFilename(m_textureFilename.c_str());
-    int ret = save_document(ctx, textureDocument.get());
-    if (ret == 0)
-      textureDocument->markAsSaved();
+    if (save_document(ctx, textureDocument) != 0) {
+      if (base::is_file(m_textureFilename))
+        base::delete_file(m_textureFilename);
+      throw base::Exception("Error saving the sprite sheet texture %s",
+                            m_textureFilename.c_str());
+    }
+    textureDocument->markAsSaved();
+  }
+
+  // We output the metadata to std::cout if the user didn't specify a file.
+  std::ofstream fos;
+  std::streambuf* osbuf = nullptr;
+  if (m_dataFilename.empty()) {
+    // Redirect to stdout if we are running in batch mode
+    if (!ctx->isUIAvailable())
+      osbuf = std::cout.rdbuf();
+  }
+  else {
+    fos.open(FSTREAM_PATH(m_dataFilename), std::ios::out);
+    osbuf = fos.rdbuf();
   }
+  std::ostream os(osbuf);
+
+  // Save the metadata.
+  if (osbuf)
+    createDataFile(sheet->samples, os, sheet->pixelFormat,
+                   sheet->textureSize);
 
-  return textureDocument.release();
+  // The streamed texture is already saved (nullptr is returned)
+  return sheet->textureDocument.release();
 }
 
 gfx::Size DocExporter::calculateSheetSize()
@@ -472,6 +716,9 @@ gfx::Size DocExporter::calculateSheetSize()
 
 void DocExporter::captureSamples(Samples& samples)
 {
+  OpaqueBoundsCache opaqueBounds;
+  int trimmedImagesMemSize = 0;
+
   for (auto& item : m_documents) {
     Doc* doc = item.doc;
     Sprite* sprite = doc->sprite();
@@ -538,37 +785,69 @@ void DocExporter::captureSamples(Samples& samples)
         if (layer && layer->isImage() && !cel)
           continue;
 
-        std::unique_ptr<Image> sampleRender(
-          Image::create(sprite->pixelFormat(),
-            sprite->width(),
-            sprite->height(),
-            m_sampleRenderBuf));
-
-        sampleRender->setMaskColor(sprite->transparentColor());
-        clear_image(sampleRender.get(), sprite->transparentColor());
-        renderSample(sample, sampleRender.get(), 0, 0);
-
         gfx::Rect frameBounds;
-        doc::color_t refColor = 0;
-
-        if (m_trimCels) {
-          if ((layer &&
-               layer->isBackground()) ||
-              (!layer &&
-               sprite->backgroundLayer() &&
-               sprite->backgroundLayer()->isVisible())) {
-            refColor = get_pixel(sampleRender.get(), 0, 0);
+        bool empty;
+
+        // Try to calculate the trimmed bounds from the bounds of the
+        // cels, if it's not possible we render the sample (only the
+        // area that can contain non-transparent pixels)
+        gfx::Rect renderBounds;
+        if (calculateSampleBounds(sample, opaqueBounds, renderBounds)) {
+          frameBounds = renderBounds;
+          empty = frameBounds.isEmpty();
+        }
+        else if (renderBounds.isEmpty()) {
+          empty = true;
+        }
+        else {
+          ImageRef sampleRender(
+            Image::create(sprite->pixelFormat(),
+                          renderBounds.w,
+                          renderBounds.h,
+                          m_sampleRenderBuf));
+
+          sampleRender->setMaskColor(sprite->transparentColor());
+          clear_image(sampleRender.get(), sprite->transparentColor());
+          renderSample(sample, sampleRender.get(),
+                       gfx::Clip(0, 0, renderBounds));
+
+          doc::color_t refColor = 0;
+
+          if (m_trimCels) {
+            if ((layer &&
+                 layer->isBackground()) ||
+                (!layer &&
+                 sprite->backgroundLayer() &&
+                 sprite->backgroundLayer()->isVisible())) {
+              refColor = get_pixel(sampleRender.get(), 0, 0);
+            }
+            else {
+              refColor = sprite->transparentColor();
+            }
           }
-          else {
+          else if (m_ignoreEmptyCels)
             refColor = sprite->transparentColor();
+
+          empty = !algorithm::shrink_bounds(sampleRender.get(), frameBounds, refColor);
+          if (!empty) {
+            // Keep the rendered pixels to re-use them in the texture
+            // (the texture is cleared with 0, so the transparent
+            // color must be 0 too).
+            const int memSize =
+              sampleRender->getRowStrideSize(frameBounds.w) * frameBounds.h;
+            if (m_trimCels &&
+                sprite->transparentColor() == 0 &&
+                trimmedImagesMemSize + memSize <= kMaxTrimmedImagesMemSize) {
+              sample.setTrimmedImage(
+                ImageRef(crop_image(sampleRender.get(), frameBounds, 0)));
+              trimmedImagesMemSize += memSize;
+            }
+            frameBounds.offset(renderBounds.origin());
           }
         }
-        else if (m_ignoreEmptyCels)
-          refColor = sprite->transparentColor();
 
-        if (!algorithm::shrink_bounds(sampleRender.get(), frameBounds, refColor)) {
-          // If shrink_bounds() returns false, it's because the whole
-          // image is transparent (equal to the mask color).
+        if (empty) {
+          // The whole sample is transparent (equal to the mask color).
 
           // Should we ignore this empty frame? (i.e. don't include
           // the frame in the sprite sheet)
@@ -596,6 +875,63 @@ void DocExporter::captureSamples(Samples& samples)
   }
 }
 
+// Calculates the bounds of the non-transparent pixels of the sample
+// from the bounds of its cels. Returns false if the sample must be
+// rendered to know its exact bounds (e.g. there is a visible
+// background layer, or layers with blend modes/opacity that can
+// produce transparent pixels), in that case "bounds" is the area to
+// render (pixels outside this area are transparent).
+bool DocExporter::calculateSampleBounds(const Sample& sample,
+                                        OpaqueBoundsCache& cache,
+                                        gfx::Rect& bounds) const
+{
+  Sprite* sprite = sample.sprite();
+  const gfx::Rect spriteBounds = sprite->bounds();
+
+  RestoreVisibleLayers layersVisibility;
+  if (sample.selectedLayers())
+    layersVisibility.showSelectedLayers(sprite,
+                                        *sample.selectedLayers());
+
+  bool exact = true;
+  bounds = gfx::Rect();
+
+  for (const Layer* layer : sprite->allVisibleLayers()) {
+    // Render::renderLayer() ignores reference layers
+    if (!layer->isImage() || layer->isReference())
+      continue;
+
+    // The background is compared with the color of its first pixel
+    if (layer->isBackground()) {
+      bounds = spriteBounds;
+      return false;
+    }
+
+    const Cel* cel = layer->cel(sample.frame());
+    if (!cel || !cel->image())
+      continue;
+
+    const LayerImage* imgLayer = static_cast<const LayerImage*>(layer);
+    if (imgLayer->blendMode() != BlendMode::NORMAL ||
+        imgLayer->opacity() < 255 ||
+        cel->opacity() < 255) {
+      // Opacity/blend modes can make transparent some pixels of the
+      // cel, but transparent pixels of the cel never modify the
+      // result (except with the "src" blend mode)
+      exact = false;
+      if (imgLayer->blendMode() == BlendMode::SRC) {
+        bounds = spriteBounds;
+        return false;
+      }
+    }
+
+    bounds |= cache.opaqueBounds(cel);
+  }
+
+  bounds &= spriteBounds;
+  return exact;
+}
+
 void DocExporter::layoutSamples(Samples& samples)
 {
   switch (m_sheetType) {
@@ -647,11 +983,10 @@ gfx::Size DocExporter::calculateSheetSize(const Samples& samples) const
                    fullTextureBounds.y+fullTextureBounds.h);
 }
 
-Doc* DocExporter::createEmptyTexture(const Samples& samples) const
+PixelFormat DocExporter::textureFormat(const Samples& samples, Palette** outPalette) const
 {
   PixelFormat pixelFormat = IMAGE_INDEXED;
   Palette* palette = nullptr;
-  int maxColors = 256;
 
   for (const auto& sample : samples) {
     if (sample.isDuplicated() ||
@@ -677,7 +1012,15 @@ Doc* DocExporter::createEmptyTexture(const Samples& samples) const
     }
   }
 
-  gfx::Size textureSize = calculateSheetSize(samples);
+  *outPalette = (pixelFormat == IMAGE_INDEXED ? palette: nullptr);
+  return pixelFormat;
+}
+
+Doc* DocExporter::createEmptyTexture(PixelFormat pixelFormat,
+                                     const Palette* palette,
+                                     const gfx::Size& textureSize) const
+{
+  int maxColors = 256;
 
   std::unique_ptr<Sprite> sprite(
     Sprite::createBasicSprite(
@@ -692,10 +1035,8 @@ Doc* DocExporter::createEmptyTexture(const Samples& samples) const
   return document.release();
 }
 
-void DocExporter::renderTexture(Context* ctx, const Samples& samples, Image* textureImage) const
+void DocExporter::convertSamples(Context* ctx, const Samples& samples, PixelFormat pixelFormat) const
 {
-  textureImage->clear(0);
-
   for (const auto& sample : samples) {
     if (sample.isDuplicated() ||
         sample.isEmpty())
@@ -703,23 +1044,202 @@ void DocExporter::renderTexture(Context* ctx, const Samples& samples, Image* tex
 
     // Make the sprite compatible with the texture so the render()
     // works correctly.
-    if (sample.sprite()->pixelFormat() != textureImage->pixelFormat()) {
+    if (sample.sprite()->pixelFormat() != pixelFormat) {
       cmd::SetPixelFormat(
         sample.sprite(),
-        textureImage->pixelFormat(),
+        pixelFormat,
         render::DitheringAlgorithm::None,
         render::DitheringMatrix(),
         nullptr)                // TODO add a delegate to show progress
         .execute(ctx);
     }
+  }
+}
+
+bool DocExporter::renderTexture(const Samples& samples, Image* textureImage) const
+{
+  textureImage->clear(0);
+
+  return renderSamples(samples, textureImage, textureImage->bounds(), 0.0, 1.0);
+}
+
+// Renders the rows [y, y+rows) of the texture in the given strip.
+bool DocExporter::renderStrip(const Samples& samples, Image* strip, int y, int rows,
+                              double progressFrom, double progressTo) const
+{
+  strip->clear(0);
+
+  return renderSamples(samples, strip, gfx::Rect(0, y, strip->width(), rows),
+                       progressFrom, progressTo);
+}
+
+// Renders the samples that intersect the "textureBounds" area of the
+// texture in "dst" (which contains just that area of the texture).
+//
+// Samples are rendered in parallel (each one in its own region of the
+// texture). The visibility of layers is modified to render the
+// selected layers of each sample, so samples are grouped by sprite
+// and selected layers: different sprites are rendered at the same
+// time, and the groups of the same sprite one after the other.
+//
+// Returns false if the task delegate canceled the rendering (pending
+// samples aren't rendered).
+bool DocExporter::renderSamples(const Samples& samples, Image* dst,
+                                const gfx::Rect& textureBounds,
+                                double progressFrom, double progressTo) const
+{
+  struct SampleArea {
+    const Sample* sample;
+    gfx::Clip clip;
+  };
+  typedef std::map<SelectedLayers*, std::vector<SampleArea> > LayersGroups;
+  std::map<Sprite*, LayersGroups> sprites;
+  int total = 0;
+
+  for (const auto& sample : samples) {
+    if (sample.isDuplicated() ||
+        sample.isEmpty())
+      continue;
 
-    renderSample(sample, textureImage,
+    const gfx::Rect& trimmed = sample.trimmedBounds();
+    const gfx::Rect sampleBounds(
       sample.inTextureBounds().x+m_innerPadding,
-      sample.inTextureBounds().y+m_innerPadding);
+      sample.inTextureBounds().y+m_innerPadding,
+      trimmed.w, trimmed.h);
+
+    const gfx::Rect area = (sampleBounds & textureBounds);
+    if (area.isEmpty())
+      continue;
+
+    SampleArea sampleArea;
+    sampleArea.sample = &sample;
+    sampleArea.clip = gfx::Clip(area.x-textureBounds.x,
+                                area.y-textureBounds.y,
+                                trimmed.x + area.x-sampleBounds.x,
+                                trimmed.y + area.y-sampleBounds.y,
+                                area.w, area.h);
+    sprites[sample.sprite()][sample.selectedLayers()].push_back(sampleArea);
+    ++total;
+  }
+
+  // The delegate is used from one thread at a time
+  std::mutex progressMutex;
+  int done = 0;
+  bool canceled = false;
+  auto notifyProgress = [&]{
+    if (!m_delegate)
+      return;
+    std::lock_guard<std::mutex> lock(progressMutex);
+    ++done;
+    m_delegate->notifyTaskProgress(
+      progressFrom + (progressTo - progressFrom) * done / total);
+  };
+  auto continueTask = [&]() -> bool {
+    if (!m_delegate)
+      return true;
+    std::lock_guard<std::mutex> lock(progressMutex);
+    if (!canceled && !m_delegate->continueTask())
+      canceled = true;
+    return !canceled;
+  };
+
+  // In each round we render one group of samples of each sprite (all
+  // the samples of the round in parallel). The visibility of layers
+  // is changed from this thread between rounds, so tasks never wait
+  // other tasks.
+  struct SpriteGroups {
+    Sprite* sprite;
+    LayersGroups::const_iterator it, end;
+  };
+  std::vector<SpriteGroups> pending;
+  for (const auto& sprite : sprites)
+    pending.push_back(SpriteGroups{ sprite.first,
+                                    sprite.second.begin(),
+                                    sprite.second.end() });
+
+  while (!pending.empty() && !canceled) {
+    std::list<RestoreVisibleLayers> layersVisibility;
+    TaskGroup samplesGroup;
+
+    for (auto it=pending.begin(); it!=pending.end(); ) {
+      const auto& layersGroup = *it->it;
+      if (layersGroup.first) {
+        layersVisibility.emplace_back();
+        layersVisibility.back().showSelectedLayers(it->sprite, *layersGroup.first);
+      }
+
+      for (const SampleArea& sampleArea : layersGroup.second) {
+        const SampleArea* p = &sampleArea;
+        samplesGroup.run(
+          [this, p, dst, &notifyProgress, &continueTask]{
+            if (!continueTask())
+              return;
+            renderVisibleLayers(*p->sample, dst, p->clip);
+            notifyProgress();
+          });
+      }
+
+      if (++it->it == it->end)
+        it = pending.erase(it);
+      else
+        ++it;
+    }
+
+    samplesGroup.wait();
+  }
+
+  return !canceled;
+}
+
+bool DocExporter::canStreamTexture() const
+{
+#ifdef ENABLE_SAVE
+  return (m_streamTexture &&
+          base::string_to_lower(base::get_file_extension(m_textureFilename)) == "png");
+#else
+  return false;
+#endif
+}
+
+#ifdef ENABLE_SAVE
+// Renders the texture in strips of rows. Each strip is encoded in a
+// background thread while the next one is being rendered, so we need
+// just two strips in memory instead of the whole texture. Returns
+// false if it was canceled (the file is incomplete).
+bool DocExporter::streamTexture(const Samples& samples,
+                                PixelFormat pixelFormat, const Palette* palette,
+                                const gfx::Size& textureSize) const
+{
+  ImageRef strips[2];
+  const int rowSize = textureSize.w * (pixelFormat == IMAGE_RGB ? 4: 1);
+  const int stripHeight = MID(1, kMaxStripMemSize / MAX(1, rowSize), textureSize.h);
+  for (auto& strip : strips)
+    strip.reset(Image::create(pixelFormat, textureSize.w, stripHeight));
+
+  // The texture doesn't have a background layer, so the transparent
+  // color of indexed images is the entry 0 (as in createEmptyTexture())
+  PngStreamEncoder encoder(m_textureFilename, pixelFormat,
+                           textureSize.w, textureSize.h,
+                           palette, 0);
+  {
+    StripWriter writer(encoder);
+    for (int y=0, i=0; y<textureSize.h; y+=stripHeight, i=1-i) {
+      const int rows = MIN(stripHeight, textureSize.h-y);
+      if (!renderStrip(samples, strips[i].get(), y, rows,
+                       double(y) / textureSize.h,
+                       double(y+rows) / textureSize.h))
+        return false;
+      writer.write(strips[i].get(), rows);
+    }
+    writer.finish();
   }
+  encoder.close();
+  return true;
 }
+#endif
 
-void DocExporter::createDataFile(const Samples& samples, std::ostream& os, Image* textureImage)
+void DocExporter::createDataFile(const Samples& samples, std::ostream& os,
+                                 PixelFormat textureFormat, const gfx::Size& textureSize)
 {
   std::string frames_begin;
   std::string frames_end;
@@ -791,10 +1311,10 @@ void DocExporter::createDataFile(const Samples& samples, std::ostream& os, Image
   if (!m_textureFilename.empty())
     os << "  \"image\": \"" << escape_for_json(m_textureFilename).c_str() << "\",\n";
 
-  os << "  \"format\": \"" << (textureImage->pixelFormat() == IMAGE_RGB ? "RGBA8888": "I8") << "\",\n"
+  os << "  \"format\": \"" << (textureFormat == IMAGE_RGB ? "RGBA8888": "I8") << "\",\n"
      << "  \"size\": { "
-     << "\"w\": " << textureImage->width() << ", "
-     << "\"h\": " << textureImage->height() << " },\n"
+     << "\"w\": " << textureSize.w << ", "
+     << "\"h\": " << textureSize.h << " },\n"
      << "  \"scale\": \"1\"";
 
   // meta.frameTags
@@ -962,15 +1482,35 @@ void DocExporter::createDataFile(const Samples& samples, std::ostream& os, Image
      << "}\n";
 }
 
-void DocExporter::renderSample(const Sample& sample, doc::Image* dst, int x, int y) const
+void DocExporter::renderSample(const Sample& sample, doc::Image* dst, const gfx::Clip& clip) const
 {
-  gfx::Clip clip(x, y, sample.trimmedBounds());
-
   RestoreVisibleLayers layersVisibility;
   if (sample.selectedLayers())
     layersVisibility.showSelectedLayers(sample.sprite(),
                                         *sample.selectedLayers());
 
+  renderVisibleLayers(sample, dst, clip);
+}
+
+// Renders the sample with the current visibility of the layers (it
+// can be called from several threads at the same time).
+void DocExporter::renderVisibleLayers(const Sample& sample, doc::Image* dst, const gfx::Clip& clip) const
+{
+  // Re-use the pixels rendered in captureSamples() (if the sprite
+  // wasn't converted to other pixel format in the meantime)
+  const ImageRef& trimmedImage = sample.trimmedImage();
+  if (trimmedImage &&
+      trimmedImage->pixelFormat() == dst->pixelFormat() &&
+      sample.trimmedBounds().contains(clip.srcBounds())) {
+    const gfx::Rect& trimmed = sample.trimmedBounds();
+    dst->copy(trimmedImage.get(),
+              gfx::Clip(clip.dst.x, clip.dst.y,
+                        clip.src.x - trimmed.x,
+                        clip.src.y - trimmed.y,
+                        clip.size.w, clip.size.h));
+    return;
+  }
+
   render::Render render;
   render.renderSprite(dst, sample.sprite(), sample.frame(), clip);
 }
@@ -13,10 +13,12 @@
 #include "doc/frame.h"
 #include "doc/image_buffer.h"
 #include "doc/object_id.h"
+#include "doc/pixel_format.h"
 #include "gfx/fwd.h"
 
 #include <iosfwd>
 #include <map>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
@@ -24,10 +26,15 @@
 namespace doc {
   class FrameTag;
   class Image;
+  class Palette;
   class SelectedLayers;
   class SelectedFrames;
 }
 
+namespace render {
+  class TaskDelegate;
+}
+
 namespace app {
 
   class Context;
@@ -42,6 +49,7 @@ namespace app {
     };
 
     DocExporter();
+    ~DocExporter();
 
     DataFormat dataFormat() const { return m_dataFormat; }
     const std::string& dataFilename() { return m_dataFilename; }
@@ -57,6 +65,7 @@ namespace app {
     const std::string& filenameFormat() const { return m_filenameFormat; }
     bool listFrameTags() const { return m_listFrameTags; }
     bool listLayers() const { return m_listLayers; }
+    bool streamTexture() const { return m_streamTexture; }
 
     void setDataFormat(DataFormat format) { m_dataFormat = format; }
     void setDataFilename(const std::string& filename) { m_dataFilename = filename; }
@@ -74,6 +83,17 @@ namespace app {
     void setListLayers(bool value) { m_listLayers = value; }
     void setListSlices(bool value) { m_listSlices = value; }
 
+    // If it's true and the texture is saved as a .png file, the
+    // texture is rendered and saved in strips of rows (so it's never
+    // completely in memory) and exportSheet() returns nullptr.
+    void setStreamTexture(bool value) { m_streamTexture = value; }
+
+    // Receives the progress of the texture rendering (it's notified
+    // from several threads, but not at the same time). If the
+    // delegate cancels the task, exportSheet() returns nullptr and
+    // the texture/data files aren't saved.
+    void setTaskDelegate(render::TaskDelegate* delegate) { m_delegate = delegate; }
+
     void addDocument(Doc* document,
                      doc::FrameTag* tag,
                      doc::SelectedLayers* selLayers,
@@ -81,7 +101,24 @@ namespace app {
       m_documents.push_back(Item(document, tag, selLayers, selFrames));
     }
 
+    // Generates the sprite sheet calling all the following steps.
+    // If the texture cannot be saved, the incomplete file is deleted,
+    // the data file is not created, and the error is thrown.
     Doc* exportSheet(Context* ctx);
+
+    // Steps of exportSheet() to generate the sheet from a job:
+    // captureSheet() and renderSheet() only read/render pixels, so
+    // they can be called from a background thread, convertSheet()
+    // and saveSheet() execute commands, save files, and show errors
+    // in the console, so they must be called from the UI thread.
+    //
+    // captureSheet() returns false if there is nothing to export,
+    // and renderSheet() if the task delegate canceled the render.
+    bool captureSheet();
+    void convertSheet(Context* ctx);
+    bool renderSheet();
+    Doc* saveSheet(Context* ctx);
+
     gfx::Size calculateSheetSize();
 
   private:
@@ -90,14 +127,33 @@ namespace app {
     class LayoutSamples;
     class SimpleLayoutSamples;
     class BestFitLayoutSamples;
+    class OpaqueBoundsCache;
+    class Sheet;
 
     void captureSamples(Samples& samples);
+    bool calculateSampleBounds(const Sample& sample,
+                               OpaqueBoundsCache& cache,
+                               gfx::Rect& bounds) const;
     void layoutSamples(Samples& samples);
     gfx::Size calculateSheetSize(const Samples& samples) const;
-    Doc* createEmptyTexture(const Samples& samples) const;
-    void renderTexture(Context* ctx, const Samples& samples, doc::Image* textureImage) const;
-    void createDataFile(const Samples& samples, std::ostream& os, doc::Image* textureImage);
-    void renderSample(const Sample& sample, doc::Image* dst, int x, int y) const;
+    doc::PixelFormat textureFormat(const Samples& samples, doc::Palette** palette) const;
+    Doc* createEmptyTexture(doc::PixelFormat pixelFormat, const doc::Palette* palette,
+                            const gfx::Size& textureSize) const;
+    void convertSamples(Context* ctx, const Samples& samples, doc::PixelFormat pixelFormat) const;
+    bool renderTexture(const Samples& samples, doc::Image* textureImage) const;
+    bool renderStrip(const Samples& samples, doc::Image* strip, int y, int rows,
+                     double progressFrom, double progressTo) const;
+    bool renderSamples(const Samples& samples, doc::Image* dst,
+                       const gfx::Rect& textureBounds,
+                       double progressFrom, double progressTo) const;
+    bool canStreamTexture() const;
+    bool streamTexture(const Samples& samples,
+                       doc::PixelFormat pixelFormat, const doc::Palette* palette,
+                       const gfx::Size& textureSize) const;
+    void createDataFile(const Samples& samples, std::ostream& os,
+                        doc::PixelFormat textureFormat, const gfx::Size& textureSize);
+    void renderSample(const Sample& sample, doc::Image* dst, const gfx::Clip& clip) const;
+    void renderVisibleLayers(const Sample& sample, doc::Image* dst, const gfx::Clip& clip) const;
 
     class Item {
     public:
@@ -140,6 +196,11 @@ namespace app {
     bool m_listFrameTags;
     bool m_listLayers;
     bool m_listSlices;
+    bool m_streamTexture;
+    render::TaskDelegate* m_delegate;
+
+    // Sheet generated by the captureSheet()/renderSheet() steps
+    std::unique_ptr<Sheet> m_sheet;
 
     // Displacement for each tag from/to frames in case we export
     // them. It's used in case we trim frames outside tags and they
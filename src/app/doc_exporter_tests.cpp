@@ -0,0 +1,344 @@
+// Aseprite
+// Copyright (C) 2018  David Capello
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#include "tests/test.h"
+
+#include "app/context.h"
+#include "app/doc.h"
+#include "app/doc_exporter.h"
+#include "app/test_context.h"
+#include "base/fstream_path.h"
+#include "base/fs.h"
+#include "doc/algorithm/shrink_bounds.h"
+#include "doc/blend_mode.h"
+#include "doc/cel.h"
+#include "doc/image.h"
+#include "doc/layer.h"
+#include "doc/primitives.h"
+#include "doc/sprite.h"
+#include "render/render.h"
+#include "render/task_delegate.h"
+
+#include "json11.hpp"
+
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+using namespace app;
+using namespace doc;
+
+typedef std::unique_ptr<Doc> DocPtr;
+
+static const char* kDataFilename = "_doc_exporter_tests.json";
+static const int kFrames = 256;
+
+namespace {
+
+  // Records the notified progress, and cancels the task after
+  // "cancelAfter" notifications.
+  class TestTaskDelegate : public render::TaskDelegate {
+  public:
+    TestTaskDelegate(int cancelAfter = -1) : m_cancelAfter(cancelAfter) { }
+
+    const std::vector<double>& progress() const { return m_progress; }
+
+    void notifyTaskProgress(double progress) override {
+      m_progress.push_back(progress);
+    }
+
+    bool continueTask() override {
+      return (m_cancelAfter < 0 ||
+              int(m_progress.size()) < m_cancelAfter);
+    }
+
+  private:
+    int m_cancelAfter;
+    std::vector<double> m_progress;
+  };
+
+}
+
+class DocExporterTest : public ::testing::Test {
+public:
+  DocExporterTest()
+    : doc(ctx.documents().add(4, 4, ColorMode::RGB)) {
+    Sprite* sprite = doc->sprite();
+    LayerImage* layer = static_cast<LayerImage*>(sprite->root()->firstLayer());
+    layer->setBackground(false);
+
+    // Different frames (so they are not duplicated samples)
+    sprite->setTotalFrames(frame_t(kFrames));
+    for (frame_t frame=0; frame<kFrames; ++frame) {
+      ImageRef image(Image::create(IMAGE_RGB, 4, 4));
+      clear_image(image.get(), 0);
+      put_pixel(image.get(), frame % 4, (frame / 4) % 4, rgba(frame, 255, 0, 255));
+      if (frame == 0)
+        copy_image(layer->cel(frame)->image(), image.get());
+      else
+        layer->addCel(new Cel(frame, image));
+    }
+
+    // The data is saved in a file (instead of stdout)
+    exporter.setDataFilename(kDataFilename);
+    exporter.addDocument(doc.get(), nullptr, nullptr, nullptr);
+  }
+
+  ~DocExporterTest() {
+    doc->close();
+    if (base::is_file(kDataFilename))
+      base::delete_file(kDataFilename);
+  }
+
+  TestContextT<Context> ctx;
+  DocPtr doc;
+  DocExporter exporter;
+};
+
+TEST_F(DocExporterTest, RenderProgress)
+{
+  TestTaskDelegate delegate;
+  exporter.setTaskDelegate(&delegate);
+
+  DocPtr sheet(exporter.exportSheet(&ctx));
+  ASSERT_TRUE(sheet != nullptr);
+
+  // One notification for each rendered sample
+  const std::vector<double>& progress = delegate.progress();
+  ASSERT_EQ(kFrames, int(progress.size()));
+  for (int i=1; i<int(progress.size()); ++i)
+    EXPECT_LT(progress[i-1], progress[i]);
+  EXPECT_DOUBLE_EQ(1.0, progress.back());
+
+  sheet->close();
+}
+
+TEST_F(DocExporterTest, CancelRender)
+{
+  TestTaskDelegate delegate(1);
+  exporter.setTaskDelegate(&delegate);
+
+  DocPtr sheet(exporter.exportSheet(&ctx));
+  EXPECT_EQ(nullptr, sheet.get());
+
+  // Samples that were being rendered when the task was canceled are
+  // completed, but the rest of samples aren't rendered.
+  EXPECT_LE(1, int(delegate.progress().size()));
+  EXPECT_GT(kFrames, int(delegate.progress().size()));
+
+  // The incomplete data file is deleted
+  EXPECT_FALSE(base::is_file(kDataFilename));
+}
+
+TEST_F(DocExporterTest, StreamTextureError)
+{
+  // The texture cannot be created in a directory that doesn't exist
+  exporter.setTextureFilename("_doc_exporter_tests/sheet.png");
+  exporter.setStreamTexture(true);
+
+  EXPECT_THROW(exporter.exportSheet(&ctx), std::exception);
+  EXPECT_FALSE(base::is_file(kDataFilename));
+}
+
+TEST_F(DocExporterTest, SaveTextureError)
+{
+  exporter.setTextureFilename("_doc_exporter_tests/sheet.png");
+
+  EXPECT_THROW(exporter.exportSheet(&ctx), std::exception);
+  EXPECT_FALSE(base::is_file(kDataFilename));
+}
+
+// Trimmed bounds of each frame calculated rendering the whole sprite
+// (the old way to calculate them in DocExporter::captureSamples()).
+static std::vector<gfx::Rect> full_render_bounds(const Sprite* sprite)
+{
+  std::vector<gfx::Rect> result;
+  for (frame_t frame=0; frame<sprite->totalFrames(); ++frame) {
+    ImageRef image(Image::create(sprite->pixelFormat(),
+                                 sprite->width(), sprite->height()));
+    image->setMaskColor(sprite->transparentColor());
+    clear_image(image.get(), sprite->transparentColor());
+    render::Render().renderSprite(image.get(), sprite, frame);
+
+    color_t refColor = sprite->transparentColor();
+    if (sprite->backgroundLayer() &&
+        sprite->backgroundLayer()->isVisible())
+      refColor = get_pixel(image.get(), 0, 0);
+
+    gfx::Rect bounds;
+    if (!algorithm::shrink_bounds(image.get(), bounds, refColor))
+      bounds = gfx::Rect(0, 0, 0, 0);
+    result.push_back(bounds);
+  }
+  return result;
+}
+
+// Trimmed bounds of each frame in the exported sprite sheet
+// ("spriteSourceSize" fields of the JSON data).
+static std::vector<gfx::Rect> exported_bounds(Context* ctx, Doc* doc)
+{
+  DocExporter exporter;
+  exporter.setDataFilename(kDataFilename);
+  exporter.setDataFormat(DocExporter::JsonArrayDataFormat);
+  exporter.setTrimCels(true);
+  exporter.addDocument(doc, nullptr, nullptr, nullptr);
+
+  DocPtr sheet(exporter.exportSheet(ctx));
+  EXPECT_TRUE(sheet != nullptr);
+  if (sheet)
+    sheet->close();
+
+  std::ifstream file(FSTREAM_PATH(kDataFilename));
+  std::stringstream buf;
+  buf << file.rdbuf();
+  file.close();
+  base::delete_file(kDataFilename);
+
+  std::string err;
+  json11::Json json = json11::Json::parse(buf.str(), err);
+  EXPECT_TRUE(err.empty()) << err;
+
+  std::vector<gfx::Rect> result;
+  for (const auto& frame : json["frames"].array_items()) {
+    const json11::Json& bounds = frame["spriteSourceSize"];
+    result.push_back(gfx::Rect(bounds["x"].int_value(),
+                               bounds["y"].int_value(),
+                               bounds["w"].int_value(),
+                               bounds["h"].int_value()));
+  }
+  return result;
+}
+
+static void expect_same_bounds(const std::vector<gfx::Rect>& expected,
+                               const std::vector<gfx::Rect>& result)
+{
+  ASSERT_EQ(expected.size(), result.size());
+  for (int i=0; i<int(expected.size()); ++i) {
+    EXPECT_EQ(expected[i], result[i])
+      << "Frame " << i << " expected "
+      << expected[i].x << "," << expected[i].y << " "
+      << expected[i].w << "x" << expected[i].h << " got "
+      << result[i].x << "," << result[i].y << " "
+      << result[i].w << "x" << result[i].h;
+  }
+}
+
+TEST(DocExporter, TrimmedBoundsOfTransparentRgbCels)
+{
+  TestContextT<Context> ctx;
+  DocPtr doc(ctx.documents().add(16, 16, ColorMode::RGB));
+  Sprite* sprite = doc->sprite();
+  LayerImage* layer = static_cast<LayerImage*>(sprite->root()->firstLayer());
+  layer->setBackground(false);
+  sprite->setTotalFrames(frame_t(3));
+
+  // Pixels with alpha=0 but RGB components != 0 are transparent
+  Image* image = layer->cel(0)->image();
+  clear_image(image, rgba(255, 0, 0, 0));
+  put_pixel(image, 3, 4, rgba(0, 255, 0, 255));
+  put_pixel(image, 9, 6, rgba(0, 0, 255, 128));
+
+  ImageRef image2(Image::create(IMAGE_RGB, 8, 8));
+  clear_image(image2.get(), rgba(255, 255, 255, 0));
+  layer->addCel(new Cel(frame_t(1), image2));
+
+  ImageRef image3(Image::create(IMAGE_RGB, 8, 8));
+  clear_image(image3.get(), rgba(0, 0, 255, 0));
+  put_pixel(image3.get(), 7, 7, rgba(0, 0, 255, 255));
+  Cel* cel3 = new Cel(frame_t(2), image3);
+  cel3->setPosition(12, -3);
+  layer->addCel(cel3);
+
+  expect_same_bounds(full_render_bounds(sprite),
+                     exported_bounds(&ctx, doc.get()));
+  doc->close();
+}
+
+TEST(DocExporter, TrimmedBoundsWithBackground)
+{
+  TestContextT<Context> ctx;
+  DocPtr doc(ctx.documents().add(16, 16, ColorMode::RGB));
+  Sprite* sprite = doc->sprite();
+  LayerImage* background = sprite->backgroundLayer();
+  ASSERT_TRUE(background != nullptr);
+  sprite->setTotalFrames(frame_t(3));
+
+  LayerImage* layer = new LayerImage(sprite);
+  sprite->root()->addLayer(layer);
+
+  for (frame_t frame=0; frame<3; ++frame) {
+    ImageRef bg(Image::create(IMAGE_RGB, 16, 16));
+    clear_image(bg.get(), rgba(64, 64, 64, 255));
+    if (frame == 0)
+      copy_image(background->cel(frame)->image(), bg.get());
+    else
+      background->addCel(new Cel(frame, bg));
+  }
+
+  // Frame 0: only the background (all pixels are equal)
+  // Frame 1: a pixel with the same color of the background
+  ImageRef image1(Image::create(IMAGE_RGB, 4, 4));
+  clear_image(image1.get(), 0);
+  put_pixel(image1.get(), 2, 2, rgba(64, 64, 64, 255));
+  layer->addCel(new Cel(frame_t(1), image1));
+
+  // Frame 2: a different pixel
+  ImageRef image2(Image::create(IMAGE_RGB, 4, 4));
+  clear_image(image2.get(), 0);
+  put_pixel(image2.get(), 1, 3, rgba(255, 0, 0, 255));
+  Cel* cel2 = new Cel(frame_t(2), image2);
+  cel2->setPosition(5, 6);
+  layer->addCel(cel2);
+
+  expect_same_bounds(full_render_bounds(sprite),
+                     exported_bounds(&ctx, doc.get()));
+  doc->close();
+}
+
+TEST(DocExporter, TrimmedBoundsWithBlendModes)
+{
+  TestContextT<Context> ctx;
+  DocPtr doc(ctx.documents().add(16, 16, ColorMode::RGB));
+  Sprite* sprite = doc->sprite();
+  LayerImage* bottom = static_cast<LayerImage*>(sprite->root()->firstLayer());
+  bottom->setBackground(false);
+  sprite->setTotalFrames(frame_t(3));
+
+  LayerImage* top = new LayerImage(sprite);
+  sprite->root()->addLayer(top);
+
+  Image* image0 = bottom->cel(0)->image();
+  clear_image(image0, 0);
+  fill_rect(image0, 2, 2, 5, 5, rgba(255, 255, 255, 255));
+
+  // Multiply over the bottom layer (and over transparent pixels)
+  top->setBlendMode(BlendMode::MULTIPLY);
+  ImageRef image1(Image::create(IMAGE_RGB, 8, 8));
+  clear_image(image1.get(), 0);
+  fill_rect(image1.get(), 4, 4, 7, 7, rgba(255, 0, 0, 255));
+  top->addCel(new Cel(frame_t(0), image1));
+
+  // Only the layer with blend mode and cel opacity
+  ImageRef image2(Image::create(IMAGE_RGB, 8, 8));
+  clear_image(image2.get(), 0);
+  put_pixel(image2.get(), 6, 1, rgba(0, 255, 0, 255));
+  Cel* cel2 = new Cel(frame_t(1), image2);
+  cel2->setPosition(3, 3);
+  cel2->setOpacity(128);
+  top->addCel(cel2);
+
+  // Cel with opacity=0 (nothing is visible)
+  ImageRef image3(Image::create(IMAGE_RGB, 8, 8));
+  clear_image(image3.get(), rgba(0, 0, 255, 255));
+  Cel* cel3 = new Cel(frame_t(2), image3);
+  cel3->setOpacity(0);
+  top->addCel(cel3);
+
+  expect_same_bounds(full_render_bounds(sprite),
+                     exported_bounds(&ctx, doc.get()));
+  doc->close();
+}
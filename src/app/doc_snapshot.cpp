@@ -0,0 +1,116 @@
+// Aseprite
+// Copyright (C) 2018  David Capello
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/doc_snapshot.h"
+
+#include "app/doc.h"
+#include "doc/cel.h"
+#include "doc/cel_data.h"
+#include "doc/frame_tag.h"
+#include "doc/image.h"
+#include "doc/layer.h"
+#include "doc/palette.h"
+#include "doc/slice.h"
+#include "doc/sprite.h"
+
+#include <functional>
+#include <map>
+
+namespace app {
+
+using namespace doc;
+
+DocSnapshot::DocSnapshot(Doc* doc)
+{
+  const Sprite* spr = doc->sprite();
+  std::unique_ptr<Sprite> sprCopy(
+    new Sprite(spr->pixelFormat(), spr->width(), spr->height(),
+               spr->palette(frame_t(0))->size()));
+
+  sprCopy->setTransparentColor(spr->transparentColor());
+  sprCopy->setPixelRatio(spr->pixelRatio());
+  sprCopy->setTotalFrames(spr->totalFrames());
+  for (frame_t i(0); i < spr->totalFrames(); ++i)
+    sprCopy->setFrameDuration(i, spr->frameDuration(i));
+
+  for (const Palette* pal : spr->getPalettes())
+    sprCopy->setPalette(pal, true);
+
+  for (const FrameTag* tag : spr->frameTags())
+    sprCopy->frameTags().add(new FrameTag(*tag));
+
+  for (const Slice* slice : spr->slices()) {
+    Slice* sliceCopy = new Slice;
+    sliceCopy->setName(slice->name());
+    sliceCopy->setUserData(slice->userData());
+    for (const auto& key : *slice)
+      sliceCopy->insert(key.frame(), key.value());
+    sprCopy->slices().add(sliceCopy);
+  }
+
+  // Copy the layers tree, cels share the pixels of the original
+  // images until they are modified (linked cels are still linked in
+  // the copy).
+  std::map<ObjectId, CelDataRef> celsData;
+
+  std::function<void(const LayerGroup*, LayerGroup*)> copyGroup =
+    [&](const LayerGroup* group, LayerGroup* groupCopy) {
+      for (const Layer* layer : group->layers()) {
+        Layer* layerCopy;
+
+        if (layer->isImage()) {
+          const LayerImage* layerImage = static_cast<const LayerImage*>(layer);
+          LayerImage* layerImageCopy = new LayerImage(sprCopy.get());
+          layerImageCopy->setBlendMode(layerImage->blendMode());
+          layerImageCopy->setOpacity(layerImage->opacity());
+
+          for (auto it=layerImage->getCelBegin(),
+                 end=layerImage->getCelEnd(); it != end; ++it) {
+            const Cel* cel = *it;
+            CelDataRef& data = celsData[cel->data()->id()];
+            if (!data) {
+              ImageRef image(Image::createSharedCopy(cel->image()));
+              data.reset(new CelData(*cel->data()));
+              data->setImage(image);
+              data->setUserData(cel->data()->userData());
+            }
+            layerImageCopy->addCel(new Cel(cel->frame(), data));
+          }
+          layerCopy = layerImageCopy;
+        }
+        else if (layer->isGroup()) {
+          LayerGroup* subgroupCopy = new LayerGroup(sprCopy.get());
+          copyGroup(static_cast<const LayerGroup*>(layer), subgroupCopy);
+          layerCopy = subgroupCopy;
+        }
+        else {
+          ASSERT(false);
+          continue;
+        }
+
+        layerCopy->setName(layer->name());
+        layerCopy->setFlags(layer->flags());
+        layerCopy->setUserData(layer->userData());
+        groupCopy->addLayer(layerCopy);
+      }
+    };
+  copyGroup(spr->root(), sprCopy->root());
+
+  m_doc.reset(new Doc(sprCopy.get()));
+  sprCopy.release();
+  m_doc->setFilename(doc->filename());
+  m_doc->setFormatOptions(doc->getFormatOptions());
+}
+
+DocSnapshot::~DocSnapshot()
+{
+}
+
+} // namespace app
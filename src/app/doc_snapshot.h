@@ -0,0 +1,41 @@
+// Aseprite
+// Copyright (C) 2018  David Capello
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_DOC_SNAPSHOT_H_INCLUDED
+#define APP_DOC_SNAPSHOT_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+
+#include <memory>
+
+namespace app {
+  class Doc;
+
+  // Immutable copy of a document that can be read from a background
+  // thread without locking the original document (e.g. to save it
+  // in a file). The structure of the sprite (layers, cels, palettes,
+  // frame tags, etc.) is copied, and the images share their pixels
+  // with the original document until they are modified there (see
+  // doc::Image::createSharedCopy()).
+  class DocSnapshot {
+  public:
+    // The given document must be locked (at least for reading).
+    DocSnapshot(Doc* doc);
+    ~DocSnapshot();
+
+    // The copy of the document. It must not be modified.
+    Doc* document() const { return m_doc.get(); }
+
+  private:
+    std::unique_ptr<Doc> m_doc;
+
+    DISABLE_COPYING(DocSnapshot);
+  };
+
+} // namespace app
+
+#endif
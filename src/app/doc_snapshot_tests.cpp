@@ -0,0 +1,138 @@
+// Aseprite
+// Copyright (C) 2018  David Capello
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#include "tests/test.h"
+
+#include "app/doc.h"
+#include "app/doc_snapshot.h"
+#include "doc/cel.h"
+#include "doc/image.h"
+#include "doc/image_impl.h"
+#include "doc/image_swap.h"
+#include "doc/layer.h"
+#include "doc/primitives.h"
+#include "doc/slice.h"
+#include "doc/sprite.h"
+
+#include <memory>
+#include <vector>
+
+using namespace app;
+using namespace doc;
+
+namespace {
+
+  // Sprite with one layer and "nframes" frames, the pixels of each
+  // frame are filled with rgba(frame, 0, 0, 255).
+  Doc* create_doc(int w, int h, int nframes, std::vector<Image*>& images) {
+    Sprite* sprite = new Sprite(IMAGE_RGB, w, h, 256);
+    sprite->setTotalFrames(nframes);
+    LayerImage* layer = new LayerImage(sprite);
+    sprite->root()->addLayer(layer);
+
+    for (frame_t frame=0; frame<nframes; ++frame) {
+      ImageRef image(Image::create(IMAGE_RGB, w, h));
+      clear_image(image.get(), rgba(frame, 0, 0, 255));
+      layer->addCel(new Cel(frame, image));
+      images.push_back(image.get());
+    }
+    return new Doc(sprite);
+  }
+
+  const Image* snapshot_image(const DocSnapshot& snapshot, frame_t frame) {
+    const Layer* layer = snapshot.document()->sprite()->root()->firstLayer();
+    return layer->cel(frame)->image();
+  }
+
+}
+
+TEST(DocSnapshot, ModifiedImagesAreCopied)
+{
+  const int w = 32, h = 32, nframes = 4;
+  std::vector<Image*> images;
+  std::unique_ptr<Doc> doc(create_doc(w, h, nframes, images));
+
+  DocSnapshot snapshot(doc.get());
+  for (frame_t frame=0; frame<nframes; ++frame) {
+    EXPECT_TRUE(images[frame]->hasSharedPixels());
+    EXPECT_EQ(static_cast<const Image*>(images[frame])->getPixelAddress(0, 0),
+              snapshot_image(snapshot, frame)->getPixelAddress(0, 0));
+  }
+
+  // Each image modified in a different way
+  put_pixel(images[0], 1, 1, rgba(255, 255, 255, 255));
+  {
+    LockImageBits<RgbTraits> bits(images[1], Image::WriteLock);
+    for (auto it=bits.begin(), end=bits.end(); it != end; ++it)
+      *it = rgba(255, 255, 255, 255);
+  }
+  clear_image(images[2], rgba(255, 255, 255, 255));
+  *(uint32_t*)images[3]->getPixelAddress(1, 1) = rgba(255, 255, 255, 255);
+
+  for (frame_t frame=0; frame<nframes; ++frame) {
+    EXPECT_FALSE(images[frame]->hasSharedPixels());
+    EXPECT_EQ(rgba(255, 255, 255, 255), get_pixel(images[frame], 1, 1));
+
+    const Image* image = snapshot_image(snapshot, frame);
+    EXPECT_NE(images[frame], image);
+    EXPECT_FALSE(image->hasSharedPixels());
+    for (int y=0; y<h; ++y)
+      for (int x=0; x<w; ++x)
+        ASSERT_EQ(rgba(frame, 0, 0, 255), get_pixel(image, x, y));
+  }
+}
+
+TEST(DocSnapshot, ImagesCanBeSwapped)
+{
+  const int w = 64, h = 64, nframes = 8;
+  std::vector<Image*> images;
+  std::unique_ptr<Doc> doc(create_doc(w, h, nframes, images));
+  Sprite* sprite = doc->sprite();
+
+  ImageSwap* swap = ImageSwap::instance();
+  swap->setFilename("_doc_snapshot_tests.tmp");
+  swap->setBudget(1);
+
+  {
+    DocSnapshot snapshot(doc.get());
+
+    // The snapshot keeps its own reference to the pixels, so the
+    // images of the original document can be moved to the swap
+    // file while the snapshot is saved from other thread.
+    swap->trim(sprite);
+    swap->trim(sprite);
+    for (frame_t frame=0; frame<nframes; ++frame) {
+      EXPECT_TRUE(images[frame]->isSwapped());
+
+      const Image* image = snapshot_image(snapshot, frame);
+      EXPECT_FALSE(image->isSwapped());
+      EXPECT_EQ(rgba(frame, 0, 0, 255), get_pixel(image, w-1, h-1));
+    }
+  }
+
+  for (frame_t frame=0; frame<nframes; ++frame)
+    EXPECT_EQ(rgba(frame, 0, 0, 255), get_pixel(images[frame], 0, 0));
+
+  doc.reset();
+  swap->setBudget(0);
+}
+
+TEST(DocSnapshot, NullSliceKeys)
+{
+  std::vector<Image*> images;
+  std::unique_ptr<Doc> doc(create_doc(8, 8, 4, images));
+
+  Slice* slice = new Slice;
+  slice->insert(0, SliceKey(gfx::Rect(0, 0, 4, 4)));
+  slice->insert(2, nullptr);
+  doc->sprite()->slices().add(slice);
+
+  DocSnapshot snapshot(doc.get());
+  const Slice* sliceCopy = *snapshot.document()->sprite()->slices().begin();
+  ASSERT_EQ(2, int(sliceCopy->size()));
+  EXPECT_EQ(gfx::Rect(0, 0, 4, 4), sliceCopy->getByFrame(1)->bounds());
+  EXPECT_EQ(nullptr, sliceCopy->getByFrame(2));
+}
@@ -16,7 +16,9 @@
 #include "app/context.h"
 #include "app/doc_undo_observer.h"
 #include "app/pref/preferences.h"
+#include "app/doc.h"
 #include "base/mem_utils.h"
+#include "doc/trace_events.h"
 #include "undo/undo_history.h"
 #include "undo/undo_state.h"
 
@@ -102,6 +104,8 @@ void DocUndo::undo()
   const undo::UndoState* state = nextUndo();
   ASSERT(state);
   const Cmd* cmd = STATE_CMD(state);
+  TRACE_EVENT("undo", "Undo " + cmd->label(),
+              m_ctx && m_ctx->activeDocument() ? m_ctx->activeDocument()->id(): doc::NullId);
   size_t oldSize = m_totalUndoSize;
   m_totalUndoSize -= cmd->memSize();
   {
@@ -118,6 +122,8 @@ void DocUndo::redo()
   const undo::UndoState* state = nextRedo();
   ASSERT(state);
   const Cmd* cmd = STATE_CMD(state);
+  TRACE_EVENT("undo", "Redo " + cmd->label(),
+              m_ctx && m_ctx->activeDocument() ? m_ctx->activeDocument()->id(): doc::NullId);
   size_t oldSize = m_totalUndoSize;
   m_totalUndoSize -= cmd->memSize();
   {
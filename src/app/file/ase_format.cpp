@@ -11,6 +11,7 @@
 #include "app/context.h"
 #include "app/doc.h"
 #include "app/file/file.h"
+#include "app/file/ase_format.h"
 #include "app/file/file_format.h"
 #include "app/file/format_options.h"
 #include "app/pref/preferences.h"
@@ -22,9 +23,11 @@
 #include "dio/aseprite_decoder.h"
 #include "dio/decode_delegate.h"
 #include "dio/file_interface.h"
+#include "doc/algorithm/rotate.h"
 #include "doc/doc.h"
 #include "fixmath/fixmath.h"
 #include "fmt/format.h"
+#include "render/render.h"
 #include "ui/alert.h"
 #include "zlib.h"
 
@@ -123,6 +126,8 @@ static void ase_file_write_slice_chunks(FILE* f, dio::AsepriteFrameHeader* frame
 static void ase_file_write_slice_chunk(FILE* f, dio::AsepriteFrameHeader* frame_header, Slice* slice,
                                        const frame_t fromFrame, const frame_t toFrame);
 static void ase_file_write_user_data_chunk(FILE* f, dio::AsepriteFrameHeader* frame_header, const UserData* userData);
+static void ase_file_write_thumbnail_chunk(FILE* f, dio::AsepriteFrameHeader* frame_header,
+                                           const Sprite* sprite, const frame_t frame);
 static bool ase_has_groups(LayerGroup* group);
 static void ase_ungroup_all(LayerGroup* group);
 
@@ -188,11 +193,18 @@ FileFormat* CreateAseFormat()
 bool AseFormat::onLoad(FileOp* fop)
 {
   FileHandle handle(open_file_with_exception(fop->filename(), "rb"));
-  dio::StdioFileInterface fileInterface(handle.get());
+
+  // Try to map the whole file in memory so the decoder can access
+  // chunks directly, if it's not possible we use regular stdio reads.
+  dio::MmapFileInterface mmapFile(handle.get());
+  dio::StdioFileInterface stdioFile(handle.get());
+  dio::FileInterface* fileInterface =
+    (mmapFile.isMapped() ? static_cast<dio::FileInterface*>(&mmapFile):
+                           static_cast<dio::FileInterface*>(&stdioFile));
 
   DecodeDelegate delegate(fop);
   dio::AsepriteDecoder decoder;
-  decoder.initialize(&delegate, &fileInterface);
+  decoder.initialize(&delegate, fileInterface);
   if (!decoder.decode())
     return false;
 
@@ -200,6 +212,18 @@ bool AseFormat::onLoad(FileOp* fop)
   return true;
 }
 
+Image* load_ase_thumbnail(const std::string& filename)
+{
+  FileHandle handle(open_file_with_exception(filename, "rb"));
+  dio::StdioFileInterface f(handle.get());
+
+  // Errors are ignored, we just want the thumbnail (or nothing)
+  dio::DecodeDelegate delegate;
+  dio::AsepriteDecoder decoder;
+  decoder.initialize(&delegate, &f);
+  return decoder.decodeThumbnail();
+}
+
 bool AseFormat::onPostLoad(FileOp* fop)
 {
   LayerGroup* group = fop->document()->sprite()->root();
@@ -265,6 +289,12 @@ bool AseFormat::onSave(FileOp* fop)
     // Frame duration
     frame_header.duration = sprite->frameDuration(frame);
 
+    // The thumbnail is the first chunk of the file, so it can be read
+    // without parsing the rest of the file (see load_ase_thumbnail())
+    if (frame == fop->roi().fromFrame() &&
+        fop->saveThumbnail())
+      ase_file_write_thumbnail_chunk(f, &frame_header, sprite, frame);
+
     // is the first frame or did the palette change?
     Palette* pal = sprite->palette(frame);
     int palFrom = 0, palTo = pal->size()-1;
@@ -926,6 +956,33 @@ static void ase_file_write_user_data_chunk(FILE* f, dio::AsepriteFrameHeader* fr
   }
 }
 
+static void ase_file_write_thumbnail_chunk(FILE* f, dio::AsepriteFrameHeader* frame_header,
+                                           const Sprite* sprite, const frame_t frame)
+{
+  // Render the frame and scale it down to the thumbnail size
+  ImageRef image(Image::create(IMAGE_RGB, sprite->width(), sprite->height()));
+  render::Render().renderSprite(image.get(), sprite, frame);
+
+  int w = image->width();
+  int h = image->height();
+  const int maxSize = MAX(w, h);
+  if (maxSize > ASE_FILE_THUMBNAIL_MAX_SIZE) {
+    w = MAX(1, ASE_FILE_THUMBNAIL_MAX_SIZE * w / maxSize);
+    h = MAX(1, ASE_FILE_THUMBNAIL_MAX_SIZE * h / maxSize);
+
+    ImageRef thumbnail(Image::create(IMAGE_RGB, w, h));
+    algorithm::scale_image(thumbnail.get(), image.get(),
+                           0, 0, w, h,
+                           0, 0, image->width(), image->height());
+    image = thumbnail;
+  }
+
+  ChunkWriter chunk(f, frame_header, ASE_FILE_CHUNK_THUMBNAIL);
+  fputw(w, f);
+  fputw(h, f);
+  write_compressed_image<RgbTraits>(f, image.get());
+}
+
 static void ase_file_write_slice_chunks(FILE* f, dio::AsepriteFrameHeader* frame_header,
                                         const Slices& slices,
                                         const frame_t fromFrame,
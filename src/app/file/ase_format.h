@@ -0,0 +1,27 @@
+// Aseprite
+// Copyright (C) 2018  David Capello
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_FILE_ASE_FORMAT_H_INCLUDED
+#define APP_FILE_ASE_FORMAT_H_INCLUDED
+#pragma once
+
+#include <string>
+
+namespace doc {
+  class Image;
+}
+
+namespace app {
+
+  // Returns the RGB thumbnail saved in the given .aseprite file (when
+  // the "save_file.thumbnail" option is enabled) or nullptr if the
+  // file doesn't contain a thumbnail. It reads just the first chunk
+  // of the file, so it's a lot faster than loading the sprite.
+  doc::Image* load_ase_thumbnail(const std::string& filename);
+
+} // namespace app
+
+#endif
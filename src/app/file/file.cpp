@@ -10,6 +10,7 @@
 
 #include "app/file/file.h"
 
+#include "app/app.h"
 #include "app/console.h"
 #include "app/context.h"
 #include "app/doc.h"
@@ -32,6 +33,7 @@
 #include "base/string.h"
 #include "dio/detect_format.h"
 #include "doc/doc.h"
+#include "doc/trace_events.h"
 #include "fmt/format.h"
 #include "render/quantization.h"
 #include "render/render.h"
@@ -320,6 +322,11 @@ FileOp* FileOp::createSaveDocumentOperation(const Context* context,
   fop->m_document = const_cast<Doc*>(roi.document());
   fop->m_roi = roi;
 
+  // Preferences are available only when the program is running
+  // (e.g. not in unit tests)
+  if (App::instance())
+    fop->m_saveThumbnail = App::instance()->preferences().saveFile.thumbnail();
+
   // Get the extension of the filename (in lower case)
   LOG("FILE: Saving document \"%s\"\n", filename.c_str());
 
@@ -553,6 +560,9 @@ FileOp* FileOp::createSaveDocumentOperation(const Context* context,
 void FileOp::operate(IFileOpProgress* progress)
 {
   ASSERT(!isDone());
+  TRACE_EVENT("file",
+              (m_type == FileOpLoad ? "Load ": "Save ") + m_filename,
+              m_document ? m_document->id(): doc::NullId);
 
   m_progressInterface = progress;
 
@@ -651,6 +661,11 @@ void FileOp::operate(IFileOpProgress* progress)
 #endif
         }
 
+        // Move the least recently used frames to the swap file (if
+        // there is a memory budget) to load long sequences.
+        if (m_document)
+          doc::ImageSwap::instance()->trim(m_document->sprite());
+
         ++frame;
         m_seq.progress_offset += m_seq.progress_fraction;
       }
@@ -1062,6 +1077,7 @@ FileOp::FileOp(FileOpType type, Context* context)
   , m_done(false)
   , m_stop(false)
   , m_oneframe(false)
+  , m_saveThumbnail(false)
 {
   m_seq.palette = nullptr;
   m_seq.image.reset(nullptr);
@@ -111,6 +111,11 @@ namespace app {
     bool isSequence() const { return !m_seq.filename_list.empty(); }
     bool isOneFrame() const { return m_oneframe; }
 
+    // True if a thumbnail of the first frame should be saved in the
+    // file (only .aseprite files, see "save_file.thumbnail" option).
+    bool saveThumbnail() const { return m_saveThumbnail; }
+    void setSaveThumbnail(bool state) { m_saveThumbnail = state; }
+
     const std::string& filename() const { return m_filename; }
     const base::paths& filenames() const { return m_seq.filename_list; }
     Context* context() const { return m_context; }
@@ -191,6 +196,7 @@ namespace app {
     bool m_oneframe;            // Load just one frame (in formats
                                 // that support animation like
                                 // GIF/FLI/ASE).
+    bool m_saveThumbnail;       // Save a thumbnail in the file.
 
     base::SharedPtr<FormatOptions> m_formatOptions;
 
@@ -9,12 +9,14 @@
 #include "app/app.h"
 #include "app/context.h"
 #include "app/doc.h"
+#include "app/file/ase_format.h"
 #include "app/file/file.h"
 #include "app/file/file_formats_manager.h"
 #include "doc/doc.h"
 
 #include <cstdio>
 #include <cstdlib>
+#include <memory>
 #include <vector>
 
 using namespace app;
@@ -76,3 +78,58 @@ TEST(File, SeveralSizes)
     }
   }
 }
+
+TEST(File, AseThumbnailChunk)
+{
+  app::Context ctx;
+  const char* fn = "test_thumbnail.ase";
+
+  // Saved without thumbnail (default option)
+  {
+    std::unique_ptr<Doc> doc(ctx.documents().add(300, 150, doc::ColorMode::RGB));
+    doc->setFilename(fn);
+    save_document(&ctx, doc.get());
+    doc->close();
+  }
+  EXPECT_EQ(nullptr, load_ase_thumbnail(fn));
+
+  // Saved with a thumbnail chunk
+  {
+    std::unique_ptr<Doc> doc(ctx.documents().add(300, 150, doc::ColorMode::RGB));
+    doc->setFilename(fn);
+    clear_image(doc->sprite()->root()->firstLayer()->cel(frame_t(0))->image(),
+                rgba(255, 0, 0, 255));
+
+    std::unique_ptr<FileOp> fop(
+      FileOp::createSaveDocumentOperation(
+        &ctx, FileOpROI(doc.get(), "", "", SelectedFrames(), false),
+        fn, ""));
+    ASSERT_TRUE(fop != nullptr);
+    fop->setSaveThumbnail(true);
+    fop->operate();
+    fop->done();
+    ASSERT_FALSE(fop->hasError());
+    doc->close();
+  }
+
+  // The thumbnail is scaled down keeping the aspect ratio
+  std::unique_ptr<Image> thumbnail(load_ase_thumbnail(fn));
+  ASSERT_TRUE(thumbnail != nullptr);
+  EXPECT_EQ(IMAGE_RGB, thumbnail->pixelFormat());
+  EXPECT_EQ(128, thumbnail->width());
+  EXPECT_EQ(64, thumbnail->height());
+  EXPECT_EQ(rgba(255, 0, 0, 255), get_pixel(thumbnail.get(), 0, 0));
+  EXPECT_EQ(rgba(255, 0, 0, 255), get_pixel(thumbnail.get(), 127, 63));
+
+  // The chunk is skipped when the file is loaded
+  {
+    std::unique_ptr<Doc> doc(load_document(&ctx, fn));
+    ASSERT_TRUE(doc != nullptr);
+    EXPECT_EQ(300, doc->sprite()->width());
+    EXPECT_EQ(150, doc->sprite()->height());
+    EXPECT_EQ(frame_t(1), doc->sprite()->totalFrames());
+    EXPECT_EQ(rgba(255, 0, 0, 255),
+              get_pixel(doc->sprite()->root()->firstLayer()->cel(frame_t(0))->image(), 10, 10));
+    doc->close();
+  }
+}
@@ -126,7 +126,7 @@ bool FliFormat::onLoad(FileOp* fop)
 
     // First frame, or the frame changes
     if (!prevCel ||
-        (count_diff_between_images(prevCel->image(), bmp.get()))) {
+        !is_same_image(prevCel->image(), bmp.get())) {
       // Add the new frame
       ImageRef image(Image::createCopy(bmp.get()));
       Cel* cel = new Cel(frame_out, image);
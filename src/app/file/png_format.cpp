@@ -14,11 +14,14 @@
 #include "app/file/file_format.h"
 #include "app/file/format_options.h"
 #include "app/file/png_format.h"
+#include "base/exception.h"
 #include "base/file_handle.h"
 #include "doc/doc.h"
 
+#include <algorithm>
 #include <stdio.h>
 #include <stdlib.h>
+#include <vector>
 
 #include "png.h"
 
@@ -592,6 +595,185 @@ bool PngFormat::onSave(FileOp* fop)
   png_destroy_write_struct(&png_ptr, &info_ptr);
   return true;
 }
+
+static void report_png_stream_error(png_structp png_ptr, png_const_charp error)
+{
+  *((std::string*)png_get_error_ptr(png_ptr)) = error;
+}
+
+static void report_png_stream_warning(png_structp png_ptr, png_const_charp warning)
+{
+  // Ignore warnings
+}
+
+class PngStreamEncoder::Impl {
+public:
+  FileHandle handle;
+  png_structp png_ptr;
+  png_infop info_ptr;
+  PixelFormat pixelFormat;
+  int width;
+  int height;
+  int y;
+  std::vector<uint8_t> row;
+  std::string error;
+
+  Impl() : png_ptr(nullptr), info_ptr(nullptr), y(0) { }
+  ~Impl() {
+    if (png_ptr)
+      png_destroy_write_struct(&png_ptr, &info_ptr);
+  }
+
+  void throwError() {
+    throw base::Exception("libpng: %s", error.c_str());
+  }
+};
+
+PngStreamEncoder::PngStreamEncoder(const std::string& filename,
+                                   const PixelFormat pixelFormat,
+                                   const int width, const int height,
+                                   const Palette* pal,
+                                   const int maskIndex)
+  : m_impl(new Impl)
+{
+  Impl* impl = m_impl.get();
+  int color_type = 0;
+  switch (pixelFormat) {
+    case IMAGE_RGB:
+      color_type = PNG_COLOR_TYPE_RGB_ALPHA;
+      impl->row.resize(4*width);
+      break;
+    case IMAGE_GRAYSCALE:
+      color_type = PNG_COLOR_TYPE_GRAY_ALPHA;
+      impl->row.resize(2*width);
+      break;
+    case IMAGE_INDEXED:
+      ASSERT(pal);
+      color_type = PNG_COLOR_TYPE_PALETTE;
+      impl->row.resize(width);
+      break;
+    default:
+      throw base::Exception("Unsupported pixel format for png files");
+  }
+
+  // Palette and transparency entries (prepared before setjmp() to
+  // avoid non-trivial objects between setjmp()/longjmp())
+  const int pal_size = (pal ? MID(1, pal->size(), PNG_MAX_PALETTE_LENGTH): 0);
+  png_color palette[PNG_MAX_PALETTE_LENGTH];
+  png_byte trans[PNG_MAX_PALETTE_LENGTH];
+  bool all_opaque = true;
+  for (int c=0; c<pal_size; ++c) {
+    const color_t color = pal->getEntry(c);
+    palette[c].red   = rgba_getr(color);
+    palette[c].green = rgba_getg(color);
+    palette[c].blue  = rgba_getb(color);
+    trans[c] = (c == maskIndex ? 0: rgba_geta(color));
+    if (rgba_geta(color) < 255)
+      all_opaque = false;
+  }
+
+  impl->pixelFormat = pixelFormat;
+  impl->width = width;
+  impl->height = height;
+  impl->handle = open_file_with_exception_sync_on_close(filename, "wb");
+
+  impl->png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, (png_voidp)&impl->error,
+                                          report_png_stream_error,
+                                          report_png_stream_warning);
+  if (!impl->png_ptr)
+    throw base::Exception("Error creating the png encoder");
+
+  impl->info_ptr = png_create_info_struct(impl->png_ptr);
+  if (!impl->info_ptr)
+    throw base::Exception("Error creating the png encoder");
+
+  if (setjmp(png_jmpbuf(impl->png_ptr)))
+    impl->throwError();
+
+  png_init_io(impl->png_ptr, impl->handle.get());
+  png_set_IHDR(impl->png_ptr, impl->info_ptr, width, height, 8, color_type,
+               PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
+
+  if (color_type == PNG_COLOR_TYPE_PALETTE) {
+    png_set_PLTE(impl->png_ptr, impl->info_ptr, palette, pal_size);
+    if (!all_opaque || (maskIndex >= 0 && maskIndex < pal_size))
+      png_set_tRNS(impl->png_ptr, impl->info_ptr, trans, pal_size, nullptr);
+  }
+
+  png_write_info(impl->png_ptr, impl->info_ptr);
+}
+
+PngStreamEncoder::~PngStreamEncoder()
+{
+}
+
+void PngStreamEncoder::writeRows(const Image* image, const int rows)
+{
+  Impl* impl = m_impl.get();
+  ASSERT(image->pixelFormat() == impl->pixelFormat);
+  ASSERT(image->width() == impl->width);
+  ASSERT(rows <= image->height());
+  ASSERT(impl->y+rows <= impl->height);
+
+  png_bytep row_pointer = &impl->row[0];
+  const int width = impl->width;
+
+  if (setjmp(png_jmpbuf(impl->png_ptr)))
+    impl->throwError();
+
+  for (int y=0; y<rows; ++y) {
+    uint8_t* dst_address = row_pointer;
+
+    switch (impl->pixelFormat) {
+      case IMAGE_RGB: {
+        const uint32_t* src_address = (const uint32_t*)image->getPixelAddress(0, y);
+        for (int x=0; x<width; ++x) {
+          const uint32_t c = *(src_address++);
+          *(dst_address++) = rgba_getr(c);
+          *(dst_address++) = rgba_getg(c);
+          *(dst_address++) = rgba_getb(c);
+          *(dst_address++) = rgba_geta(c);
+        }
+        break;
+      }
+      case IMAGE_GRAYSCALE: {
+        const uint16_t* src_address = (const uint16_t*)image->getPixelAddress(0, y);
+        for (int x=0; x<width; ++x) {
+          const uint16_t c = *(src_address++);
+          *(dst_address++) = graya_getv(c);
+          *(dst_address++) = graya_geta(c);
+        }
+        break;
+      }
+      case IMAGE_INDEXED:
+        std::copy(image->getPixelAddress(0, y),
+                  image->getPixelAddress(0, y)+width,
+                  dst_address);
+        break;
+      default:
+        break;
+    }
+
+    png_write_rows(impl->png_ptr, &row_pointer, 1);
+  }
+
+  impl->y += rows;
+}
+
+void PngStreamEncoder::close()
+{
+  Impl* impl = m_impl.get();
+  ASSERT(impl->y == impl->height);
+
+  if (setjmp(png_jmpbuf(impl->png_ptr)))
+    impl->throwError();
+
+  png_write_end(impl->png_ptr, impl->info_ptr);
+  png_destroy_write_struct(&impl->png_ptr, &impl->info_ptr);
+  impl->png_ptr = nullptr;
+  impl->info_ptr = nullptr;
+  impl->handle.reset();
+}
 #endif
 
 } // namespace app
@@ -8,6 +8,16 @@
 #define APP_FILE_PNG_FORMAT_H_INCLUDED
 #pragma once
 
+#include "doc/pixel_format.h"
+
+#include <memory>
+#include <string>
+
+namespace doc {
+  class Image;
+  class Palette;
+}
+
 namespace app {
 
   // This can be used to save opaque png files with one pixel with
@@ -19,6 +29,37 @@ namespace app {
     ~PngEncoderOneAlphaPixel();
   };
 
+#ifdef ENABLE_SAVE
+  // Saves a png file row by row, so a big image can be generated and
+  // encoded in strips without keeping the whole image in memory
+  // (e.g. a sprite sheet texture). RGB and grayscale images are
+  // saved with alpha channel. Errors are reported with exceptions.
+  class PngStreamEncoder {
+  public:
+    // The palette is used for indexed images, the "maskIndex" entry
+    // is saved with alpha=0 (use -1 if there is no transparent
+    // entry).
+    PngStreamEncoder(const std::string& filename,
+                     const doc::PixelFormat pixelFormat,
+                     const int width, const int height,
+                     const doc::Palette* palette,
+                     const int maskIndex);
+    ~PngStreamEncoder();
+
+    // Encodes the first "rows" rows of the given image, it must have
+    // the pixel format and the width of the png file.
+    void writeRows(const doc::Image* image, const int rows);
+
+    // Finishes the file after writing all the rows.
+    void close();
+
+  private:
+    class Impl;
+    std::unique_ptr<Impl> m_impl;
+  };
+#endif
+
+
 } // namespace app
 
 #endif
@@ -23,8 +23,14 @@
 #include "she/system.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cstdio>
+#include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -52,6 +58,115 @@
 
 namespace app {
 
+#ifndef _WIN32
+
+// An entry read from a directory (the FileItem is created later in
+// the UI thread).
+struct DirEntry {
+  std::string name;
+  bool is_folder;
+};
+
+typedef std::vector<DirEntry> DirEntries;
+
+// Number of entries that are read before they are given to the UI
+// thread.
+const int kDirEntriesBatchSize = 256;
+
+// Reads the given directory calling "onBatch" for each group of
+// entries. The most expensive part (stat() of each entry) is done
+// here, so it can be called from a background thread.
+static void read_dir_entries(const std::string& path,
+                             const std::atomic<bool>& stop,
+                             const std::function<void(DirEntries&)>& onBatch)
+{
+  DIR* dir = opendir(path.c_str());
+  if (!dir)
+    return;
+
+  DirEntries batch;
+  batch.reserve(kDirEntriesBatchSize);
+
+  dirent* entry;
+  while (!stop && (entry = readdir(dir)) != NULL) {
+    std::string fn = entry->d_name;
+    if (fn == "." || fn == "..")
+      continue;
+
+    std::string fullfn = base::join_path(path, fn);
+    bool is_folder;
+    struct stat fileStat;
+
+    stat(fullfn.c_str(), &fileStat);
+
+    if ((fileStat.st_mode & S_IFMT) == S_IFLNK) {
+      is_folder = base::is_directory(fullfn);
+    }
+    else {
+      is_folder = ((fileStat.st_mode & S_IFMT) == S_IFDIR);
+    }
+
+    batch.push_back(DirEntry{ fn, is_folder });
+    if (int(batch.size()) == kDirEntriesBatchSize) {
+      onBatch(batch);
+      batch.clear();
+    }
+  }
+  closedir(dir);
+
+  if (!batch.empty())
+    onBatch(batch);
+}
+
+// Reads a directory in a background thread.
+class DirLoader {
+public:
+  DirLoader(const std::string& path)
+    : m_stop(false)
+    , m_done(false)
+    , m_thread([this, path]{ run(path); }) {
+  }
+
+  ~DirLoader() {
+    m_stop = true;
+    wait();
+  }
+
+  // Moves the entries read up to now to "entries". Returns true if
+  // the whole directory was read.
+  bool takeEntries(DirEntries& entries) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::swap(entries, m_entries);
+    return m_done;
+  }
+
+  void wait() {
+    if (m_thread.joinable())
+      m_thread.join();
+  }
+
+private:
+  void run(const std::string& path) {
+    read_dir_entries(
+      path, m_stop,
+      [this](DirEntries& batch){
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entries.insert(m_entries.end(), batch.begin(), batch.end());
+      });
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_done = true;
+  }
+
+  std::atomic<bool> m_stop;
+  std::mutex m_mutex;
+  DirEntries m_entries;
+  bool m_done;
+  std::thread m_thread;
+};
+
+#endif
+
 // a position in the file-system
 class FileItem : public IFileItem {
 public:
@@ -60,6 +175,12 @@ public:
   std::string m_displayname;
   FileItem* m_parent;
   FileItemList m_children;
+  // Children indexed by key name
+  std::unordered_map<std::string, FileItem*> m_childrenIndex;
+#ifndef _WIN32
+  // Loads the children in background (see childrenAsync())
+  std::unique_ptr<DirLoader> m_loader;
+#endif
   unsigned int m_version;
   bool m_removed;
   bool m_is_folder;
@@ -73,7 +194,14 @@ public:
   FileItem(FileItem* parent);
   ~FileItem();
 
-  void insertChildSorted(FileItem* child);
+  bool childrenAreOutdated() const;
+  void markChildrenAsRemoved();
+  void addChild(FileItem* child, FileItemList& newChildren);
+  void insertChildrenSorted(FileItemList& newChildren);
+  void deleteRemovedChildren();
+#ifndef _WIN32
+  void addChildren(const DirEntries& entries, FileItemList& newChildren);
+#endif
   int compare(const FileItem& that) const;
 
   bool operator<(const FileItem& that) const { return compare(that) < 0; }
@@ -93,6 +221,7 @@ public:
 
   IFileItem* parent() const;
   const FileItemList& children();
+  const FileItemList& childrenAsync(bool& done, FileItemList& newChildren);
   void createDirectory(const std::string& dirname);
 
   bool hasExtension(const base::paths& extensions);
@@ -102,13 +231,14 @@ public:
 
 };
 
-typedef std::map<std::string, FileItem*> FileItemMap;
+typedef std::unordered_map<std::string, FileItem*> FileItemMap;
 typedef std::map<std::string, she::Surface*> ThumbnailMap;
 
 // the root of the file-system
 static FileItem* rootitem = NULL;
 static FileItemMap* fileitems_map;
 static ThumbnailMap* thumbnail_map;
+static std::mutex thumbnail_mutex; // Thumbnails are set from other threads
 static unsigned int current_file_system_version = 0;
 
 #ifdef _WIN32
@@ -356,24 +486,14 @@ IFileItem* FileItem::parent() const
 const FileItemList& FileItem::children()
 {
   // Is the file-item a folder?
-  if (isFolder() &&
-      // if the children list is empty, or the file-system version
-      // change (it's like to say: the current m_children list
-      // is outdated)...
-      (m_children.empty() ||
-       current_file_system_version > m_version)) {
-    FileItemList::iterator it;
-    FileItem* child;
-
-    // we have to mark current items as deprecated
-    for (it=m_children.begin();
-         it!=m_children.end(); ++it) {
-      child = static_cast<FileItem*>(*it);
-      child->m_removed = true;
-    }
+  if (!isFolder())
+    return m_children;
 
-    //LOG("FS: Loading files for %p (%s)\n", fileitem, fileitem->displayname);
 #ifdef _WIN32
+  if (childrenAreOutdated()) {
+    markChildrenAsRemoved();
+
+    FileItemList newChildren;
     {
       IShellFolder* pFolder = NULL;
       HRESULT hr;
@@ -414,7 +534,7 @@ const FileItemList& FileItem::children()
               LPITEMIDLIST fullpidl = concat_pidl(m_fullpidl,
                                                   itempidl[c]);
 
-              child = get_fileitem_by_fullpidl(fullpidl, false);
+              FileItem* child = get_fileitem_by_fullpidl(fullpidl, false);
               if (!child) {
                 child = new FileItem(this);
 
@@ -430,7 +550,7 @@ const FileItemList& FileItem::children()
                 free_pidl(itempidl[c]);
               }
 
-              insertChildSorted(child);
+              addChild(child, newChildren);
             }
           }
 
@@ -441,73 +561,72 @@ const FileItemList& FileItem::children()
           pFolder->Release();
       }
     }
+    insertChildrenSorted(newChildren);
+    deleteRemovedChildren();
+  }
 #else
-    {
-      DIR* dir = opendir(m_filename.c_str());
-      if (dir) {
-        dirent* entry;
-        while ((entry = readdir(dir)) != NULL) {
-          FileItem* child;
-          std::string fn = entry->d_name;
-          std::string fullfn = base::join_path(m_filename, fn);
-
-          if (fn == "." || fn == "..")
-            continue;
-
-          child = get_fileitem_by_path(fullfn, false);
-          if (!child) {
-            child = new FileItem(this);
-
-            bool is_folder;
-            struct stat fileStat;
+  // Wait the background thread that is loading this folder
+  if (m_loader) {
+    m_loader->wait();
 
-            stat(fullfn.c_str(), &fileStat);
+    DirEntries entries;
+    m_loader->takeEntries(entries);
+    m_loader.reset();
 
-            if ((fileStat.st_mode & S_IFMT) == S_IFLNK) {
-              is_folder = base::is_directory(fullfn);
-            }
-            else {
-              is_folder = ((fileStat.st_mode & S_IFMT) == S_IFDIR);
-            }
-
-            child->m_filename = fullfn;
-            child->m_displayname = fn;
-            child->m_is_folder = is_folder;
-
-            put_fileitem(child);
-          }
-          else {
-            ASSERT(child->m_parent == this);
-          }
-
-          insertChildSorted(child);
-        }
-        closedir(dir);
-      }
+    FileItemList newChildren;
+    addChildren(entries, newChildren);
+    deleteRemovedChildren();
+  }
+  else if (childrenAreOutdated()) {
+    markChildrenAsRemoved();
+
+    DirEntries entries;
+    std::atomic<bool> stop(false);
+    read_dir_entries(
+      m_filename, stop,
+      [&entries](DirEntries& batch){
+        entries.insert(entries.end(), batch.begin(), batch.end());
+      });
+
+    FileItemList newChildren;
+    addChildren(entries, newChildren);
+    deleteRemovedChildren();
   }
 #endif
 
-    // check old file-items (maybe removed directories or file-items)
-    for (it=m_children.begin();
-         it!=m_children.end(); ) {
-      child = static_cast<FileItem*>(*it);
-      ASSERT(child != NULL);
+  return m_children;
+}
 
-      if (child && child->m_removed) {
-        it = m_children.erase(it);
+const FileItemList& FileItem::childrenAsync(bool& done, FileItemList& newChildren)
+{
+  newChildren.clear();
 
-        fileitems_map->erase(fileitems_map->find(child->m_keyname));
-        delete child;
-      }
-      else
-        ++it;
+#ifdef _WIN32
+  // TODO Shell folders are enumerated in the UI thread
+  done = true;
+  return children();
+#else
+  if (isFolder()) {
+    if (!m_loader && childrenAreOutdated()) {
+      markChildrenAsRemoved();
+      m_loader.reset(new DirLoader(m_filename));
     }
 
-    // now this file-item is updated
-    m_version = current_file_system_version;
+    if (m_loader) {
+      DirEntries entries;
+      bool finished = m_loader->takeEntries(entries);
+      addChildren(entries, newChildren);
+
+      if (finished) {
+        m_loader.reset();
+        deleteRemovedChildren();
+      }
+    }
   }
 
+  done = (m_loader == nullptr);
   return m_children;
+#endif
 }
 
 void FileItem::createDirectory(const std::string& dirname)
@@ -527,6 +646,7 @@ bool FileItem::hasExtension(const base::paths& extensions)
 
 she::Surface* FileItem::getThumbnail()
 {
+  std::lock_guard<std::mutex> lock(thumbnail_mutex);
   ThumbnailMap::iterator it = thumbnail_map->find(m_filename);
   if (it != thumbnail_map->end())
     return it->second;
@@ -536,6 +656,8 @@ she::Surface* FileItem::getThumbnail()
 
 void FileItem::setThumbnail(she::Surface* thumbnail)
 {
+  std::lock_guard<std::mutex> lock(thumbnail_mutex);
+
   // destroy the current thumbnail of the file (if exists)
   ThumbnailMap::iterator it = thumbnail_map->find(m_filename);
   if (it != thumbnail_map->end()) {
@@ -581,25 +703,107 @@ FileItem::~FileItem()
 #endif
 }
 
-void FileItem::insertChildSorted(FileItem* child)
+bool FileItem::childrenAreOutdated() const
+{
+  // if the children list is empty, or the file-system version
+  // change (it's like to say: the current m_children list
+  // is outdated)...
+  return (m_children.empty() ||
+          current_file_system_version > m_version);
+}
+
+void FileItem::markChildrenAsRemoved()
+{
+  // we have to mark current items as deprecated (they will be
+  // unmarked as we find them again in the file system)
+  for (IFileItem* child : m_children)
+    static_cast<FileItem*>(child)->m_removed = true;
+}
+
+void FileItem::addChild(FileItem* child, FileItemList& newChildren)
 {
   // this file-item wasn't removed from the last lookup
   child->m_removed = false;
 
   // if the fileitem is already in the list we can go back
-  if (std::find(m_children.begin(), m_children.end(), child) != m_children.end())
+  if (m_childrenIndex.find(child->m_keyname) != m_childrenIndex.end())
     return;
 
-  for (auto it=m_children.begin(), end=m_children.end(); it!=end; ++it) {
-    if (*child < *static_cast<FileItem*>(*it)) {
-      m_children.insert(it, child);
-      return;
+  m_childrenIndex[child->m_keyname] = child;
+  newChildren.push_back(child);
+}
+
+void FileItem::insertChildrenSorted(FileItemList& newChildren)
+{
+  if (newChildren.empty())
+    return;
+
+  auto lessThan = [](const IFileItem* a, const IFileItem* b) {
+    return (*static_cast<const FileItem*>(a) <
+            *static_cast<const FileItem*>(b));
+  };
+
+  // Sort the new children and merge them with the current (already
+  // sorted) list
+  std::sort(newChildren.begin(), newChildren.end(), lessThan);
+
+  const std::size_t n = m_children.size();
+  m_children.insert(m_children.end(), newChildren.begin(), newChildren.end());
+  std::inplace_merge(m_children.begin(), m_children.begin()+n,
+                     m_children.end(), lessThan);
+}
+
+void FileItem::deleteRemovedChildren()
+{
+  // check old file-items (maybe removed directories or file-items)
+  auto it = std::remove_if(
+    m_children.begin(), m_children.end(),
+    [this](IFileItem* item) {
+      FileItem* child = static_cast<FileItem*>(item);
+      ASSERT(child != NULL);
+
+      if (!child->m_removed)
+        return false;
+
+      m_childrenIndex.erase(child->m_keyname);
+      fileitems_map->erase(child->m_keyname);
+      delete child;
+      return true;
+    });
+  m_children.erase(it, m_children.end());
+
+  // now this file-item is updated
+  m_version = current_file_system_version;
+}
+
+#ifndef _WIN32
+
+void FileItem::addChildren(const DirEntries& entries, FileItemList& newChildren)
+{
+  for (const DirEntry& entry : entries) {
+    std::string fullfn = base::join_path(m_filename, entry.name);
+
+    FileItem* child = get_fileitem_by_path(fullfn, false);
+    if (!child) {
+      child = new FileItem(this);
+      child->m_filename = fullfn;
+      child->m_displayname = entry.name;
+      child->m_is_folder = entry.is_folder;
+
+      put_fileitem(child);
+    }
+    else {
+      ASSERT(child->m_parent == this);
     }
+
+    addChild(child, newChildren);
   }
 
-  m_children.push_back(child);
+  insertChildrenSorted(newChildren);
 }
 
+#endif
+
 int FileItem::compare(const FileItem& that) const
 {
   if (isFolder()) {
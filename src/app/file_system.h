@@ -76,6 +76,16 @@ namespace app {
 
     virtual IFileItem* parent() const = 0;
     virtual const FileItemList& children() = 0;
+
+    // Like children() but the folder is read in a background thread.
+    // Returns the children found up to now (sorted), and "done" is
+    // false if the folder is still being loaded (in that case it must
+    // be called again later from the UI thread to get the rest of
+    // items). "newChildren" receives the children found in this call
+    // (sorted). Removed children are deleted when the folder is
+    // completely loaded.
+    virtual const FileItemList& childrenAsync(bool& done, FileItemList& newChildren) = 0;
+
     virtual void createDirectory(const std::string& dirname) = 0;
 
     virtual bool hasExtension(const base::paths& extensions) = 0;
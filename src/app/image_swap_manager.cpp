@@ -0,0 +1,111 @@
+// Aseprite
+// Copyright (C) 2018  David Capello
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/image_swap_manager.h"
+
+#include "app/context.h"
+#include "app/doc.h"
+#include "app/pref/preferences.h"
+#include "app/resource_finder.h"
+#include "base/bind.h"
+#include "base/fs.h"
+#include "base/process.h"
+#include "doc/image_swap.h"
+#include "doc/sprite.h"
+#include "fmt/format.h"
+
+#ifdef ENABLE_UI
+  #include "ui/timer.h"
+#endif
+
+#include <algorithm>
+
+namespace app {
+
+// Interval to trim images in GUI mode (e.g. to move to the swap file
+// frames that were loaded in memory to play the animation)
+static const int kTrimInterval = 1000;
+
+ImageSwapManager::ImageSwapManager(Context* ctx, Preferences& pref)
+  : m_ctx(ctx)
+  , m_pref(pref)
+{
+  ResourceFinder rf;
+  rf.includeUserDir(base::join_path("swap", ".").c_str());
+  std::string swapDir = rf.getFirstOrCreateDefault();
+
+  doc::ImageSwap::instance()->setFilename(
+    base::join_path(swapDir,
+                    fmt::format("{0}.swap", base::get_current_process_id())));
+
+  onBudgetChange();
+
+  m_budgetConn = m_pref.general.memoryBudget.AfterChange.connect(
+    base::Bind<void>(&ImageSwapManager::onBudgetChange, this));
+  m_afterCommandConn = m_ctx->AfterCommandExecution.connect(
+    &ImageSwapManager::onAfterCommandExecution, this);
+
+#ifdef ENABLE_UI
+  if (m_ctx->isUIAvailable()) {
+    m_timer.reset(new ui::Timer(kTrimInterval));
+    m_timer->Tick.connect(base::Bind<void>(&ImageSwapManager::onTick, this));
+    m_timer->start();
+  }
+#endif
+}
+
+ImageSwapManager::~ImageSwapManager()
+{
+#ifdef ENABLE_UI
+  if (m_timer)
+    m_timer->stop();
+#endif
+}
+
+void ImageSwapManager::trim()
+{
+  doc::ImageSwap* swap = doc::ImageSwap::instance();
+  if (swap->budget() == 0)
+    return;
+
+  for (Doc* doc : m_ctx->documents()) {
+    // A document locked by other thread (or with an operation in
+    // progress) can have pointers to its pixels.
+    if (!doc->lock(Doc::WriteLock, 0))
+      continue;
+
+    swap->trim(doc->sprite());
+    doc->unlock();
+  }
+}
+
+void ImageSwapManager::onBudgetChange()
+{
+  // The preference is in megabytes
+  doc::ImageSwap::instance()->setBudget(
+    std::size_t(std::max(0, m_pref.general.memoryBudget())) * 1024 * 1024);
+}
+
+void ImageSwapManager::onAfterCommandExecution(CommandExecutionEvent& ev)
+{
+  trim();
+}
+
+void ImageSwapManager::onTick()
+{
+  // Trim only when it's needed (a write lock interrupts the backup
+  // of documents in the background)
+  doc::ImageSwap* swap = doc::ImageSwap::instance();
+  if (swap->budget() > 0 &&
+      swap->residentSize() > swap->budget())
+    trim();
+}
+
+} // namespace app
@@ -0,0 +1,56 @@
+// Aseprite
+// Copyright (C) 2018  David Capello
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_IMAGE_SWAP_MANAGER_H_INCLUDED
+#define APP_IMAGE_SWAP_MANAGER_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+#include "obs/connection.h"
+
+#include <memory>
+
+namespace ui {
+  class Timer;
+}
+
+namespace app {
+  class CommandExecutionEvent;
+  class Context;
+  class Preferences;
+
+  // Configures the doc::ImageSwap with the "general.memory_budget"
+  // preference, and moves cold cel images of the open documents to
+  // the swap file after each command and periodically in GUI mode.
+  class ImageSwapManager {
+  public:
+    ImageSwapManager(Context* ctx, Preferences& pref);
+    ~ImageSwapManager();
+
+    // Trims the images of each document that isn't locked (documents
+    // being modified, undone/redone, or saved by other threads are
+    // skipped).
+    void trim();
+
+  private:
+    void onBudgetChange();
+    void onAfterCommandExecution(CommandExecutionEvent& ev);
+    void onTick();
+
+    Context* m_ctx;
+    Preferences& m_pref;
+    obs::scoped_connection m_budgetConn;
+    obs::scoped_connection m_afterCommandConn;
+#ifdef ENABLE_UI
+    std::unique_ptr<ui::Timer> m_timer;
+#endif
+
+    DISABLE_COPYING(ImageSwapManager);
+  };
+
+} // namespace app
+
+#endif
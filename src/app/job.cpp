@@ -15,7 +15,6 @@
 #include "app/i18n/strings.h"
 #include "base/mutex.h"
 #include "base/scoped_lock.h"
-#include "base/thread.h"
 #include "fmt/format.h"
 #include "ui/alert.h"
 #include "ui/widget.h"
@@ -37,7 +36,6 @@ int Job::runningJobs()
 Job::Job(const char* jobName)
 {
   m_mutex = NULL;
-  m_thread = NULL;
   m_last_progress = 0.0;
   m_done_flag = false;
   m_canceled_flag = false;
@@ -59,7 +57,7 @@ Job::~Job()
 {
   if (App::instance()->isGui()) {
     ASSERT(!m_timer->isRunning());
-    ASSERT(m_thread == NULL);
+    ASSERT(!m_thread.joinable());
 
     if (m_alert_window)
       m_alert_window->closeWindow(NULL);
@@ -71,7 +69,7 @@ Job::~Job()
 
 void Job::startJob()
 {
-  m_thread = new base::thread(&Job::thread_proc, this);
+  m_thread = std::thread([this]{ job_proc(this); });
   ++g_runningJobs;
 
   if (m_alert_window) {
@@ -107,10 +105,8 @@ void Job::waitJob()
   if (m_timer && m_timer->isRunning())
     m_timer->stop();
 
-  if (m_thread) {
-    m_thread->join();
-    delete m_thread;
-    m_thread = nullptr;
+  if (m_thread.joinable()) {
+    m_thread.join();
 
     --g_runningJobs;
   }
@@ -118,6 +114,9 @@ void Job::waitJob()
 
 void Job::jobProgress(double f)
 {
+  // It can be called from several worker threads (e.g. from tasks
+  // of SpriteJob::forEachCelInParallel())
+  base::scoped_lock hold(*m_mutex);
   m_last_progress = f;
 }
 
@@ -146,8 +145,8 @@ void Job::done()
   m_done_flag = true;
 }
 
-// Called to start the worker thread.
-void Job::thread_proc(Job* self)
+// Called from the thread of the job.
+void Job::job_proc(Job* self)
 {
   try {
     self->onJob();
@@ -11,10 +11,12 @@
 #include "ui/alert.h"
 #include "ui/timer.h"
 
+#include <atomic>
 #include <exception>
+#include <memory>
+#include <thread>
 
 namespace base {
-  class thread;
   class mutex;
 }
 
@@ -27,8 +29,10 @@ namespace app {
     Job(const char* jobName);
     virtual ~Job();
 
-    // Starts the job calling onJob() event in another thread and
-    // monitoring the progress with onMonitorTick() event.
+    // Starts the job calling onJob() event in its own thread (not in
+    // a worker of the TaskScheduler, so the job can wait its tasks
+    // without blocking a worker) and monitoring the progress with
+    // onMonitorTick() event.
     void startJob();
 
     void waitJob();
@@ -44,8 +48,8 @@ namespace app {
 
   protected:
 
-    // This member function is called from another dedicated thread
-    // outside the GUI one, so you can do some image processing here.
+    // This member function is called from a worker thread outside
+    // the GUI one, so you can do some image processing here.
     // Remember that you cannot use any GUI element in this handler.
     virtual void onJob() = 0;
 
@@ -56,17 +60,17 @@ namespace app {
   private:
     void done();
 
-    static void thread_proc(Job* self);
+    static void job_proc(Job* self);
     static void monitor_proc(void* data);
     static void monitor_free(void* data);
 
-    base::thread* m_thread;
+    std::thread m_thread;
     std::unique_ptr<ui::Timer> m_timer;
     base::mutex* m_mutex;
     ui::AlertPtr m_alert_window;
     double m_last_progress;
     bool m_done_flag;
-    bool m_canceled_flag;
+    std::atomic<bool> m_canceled_flag;
     std::exception_ptr m_error;
 
     // these methods are privated and not defined
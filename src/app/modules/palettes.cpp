@@ -43,6 +43,15 @@ void exit_module_palette()
 }
 
 void load_default_palette()
+{
+  std::unique_ptr<Palette> pal(read_default_palette());
+  if (pal)
+    set_default_palette(pal.get());
+
+  set_current_palette(nullptr, true);
+}
+
+Palette* read_default_palette()
 {
   std::unique_ptr<Palette> pal;
   std::string defaultPalName = get_preset_palette_filename(
@@ -113,10 +122,7 @@ void load_default_palette()
     }
   }
 
-  if (pal)
-    set_default_palette(pal.get());
-
-  set_current_palette(nullptr, true);
+  return pal.release();
 }
 
 Palette* get_current_palette()
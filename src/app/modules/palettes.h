@@ -24,6 +24,11 @@ namespace app {
   // palette if the palette format changes, etc.
   void load_default_palette();
 
+  // Reads (or creates) the default palette file without changing
+  // the current palette (it can be called from a background thread
+  // at startup). Returns nullptr if there is no default palette.
+  Palette* read_default_palette();
+
   Palette* get_default_palette();
   Palette* get_current_palette();
 
@@ -0,0 +1,893 @@
+// Aseprite
+// Copyright (C) 2018  David Capello
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+// Headless benchmark of the interactive latency of the editor. It
+// replays input sequences (strokes, fills, selection moves, zoom
+// changes, and timeline scrubbing) against the ToolLoopManager and
+// the editor render engine (without a display, using the "none"
+// she backend) and reports the p50/p99 latency of each input event.
+//
+// Usage: replay_benchmark [--repeat <n>]
+//                         [--sequences <file.txt>]
+//                         [--save-sequences <file.txt>]
+//                         [filename.aseprite]
+//
+// Without --sequences a default set of sequences is generated for
+// the visible area of the sprite (--save-sequences can be used to
+// save them as a starting point to edit/record new sequences).
+//
+// Input sequences file format (one command per line, positions in
+// sprite coordinates, empty lines and lines starting with # are
+// ignored):
+//
+//   sequence <name>           Starts a new sequence
+//   tool <tool-id> <size>     Paint with the given tool/brush size
+//   select <x> <y> <w> <h>    Move a selection with these bounds
+//   down <x> <y>              Mouse button pressed
+//   move <x> <y>              Mouse movement
+//   up <x> <y>                Mouse button released
+//   zoom <linear-scale>       Change the zoom level
+//   frame <frame>             Go to the given frame
+//
+// A sequence with a "tool" replays strokes, one with "select" moves
+// the selection edges, and one without both changes the view (zoom
+// and frame).
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/app.h"
+#include "app/cli/app_options.h"
+#include "app/cmd/set_mask.h"
+#include "app/color.h"
+#include "app/color_target.h"
+#include "app/color_utils.h"
+#include "app/context.h"
+#include "app/context_access.h"
+#include "app/doc.h"
+#include "app/file/file.h"
+#include "app/pref/preferences.h"
+#include "app/site.h"
+#include "app/tools/controller.h"
+#include "app/tools/ink.h"
+#include "app/tools/point_shape.h"
+#include "app/tools/tool.h"
+#include "app/tools/tool_box.h"
+#include "app/tools/tool_loop.h"
+#include "app/tools/tool_loop_manager.h"
+#include "app/transaction.h"
+#include "app/ui/editor/editor_render.h"
+#include "app/util/expand_cel_canvas.h"
+#include "app/util/selection_edges_mover.h"
+#include "base/exception.h"
+#include "base/fstream_path.h"
+#include "doc/brush.h"
+#include "doc/cel.h"
+#include "doc/image.h"
+#include "doc/layer.h"
+#include "doc/mask.h"
+#include "doc/primitives.h"
+#include "doc/sprite.h"
+#include "render/dithering.h"
+#include "render/projection.h"
+#include "render/zoom.h"
+#include "she/scoped_handle.h"
+#include "she/system.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace app;
+using namespace doc;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+// Size of the simulated editor viewport (in screen pixels)
+const gfx::Size kViewportSize(1280, 720);
+
+// An input event recorded from the editor (positions are in sprite
+// coordinates, as in tools::Pointer).
+struct InputEvent {
+  enum Type { MouseDown, MouseMove, MouseUp, Zoom, Frame };
+  Type type;
+  gfx::Point pos;
+  int value;                    // Linear zoom scale or frame
+
+  InputEvent(Type type, const gfx::Point& pos, int value = 0)
+    : type(type), pos(pos), value(value) { }
+};
+
+typedef std::vector<InputEvent> InputSequence;
+
+struct Scenario {
+  enum Kind { ToolStroke, MoveSelection, View };
+  std::string name;
+  Kind kind;
+  std::string toolId;           // For ToolStroke
+  int brushSize;
+  gfx::Rect selection;          // For MoveSelection
+  InputSequence events;
+  std::vector<double> latencies; // In milliseconds
+
+  Scenario(const std::string& name = std::string())
+    : name(name), kind(View), brushSize(1) { }
+};
+
+typedef std::vector<Scenario> Scenarios;
+
+class HeadlessEditor;
+
+//////////////////////////////////////////////////////////////////////
+// ToolLoop implementation without Editor/ContextBar (similar to
+// ToolLoopImpl in app/ui/editor/tool_loop_impl.cpp)
+
+class HeadlessToolLoop : public tools::ToolLoop {
+public:
+  HeadlessToolLoop(HeadlessEditor* editor,
+                   Context* context,
+                   Site site,
+                   tools::Tool* tool,
+                   int brushSize);
+  ~HeadlessToolLoop();
+
+  void commitOrRollback() override;
+
+  tools::Tool* getTool() override { return m_tool; }
+  Brush* getBrush() override { return m_brush.get(); }
+  Doc* getDocument() override { return m_document; }
+  Sprite* sprite() override { return m_sprite; }
+  Layer* getLayer() override { return m_layer; }
+  frame_t getFrame() override { return m_frame; }
+  const Image* getSrcImage() override { return m_expandCelCanvas->getSourceCanvas(); }
+  const Image* getFloodFillSrcImage() override { return getSrcImage(); }
+  Image* getDstImage() override { return m_expandCelCanvas->getDestCanvas(); }
+  void validateSrcImage(const gfx::Region& rgn) override {
+    m_expandCelCanvas->validateSourceCanvas(rgn);
+  }
+  void validateDstImage(const gfx::Region& rgn) override {
+    m_expandCelCanvas->validateDestCanvas(rgn);
+  }
+  void invalidateDstImage() override {
+    m_expandCelCanvas->invalidateDestCanvas();
+  }
+  void invalidateDstImage(const gfx::Region& rgn) override {
+    m_expandCelCanvas->invalidateDestCanvas(rgn);
+  }
+  void copyValidDstToSrcImage(const gfx::Region& rgn) override {
+    m_expandCelCanvas->copyValidDestToSourceCanvas(rgn);
+  }
+  RgbMap* getRgbMap() override {
+    if (!m_rgbMap)
+      m_rgbMap = m_sprite->rgbMap(m_frame);
+    return m_rgbMap;
+  }
+  bool useMask() override { return m_useMask; }
+  Mask* getMask() override { return m_mask; }
+  void setMask(Mask* newMask, const gfx::Rect& modifiedArea) override {
+    m_transaction.execute(new cmd::SetMask(m_document, newMask));
+  }
+  void addSlice(Slice* newSlice) override { delete newSlice; }
+  gfx::Point getMaskOrigin() override { return m_maskOrigin; }
+  Button getMouseButton() override { return Left; }
+  doc::color_t getFgColor() override { return m_fgColor; }
+  doc::color_t getBgColor() override { return m_bgColor; }
+  doc::color_t getPrimaryColor() override { return m_primaryColor; }
+  void setPrimaryColor(doc::color_t color) override { m_primaryColor = color; }
+  doc::color_t getSecondaryColor() override { return m_secondaryColor; }
+  void setSecondaryColor(doc::color_t color) override { m_secondaryColor = color; }
+  int getOpacity() override { return m_toolPref.opacity(); }
+  int getTolerance() override { return m_toolPref.tolerance(); }
+  bool getContiguous() override { return m_toolPref.contiguous(); }
+  tools::ToolLoopModifiers getModifiers() override {
+    return tools::ToolLoopModifiers::kReplaceSelection;
+  }
+  filters::TiledMode getTiledMode() override { return filters::TiledMode::NONE; }
+  bool getGridVisible() override { return false; }
+  bool getSnapToGrid() override { return false; }
+  bool getStopAtGrid() override { return false; }
+  gfx::Rect getGridBounds() override { return m_docPref.grid.bounds(); }
+  bool getFilled() override { return m_filled; }
+  bool getPreviewFilled() override { return m_toolPref.filledPreview(); }
+  int getSprayWidth() override { return m_toolPref.spray.width(); }
+  int getSpraySpeed() override { return m_toolPref.spray.speed(); }
+  gfx::Point getCelOrigin() override { return m_celOrigin; }
+  void setSpeed(const gfx::Point& speed) override { m_speed = speed; }
+  gfx::Point getSpeed() override { return m_speed; }
+  tools::Ink* getInk() override { return m_ink.get(); }
+  tools::Controller* getController() override { return m_controller; }
+  tools::PointShape* getPointShape() override { return m_pointShape; }
+  tools::Intertwine* getIntertwine() override { return m_intertwine; }
+  tools::TracePolicy getTracePolicy() override {
+    if (m_controller->handleTracePolicy())
+      return m_controller->getTracePolicy();
+    else
+      return m_tracePolicy;
+  }
+  tools::Symmetry* getSymmetry() override { return nullptr; }
+  const doc::Remap* getShadingRemap() override { return nullptr; }
+  void cancel() override { m_canceled = true; }
+  bool isCanceled() override { return m_canceled; }
+  gfx::Region& getDirtyArea() override { return m_dirtyArea; }
+  void updateDirtyArea() override;
+  void updateStatusBar(const char* text) override { }
+  gfx::Point statusBarPositionOffset() override { return gfx::Point(0, 0); }
+  render::DitheringMatrix getDitheringMatrix() override { return render::DitheringMatrix(); }
+  render::DitheringAlgorithmBase* getDitheringAlgorithm() override { return nullptr; }
+
+private:
+  HeadlessEditor* m_editor;
+  Context* m_context;
+  tools::Tool* m_tool;
+  BrushRef m_brush;
+  Doc* m_document;
+  Sprite* m_sprite;
+  Layer* m_layer;
+  frame_t m_frame;
+  RgbMap* m_rgbMap;
+  DocumentPreferences& m_docPref;
+  ToolPreferences& m_toolPref;
+  std::unique_ptr<tools::Ink> m_ink;
+  tools::Controller* m_controller;
+  tools::PointShape* m_pointShape;
+  tools::Intertwine* m_intertwine;
+  tools::TracePolicy m_tracePolicy;
+  doc::color_t m_fgColor;
+  doc::color_t m_bgColor;
+  doc::color_t m_primaryColor;
+  doc::color_t m_secondaryColor;
+  gfx::Region m_dirtyArea;
+  gfx::Point m_celOrigin;
+  gfx::Point m_speed;
+  bool m_filled;
+  bool m_useMask;
+  Mask* m_mask;
+  gfx::Point m_maskOrigin;
+  bool m_canceled;
+  Transaction m_transaction;
+  std::unique_ptr<ExpandCelCanvas> m_expandCelCanvas;
+};
+
+//////////////////////////////////////////////////////////////////////
+// Renders the visible area of the sprite in the same way that the
+// Editor does (without converting the result to a she::Surface)
+
+class HeadlessEditor {
+public:
+  HeadlessEditor(Context* context, Doc* doc)
+    : m_context(context)
+    , m_doc(doc)
+    , m_sprite(doc->sprite())
+    , m_layer(doc->sprite()->root()->firstLayer())
+    , m_frame(0)
+    , m_proj(doc->sprite()->pixelRatio(), render::Zoom(1, 1)) {
+  }
+
+  void setZoom(int linearScale) {
+    m_proj.setZoom(render::Zoom::fromLinearScale(linearScale));
+    redraw(m_sprite->bounds());
+  }
+
+  void setFrame(frame_t frame) {
+    m_frame = frame;
+    redraw(m_sprite->bounds());
+  }
+
+  // Sprite area that is visible in the viewport (centered in the
+  // sprite)
+  gfx::Rect visibleBounds() const {
+    const gfx::Size size(
+      int(std::ceil(kViewportSize.w / m_proj.scaleX())),
+      int(std::ceil(kViewportSize.h / m_proj.scaleY())));
+    return gfx::Rect(
+      m_sprite->width()/2 - size.w/2,
+      m_sprite->height()/2 - size.h/2,
+      size.w, size.h) & m_sprite->bounds();
+  }
+
+  // Like Editor::drawOneSpriteUnclippedRect() with the old engine
+  void redraw(const gfx::Rect& spriteBounds,
+              tools::ToolLoop* toolLoop = nullptr) {
+    gfx::Rect expose = (spriteBounds & visibleBounds());
+    if (expose.isEmpty())
+      return;
+
+    // DrawingState::onExposeSpritePixels()
+    if (toolLoop)
+      toolLoop->validateDstImage(gfx::Region(expose));
+
+    const gfx::Rect rc = m_proj.apply(expose);
+    std::unique_ptr<Image> rendered(
+      Image::create(IMAGE_RGB, rc.w, rc.h,
+                    m_render.getRenderImageBuffer()));
+
+    m_render.setRefLayersVisiblity(true);
+    m_render.setSelectedLayer(m_layer);
+    m_render.setNonactiveLayersOpacity(255);
+    m_render.setProjection(m_proj);
+    m_render.setupBackground(m_doc, rendered->pixelFormat());
+    m_render.disableOnionskin();
+    m_render.renderSprite(rendered.get(), m_sprite, m_frame,
+                          gfx::Clip(0, 0, rc));
+  }
+
+  void replay(Scenario& scenario) {
+    tools::Tool* tool = nullptr;
+    if (scenario.kind == Scenario::ToolStroke) {
+      tool = App::instance()->toolBox()->getToolById(scenario.toolId);
+      if (!tool)
+        throw base::Exception("Invalid tool \"%s\" in sequence \"%s\"",
+                              scenario.toolId.c_str(), scenario.name.c_str());
+    }
+    std::unique_ptr<HeadlessToolLoop> toolLoop;
+    std::unique_ptr<tools::ToolLoopManager> manager;
+    std::unique_ptr<SelectionEdgesMover> mover;
+    gfx::Point selStart;
+
+    for (const InputEvent& ev : scenario.events) {
+      const tools::Pointer pointer(ev.pos, tools::Pointer::Left);
+      const Clock::time_point t0 = Clock::now();
+
+      switch (scenario.kind) {
+
+        case Scenario::ToolStroke:
+          switch (ev.type) {
+            case InputEvent::MouseDown: {
+              Site site;
+              site.document(m_doc);
+              site.sprite(m_sprite);
+              site.layer(m_layer);
+              site.frame(m_frame);
+              toolLoop.reset(
+                new HeadlessToolLoop(this, m_context, site,
+                                     tool, scenario.brushSize));
+              manager.reset(new tools::ToolLoopManager(toolLoop.get()));
+
+              // DrawingState::initToolLoop()
+              m_render.setPreviewImage(
+                m_layer, m_frame,
+                toolLoop->getDstImage(),
+                toolLoop->getCelOrigin(),
+                static_cast<LayerImage*>(m_layer)->blendMode());
+
+              manager->prepareLoop(pointer);
+              manager->pressButton(pointer);
+              break;
+            }
+            case InputEvent::MouseMove:
+              manager->movement(pointer);
+              break;
+            case InputEvent::MouseUp: {
+              manager->releaseButton(pointer);
+              toolLoop->commitOrRollback();
+              const gfx::Rect bounds = toolLoop->getDirtyArea().bounds();
+              m_render.removePreviewImage();
+              manager.reset();
+              toolLoop.reset();
+              redraw(bounds);
+              break;
+            }
+            default:
+              break;
+          }
+          break;
+
+        // Same steps as MovingSelectionState
+        case Scenario::MoveSelection:
+          switch (ev.type) {
+            case InputEvent::MouseDown:
+              mover.reset(new SelectionEdgesMover(m_context, m_doc));
+              selStart = ev.pos;
+              break;
+            case InputEvent::MouseMove:
+              if (mover && mover->moveTo(mover->origin() + ev.pos - selStart))
+                redraw(m_sprite->bounds());
+              break;
+            case InputEvent::MouseUp:
+              if (mover) {
+                mover->commit();
+                mover.reset();
+                redraw(m_sprite->bounds());
+              }
+              break;
+            default:
+              break;
+          }
+          break;
+
+        case Scenario::View:
+          if (ev.type == InputEvent::Zoom)
+            setZoom(ev.value);
+          else if (ev.type == InputEvent::Frame)
+            setFrame(frame_t(ev.value % m_sprite->totalFrames()));
+          break;
+      }
+
+      scenario.latencies.push_back(
+        std::chrono::duration<double, std::milli>(Clock::now() - t0).count());
+    }
+
+    // Restore the default view
+    m_proj.setZoom(render::Zoom(1, 1));
+    m_frame = 0;
+  }
+
+private:
+  Context* m_context;
+  Doc* m_doc;
+  Sprite* m_sprite;
+  Layer* m_layer;
+  frame_t m_frame;
+  render::Projection m_proj;
+  EditorRender m_render;
+};
+
+HeadlessToolLoop::HeadlessToolLoop(HeadlessEditor* editor,
+                                   Context* context,
+                                   Site site,
+                                   tools::Tool* tool,
+                                   int brushSize)
+  : m_editor(editor)
+  , m_context(context)
+  , m_tool(tool)
+  , m_brush(new Brush(kCircleBrushType, brushSize, 0))
+  , m_document(site.document())
+  , m_sprite(site.sprite())
+  , m_layer(site.layer())
+  , m_frame(site.frame())
+  , m_rgbMap(nullptr)
+  , m_docPref(Preferences::instance().document(m_document))
+  , m_toolPref(Preferences::instance().tool(m_tool))
+  , m_ink(m_tool->getInk(0)->clone())
+  , m_controller(m_tool->getController(0))
+  , m_pointShape(m_tool->getPointShape(0))
+  , m_intertwine(m_tool->getIntertwine(0))
+  , m_tracePolicy(m_tool->getTracePolicy(0))
+  , m_filled(m_tool->getFill(0) == tools::FillAlways)
+  , m_canceled(false)
+  , m_transaction(m_context,
+                  m_tool->getText().c_str(),
+                  (m_ink->isSelection() ? DoesntModifyDocument:
+                                          ModifyDocument))
+{
+  const ColorTarget colorTarget(m_layer);
+  m_fgColor = color_utils::color_for_target_mask(app::Color::fromRgb(0, 0, 0), colorTarget);
+  m_bgColor = color_utils::color_for_target_mask(app::Color::fromRgb(255, 255, 255), colorTarget);
+  m_primaryColor = m_fgColor;
+  m_secondaryColor = m_bgColor;
+
+  // Default freehand algorithm
+  if (m_tracePolicy == tools::TracePolicy::Accumulate ||
+      m_tracePolicy == tools::TracePolicy::AccumulateUpdateLast) {
+    m_intertwine = App::instance()->toolBox()->getIntertwinerById(
+      tools::WellKnownIntertwiners::AsLines);
+    m_tracePolicy = tools::TracePolicy::Accumulate;
+  }
+
+  m_expandCelCanvas.reset(
+    new ExpandCelCanvas(
+      site, m_layer, filters::TiledMode::NONE, m_transaction,
+      ExpandCelCanvas::Flags(
+        ExpandCelCanvas::NeedsSource |
+        (m_controller->isFreehand() ?
+         ExpandCelCanvas::UseModifiedRegionAsUndoInfo:
+         ExpandCelCanvas::None))));
+
+  m_useMask = (!m_ink->isSelection() && m_document->isMaskVisible());
+  if (m_ink->isSelection()) {
+    Mask emptyMask;
+    m_transaction.execute(new cmd::SetMask(m_document, &emptyMask));
+  }
+
+  m_celOrigin = m_expandCelCanvas->getCel()->position();
+  m_mask = m_document->mask();
+  m_maskOrigin = (!m_mask->isEmpty() ? gfx::Point(m_mask->bounds().x-m_celOrigin.x,
+                                                  m_mask->bounds().y-m_celOrigin.y):
+                                       gfx::Point(0, 0));
+}
+
+HeadlessToolLoop::~HeadlessToolLoop()
+{
+  m_expandCelCanvas.reset();
+}
+
+void HeadlessToolLoop::commitOrRollback()
+{
+  if (!m_canceled) {
+    if (m_ink->isPaint()) {
+      ContextReader reader(m_context, 500);
+      ContextWriter writer(reader, 500);
+      m_expandCelCanvas->commit();
+    }
+    else if (m_ink->isSelection()) {
+      m_document->generateMaskBoundaries();
+    }
+    m_transaction.commit();
+  }
+
+  if (m_canceled || !m_ink->isPaint()) {
+    ContextReader reader(m_context, 500);
+    ContextWriter writer(reader, 500);
+    m_expandCelCanvas->rollback();
+  }
+}
+
+void HeadlessToolLoop::updateDirtyArea()
+{
+  m_editor->redraw(m_dirtyArea.bounds(), this);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Input sequences
+
+// Zig-zag stroke over the given area (like a recorded mouse
+// movement, one event each 4 pixels)
+InputSequence create_stroke(const gfx::Rect& area, int rows)
+{
+  InputSequence seq;
+  const int step = 4;
+  seq.push_back(InputEvent(InputEvent::MouseDown, area.origin()));
+  for (int row=0; row<rows; ++row) {
+    const int y = area.y + area.h * row / rows;
+    for (int i=0; i<=area.w; i+=step) {
+      const int x = ((row & 1) ? area.x2()-i: area.x+i);
+      seq.push_back(InputEvent(InputEvent::MouseMove, gfx::Point(x, y)));
+    }
+  }
+  seq.push_back(InputEvent(InputEvent::MouseUp, seq.back().pos));
+  return seq;
+}
+
+InputSequence create_clicks(const gfx::Rect& area, int n)
+{
+  InputSequence seq;
+  for (int i=0; i<n; ++i) {
+    const gfx::Point pt(area.x + area.w * (i+1) / (n+1),
+                        area.y + area.h * ((i*7) % n + 1) / (n+1));
+    seq.push_back(InputEvent(InputEvent::MouseDown, pt));
+    seq.push_back(InputEvent(InputEvent::MouseUp, pt));
+  }
+  return seq;
+}
+
+InputSequence create_drag(const gfx::Point& from, const gfx::Point& to, int steps)
+{
+  InputSequence seq;
+  seq.push_back(InputEvent(InputEvent::MouseDown, from));
+  for (int i=1; i<=steps; ++i)
+    seq.push_back(InputEvent(InputEvent::MouseMove,
+                             from + (to - from) * i / steps));
+  seq.push_back(InputEvent(InputEvent::MouseUp, to));
+  return seq;
+}
+
+InputSequence create_zooms()
+{
+  // Zoom in/out with the mouse wheel through all zoom levels
+  InputSequence seq;
+  const int n = render::Zoom::linearValues();
+  const int z100 = render::Zoom(1, 1).linearScale();
+  for (int i=z100; i<n; ++i)
+    seq.push_back(InputEvent(InputEvent::Zoom, gfx::Point(0, 0), i));
+  for (int i=n-1; i>=0; --i)
+    seq.push_back(InputEvent(InputEvent::Zoom, gfx::Point(0, 0), i));
+  for (int i=0; i<=z100; ++i)
+    seq.push_back(InputEvent(InputEvent::Zoom, gfx::Point(0, 0), i));
+  return seq;
+}
+
+InputSequence create_scrubbing(int frames)
+{
+  // Scrub forward and backward through the timeline
+  InputSequence seq;
+  for (int i=0; i<frames*2; ++i) {
+    const int frame = (i < frames ? i: 2*frames-1-i);
+    seq.push_back(InputEvent(InputEvent::Frame, gfx::Point(0, 0), frame));
+  }
+  return seq;
+}
+
+// Default sequences for the given visible area of the sprite
+Scenarios create_scenarios(const Sprite* sprite, const gfx::Rect& area)
+{
+  const gfx::Rect inner(area.x + area.w/8, area.y + area.h/8,
+                        area.w*3/4, area.h*3/4);
+  Scenarios scenarios;
+
+  Scenario pencil("pencil");
+  pencil.kind = Scenario::ToolStroke;
+  pencil.toolId = "pencil";
+  pencil.events = create_stroke(inner, 8);
+  scenarios.push_back(pencil);
+
+  Scenario brush("large brush");
+  brush.kind = Scenario::ToolStroke;
+  brush.toolId = "pencil";
+  brush.brushSize = 64;
+  brush.events = create_stroke(inner, 4);
+  scenarios.push_back(brush);
+
+  Scenario fill("fill");
+  fill.kind = Scenario::ToolStroke;
+  fill.toolId = "paint_bucket";
+  fill.events = create_clicks(inner, 16);
+  scenarios.push_back(fill);
+
+  Scenario move("selection move");
+  move.kind = Scenario::MoveSelection;
+  move.selection = gfx::Rect(inner.x, inner.y, inner.w/2, inner.h/2);
+  move.events = create_drag(inner.center(),
+                            inner.center() + gfx::Point(inner.w/4, inner.h/4), 64);
+  scenarios.push_back(move);
+
+  Scenario zoom("zoom");
+  zoom.events = create_zooms();
+  scenarios.push_back(zoom);
+
+  Scenario scrubbing("timeline scrubbing");
+  scrubbing.events = create_scrubbing(sprite->totalFrames());
+  scenarios.push_back(scrubbing);
+
+  return scenarios;
+}
+
+// Loads input sequences from a text file (see the format at the
+// beginning of this file)
+Scenarios load_scenarios(const std::string& filename)
+{
+  std::ifstream f(FSTREAM_PATH(filename));
+  if (!f)
+    throw base::Exception("Error opening %s", filename.c_str());
+
+  Scenarios scenarios;
+  bool pressed = false;
+  std::string line;
+  for (int lineNum=1; std::getline(f, line); ++lineNum) {
+    std::istringstream in(line);
+    std::string cmd;
+    if (!(in >> cmd) || cmd[0] == '#')
+      continue;
+
+    if (cmd == "sequence") {
+      std::string name;
+      std::getline(in >> std::ws, name);
+      if (pressed)
+        throw base::Exception("%s:%d: mouse button not released in the previous sequence",
+                              filename.c_str(), lineNum);
+      scenarios.push_back(Scenario(name));
+      continue;
+    }
+
+    if (scenarios.empty())
+      throw base::Exception("%s:%d: \"%s\" before the first sequence",
+                            filename.c_str(), lineNum, cmd.c_str());
+
+    Scenario& scenario = scenarios.back();
+    bool ok = true;
+    if (cmd == "tool") {
+      ok = (scenario.events.empty() &&
+            scenario.kind == Scenario::View &&
+            (in >> scenario.toolId >> scenario.brushSize) &&
+            scenario.brushSize > 0);
+      scenario.kind = Scenario::ToolStroke;
+    }
+    else if (cmd == "select") {
+      gfx::Rect& rc = scenario.selection;
+      ok = (scenario.events.empty() &&
+            scenario.kind == Scenario::View &&
+            (in >> rc.x >> rc.y >> rc.w >> rc.h) &&
+            !rc.isEmpty());
+      scenario.kind = Scenario::MoveSelection;
+    }
+    else if (cmd == "down" || cmd == "move" || cmd == "up") {
+      InputEvent::Type type = (cmd == "down" ? InputEvent::MouseDown:
+                               cmd == "move" ? InputEvent::MouseMove:
+                                               InputEvent::MouseUp);
+      gfx::Point pos;
+      ok = (scenario.kind != Scenario::View &&
+            (in >> pos.x >> pos.y) &&
+            pressed == (type != InputEvent::MouseDown));
+      if (ok) {
+        scenario.events.push_back(InputEvent(type, pos));
+        if (type != InputEvent::MouseMove)
+          pressed = !pressed;
+      }
+    }
+    else if (cmd == "zoom" || cmd == "frame") {
+      int value;
+      ok = (scenario.kind == Scenario::View &&
+            (in >> value) && value >= 0 &&
+            (cmd == "frame" || value < render::Zoom::linearValues()));
+      if (ok)
+        scenario.events.push_back(
+          InputEvent(cmd == "zoom" ? InputEvent::Zoom: InputEvent::Frame,
+                     gfx::Point(0, 0), value));
+    }
+    else
+      ok = false;
+
+    if (!ok)
+      throw base::Exception("%s:%d: invalid command \"%s\"",
+                            filename.c_str(), lineNum, line.c_str());
+  }
+
+  if (pressed)
+    throw base::Exception("%s: mouse button not released", filename.c_str());
+  if (scenarios.empty())
+    throw base::Exception("%s: no input sequences", filename.c_str());
+  return scenarios;
+}
+
+void save_scenarios(const std::string& filename, const Scenarios& scenarios)
+{
+  std::ofstream f(FSTREAM_PATH(filename));
+  if (!f)
+    throw base::Exception("Error creating %s", filename.c_str());
+
+  for (const Scenario& scenario : scenarios) {
+    f << "sequence " << scenario.name << "\n";
+    if (scenario.kind == Scenario::ToolStroke)
+      f << "tool " << scenario.toolId << " " << scenario.brushSize << "\n";
+    else if (scenario.kind == Scenario::MoveSelection) {
+      const gfx::Rect& rc = scenario.selection;
+      f << "select " << rc.x << " " << rc.y << " " << rc.w << " " << rc.h << "\n";
+    }
+    for (const InputEvent& ev : scenario.events) {
+      switch (ev.type) {
+        case InputEvent::MouseDown: f << "down " << ev.pos.x << " " << ev.pos.y; break;
+        case InputEvent::MouseMove: f << "move " << ev.pos.x << " " << ev.pos.y; break;
+        case InputEvent::MouseUp:   f << "up " << ev.pos.x << " " << ev.pos.y; break;
+        case InputEvent::Zoom:      f << "zoom " << ev.value; break;
+        case InputEvent::Frame:     f << "frame " << ev.value; break;
+      }
+      f << "\n";
+    }
+    f << "\n";
+  }
+}
+
+// Creates a sprite with some layers and frames with random shapes
+Doc* create_document(Context* ctx)
+{
+  const int w = 1024, h = 1024, layers = 3, frames = 16;
+  Doc* doc = ctx->documents().add(w, h, ColorMode::RGB, 256);
+  Sprite* sprite = doc->sprite();
+  sprite->setTotalFrames(frame_t(frames));
+
+  for (int i=1; i<layers; ++i)
+    sprite->root()->addLayer(new LayerImage(sprite));
+
+  std::srand(1);
+  for (Layer* layer : sprite->root()->layers()) {
+    LayerImage* layerImage = static_cast<LayerImage*>(layer);
+    for (frame_t frame=0; frame<frames; ++frame) {
+      Image* image = nullptr;
+      if (Cel* cel = layerImage->cel(frame))
+        image = cel->image();
+      else {
+        ImageRef imageRef(Image::create(IMAGE_RGB, w, h));
+        image = imageRef.get();
+        clear_image(image, 0);
+        layerImage->addCel(new Cel(frame, imageRef));
+      }
+      for (int j=0; j<32; ++j) {
+        const int x = std::rand() % w, y = std::rand() % h;
+        const int s = 16 + std::rand() % 128;
+        fill_ellipse(image, x, y, x+s, y+s,
+                     rgba(std::rand() % 256, std::rand() % 256,
+                          std::rand() % 256, 255));
+      }
+    }
+  }
+  return doc;
+}
+
+double percentile(const std::vector<double>& sorted, double p)
+{
+  if (sorted.empty())
+    return 0.0;
+  const int i = int(std::ceil(p * sorted.size())) - 1;
+  return sorted[std::max(0, std::min<int>(i, sorted.size()-1))];
+}
+
+} // anonymous namespace
+
+int app_main(int argc, char* argv[])
+{
+  int repeat = 3;
+  const char* filename = nullptr;
+  const char* sequencesFn = nullptr;
+  const char* saveSequencesFn = nullptr;
+  for (int i=1; i<argc; ++i) {
+    if (std::strcmp(argv[i], "--repeat") == 0 && i+1 < argc)
+      repeat = std::max(1, std::atoi(argv[++i]));
+    else if (std::strcmp(argv[i], "--sequences") == 0 && i+1 < argc)
+      sequencesFn = argv[++i];
+    else if (std::strcmp(argv[i], "--save-sequences") == 0 && i+1 < argc)
+      saveSequencesFn = argv[++i];
+    else
+      filename = argv[i];
+  }
+
+  try {
+    // Initialize the App in --batch mode (without UI)
+    const char* appArgv[] = { argv[0], "--batch" };
+    AppOptions options(2, appArgv);
+    she::ScopedHandle<she::System> system(she::create_system());
+    App app;
+    app.initialize(options);
+
+    Context* ctx = app.context();
+    Doc* doc;
+    if (filename) {
+      doc = load_document(ctx, filename);
+      if (!doc) {
+        std::fprintf(stderr, "Error loading %s\n", filename);
+        return 1;
+      }
+    }
+    else
+      doc = create_document(ctx);
+    ctx->setActiveDocument(doc);
+
+    Sprite* sprite = doc->sprite();
+    if (!sprite->root()->firstLayer() ||
+        !sprite->root()->firstLayer()->isImage()) {
+      std::fprintf(stderr, "The first layer must be an image layer\n");
+      return 1;
+    }
+
+    HeadlessEditor editor(ctx, doc);
+    Scenarios scenarios;
+    if (sequencesFn)
+      scenarios = load_scenarios(sequencesFn);
+    else
+      scenarios = create_scenarios(sprite, editor.visibleBounds());
+
+    if (saveSequencesFn)
+      save_scenarios(saveSequencesFn, scenarios);
+
+    for (Scenario& scenario : scenarios) {
+      // Selection to move
+      Mask mask;
+      if (scenario.kind == Scenario::MoveSelection)
+        mask.replace(scenario.selection);
+      doc->setMask(&mask);
+      doc->generateMaskBoundaries();
+
+      for (int i=0; i<repeat; ++i)
+        editor.replay(scenario);
+    }
+
+    std::printf("%-20s %8s %10s %10s %10s\n",
+                "Sequence", "Events", "p50 (ms)", "p99 (ms)", "max (ms)");
+    for (Scenario& scenario : scenarios) {
+      std::vector<double>& v = scenario.latencies;
+      std::sort(v.begin(), v.end());
+      std::printf("%-20s %8d %10.3f %10.3f %10.3f\n",
+                  scenario.name.c_str(), int(v.size()),
+                  percentile(v, 0.50),
+                  percentile(v, 0.99),
+                  v.empty() ? 0.0: v.back());
+    }
+    return 0;
+  }
+  catch (const std::exception& e) {
+    std::fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+}
@@ -0,0 +1,105 @@
+// Aseprite
+// Copyright (C) 2018  David Capello
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/save_file_queue.h"
+
+#include "app/console.h"
+#include "app/doc_snapshot.h"
+#include "app/file/file.h"
+#include "app/task_scheduler.h"
+#include "base/base.h"
+
+namespace app {
+
+// static
+SaveFileQueue* SaveFileQueue::instance()
+{
+  static SaveFileQueue queue;
+  return &queue;
+}
+
+SaveFileQueue::SaveFileQueue()
+  : m_maxJobs(1)
+  , m_running(0)
+{
+}
+
+SaveFileQueue::~SaveFileQueue()
+{
+  // Pending tasks are waited by the TaskGroup destructor
+}
+
+void SaveFileQueue::setMaxJobs(int jobs)
+{
+  m_maxJobs = MAX(1, jobs);
+}
+
+void SaveFileQueue::enqueue(std::unique_ptr<DocSnapshot>&& snapshot,
+                            std::unique_ptr<FileOp>&& fop)
+{
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this]{ return m_running < m_maxJobs; });
+    ++m_running;
+  }
+
+  if (!m_tasks)
+    m_tasks.reset(new TaskGroup);
+
+  // std::function needs copyable captures
+  std::shared_ptr<DocSnapshot> sharedSnapshot(snapshot.release());
+  std::shared_ptr<FileOp> sharedFop(fop.release());
+
+  m_tasks->run(
+    [this, sharedSnapshot, sharedFop]() mutable {
+      try {
+        sharedFop->operate(nullptr);
+      }
+      catch (const std::exception& e) {
+        sharedFop->setError("Error saving file:\n%s", e.what());
+      }
+      sharedFop->done();
+
+      const std::string error = sharedFop->error();
+
+      // Release the snapshot as soon as possible (it can keep
+      // copies of modified images)
+      sharedFop.reset();
+      sharedSnapshot.reset();
+
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (!error.empty())
+        m_errors.push_back(error);
+      --m_running;
+      m_cv.notify_all();
+    });
+}
+
+void SaveFileQueue::waitAll()
+{
+  if (m_tasks) {
+    m_tasks->wait();
+    m_tasks.reset();
+  }
+
+  std::vector<std::string> errors;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::swap(errors, m_errors);
+  }
+
+  if (!errors.empty()) {
+    Console console;
+    for (const auto& error : errors)
+      console.printf("%s", error.c_str());
+  }
+}
+
+} // namespace app
@@ -0,0 +1,64 @@
+// Aseprite
+// Copyright (C) 2018  David Capello
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_SAVE_FILE_QUEUE_H_INCLUDED
+#define APP_SAVE_FILE_QUEUE_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace app {
+
+  class DocSnapshot;
+  class FileOp;
+  class TaskGroup;
+
+  // Files that are being saved in background tasks (e.g. the outputs
+  // of --save-as with --split-layers when --jobs is used in the
+  // command line). Each file is saved from its own DocSnapshot, so
+  // the original document can be modified in the meantime.
+  class SaveFileQueue {
+  public:
+    static SaveFileQueue* instance();
+
+    // Maximum number of files that can be saved at the same time.
+    // If it's 1 (the default value), files are saved synchronously
+    // by the save commands.
+    int maxJobs() const { return m_maxJobs; }
+    void setMaxJobs(int jobs);
+
+    // Saves the given file in a background task. The calling thread
+    // is blocked while there are maxJobs() files being saved.
+    void enqueue(std::unique_ptr<DocSnapshot>&& snapshot,
+                 std::unique_ptr<FileOp>&& fop);
+
+    // Waits all the pending files and shows the errors in the
+    // console. Must be called from the main thread.
+    void waitAll();
+
+  private:
+    SaveFileQueue();
+    ~SaveFileQueue();
+
+    int m_maxJobs;
+    int m_running;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::vector<std::string> m_errors;
+    std::unique_ptr<TaskGroup> m_tasks;
+
+    DISABLE_COPYING(SaveFileQueue);
+  };
+
+} // namespace app
+
+#endif
@@ -0,0 +1,199 @@
+// Aseprite
+// Copyright (C) 2018  David Capello
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#include "tests/test.h"
+
+#include "app/cmd/set_pixel_format.h"
+#include "app/context.h"
+#include "app/doc.h"
+#include "app/test_context.h"
+#include "doc/cel.h"
+#include "doc/image.h"
+#include "doc/layer.h"
+#include "doc/primitives.h"
+#include "doc/sprite.h"
+#include "render/dithering_matrix.h"
+#include "render/task_delegate.h"
+
+#include <limits>
+#include <memory>
+
+using namespace app;
+using namespace doc;
+
+typedef std::unique_ptr<Doc> DocPtr;
+
+namespace {
+
+  // Counts the converted images (continueTask() is called once
+  // before converting each image) and the notified progress.
+  class TestTaskDelegate : public render::TaskDelegate {
+  public:
+    TestTaskDelegate() : m_conversions(0), m_notifications(0), m_progress(0.0) { }
+
+    int conversions() const { return m_conversions; }
+    int notifications() const { return m_notifications; }
+    double progress() const { return m_progress; }
+
+    void notifyTaskProgress(double progress) override {
+      ++m_notifications;
+      m_progress = progress;
+    }
+
+    bool continueTask() override {
+      ++m_conversions;
+      return true;
+    }
+
+  private:
+    int m_conversions;
+    int m_notifications;
+    double m_progress;
+  };
+
+  // Cancels the task after "n" calls to continueTask(), checking that
+  // the progress is always increasing.
+  class CancelTaskDelegate : public render::TaskDelegate {
+  public:
+    CancelTaskDelegate(int n) : m_n(n), m_calls(0), m_notifications(0), m_progress(0.0) { }
+
+    int calls() const { return m_calls; }
+    int notifications() const { return m_notifications; }
+    double progress() const { return m_progress; }
+
+    void notifyTaskProgress(double progress) override {
+      EXPECT_LE(m_progress, progress);
+      ++m_notifications;
+      m_progress = progress;
+    }
+
+    bool continueTask() override {
+      return (++m_calls <= m_n);
+    }
+
+  private:
+    int m_n;
+    int m_calls;
+    int m_notifications;
+    double m_progress;
+  };
+
+  Doc* create_dithering_doc(Context& ctx, int w, int h) {
+    Doc* doc = ctx.documents().add(w, h, ColorMode::RGB);
+    Image* image = doc->sprite()->root()->firstLayer()->cel(0)->image();
+    for (int y=0; y<h; ++y)
+      for (int x=0; x<w; ++x)
+        put_pixel(image, x, y, rgba(x*255/w, y*255/h, 128, 255));
+    return doc;
+  }
+
+}
+
+TEST(SetPixelFormat, DuplicatedCelsAreConvertedOnce)
+{
+  const int kFrames = 12;
+  const int kDifferentCels = 3;
+
+  TestContextT<Context> ctx;
+  DocPtr doc(ctx.documents().add(8, 8, ColorMode::RGB));
+  Sprite* sprite = doc->sprite();
+  LayerImage* layer = static_cast<LayerImage*>(sprite->root()->firstLayer());
+  layer->setBackground(false);
+
+  // Different images (not linked cels) with the same pixels
+  sprite->setTotalFrames(frame_t(kFrames));
+  for (frame_t frame=0; frame<kFrames; ++frame) {
+    ImageRef image(Image::create(IMAGE_RGB, 8, 8));
+    clear_image(image.get(), 0);
+    put_pixel(image.get(), frame % kDifferentCels, 0, rgba(255, 255, 255, 255));
+    if (frame == 0)
+      copy_image(layer->cel(frame)->image(), image.get());
+    else
+      layer->addCel(new Cel(frame, image));
+  }
+
+  {
+    TestTaskDelegate delegate;
+    cmd::SetPixelFormat cmd(sprite, IMAGE_INDEXED,
+                            render::DitheringAlgorithm::None,
+                            render::DitheringMatrix(),
+                            &delegate);
+    cmd.execute(&ctx);
+
+    EXPECT_EQ(kDifferentCels, delegate.conversions());
+    EXPECT_EQ(kFrames, delegate.notifications());
+    EXPECT_DOUBLE_EQ(1.0, delegate.progress());
+  }
+
+  EXPECT_EQ(IMAGE_INDEXED, sprite->pixelFormat());
+  for (frame_t i=0; i<kFrames; ++i) {
+    const Image* a = layer->cel(i)->image();
+    EXPECT_EQ(IMAGE_INDEXED, a->pixelFormat());
+
+    for (frame_t j=i+1; j<kFrames; ++j) {
+      const Image* b = layer->cel(j)->image();
+
+      // Each cel has its own image
+      EXPECT_NE(a, b);
+      if ((i % kDifferentCels) == (j % kDifferentCels))
+        EXPECT_EQ(0, count_diff_between_images(a, b));
+      else
+        EXPECT_NE(0, count_diff_between_images(a, b));
+    }
+  }
+
+  doc->close();
+}
+
+TEST(SetPixelFormat, DitheringProgress)
+{
+  const int kRows = 32;
+
+  TestContextT<Context> ctx;
+  DocPtr doc(create_dithering_doc(ctx, 16, kRows));
+  Sprite* sprite = doc->sprite();
+
+  {
+    // Progress is notified for each converted row
+    CancelTaskDelegate delegate(std::numeric_limits<int>::max());
+    cmd::SetPixelFormat cmd(sprite, IMAGE_INDEXED,
+                            render::DitheringAlgorithm::Ordered,
+                            render::BayerMatrix(8),
+                            &delegate);
+    cmd.execute(&ctx);
+
+    EXPECT_LE(kRows, delegate.notifications());
+    EXPECT_DOUBLE_EQ(1.0, delegate.progress());
+  }
+
+  doc->close();
+}
+
+TEST(SetPixelFormat, DitheringCancel)
+{
+  const int kRows = 32;
+
+  TestContextT<Context> ctx;
+  DocPtr doc(create_dithering_doc(ctx, 16, kRows));
+  Sprite* sprite = doc->sprite();
+
+  {
+    // The conversion is stopped in the middle of the image (the
+    // delegate is not asked for each pixel)
+    CancelTaskDelegate delegate(kRows/2);
+    cmd::SetPixelFormat cmd(sprite, IMAGE_INDEXED,
+                            render::DitheringAlgorithm::Ordered,
+                            render::BayerMatrix(8),
+                            &delegate);
+    cmd.execute(&ctx);
+
+    EXPECT_LE(kRows/2, delegate.calls());
+    EXPECT_GT(kRows, delegate.calls());
+    EXPECT_GT(1.0, delegate.progress());
+  }
+
+  doc->close();
+}
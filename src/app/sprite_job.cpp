@@ -10,6 +10,8 @@
 
 #include "app/sprite_job.h"
 
+#include "app/task_scheduler.h"
+
 namespace app {
 
 SpriteJob::SpriteJob(const ContextReader& reader, const char* jobName)
@@ -32,6 +34,31 @@ void SpriteJob::onJob()
   m_callback();
 }
 
+void SpriteJob::forEachCelInParallel(
+  const doc::CelList& cels,
+  const std::function<void(int, doc::Cel*)>& func,
+  const double progressFrom,
+  const double progressTo)
+{
+  // Cancel pending tasks when the user cancels the job
+  CancellationToken token;
+  TaskGroup group(&token);
+
+  for (int i=0; i<int(cels.size()); ++i) {
+    doc::Cel* cel = cels[i];
+    group.run(
+      [this, &func, &group, &token, i, cel, progressFrom, progressTo]{
+        if (isCanceled()) {
+          token.cancel();
+          return;
+        }
+        func(i, cel);
+        jobProgress(progressFrom + (progressTo - progressFrom) * group.progress());
+      });
+  }
+  group.wait();
+}
+
 bool SpriteJob::continueTask()
 {
   return !isCanceled();
@@ -12,6 +12,7 @@
 #include "app/context_access.h"
 #include "app/job.h"
 #include "app/transaction.h"
+#include "doc/cel_list.h"
 #include "render/task_delegate.h"
 
 #include <functional>
@@ -35,6 +36,19 @@ public:
     Job::startJob();
   }
 
+protected:
+  // Calls the given function for each cel from several worker
+  // threads at the same time, so the function must not modify the
+  // document (e.g. it can create new images for each cel, and then
+  // they can be applied to the document in the job thread). The job
+  // progress goes from "progressFrom" to "progressTo", and pending
+  // cels are not processed if the job is canceled.
+  void forEachCelInParallel(
+    const doc::CelList& cels,
+    const std::function<void(int, doc::Cel*)>& func,
+    const double progressFrom = 0.0,
+    const double progressTo = 1.0);
+
 private:
   // Job impl
   void onJob() override;
@@ -0,0 +1,71 @@
+// Aseprite
+// Copyright (C) 2018  David Capello
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/startup_tasks.h"
+
+#include "app/startup_trace.h"
+#include "base/debug.h"
+
+namespace app {
+
+StartupTasks::~StartupTasks()
+{
+  // Errors are ignored here, they must be handled with wait()
+  for (auto& task : m_tasks)
+    task.second.wait();
+}
+
+void StartupTasks::run(const char* name,
+                       const std::vector<const char*>& deps,
+                       Func&& func)
+{
+  std::vector<std::shared_future<void> > depFutures;
+  for (const char* dep : deps) {
+    const std::shared_future<void>* future = find(dep);
+    ASSERT(future);
+    if (future)
+      depFutures.push_back(*future);
+  }
+
+  m_tasks.push_back(
+    std::make_pair(
+      std::string(name),
+      std::async(
+        std::launch::async,
+        [name, depFutures, func]{
+          for (const auto& dep : depFutures)
+            dep.get();
+
+          StartupTrace::Scope trace(name);
+          func();
+        }).share()));
+}
+
+void StartupTasks::wait(const char* name)
+{
+  if (const std::shared_future<void>* future = find(name))
+    future->get();
+}
+
+void StartupTasks::waitAll()
+{
+  for (auto& task : m_tasks)
+    task.second.get();
+}
+
+const std::shared_future<void>* StartupTasks::find(const char* name) const
+{
+  for (const auto& task : m_tasks)
+    if (task.first == name)
+      return &task.second;
+  return nullptr;
+}
+
+} // namespace app
@@ -0,0 +1,55 @@
+// Aseprite
+// Copyright (C) 2018  David Capello
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_STARTUP_TASKS_H_INCLUDED
+#define APP_STARTUP_TASKS_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+
+#include <functional>
+#include <future>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace app {
+
+  // Resources that are loaded in parallel at startup (e.g. while
+  // the GUI is being created). Each task runs in its own thread
+  // after the tasks it depends on, and the main thread must call
+  // wait() before using the resource loaded by a task. These member
+  // functions can be called from the main thread only.
+  class StartupTasks {
+  public:
+    typedef std::function<void()> Func;
+
+    StartupTasks() { }
+    ~StartupTasks();
+
+    // Runs "func" in a background thread when all the "deps" tasks
+    // (which must be added before this one) are finished. The "name"
+    // is used to wait the task and in the --startup-trace report.
+    void run(const char* name,
+             const std::vector<const char*>& deps,
+             Func&& func);
+
+    // Waits the given task (if it exists), rethrowing the exception
+    // thrown by the task or its dependencies.
+    void wait(const char* name);
+    void waitAll();
+
+  private:
+    const std::shared_future<void>* find(const char* name) const;
+
+    std::vector<std::pair<std::string, std::shared_future<void> > > m_tasks;
+
+    DISABLE_COPYING(StartupTasks);
+  };
+
+} // namespace app
+
+#endif
@@ -0,0 +1,116 @@
+// Aseprite
+// Copyright (C) 2018  David Capello
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/startup_trace.h"
+
+#include "fmt/format.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace app {
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+struct Step {
+  std::string name;
+  double start;
+  double duration;
+  std::thread::id thread;
+};
+
+std::atomic<bool> enabled(false);
+Clock::time_point start_time;
+std::thread::id main_thread;
+std::mutex steps_mutex;
+std::vector<Step> steps;
+
+double now()
+{
+  return std::chrono::duration<double, std::milli>(Clock::now() - start_time).count();
+}
+
+} // anonymous namespace
+
+StartupTrace::Scope::Scope(const char* name)
+  : m_name(name)
+  , m_start(enabled ? now(): 0.0)
+{
+}
+
+StartupTrace::Scope::~Scope()
+{
+  if (!enabled)
+    return;
+
+  Step step = { m_name, m_start, now() - m_start, std::this_thread::get_id() };
+  std::lock_guard<std::mutex> lock(steps_mutex);
+  steps.push_back(step);
+}
+
+// static
+void StartupTrace::enable()
+{
+  start_time = Clock::now();
+  main_thread = std::this_thread::get_id();
+  enabled = true;
+}
+
+// static
+bool StartupTrace::isEnabled()
+{
+  return enabled;
+}
+
+// static
+void StartupTrace::printReport(std::ostream& os)
+{
+  if (!enabled)
+    return;
+
+  std::vector<Step> sorted;
+  {
+    std::lock_guard<std::mutex> lock(steps_mutex);
+    sorted = steps;
+  }
+  std::stable_sort(sorted.begin(), sorted.end(),
+                   [](const Step& a, const Step& b){
+                     return a.start < b.start;
+                   });
+
+  // Background threads are numbered in order of appearance
+  std::vector<std::thread::id> threads;
+
+  os << fmt::format("{:>10} {:>10}  {:<8} {}\n",
+                    "start ms", "time ms", "thread", "step");
+  for (const auto& step : sorted) {
+    std::string thread = "main";
+    if (step.thread != main_thread) {
+      auto it = std::find(threads.begin(), threads.end(), step.thread);
+      if (it == threads.end())
+        it = threads.insert(threads.end(), step.thread);
+      thread = fmt::format("bg{}", int(it - threads.begin())+1);
+    }
+    os << fmt::format("{:>10.2f} {:>10.2f}  {:<8} {}\n",
+                      step.start, step.duration, thread, step.name);
+  }
+  os << fmt::format("{:>10.2f} {:>10}  {:<8} {}\n",
+                    now(), "", "", "total");
+}
+
+} // namespace app
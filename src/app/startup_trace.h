@@ -0,0 +1,42 @@
+// Aseprite
+// Copyright (C) 2018  David Capello
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_STARTUP_TRACE_H_INCLUDED
+#define APP_STARTUP_TRACE_H_INCLUDED
+#pragma once
+
+#include <iosfwd>
+
+namespace app {
+
+  // Time spent in each step of the program startup (modules,
+  // resources, etc.). It's enabled with the --startup-trace option
+  // and the report is printed at the end of App::initialize().
+  class StartupTrace {
+  public:
+    // Measures the time between the constructor and the destructor
+    // (it does nothing if the trace is disabled). It can be used
+    // from any thread.
+    class Scope {
+    public:
+      Scope(const char* name);
+      ~Scope();
+    private:
+      const char* m_name;
+      double m_start;
+    };
+
+    static void enable();
+    static bool isEnabled();
+
+    // Prints the start time/duration of each step in milliseconds
+    // (relative to the enable() call).
+    static void printReport(std::ostream& os);
+  };
+
+} // namespace app
+
+#endif
@@ -0,0 +1,231 @@
+// Aseprite
+// Copyright (C) 2018  David Capello
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/task_scheduler.h"
+
+#include "base/base.h"
+#include "base/debug.h"
+
+namespace app {
+
+// Index of the worker of the current thread (or -1 if it's not a
+// worker thread)
+static thread_local int t_worker = -1;
+
+// static
+TaskScheduler* TaskScheduler::instance()
+{
+  static TaskScheduler scheduler(
+    MAX(1, int(std::thread::hardware_concurrency())));
+  return &scheduler;
+}
+
+TaskScheduler::TaskScheduler(int nworkers)
+  : m_pending(0)
+  , m_next(0)
+  , m_stop(false)
+{
+  for (int i=0; i<nworkers; ++i)
+    m_workers.push_back(std::unique_ptr<Worker>(new Worker));
+
+  for (int i=0; i<nworkers; ++i)
+    m_workers[i]->thread = std::thread([this, i]{ workerLoop(i); });
+}
+
+TaskScheduler::~TaskScheduler()
+{
+  // Pending tasks are discarded (they are just references to task
+  // groups, and the tasks of a group are executed by the thread that
+  // waits the group), we only wait the tasks that are running.
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_cv.notify_all();
+
+  for (auto& worker : m_workers)
+    worker->thread.join();
+
+  for (auto& worker : m_workers)
+    worker->tasks.clear();
+}
+
+void TaskScheduler::schedule(Task&& task)
+{
+  const int n = int(m_workers.size());
+  const int i = (t_worker >= 0 ? t_worker: int(m_next++ % n));
+  {
+    std::lock_guard<std::mutex> lock(m_workers[i]->mutex);
+    m_workers[i]->tasks.push_back(std::move(task));
+  }
+  ++m_pending;
+
+  // Lock the mutex so a worker cannot miss the notification between
+  // checking m_pending and waiting the condition variable.
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_cv.notify_one();
+}
+
+bool TaskScheduler::popTask(const int worker, Task& task)
+{
+  if (m_pending == 0)
+    return false;
+
+  // The last task of our queue (the most recent one, which probably
+  // uses data that is still in the cache)
+  {
+    Worker* w = m_workers[worker].get();
+    std::lock_guard<std::mutex> lock(w->mutex);
+    if (!w->tasks.empty()) {
+      task = std::move(w->tasks.back());
+      w->tasks.pop_back();
+      --m_pending;
+      return true;
+    }
+  }
+
+  // Steal the oldest task from other worker
+  const int n = int(m_workers.size());
+  for (int i=1; i<n; ++i) {
+    Worker* w = m_workers[(worker+i) % n].get();
+    std::lock_guard<std::mutex> lock(w->mutex);
+    if (!w->tasks.empty()) {
+      task = std::move(w->tasks.front());
+      w->tasks.pop_front();
+      --m_pending;
+      return true;
+    }
+  }
+  return false;
+}
+
+void TaskScheduler::workerLoop(const int worker)
+{
+  t_worker = worker;
+
+  while (!m_stop) {
+    Task task;
+    if (popTask(worker, task)) {
+      task();
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this]{ return m_stop || m_pending > 0; });
+  }
+}
+
+struct TaskGroup::State {
+  CancellationToken* token;
+  std::atomic<int> total;
+  std::atomic<int> done;
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<TaskScheduler::Task> tasks; // Tasks that weren't started yet
+  std::exception_ptr error;
+
+  State(CancellationToken* token)
+    : token(token), total(0), done(0) { }
+
+  bool isCanceled() const { return (token && token->isCanceled()); }
+};
+
+TaskGroup::TaskGroup(CancellationToken* token)
+  : m_state(std::make_shared<State>(token))
+{
+}
+
+TaskGroup::~TaskGroup()
+{
+  waitTasks();
+}
+
+void TaskGroup::run(TaskScheduler::Task&& task)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    m_state->tasks.push_back(std::move(task));
+    ++m_state->total;
+  }
+
+  // The task can be executed by a worker or by the thread that waits
+  // the group (whatever comes first).
+  std::shared_ptr<State> state = m_state;
+  TaskScheduler::instance()->schedule(
+    [state]{ runPendingTask(*state); });
+}
+
+void TaskGroup::wait()
+{
+  waitTasks();
+
+  State& state = *m_state;
+  if (state.error) {
+    std::exception_ptr error = state.error;
+    state.error = nullptr;
+    std::rethrow_exception(error);
+  }
+}
+
+bool TaskGroup::isCanceled() const
+{
+  return m_state->isCanceled();
+}
+
+double TaskGroup::progress() const
+{
+  const int total = m_state->total;
+  return (total > 0 ? double(m_state->done) / double(total): 1.0);
+}
+
+// static
+bool TaskGroup::runPendingTask(State& state)
+{
+  TaskScheduler::Task task;
+  {
+    std::lock_guard<std::mutex> lock(state.mutex);
+    if (state.tasks.empty())
+      return false;
+
+    task = std::move(state.tasks.front());
+    state.tasks.pop_front();
+  }
+
+  if (!state.isCanceled()) {
+    try {
+      task();
+    }
+    catch (...) {
+      std::lock_guard<std::mutex> lock(state.mutex);
+      if (!state.error)
+        state.error = std::current_exception();
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(state.mutex);
+  ++state.done;
+  state.cv.notify_all();
+  return true;
+}
+
+void TaskGroup::waitTasks()
+{
+  State& state = *m_state;
+
+  // Help with the tasks of this group that weren't started yet
+  while (runPendingTask(state))
+    ;
+
+  // All the remaining tasks are running in other threads
+  std::unique_lock<std::mutex> lock(state.mutex);
+  state.cv.wait(lock, [&state]{ return state.done == state.total; });
+}
+
+} // namespace app
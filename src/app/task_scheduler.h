@@ -0,0 +1,113 @@
+// Aseprite
+// Copyright (C) 2018  David Capello
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_TASK_SCHEDULER_H_INCLUDED
+#define APP_TASK_SCHEDULER_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace app {
+
+  // Application-wide pool of worker threads (one for each CPU
+  // core). Each worker has its own queue of tasks, and idle workers
+  // steal tasks from the queues of other workers.
+  class TaskScheduler {
+  public:
+    typedef std::function<void()> Task;
+
+    static TaskScheduler* instance();
+
+    int workers() const { return int(m_workers.size()); }
+
+    // Adds a task to the queue of the current worker (if this is
+    // called from a worker thread), or to the queue of the next
+    // worker.
+    void schedule(Task&& task);
+
+  private:
+    struct Worker {
+      std::mutex mutex;
+      std::deque<Task> tasks;
+      std::thread thread;
+    };
+
+    TaskScheduler(int nworkers);
+    ~TaskScheduler();
+
+    bool popTask(const int worker, Task& task);
+    void workerLoop(const int worker);
+
+    std::vector<std::unique_ptr<Worker> > m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::atomic<int> m_pending;
+    std::atomic<unsigned int> m_next;
+    std::atomic<bool> m_stop;
+
+    DISABLE_COPYING(TaskScheduler);
+  };
+
+  // Flag shared by a group of tasks to stop them.
+  class CancellationToken {
+  public:
+    CancellationToken() : m_canceled(false) { }
+    void cancel() { m_canceled = true; }
+    bool isCanceled() const { return m_canceled; }
+  private:
+    std::atomic<bool> m_canceled;
+  };
+
+  // Tasks that run in the TaskScheduler and are waited together. The
+  // progress of the group is the fraction of finished tasks, and the
+  // first exception thrown by a task is rethrown by wait().
+  //
+  // Tasks are queued in the group itself (the scheduler only receives
+  // a reference to the group), so a thread waiting the group can run
+  // the pending tasks of the group, but never tasks of other groups.
+  class TaskGroup {
+  public:
+    TaskGroup(CancellationToken* token = nullptr);
+    ~TaskGroup();
+
+    // Schedules a new task. The task isn't executed if the group is
+    // canceled before the task starts.
+    void run(TaskScheduler::Task&& task);
+
+    // Waits all tasks of the group. The calling thread executes the
+    // pending tasks of this group in the meantime.
+    void wait();
+
+    bool isCanceled() const;
+    double progress() const;
+
+  private:
+    struct State;
+
+    static bool runPendingTask(State& state);
+    void waitTasks();
+
+    // Shared with the tasks queued in the scheduler, which can be
+    // popped by a worker after the group is destroyed (when the
+    // waiting thread already executed their group tasks).
+    std::shared_ptr<State> m_state;
+
+    DISABLE_COPYING(TaskGroup);
+  };
+
+} // namespace app
+
+#endif
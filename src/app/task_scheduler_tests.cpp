@@ -0,0 +1,117 @@
+// Aseprite
+// Copyright (C) 2018  David Capello
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#include "tests/test.h"
+
+#include "app/task_scheduler.h"
+
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace app;
+
+TEST(TaskScheduler, RunAllTasks)
+{
+  std::vector<int> values(1000, 0);
+  {
+    TaskGroup group;
+    for (int i=0; i<int(values.size()); ++i)
+      group.run([&values, i]{ values[i] = i*2; });
+    group.wait();
+    EXPECT_EQ(1.0, group.progress());
+  }
+  for (int i=0; i<int(values.size()); ++i)
+    EXPECT_EQ(i*2, values[i]);
+}
+
+TEST(TaskScheduler, NestedGroups)
+{
+  // Tasks that wait other tasks cannot block the workers
+  const int n = 4*TaskScheduler::instance()->workers();
+  std::atomic<int> count(0);
+  TaskGroup group;
+  for (int i=0; i<n; ++i) {
+    group.run([&count]{
+        TaskGroup subgroup;
+        for (int j=0; j<10; ++j)
+          subgroup.run([&count]{ ++count; });
+        subgroup.wait();
+      });
+  }
+  group.wait();
+  EXPECT_EQ(n*10, count);
+}
+
+TEST(TaskScheduler, Exceptions)
+{
+  std::atomic<int> count(0);
+  TaskGroup group;
+  for (int i=0; i<100; ++i) {
+    group.run([&count, i]{
+        ++count;
+        if (i == 50)
+          throw std::runtime_error("error");
+      });
+  }
+  EXPECT_THROW(group.wait(), std::runtime_error);
+  EXPECT_EQ(100, count);
+}
+
+TEST(TaskScheduler, Cancel)
+{
+  CancellationToken token;
+  std::atomic<int> count(0);
+  TaskGroup group(&token);
+  token.cancel();
+  for (int i=0; i<100; ++i)
+    group.run([&count]{ ++count; });
+  group.wait();
+  EXPECT_EQ(0, count);
+  EXPECT_TRUE(group.isCanceled());
+}
+
+TEST(TaskScheduler, WaitOnlyRunsTasksOfTheGroup)
+{
+  const std::thread::id thisThread = std::this_thread::get_id();
+  std::atomic<bool> release(false);
+  std::atomic<int> othersInThisThread(0);
+  TaskGroup others;
+  auto runOther = [&]{
+    others.run([&]{
+        if (std::this_thread::get_id() == thisThread) {
+          ++othersInThisThread;
+          return;
+        }
+        // Block the worker
+        while (!release)
+          std::this_thread::yield();
+      });
+  };
+
+  // Tasks of other group before and after the tasks of our group
+  const int n = TaskScheduler::instance()->workers();
+  for (int i=0; i<n; ++i)
+    runOther();
+
+  int count = 0;
+  TaskGroup group;
+  for (int i=0; i<10; ++i)
+    group.run([&count]{ ++count; });
+
+  for (int i=0; i<n; ++i)
+    runOther();
+
+  // This thread executes the tasks of the group (the workers are
+  // busy) but not the tasks of the other group
+  group.wait();
+  EXPECT_EQ(10, count);
+  EXPECT_EQ(0, othersInThisThread);
+
+  release = true;
+  others.wait();
+}
@@ -0,0 +1,246 @@
+// Aseprite
+// Copyright (C) 2018  David Capello
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/thumbnail_cache.h"
+
+#include "app/resource_finder.h"
+#include "base/fs.h"
+#include "base/fstream_path.h"
+#include "base/log.h"
+#include "base/serialization.h"
+#include "doc/image.h"
+#include "doc/image_io.h"
+#include "doc/string_io.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <vector>
+
+namespace app {
+
+using namespace base::serialization;
+using namespace base::serialization::little_endian;
+
+namespace {
+
+const uint32_t kThumbnailMagic = 0x4d485441; // "ATHM"
+const uint16_t kThumbnailVersion = 1;
+const char* kThumbnailExtension = "thumb";
+
+// The cache is pruned after this number of saved thumbnails (and
+// with the first one)
+const int kPruneInterval = 64;
+
+uint64_t hash_string(const std::string& str)
+{
+  // FNV-1a
+  uint64_t hash = 14695981039346656037ull;
+  for (char chr : str)
+    hash = (hash ^ uint8_t(chr)) * 1099511628211ull;
+  return hash;
+}
+
+void write_stamp(std::ostream& os, const ThumbnailCache::FileStamp& stamp)
+{
+  write16(os, stamp.time.year);
+  write8(os, stamp.time.month);
+  write8(os, stamp.time.day);
+  write8(os, stamp.time.hour);
+  write8(os, stamp.time.minute);
+  write8(os, stamp.time.second);
+  write32(os, uint32_t(uint64_t(stamp.size) & 0xffffffff));
+  write32(os, uint32_t(uint64_t(stamp.size) >> 32));
+}
+
+ThumbnailCache::FileStamp read_stamp(std::istream& is)
+{
+  ThumbnailCache::FileStamp stamp;
+  stamp.time.year = read16(is);
+  stamp.time.month = read8(is);
+  stamp.time.day = read8(is);
+  stamp.time.hour = read8(is);
+  stamp.time.minute = read8(is);
+  stamp.time.second = read8(is);
+  uint64_t lo = read32(is);
+  uint64_t hi = read32(is);
+  stamp.size = size_t(lo | (hi << 32));
+  return stamp;
+}
+
+// Value to sort times (from the oldest to the newest one)
+uint64_t time_key(const base::Time& t)
+{
+  return ((((uint64_t(t.year)*12 + t.month)*31 + t.day)*24
+           + t.hour)*60 + t.minute)*60 + t.second;
+}
+
+} // anonymous namespace
+
+// static
+ThumbnailCache::FileStamp ThumbnailCache::FileStamp::fromFile(const std::string& filename)
+{
+  FileStamp stamp;
+  stamp.time = base::get_modification_time(filename);
+  stamp.size = base::file_size(filename);
+  return stamp;
+}
+
+ThumbnailCache::ThumbnailCache()
+  : m_saves(0)
+{
+  ResourceFinder rf;
+  rf.includeUserDir(base::join_path("thumbnails", ".").c_str());
+  m_dir = base::normalize_path(rf.getFirstOrCreateDefault());
+  if (!m_dir.empty() && m_dir.back() == '.')
+    m_dir = base::get_file_path(m_dir);
+
+  LOG("THUMB: Thumbnails cache in '%s'\n", m_dir.c_str());
+}
+
+ThumbnailCache::ThumbnailCache(const std::string& dir)
+  : m_dir(dir)
+  , m_saves(0)
+{
+}
+
+doc::Image* ThumbnailCache::load(const std::string& filename,
+                                 const FileStamp& stamp) const
+{
+  const std::string fn = cacheFilename(filename);
+  if (fn.empty() || !base::is_file(fn))
+    return nullptr;
+
+  try {
+    std::ifstream s(FSTREAM_PATH(fn), std::ifstream::binary);
+    if (read32(s) != kThumbnailMagic ||
+        read16(s) != kThumbnailVersion)
+      return nullptr;
+
+    // Check that the thumbnail was generated from the same file and
+    // it wasn't modified in the meantime.
+    if (doc::read_string(s) != filename ||
+        !(read_stamp(s) == stamp) ||
+        s.fail())
+      return nullptr;
+
+    std::unique_ptr<doc::Image> image(doc::read_image(s, false));
+    if (s.fail())
+      return nullptr;
+    s.close();
+
+    // The modification time of the thumbnail is the last time it
+    // was used (see prune()), we update it once a day re-saving it.
+    base::Time now = base::current_time();
+    base::Time time = base::get_modification_time(fn);
+    now.dateOnly();
+    time.dateOnly();
+    if (!(now == time))
+      save(filename, stamp, image.get());
+
+    return image.release();
+  }
+  catch (const std::exception& ex) {
+    LOG(ERROR) << "THUMB: Error loading thumbnail of '" << filename << "': "
+               << ex.what() << "\n";
+    return nullptr;
+  }
+}
+
+void ThumbnailCache::save(const std::string& filename,
+                          const FileStamp& stamp,
+                          const doc::Image* thumbnail) const
+{
+  const std::string fn = cacheFilename(filename);
+  if (fn.empty())
+    return;
+
+  try {
+    std::ofstream s(FSTREAM_PATH(fn), std::ofstream::binary);
+    write32(s, kThumbnailMagic);
+    write16(s, kThumbnailVersion);
+    doc::write_string(s, filename);
+    write_stamp(s, stamp);
+    doc::write_image(s, thumbnail);
+  }
+  catch (const std::exception& ex) {
+    LOG(ERROR) << "THUMB: Error saving thumbnail of '" << filename << "': "
+               << ex.what() << "\n";
+  }
+
+  if ((m_saves++ % kPruneInterval) == 0)
+    prune(kMaxFiles, kMaxSize);
+}
+
+void ThumbnailCache::prune(const int maxFiles, const std::size_t maxSize) const
+{
+  if (m_dir.empty())
+    return;
+
+  struct Item {
+    uint64_t time;
+    std::size_t size;
+    std::string fn;
+  };
+
+  std::lock_guard<std::mutex> lock(m_pruneMutex);
+  std::vector<Item> items;
+  std::size_t totalSize = 0;
+  for (const auto& name : base::list_files(m_dir)) {
+    if (base::get_file_extension(name) != kThumbnailExtension)
+      continue;
+
+    Item item;
+    item.fn = base::join_path(m_dir, name);
+    item.time = time_key(base::get_modification_time(item.fn));
+    item.size = base::file_size(item.fn);
+    items.push_back(item);
+    totalSize += item.size;
+  }
+
+  // Delete the least recently used thumbnails first
+  std::sort(items.begin(), items.end(),
+            [](const Item& a, const Item& b) {
+              return a.time < b.time;
+            });
+
+  int count = int(items.size());
+  for (const Item& item : items) {
+    if (count <= maxFiles && totalSize <= maxSize)
+      break;
+
+    try {
+      base::delete_file(item.fn);
+    }
+    catch (const std::exception& ex) {
+      LOG(ERROR) << "THUMB: Error deleting '" << item.fn << "': "
+                 << ex.what() << "\n";
+      continue;
+    }
+    --count;
+    totalSize -= item.size;
+  }
+}
+
+std::string ThumbnailCache::cacheFilename(const std::string& filename) const
+{
+  if (m_dir.empty())
+    return std::string();
+
+  char buf[32];
+  std::sprintf(buf, "%016llx.%s",
+               (unsigned long long)hash_string(filename),
+               kThumbnailExtension);
+  return base::join_path(m_dir, buf);
+}
+
+} // namespace app
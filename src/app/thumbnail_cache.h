@@ -0,0 +1,81 @@
+// Aseprite
+// Copyright (C) 2018  David Capello
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_THUMBNAIL_CACHE_H_INCLUDED
+#define APP_THUMBNAIL_CACHE_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+#include "base/time.h"
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <string>
+
+namespace doc {
+  class Image;
+}
+
+namespace app {
+
+  // Thumbnails of the file selector saved in the user folder
+  // ("thumbnails" directory), so they can be shown without loading
+  // the files again. Each thumbnail is associated to the file path,
+  // modification time and size of the original file. It's safe to
+  // use from several threads at the same time (for different files).
+  //
+  // The cache is limited in number of files and total size, the
+  // least recently used thumbnails are deleted when it's too big.
+  class ThumbnailCache {
+  public:
+    // Identifies one version of a file
+    struct FileStamp {
+      base::Time time;
+      size_t size;
+
+      static FileStamp fromFile(const std::string& filename);
+
+      bool operator==(const FileStamp& other) const {
+        return (time == other.time && size == other.size);
+      }
+    };
+
+    // Limits of the cache directory
+    static const int kMaxFiles = 4096;
+    static const std::size_t kMaxSize = 64*1024*1024;
+
+    // Uses the "thumbnails" directory of the user folder.
+    ThumbnailCache();
+    explicit ThumbnailCache(const std::string& dir);
+
+    // Returns the cached thumbnail for the given version of the file
+    // (or nullptr if there is no thumbnail for it).
+    doc::Image* load(const std::string& filename,
+                     const FileStamp& stamp) const;
+
+    void save(const std::string& filename,
+              const FileStamp& stamp,
+              const doc::Image* thumbnail) const;
+
+    // Deletes the least recently used thumbnails until there are at
+    // most "maxFiles" thumbnails using "maxSize" bytes. It's called
+    // automatically from save() from time to time.
+    void prune(const int maxFiles, const std::size_t maxSize) const;
+
+  private:
+    std::string cacheFilename(const std::string& filename) const;
+
+    std::string m_dir;
+    mutable std::mutex m_pruneMutex;
+    mutable std::atomic<int> m_saves;
+
+    DISABLE_COPYING(ThumbnailCache);
+  };
+
+} // namespace app
+
+#endif
@@ -0,0 +1,109 @@
+// Aseprite
+// Copyright (C) 2018  David Capello
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#include "tests/test.h"
+
+#include "app/thumbnail_cache.h"
+#include "base/fs.h"
+#include "doc/image.h"
+#include "doc/primitives.h"
+
+#include <memory>
+
+using namespace app;
+using namespace doc;
+
+static const char* kDir = "_thumbnail_cache_tests";
+
+static int count_thumbnails()
+{
+  int n = 0;
+  for (const auto& name : base::list_files(kDir))
+    if (base::get_file_extension(name) == "thumb")
+      ++n;
+  return n;
+}
+
+static void remove_thumbnails()
+{
+  for (const auto& name : base::list_files(kDir))
+    base::delete_file(base::join_path(kDir, name));
+}
+
+static ThumbnailCache::FileStamp make_stamp(int second, size_t size)
+{
+  ThumbnailCache::FileStamp stamp;
+  stamp.time.year = 2018;
+  stamp.time.month = 1;
+  stamp.time.day = 2;
+  stamp.time.hour = 10;
+  stamp.time.minute = 20;
+  stamp.time.second = second;
+  stamp.size = size;
+  return stamp;
+}
+
+class ThumbnailCacheTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    if (!base::is_directory(kDir))
+      base::make_directory(kDir);
+    remove_thumbnails();
+  }
+
+  void TearDown() override {
+    remove_thumbnails();
+    base::remove_directory(kDir);
+  }
+};
+
+TEST_F(ThumbnailCacheTest, HitAndMiss)
+{
+  ThumbnailCache cache(kDir);
+  const auto stamp = make_stamp(30, 1024);
+
+  EXPECT_EQ(nullptr, cache.load("a.png", stamp));
+
+  std::unique_ptr<Image> thumbnail(Image::create(IMAGE_RGB, 4, 2));
+  clear_image(thumbnail.get(), rgba(0, 0, 255, 255));
+  put_pixel(thumbnail.get(), 3, 1, rgba(255, 0, 0, 128));
+  cache.save("a.png", stamp, thumbnail.get());
+  EXPECT_EQ(1, count_thumbnails());
+
+  std::unique_ptr<Image> image(cache.load("a.png", stamp));
+  ASSERT_TRUE(image != nullptr);
+  EXPECT_EQ(IMAGE_RGB, image->pixelFormat());
+  EXPECT_EQ(0, count_diff_between_images(thumbnail.get(), image.get()));
+
+  // The original file was modified
+  EXPECT_EQ(nullptr, cache.load("a.png", make_stamp(31, 1024)));
+  EXPECT_EQ(nullptr, cache.load("a.png", make_stamp(30, 1025)));
+
+  // Other file
+  EXPECT_EQ(nullptr, cache.load("b.png", stamp));
+}
+
+TEST_F(ThumbnailCacheTest, Prune)
+{
+  ThumbnailCache cache(kDir);
+  const auto stamp = make_stamp(0, 1);
+
+  std::unique_ptr<Image> thumbnail(Image::create(IMAGE_RGB, 8, 8));
+  clear_image(thumbnail.get(), rgba(0, 255, 0, 255));
+  cache.save("a.png", stamp, thumbnail.get());
+  cache.save("b.png", stamp, thumbnail.get());
+  cache.save("c.png", stamp, thumbnail.get());
+  EXPECT_EQ(3, count_thumbnails());
+
+  cache.prune(ThumbnailCache::kMaxFiles, ThumbnailCache::kMaxSize);
+  EXPECT_EQ(3, count_thumbnails());
+
+  cache.prune(2, ThumbnailCache::kMaxSize);
+  EXPECT_EQ(2, count_thumbnails());
+
+  cache.prune(ThumbnailCache::kMaxFiles, 1);
+  EXPECT_EQ(0, count_thumbnails());
+}
@@ -12,24 +12,36 @@
 
 #include "app/app.h"
 #include "app/doc.h"
+#include "app/file/ase_format.h"
 #include "app/file/file.h"
 #include "app/file_system.h"
+#include "app/thumbnail_cache.h"
 #include "app/ui/editor/editor_render.h"
 #include "base/bind.h"
-#include "base/scoped_lock.h"
+#include "base/fs.h"
+#include "base/string.h"
 #include "base/thread.h"
 #include "doc/algorithm/rotate.h"
 #include "doc/conversion_she.h"
 #include "doc/image.h"
-#include "doc/palette.h"
 #include "doc/primitives.h"
 #include "doc/sprite.h"
 #include "she/system.h"
 
+#include <algorithm>
 #include <memory>
+#include <thread>
 
 #define MAX_THUMBNAIL_SIZE              128
 
+// Maximum number of threads generating thumbnails at the same time
+#define MAX_WORKER_THREADS              4
+
+// Maximum number of thumbnails waiting to be generated. The oldest
+// requests are discarded (they are for items that the user has
+// already left behind).
+#define MAX_QUEUED_WORKERS              32
+
 namespace app {
 
 class ThumbnailGenerator::Worker {
@@ -37,78 +49,52 @@ public:
   Worker(FileOp* fop, IFileItem* fileitem)
     : m_fop(fop)
     , m_fileitem(fileitem)
-    , m_thumbnail(nullptr)
-    , m_palette(nullptr)
-    , m_thread(base::Bind<void>(&Worker::loadBgThread, this)) {
-  }
-
-  ~Worker() {
-    m_fop->stop();
-    m_thread.join();
+    , m_finished(false) {
   }
 
   IFileItem* getFileItem() { return m_fileitem; }
   bool isDone() const { return m_fop->isDone(); }
+
+  // True when the thread of the pool that generated the thumbnail
+  // doesn't use this worker anymore (it's like a joined thread, the
+  // worker can be deleted). Accessed with the generator mutex locked.
+  bool isFinished() const { return m_finished; }
+  void setFinished() { m_finished = true; }
   double getProgress() const { return m_fop->progress(); }
+  void stop() { m_fop->stop(); }
 
-private:
-  void loadBgThread() {
+  // Called from a thread of the ThumbnailGenerator pool
+  void generateThumbnail(const ThumbnailCache* cache) {
     try {
-      m_fop->operate(nullptr);
-
-      // Post load
-      m_fop->postLoad();
-
-      // Convert the loaded document into the she::Surface.
-      const Sprite* sprite =
-        (m_fop->document() &&
-         m_fop->document()->sprite() ?
-         m_fop->document()->sprite(): nullptr);
-
-      if (!m_fop->isStop() && sprite) {
-        // The palette to convert the Image
-        m_palette.reset(new Palette(*sprite->palette(frame_t(0))));
-
-        // Render first frame of the sprite in 'image'
-        std::unique_ptr<Image> image(Image::create(
-            IMAGE_RGB, sprite->width(), sprite->height()));
-
-        EditorRender render;
-        render.setupBackground(NULL, image->pixelFormat());
-        render.renderSprite(image.get(), sprite, frame_t(0));
-
-        // Calculate the thumbnail size
-        int thumb_w = MAX_THUMBNAIL_SIZE * image->width() / MAX(image->width(), image->height());
-        int thumb_h = MAX_THUMBNAIL_SIZE * image->height() / MAX(image->width(), image->height());
-        if (MAX(thumb_w, thumb_h) > MAX(image->width(), image->height())) {
-          thumb_w = image->width();
-          thumb_h = image->height();
-        }
-        thumb_w = MID(1, thumb_w, MAX_THUMBNAIL_SIZE);
-        thumb_h = MID(1, thumb_h, MAX_THUMBNAIL_SIZE);
-
-        // Stretch the 'image'
-        m_thumbnail.reset(Image::create(image->pixelFormat(), thumb_w, thumb_h));
-        clear_image(m_thumbnail.get(), 0);
-        algorithm::scale_image(m_thumbnail.get(), image.get(),
-                               0, 0, thumb_w, thumb_h,
-                               0, 0, image->width(), image->height());
-      }
+      const std::string& filename = m_fileitem->fileName();
+      const auto stamp = ThumbnailCache::FileStamp::fromFile(filename);
+
+      // Thumbnail from a previous session
+      std::unique_ptr<Image> thumbnail(cache->load(filename, stamp));
+      const bool fromCache = (thumbnail != nullptr);
 
-      // Close file
-      delete m_fop->releaseDocument();
+      // Thumbnail saved in the .aseprite file
+      if (!thumbnail && isAsepriteFile(filename))
+        thumbnail.reset(loadAsepriteThumbnail(filename));
 
-      // Set the thumbnail of the file-item.
-      if (m_thumbnail) {
-        she::Surface* thumbnail = she::instance()->createRgbaSurface(
-          m_thumbnail->width(),
-          m_thumbnail->height());
+      // Load and render the first frame of the file
+      if (!thumbnail)
+        thumbnail.reset(loadFirstFrame());
+
+      if (thumbnail) {
+        if (!fromCache)
+          cache->save(filename, stamp, thumbnail.get());
+
+        // Set the thumbnail of the file-item.
+        she::Surface* surface = she::instance()->createRgbaSurface(
+          thumbnail->width(),
+          thumbnail->height());
 
         convert_image_to_surface(
-          m_thumbnail.get(), m_palette.get(), thumbnail,
-          0, 0, 0, 0, m_thumbnail->width(), m_thumbnail->height());
+          thumbnail.get(), nullptr, surface,
+          0, 0, 0, 0, thumbnail->width(), thumbnail->height());
 
-        m_fileitem->setThumbnail(thumbnail);
+        m_fileitem->setThumbnail(surface);
       }
     }
     catch (const std::exception& e) {
@@ -117,11 +103,85 @@ private:
     m_fop->done();
   }
 
+private:
+  static bool isAsepriteFile(const std::string& filename) {
+    const std::string ext =
+      base::string_to_lower(base::get_file_extension(filename));
+    return (ext == "ase" || ext == "aseprite");
+  }
+
+  Image* loadAsepriteThumbnail(const std::string& filename) {
+    std::unique_ptr<Image> image(load_ase_thumbnail(filename));
+    if (!image)
+      return nullptr;
+
+    // Draw the thumbnail (which can have transparent pixels) over the
+    // checked background
+    std::unique_ptr<Image> bg(
+      Image::create(IMAGE_RGB, image->width(), image->height()));
+
+    EditorRender render;
+    render.setupBackground(NULL, bg->pixelFormat());
+    render.renderBackground(
+      bg.get(), gfx::Clip(0, 0, 0, 0, bg->width(), bg->height()));
+    render.renderImage(bg.get(), image.get(), nullptr,
+                       0, 0, 255, BlendMode::NORMAL);
+
+    return createThumbnail(bg.get());
+  }
+
+  Image* loadFirstFrame() {
+    m_fop->operate(nullptr);
+
+    // Post load
+    m_fop->postLoad();
+
+    const Sprite* sprite =
+      (m_fop->document() &&
+       m_fop->document()->sprite() ?
+       m_fop->document()->sprite(): nullptr);
+
+    Image* thumbnail = nullptr;
+    if (!m_fop->isStop() && sprite) {
+      // Render first frame of the sprite in 'image'
+      std::unique_ptr<Image> image(Image::create(
+          IMAGE_RGB, sprite->width(), sprite->height()));
+
+      EditorRender render;
+      render.setupBackground(NULL, image->pixelFormat());
+      render.renderSprite(image.get(), sprite, frame_t(0));
+
+      thumbnail = createThumbnail(image.get());
+    }
+
+    // Close file
+    delete m_fop->releaseDocument();
+    return thumbnail;
+  }
+
+  static Image* createThumbnail(const Image* image) {
+    // Calculate the thumbnail size
+    int thumb_w = MAX_THUMBNAIL_SIZE * image->width() / MAX(image->width(), image->height());
+    int thumb_h = MAX_THUMBNAIL_SIZE * image->height() / MAX(image->width(), image->height());
+    if (MAX(thumb_w, thumb_h) > MAX(image->width(), image->height())) {
+      thumb_w = image->width();
+      thumb_h = image->height();
+    }
+    thumb_w = MID(1, thumb_w, MAX_THUMBNAIL_SIZE);
+    thumb_h = MID(1, thumb_h, MAX_THUMBNAIL_SIZE);
+
+    // Stretch the 'image'
+    Image* thumbnail = Image::create(image->pixelFormat(), thumb_w, thumb_h);
+    clear_image(thumbnail, 0);
+    algorithm::scale_image(thumbnail, image,
+                           0, 0, thumb_w, thumb_h,
+                           0, 0, image->width(), image->height());
+    return thumbnail;
+  }
+
   std::unique_ptr<FileOp> m_fop;
   IFileItem* m_fileitem;
-  std::unique_ptr<Image> m_thumbnail;
-  std::unique_ptr<Palette> m_palette;
-  base::thread m_thread;
+  bool m_finished;
 };
 
 static void delete_singleton(ThumbnailGenerator* singleton)
@@ -139,13 +199,38 @@ ThumbnailGenerator* ThumbnailGenerator::instance()
   return singleton;
 }
 
+ThumbnailGenerator::ThumbnailGenerator()
+  : m_cache(new ThumbnailCache)
+  , m_exit(false)
+{
+}
+
+ThumbnailGenerator::~ThumbnailGenerator()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_exit = true;
+    for (Worker* worker : m_workers)
+      worker->stop();
+    for (Worker* worker : m_stoppedWorkers)
+      worker->stop();
+  }
+  m_cv.notify_all();
+
+  for (auto& thread : m_threads)
+    thread->join();
+
+  for (Worker* worker : m_workers)
+    delete worker;
+  for (Worker* worker : m_stoppedWorkers)
+    delete worker;
+}
+
 ThumbnailGenerator::WorkerStatus ThumbnailGenerator::getWorkerStatus(IFileItem* fileitem, double& progress)
 {
-  base::scoped_lock hold(m_workersAccess);
+  std::lock_guard<std::mutex> lock(m_mutex);
 
-  for (WorkerList::iterator
-         it=m_workers.begin(), end=m_workers.end(); it!=end; ++it) {
-    Worker* worker = *it;
+  for (Worker* worker : m_workers) {
     if (worker->getFileItem() == fileitem) {
       if (worker->isDone())
         return ThumbnailIsDone;
@@ -160,17 +245,21 @@ ThumbnailGenerator::WorkerStatus ThumbnailGenerator::getWorkerStatus(IFileItem*
 
 bool ThumbnailGenerator::checkWorkers()
 {
-  base::scoped_lock hold(m_workersAccess);
+  std::lock_guard<std::mutex> lock(m_mutex);
   bool doingWork = !m_workers.empty();
 
-  for (WorkerList::iterator
-         it=m_workers.begin(); it != m_workers.end(); ) {
-    if ((*it)->isDone()) {
-      delete *it;
-      it = m_workers.erase(it);
-    }
-    else {
-      ++it;
+  for (WorkerList* list : { &m_workers, &m_stoppedWorkers }) {
+    for (auto it=list->begin(); it != list->end(); ) {
+      // The worker is done when the FileOp is marked as done, but
+      // we have to wait its thread to leave generateThumbnail()
+      // before deleting it.
+      if ((*it)->isFinished()) {
+        delete *it;
+        it = list->erase(it);
+      }
+      else {
+        ++it;
+      }
     }
   }
 
@@ -198,34 +287,74 @@ void ThumbnailGenerator::addWorkerToGenerateThumbnail(IFileItem* fileitem)
   if (fop->hasError())
     return;
 
-  Worker* worker = new Worker(fop.release(), fileitem);
-  try {
-    base::scoped_lock hold(m_workersAccess);
-    m_workers.push_back(worker);
-  }
-  catch (...) {
-    delete worker;
-    throw;
+  std::unique_ptr<Worker> worker(new Worker(fop.release(), fileitem));
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Discard the oldest request if there are too many
+    if (m_queue.size() >= MAX_QUEUED_WORKERS) {
+      Worker* oldest = m_queue.back();
+      m_queue.pop_back();
+      m_workers.erase(std::find(m_workers.begin(), m_workers.end(), oldest));
+      delete oldest;
+    }
+
+    m_workers.push_back(worker.get());
+    m_queue.push_front(worker.release());
+
+    // Start a new thread if all threads are busy
+    const int maxThreads =
+      MID(1, int(std::thread::hardware_concurrency())/2, MAX_WORKER_THREADS);
+    if (int(m_threads.size()) < maxThreads &&
+        int(m_workers.size()) > int(m_threads.size())) {
+      m_threads.push_back(
+        std::unique_ptr<base::thread>(
+          new base::thread(base::Bind<void>(&ThumbnailGenerator::workerThread, this))));
+    }
   }
+  m_cv.notify_one();
 }
 
 void ThumbnailGenerator::stopAllWorkers()
 {
-  base::thread* ptr = new base::thread(base::Bind<void>(&ThumbnailGenerator::stopAllWorkersBackground, this));
-  m_stopThread.reset(ptr);
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  // Workers that were not started can be deleted right now
+  for (Worker* worker : m_queue) {
+    m_workers.erase(std::find(m_workers.begin(), m_workers.end(), worker));
+    delete worker;
+  }
+  m_queue.clear();
+
+  // The rest of workers are stopped and deleted when they finish
+  for (Worker* worker : m_workers) {
+    worker->stop();
+    m_stoppedWorkers.push_back(worker);
+  }
+  m_workers.clear();
 }
 
-void ThumbnailGenerator::stopAllWorkersBackground()
+void ThumbnailGenerator::workerThread()
 {
-  WorkerList workersCopy;
-  {
-    base::scoped_lock hold(m_workersAccess);
-    workersCopy = m_workers;
-    m_workers.clear();
-  }
+  while (true) {
+    Worker* worker;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_cv.wait(lock, [this]{ return m_exit || !m_queue.empty(); });
+      if (m_exit)
+        return;
+
+      worker = m_queue.front();
+      m_queue.pop_front();
+    }
 
-  for (auto it=workersCopy.begin(), end=workersCopy.end(); it!=end; ++it)
-    delete *it;
+    // The worker cannot be deleted until it's finished
+    worker->generateThumbnail(m_cache.get());
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      worker->setFinished();
+    }
+  }
 }
 
 } // namespace app
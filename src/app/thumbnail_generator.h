@@ -8,9 +8,10 @@
 #define APP_THUMBNAIL_GENERATOR_H_INCLUDED
 #pragma once
 
-#include "base/mutex.h"
-
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
 #include <vector>
 
 namespace base {
@@ -19,15 +20,20 @@ namespace base {
 
 namespace app {
   class IFileItem;
+  class ThumbnailCache;
 
   class ThumbnailGenerator {
   public:
     enum WorkerStatus { WithoutWorker, WorkingOnThumbnail, ThumbnailIsDone };
 
+    ThumbnailGenerator();
+    ~ThumbnailGenerator();
+
     static ThumbnailGenerator* instance();
 
     // Generate a thumbnail for the given file-item.  It must be called
-    // from the GUI thread.
+    // from the GUI thread. The last requested thumbnails are
+    // generated first (as they are the visible ones).
     void addWorkerToGenerateThumbnail(IFileItem* fileitem);
 
     // Returns the status of the worker that is generating the thumbnail
@@ -36,24 +42,36 @@ namespace app {
 
     // Checks the status of workers. If there are workers that already
     // done its job, we've to destroy them. This function must be called
-    // from the GUI thread (because a thread is joint to it).
+    // from the GUI thread.
     // Returns true if there are workers generating thumbnails.
     bool checkWorkers();
 
     // Stops all workers generating thumbnails. This is an non-blocking
-    // operation. The cancelation of all workers is done in a background
-    // thread.
+    // operation, workers that are loading a file are stopped and
+    // destroyed later in checkWorkers().
     void stopAllWorkers();
 
   private:
-    void stopAllWorkersBackground();
+    void workerThread();
 
     class Worker;
     typedef std::vector<Worker*> WorkerList;
 
+    // Workers waiting or generating a thumbnail
     WorkerList m_workers;
-    base::mutex m_workersAccess;
-    std::unique_ptr<base::thread> m_stopThread;
+
+    // Workers waiting for a free thread (the first one is the next
+    // one to be processed)
+    std::deque<Worker*> m_queue;
+
+    // Stopped workers that are still running
+    WorkerList m_stoppedWorkers;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::vector<std::unique_ptr<base::thread> > m_threads;
+    std::unique_ptr<ThumbnailCache> m_cache;
+    bool m_exit;
   };
 } // namespace app
 
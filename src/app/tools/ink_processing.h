@@ -7,10 +7,12 @@
 #include "app/modules/palettes.h"
 #include "app/util/wrap_point.h"
 #include "app/util/wrap_value.h"
+#include "doc/bitmap_ops.h"
 #include "doc/blend_funcs.h"
 #include "doc/image_impl.h"
 #include "doc/layer.h"
 #include "doc/palette.h"
+#include "doc/primitives.h"
 #include "doc/remap.h"
 #include "doc/rgbmap.h"
 #include "doc/sprite.h"
@@ -44,8 +46,6 @@ template<typename Derived>
 class InkProcessing : public BaseInkProcessing {
 public:
   void processScanline(int x1, int y, int x2, ToolLoop* loop) override {
-    int x;
-
     // Use mask
     if (loop->useMask()) {
       Point maskOrigin(loop->getMaskOrigin());
@@ -61,20 +61,26 @@ public:
         x2 = maskOrigin.x+maskBounds.w-1;
 
       if (Image* bitmap = loop->getMask()->bitmap()) {
-        static_cast<Derived*>(this)->initIterators(loop, x1, y);
-
-        for (x=x1; x<=x2; ++x) {
-          if (bitmap->getPixel(x-maskOrigin.x, y-maskOrigin.y))
-            static_cast<Derived*>(this)->processPixel(x, y);
-
-          static_cast<Derived*>(this)->moveIterators();
-        }
+        // Process the runs of pixels inside the mask only
+        for_each_bitmap_span(
+          bitmap, x1-maskOrigin.x, y-maskOrigin.y, x2-maskOrigin.x,
+          [this, loop, &maskOrigin, y](int u1, int u2) {
+            static_cast<Derived*>(this)->processSpan(
+              loop, u1+maskOrigin.x, y, u2+maskOrigin.x);
+          });
         return;
       }
     }
 
+    static_cast<Derived*>(this)->processSpan(loop, x1, y, x2);
+  }
+
+  // Processes the pixels from x1 to x2 (inclusive) of the scanline
+  // "y". Inks can hide this member function to process the whole
+  // span at once (e.g. with a row kernel).
+  void processSpan(ToolLoop* loop, int x1, int y, int x2) {
     static_cast<Derived*>(this)->initIterators(loop, x1, y);
-    for (x=x1; x<=x2; ++x) {
+    for (int x=x1; x<=x2; ++x) {
       static_cast<Derived*>(this)->processPixel(x, y);
       static_cast<Derived*>(this)->moveIterators();
     }
@@ -136,6 +142,10 @@ public:
     *SimpleInkProcessing<CopyInkProcessing<ImageTraits>, ImageTraits>::m_dstAddress = m_color;
   }
 
+  void processSpan(ToolLoop* loop, int x1, int y, int x2) {
+    fill_rect(loop->getDstImage(), gfx::Rect(x1, y, x2-x1+1, 1), m_color);
+  }
+
 private:
   color_t m_color;
 };
@@ -147,6 +157,8 @@ private:
 template<typename ImageTraits>
 class LockAlphaInkProcessing : public DoubleInkProcessing<LockAlphaInkProcessing<ImageTraits>, ImageTraits> {
 public:
+  typedef DoubleInkProcessing<LockAlphaInkProcessing<ImageTraits>, ImageTraits> base;
+
   LockAlphaInkProcessing(ToolLoop* loop)
     : m_color(loop->getPrimaryColor())
     , m_opacity(loop->getOpacity()) {
@@ -156,6 +168,11 @@ public:
     // Do nothing
   }
 
+  void processSpan(ToolLoop* loop, int x1, int y, int x2) {
+    // Pixel by pixel (it's specialized for RGB images)
+    base::processSpan(loop, x1, y, x2);
+  }
+
 private:
   const color_t m_color;
   const int m_opacity;
@@ -171,6 +188,14 @@ void LockAlphaInkProcessing<RgbTraits>::processPixel(int x, int y) {
     rgba_geta(*m_srcAddress));
 }
 
+template<>
+void LockAlphaInkProcessing<RgbTraits>::processSpan(ToolLoop* loop, int x1, int y, int x2) {
+  if (x1 <= x2) {
+    initIterators(loop, x1, y);
+    rgba_blender_lock_alpha_row(m_dstAddress, m_srcAddress, x2-x1+1, m_color, m_opacity);
+  }
+}
+
 template<>
 void LockAlphaInkProcessing<GrayscaleTraits>::processPixel(int x, int y) {
   color_t result = graya_blender_normal(*m_srcAddress, m_color, m_opacity);
@@ -221,6 +246,8 @@ private:
 template<typename ImageTraits>
 class TransparentInkProcessing : public DoubleInkProcessing<TransparentInkProcessing<ImageTraits>, ImageTraits> {
 public:
+  typedef DoubleInkProcessing<TransparentInkProcessing<ImageTraits>, ImageTraits> base;
+
   TransparentInkProcessing(ToolLoop* loop) {
     m_color = loop->getPrimaryColor();
     m_opacity = loop->getOpacity();
@@ -230,6 +257,11 @@ public:
     // Do nothing
   }
 
+  void processSpan(ToolLoop* loop, int x1, int y, int x2) {
+    // Pixel by pixel (it's specialized for RGB images)
+    base::processSpan(loop, x1, y, x2);
+  }
+
 private:
   color_t m_color;
   int m_opacity;
@@ -240,6 +272,14 @@ void TransparentInkProcessing<RgbTraits>::processPixel(int x, int y) {
   *m_dstAddress = rgba_blender_normal(*m_srcAddress, m_color, m_opacity);
 }
 
+template<>
+void TransparentInkProcessing<RgbTraits>::processSpan(ToolLoop* loop, int x1, int y, int x2) {
+  if (x1 <= x2) {
+    initIterators(loop, x1, y);
+    rgba_blender_normal_row(m_dstAddress, m_srcAddress, x2-x1+1, m_color, m_opacity);
+  }
+}
+
 template<>
 void TransparentInkProcessing<GrayscaleTraits>::processPixel(int x, int y) {
   *m_dstAddress = graya_blender_normal(*m_srcAddress, m_color, m_opacity);
@@ -285,6 +325,8 @@ private:
 template<typename ImageTraits>
 class MergeInkProcessing : public DoubleInkProcessing<MergeInkProcessing<ImageTraits>, ImageTraits> {
 public:
+  typedef DoubleInkProcessing<MergeInkProcessing<ImageTraits>, ImageTraits> base;
+
   MergeInkProcessing(ToolLoop* loop) {
     m_color = loop->getPrimaryColor();
     m_opacity = loop->getOpacity();
@@ -294,6 +336,11 @@ public:
     // Do nothing
   }
 
+  void processSpan(ToolLoop* loop, int x1, int y, int x2) {
+    // Pixel by pixel (it's specialized for RGB images)
+    base::processSpan(loop, x1, y, x2);
+  }
+
 private:
   color_t m_color;
   int m_opacity;
@@ -304,6 +351,14 @@ void MergeInkProcessing<RgbTraits>::processPixel(int x, int y) {
   *m_dstAddress = rgba_blender_merge(*m_srcAddress, m_color, m_opacity);
 }
 
+template<>
+void MergeInkProcessing<RgbTraits>::processSpan(ToolLoop* loop, int x1, int y, int x2) {
+  if (x1 <= x2) {
+    initIterators(loop, x1, y);
+    rgba_blender_merge_row(m_dstAddress, m_srcAddress, x2-x1+1, m_color, m_opacity);
+  }
+}
+
 template<>
 void MergeInkProcessing<GrayscaleTraits>::processPixel(int x, int y) {
   *m_dstAddress = graya_blender_merge(*m_srcAddress, m_color, m_opacity);
@@ -933,9 +988,9 @@ public:
   {
   }
 
-  void processScanline(int x1, int y, int x2, ToolLoop* loop) override {
+  void initIterators(ToolLoop* loop, int x1, int y) {
+    base::initIterators(loop, x1, y);
     m_tmpAddress = (RgbTraits::address_t)m_tmpImage->getPixelAddress(x1, y);
-    base::processScanline(x1, y, x2, loop);
   }
 
   void prepareForStrokes(ToolLoop* loop, Strokes& strokes) override {
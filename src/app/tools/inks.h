@@ -348,6 +348,7 @@ class SelectionInk : public BaseInk {
   bool m_modify_selection;
   Mask m_mask;
   Rect m_maxBounds;
+  Rect m_modifiedArea;
 
 public:
   SelectionInk()
@@ -377,6 +378,7 @@ public:
       }
 
       m_maxBounds |= gfx::Rect(x1, y, x2-x1+1, 1);
+      m_modifiedArea |= gfx::Rect(x1, y, x2-x1+1, 1);
     }
     else {
       BaseInk::inkHline(x1, y, x2, loop);
@@ -388,6 +390,7 @@ public:
 
     if (state) {
       m_maxBounds = loop->getMask()->bounds();
+      m_modifiedArea = Rect();
 
       m_mask.copyFrom(loop->getMask());
       m_mask.freeze();
@@ -400,7 +403,7 @@ public:
 
       m_mask.unfreeze();
 
-      loop->setMask(&m_mask);
+      loop->setMask(&m_mask, m_modifiedArea);
       loop->getDocument()->setTransformation(
         Transformation(RectF(m_mask.bounds())));
 
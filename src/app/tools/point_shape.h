@@ -27,6 +27,11 @@ namespace app {
       virtual void transformPoint(ToolLoop* loop, int x, int y) = 0;
       virtual void getModifiedArea(ToolLoop* loop, int x, int y, gfx::Rect& area) = 0;
 
+      // Called after the points of each tool loop step were
+      // transformed, so shapes that accumulate the scanlines of
+      // several points can paint them.
+      virtual void flushPointShape(ToolLoop* loop) { }
+
     protected:
       // Calls loop->getInk()->inkHline() function for each horizontal-scanline
       // that should be drawn (applying the "tiled" mode loop->getTiledMode())
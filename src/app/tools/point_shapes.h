@@ -5,6 +5,10 @@
 // the End-User License Agreement for Aseprite.
 
 #include "app/util/wrap_point.h"
+#include "base/base.h"
+
+#include <algorithm>
+#include <vector>
 
 namespace app {
 namespace tools {
@@ -33,18 +37,77 @@ public:
   }
 };
 
+// Scanlines painted by several brush stamps. Overlapping (or
+// adjacent) scanlines of the same row are merged before they are
+// painted, so each pixel is processed by the ink only one time.
+class ScanlineCoverage {
+public:
+  // Maximum number of scanlines to accumulate before painting them
+  // (e.g. filled shapes can stamp the brush in each pixel).
+  static const int kMaxScanlines = 64*1024;
+
+  bool isFull() const { return m_scanlines.size() >= kMaxScanlines; }
+
+  void add(int x1, int y, int x2) {
+    m_scanlines.push_back(Scanline{ y, x1, x2 });
+  }
+
+  void clear() {
+    m_scanlines.clear();
+  }
+
+  // Calls func(x1, y, x2) for each merged scanline and clears the
+  // accumulated scanlines.
+  template<typename Func>
+  void flush(Func func) {
+    if (m_scanlines.empty())
+      return;
+
+    std::sort(m_scanlines.begin(), m_scanlines.end());
+
+    Scanline cur = m_scanlines[0];
+    for (const auto& scanline : m_scanlines) {
+      if (scanline.y == cur.y && scanline.x1 <= cur.x2+1) {
+        cur.x2 = MAX(cur.x2, scanline.x2);
+      }
+      else {
+        func(cur.x1, cur.y, cur.x2);
+        cur = scanline;
+      }
+    }
+    func(cur.x1, cur.y, cur.x2);
+
+    m_scanlines.clear();
+  }
+
+private:
+  struct Scanline {
+    int y, x1, x2;
+    bool operator<(const Scanline& b) const {
+      return (y < b.y || (y == b.y && x1 < b.x1));
+    }
+  };
+  std::vector<Scanline> m_scanlines;
+};
+
 class BrushPointShape : public PointShape {
   Brush* m_brush;
-  base::SharedPtr<CompressedImage> m_compressedImage;
+  const CompressedImage* m_scanlines;
+  ScanlineCoverage m_coverage;
+  bool m_accumulate;
   bool m_firstPoint;
 
 public:
 
   void preparePointShape(ToolLoop* loop) override {
     m_brush = loop->getBrush();
-    m_compressedImage.reset(new CompressedImage(m_brush->image(),
-                                                m_brush->maskBitmap(),
-                                                false));
+    m_scanlines = &m_brush->scanlines();
+    m_coverage.clear();
+
+    // Image brushes can paint a different pattern in each stamp
+    // (prepareForPointShape() changes the pattern origin), so
+    // their stamps cannot be merged.
+    m_accumulate = (m_brush->type() != kImageBrushType);
     m_firstPoint = true;
   }
 
@@ -68,9 +131,19 @@ public:
 
     loop->getInk()->prepareForPointShape(loop, m_firstPoint, x, y);
 
-    for (auto scanline : *m_compressedImage) {
-      int u = x+scanline.x;
-      doInkHline(u, y+scanline.y, u+scanline.w-1, loop);
+    if (m_accumulate) {
+      for (auto scanline : *m_scanlines) {
+        int u = x+scanline.x;
+        m_coverage.add(u, y+scanline.y, u+scanline.w-1);
+      }
+      if (m_coverage.isFull())
+        flushPointShape(loop);
+    }
+    else {
+      for (auto scanline : *m_scanlines) {
+        int u = x+scanline.x;
+        doInkHline(u, y+scanline.y, u+scanline.w-1, loop);
+      }
     }
 
     m_firstPoint = false;
@@ -82,6 +155,13 @@ public:
     area.y += y;
   }
 
+  void flushPointShape(ToolLoop* loop) override {
+    m_coverage.flush(
+      [loop](int x1, int y, int x2) {
+        doInkHline(x1, y, x2, loop);
+      });
+  }
+
 };
 
 class FloodFillPointShape : public PointShape {
@@ -153,6 +233,10 @@ public:
     m_subPointShape.preparePointShape(loop);
   }
 
+  void flushPointShape(ToolLoop* loop) override {
+    m_subPointShape.flushPointShape(loop);
+  }
+
   void transformPoint(ToolLoop* loop, int x, int y) override {
     int spray_width = loop->getSprayWidth();
     int spray_speed = loop->getSpraySpeed();
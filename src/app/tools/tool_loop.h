@@ -123,7 +123,9 @@ namespace app {
 
       // Current mask to limit paint area
       virtual Mask* getMask() = 0;
-      virtual void setMask(Mask* newMask) = 0;
+      // The "modifiedArea" contains the pixels (in sprite
+      // coordinates) that are different from the current mask.
+      virtual void setMask(Mask* newMask, const gfx::Rect& modifiedArea) = 0;
 
       // Adds a new slice (only for slice ink)
       virtual void addSlice(doc::Slice* newSlice) = 0;
@@ -199,6 +199,8 @@ void ToolLoopManager::doLoopStep(bool last_step)
   else
     m_toolLoop->getIntertwine()->fillStroke(m_toolLoop, main_stroke);
 
+  m_toolLoop->getPointShape()->flushPointShape(m_toolLoop);
+
   if (m_toolLoop->getTracePolicy() == TracePolicy::Overlap) {
     // Copy destination to source (yes, destination to source). In
     // this way each new trace overlaps the previous one.
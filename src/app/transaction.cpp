@@ -15,6 +15,7 @@
 #include "app/doc.h"
 #include "app/doc_undo.h"
 #include "doc/sprite.h"
+#include "doc/trace_events.h"
 
 #define TX_TRACE(...)
 
@@ -70,6 +71,8 @@ void Transaction::commit()
 {
   ASSERT(m_cmds);
   TX_TRACE("TX: Commit <%s>\n", m_cmds->label().c_str());
+  TRACE_EVENT("transaction", m_cmds->label(),
+              m_ctx->activeDocument() ? m_ctx->activeDocument()->id(): NullId);
 
   m_cmds->commit();
   m_undo->add(m_cmds);
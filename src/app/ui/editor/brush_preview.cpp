@@ -253,6 +253,7 @@ void BrushPreview::show(const gfx::Point& screenPos)
           loop.get(),
           brushBounds.x-origBrushBounds.x,
           brushBounds.y-origBrushBounds.y);
+        loop->getPointShape()->flushPointShape(loop.get());
       }
     }
 
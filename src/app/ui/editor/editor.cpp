@@ -41,6 +41,7 @@
 #include "app/ui/editor/moving_pixels_state.h"
 #include "app/ui/editor/pixels_movement.h"
 #include "app/ui/editor/play_state.h"
+#include "app/ui/editor/playback_cache.h"
 #include "app/ui/editor/scrolling_state.h"
 #include "app/ui/editor/standby_state.h"
 #include "app/ui/editor/zooming_state.h"
@@ -148,6 +149,7 @@ Editor::Editor(Doc* document, EditorFlags flags)
   , m_secondaryButton(false)
   , m_aniSpeed(1.0)
   , m_isPlaying(false)
+  , m_playbackCache(nullptr)
   , m_showGuidesThisCel(nullptr)
   , m_tagFocusBand(-1)
 {
@@ -187,7 +189,7 @@ Editor::Editor(Doc* document, EditorFlags flags)
   m_tiledConn = m_docPref.tiled.AfterChange.connect(base::Bind<void>(&Editor::onTiledModeChange, this));
   m_gridConn = m_docPref.grid.AfterChange.connect(base::Bind<void>(&Editor::invalidate, this));
   m_pixelGridConn = m_docPref.pixelGrid.AfterChange.connect(base::Bind<void>(&Editor::invalidate, this));
-  m_bgConn = m_docPref.bg.AfterChange.connect(base::Bind<void>(&Editor::invalidate, this));
+  m_bgConn = m_docPref.bg.AfterChange.connect(base::Bind<void>(&Editor::onBgChange, this));
   m_onionskinConn = m_docPref.onionskin.AfterChange.connect(base::Bind<void>(&Editor::invalidate, this));
   m_symmetryModeConn = Preferences::instance().symmetryMode.enabled.AfterChange.connect(base::Bind<void>(&Editor::invalidateIfActive, this));
   m_showExtrasConn =
@@ -490,6 +492,33 @@ void Editor::updateEditor()
   View::getView(this)->updateView();
 }
 
+bool Editor::getOnionskinOptions(render::OnionskinOptions& opts) const
+{
+  if ((m_flags & kShowOnionskin) != kShowOnionskin ||
+      !m_docPref.onionskin.active())
+    return false;
+
+  opts.type(
+    (m_docPref.onionskin.type() == app::gen::OnionskinType::MERGE ?
+     render::OnionskinType::MERGE:
+     (m_docPref.onionskin.type() == app::gen::OnionskinType::RED_BLUE_TINT ?
+      render::OnionskinType::RED_BLUE_TINT:
+      render::OnionskinType::NONE)));
+
+  opts.position(m_docPref.onionskin.position());
+  opts.prevFrames(m_docPref.onionskin.prevFrames());
+  opts.nextFrames(m_docPref.onionskin.nextFrames());
+  opts.opacityBase(m_docPref.onionskin.opacityBase());
+  opts.opacityStep(m_docPref.onionskin.opacityStep());
+  opts.layer(m_docPref.onionskin.currentLayer() ? m_layer: nullptr);
+
+  FrameTag* tag = nullptr;
+  if (m_docPref.onionskin.loopTag())
+    tag = m_sprite->frameTags().innerTag(m_frame);
+  opts.loopTag(tag);
+  return true;
+}
+
 void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& spriteRectToDraw, int dx, int dy)
 {
   // Clip from sprite and apply zoom
@@ -585,56 +614,61 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& sprite
     rendered.reset(Image::create(IMAGE_RGB, rc2.w, rc2.h,
                                  m_renderEngine->getRenderImageBuffer()));
 
-    m_renderEngine->setRefLayersVisiblity(true);
-    m_renderEngine->setSelectedLayer(m_layer);
-    if (m_flags & Editor::kUseNonactiveLayersOpacityWhenEnabled)
-      m_renderEngine->setNonactiveLayersOpacity(Preferences::instance().experimental.nonactiveLayersOpacity());
-    else
-      m_renderEngine->setNonactiveLayersOpacity(255);
-    m_renderEngine->setProjection(
-      newEngine ? render::Projection(): m_proj);
-    m_renderEngine->setupBackground(m_document, rendered->pixelFormat());
-    m_renderEngine->disableOnionskin();
-
-    if ((m_flags & kShowOnionskin) == kShowOnionskin) {
-      if (m_docPref.onionskin.active()) {
-        OnionskinOptions opts(
-          (m_docPref.onionskin.type() == app::gen::OnionskinType::MERGE ?
-           render::OnionskinType::MERGE:
-           (m_docPref.onionskin.type() == app::gen::OnionskinType::RED_BLUE_TINT ?
-            render::OnionskinType::RED_BLUE_TINT:
-            render::OnionskinType::NONE)));
-
-        opts.position(m_docPref.onionskin.position());
-        opts.prevFrames(m_docPref.onionskin.prevFrames());
-        opts.nextFrames(m_docPref.onionskin.nextFrames());
-        opts.opacityBase(m_docPref.onionskin.opacityBase());
-        opts.opacityStep(m_docPref.onionskin.opacityStep());
-        opts.layer(m_docPref.onionskin.currentLayer() ? m_layer: nullptr);
-
-        FrameTag* tag = nullptr;
-        if (m_docPref.onionskin.loopTag())
-          tag = m_sprite->frameTags().innerTag(m_frame);
-        opts.loopTag(tag);
+    const int nonactiveLayersOpacity =
+      ((m_flags & Editor::kUseNonactiveLayersOpacityWhenEnabled) ?
+       Preferences::instance().experimental.nonactiveLayersOpacity(): 255);
 
-        m_renderEngine->setOnionskin(opts);
-      }
-    }
+    OnionskinOptions opts(render::OnionskinType::NONE);
+    const bool onionskin = getOnionskinOptions(opts);
 
     ExtraCelRef extraCel = m_document->extraCel();
-    if (extraCel && extraCel->type() != render::ExtraType::NONE) {
-      m_renderEngine->setExtraImage(
-        extraCel->type(),
-        extraCel->cel(),
-        extraCel->image(),
-        extraCel->blendMode(),
-        m_layer, m_frame);
+    const bool hasExtraCel =
+      (extraCel && extraCel->type() != render::ExtraType::NONE);
+
+    // Use the pre-rendered frame if we are playing the animation
+    ImageRef cached;
+    if (m_playbackCache && !hasExtraCel) {
+      PlaybackCache::Config config;
+      config.proj = (newEngine ? render::Projection(): m_proj);
+      config.selectedLayer = m_layer;
+      config.nonactiveLayersOpacity = nonactiveLayersOpacity;
+      config.onionskin = onionskin;
+      config.onionskinOpts = opts;
+      config.onionskinLoopTag = m_docPref.onionskin.loopTag();
+      m_playbackCache->setConfig(config);
+
+      cached = m_playbackCache->frameImage(m_frame);
+    }
+
+    if (cached) {
+      copy_image(rendered.get(), cached.get(), -rc2.x, -rc2.y);
     }
+    else {
+      m_renderEngine->setRefLayersVisiblity(true);
+      m_renderEngine->setSelectedLayer(m_layer);
+      m_renderEngine->setNonactiveLayersOpacity(nonactiveLayersOpacity);
+      m_renderEngine->setProjection(
+        newEngine ? render::Projection(): m_proj);
+      m_renderEngine->setupBackground(m_document, rendered->pixelFormat());
+      m_renderEngine->disableOnionskin();
+
+      if (onionskin)
+        m_renderEngine->setOnionskin(opts);
+
+      if (hasExtraCel) {
+        m_renderEngine->setExtraImage(
+          extraCel->type(),
+          extraCel->cel(),
+          extraCel->image(),
+          extraCel->blendMode(),
+          m_layer, m_frame);
+      }
 
-    m_renderEngine->renderSprite(
-      rendered.get(), m_sprite, m_frame, gfx::Clip(0, 0, rc2));
+      m_renderEngine->renderSprite(
+        rendered.get(), m_sprite, m_frame, gfx::Clip(0, 0, rc2));
 
-    m_renderEngine->removeExtraImage();
+      m_renderEngine->removeExtraImage();
+    }
   }
   catch (const std::exception& e) {
     Console::showException(e);
@@ -878,28 +912,35 @@ void Editor::drawMask(Graphics* g)
   pt.x = m_padding.x + m_proj.applyX(pt.x);
   pt.y = m_padding.y + m_proj.applyY(pt.y);
 
-  for (const auto& seg : *m_document->getMaskBoundaries()) {
-    CheckedDrawMode checked(g, m_antsOffset,
-                            gfx::rgba(0, 0, 0, 255),
-                            gfx::rgba(255, 255, 255, 255));
-    gfx::Rect bounds = m_proj.apply(seg.bounds());
+  // Only segments in the visible area (clip bounds) are drawn
+  const gfx::Rect visibleBounds =
+    m_proj.remove(gfx::Rect(g->getClipBounds()).offset(-pt)).enlarge(1);
 
-    if (m_proj.scaleX() >= 1.0) {
-      if (!seg.open() && seg.vertical())
-        --bounds.x;
-    }
+  CheckedDrawMode checked(g, m_antsOffset,
+                          gfx::rgba(0, 0, 0, 255),
+                          gfx::rgba(255, 255, 255, 255));
 
-    if (m_proj.scaleY() >= 1.0) {
-      if (!seg.open() && !seg.vertical())
-        --bounds.y;
-    }
+  m_document->getMaskBoundaries()->forEachSegment(
+    visibleBounds,
+    [this, g, &pt](const doc::MaskBoundaries::Segment& seg) {
+      gfx::Rect bounds = m_proj.apply(seg.bounds());
 
-    // The color doesn't matter, we are using CheckedDrawMode
-    if (seg.vertical())
-      g->drawVLine(gfx::rgba(0, 0, 0), pt.x+bounds.x, pt.y+bounds.y, bounds.h);
-    else
-      g->drawHLine(gfx::rgba(0, 0, 0), pt.x+bounds.x, pt.y+bounds.y, bounds.w);
-  }
+      if (m_proj.scaleX() >= 1.0) {
+        if (!seg.open() && seg.vertical())
+          --bounds.x;
+      }
+
+      if (m_proj.scaleY() >= 1.0) {
+        if (!seg.open() && !seg.vertical())
+          --bounds.y;
+      }
+
+      // The color doesn't matter, we are using CheckedDrawMode
+      if (seg.vertical())
+        g->drawVLine(gfx::rgba(0, 0, 0), pt.x+bounds.x, pt.y+bounds.y, bounds.h);
+      else
+        g->drawHLine(gfx::rgba(0, 0, 0), pt.x+bounds.x, pt.y+bounds.y, bounds.w);
+    });
 }
 
 void Editor::drawMaskSafe()
@@ -1921,6 +1962,15 @@ void Editor::onTiledModeChange()
   centerInSpritePoint(spritePos);
 }
 
+void Editor::onBgChange()
+{
+  // The playback cache has frames rendered with the old background
+  if (m_playbackCache)
+    m_playbackCache->invalidate();
+
+  invalidate();
+}
+
 void Editor::onShowExtrasChange()
 {
   invalidate();
@@ -2337,6 +2387,11 @@ bool Editor::isPlaying() const
   return m_isPlaying;
 }
 
+void Editor::setPlaybackCache(PlaybackCache* cache)
+{
+  m_playbackCache = cache;
+}
+
 void Editor::showAnimationSpeedMultiplierPopup(Option<bool>& playOnce,
                                                Option<bool>& playAll,
                                                const bool withStopBehaviorOptions)
@@ -26,6 +26,7 @@
 #include "filters/tiled_mode.h"
 #include "gfx/fwd.h"
 #include "obs/connection.h"
+#include "render/onionskin_options.h"
 #include "render/projection.h"
 #include "render/zoom.h"
 #include "ui/base.h"
@@ -53,6 +54,7 @@ namespace app {
   class EditorCustomizationDelegate;
   class EditorRender;
   class PixelsMovement;
+  class PlaybackCache;
   class Site;
 
   namespace tools {
@@ -242,6 +244,10 @@ namespace app {
     void stop();
     bool isPlaying() const;
 
+    // Used by PlayState to show pre-rendered frames during the
+    // playback (it can be nullptr to render each frame normally).
+    void setPlaybackCache(PlaybackCache* cache);
+
     // Shows a popup menu to change the editor animation speed.
     void showAnimationSpeedMultiplierPopup(Option<bool>& playOnce,
                                            Option<bool>& playAll,
@@ -282,6 +288,7 @@ namespace app {
     void onTiledModeBeforeChange();
     void onTiledModeChange();
     void onShowExtrasChange();
+    void onBgChange();
 
     // DocObserver impl
     void onExposeSpritePixels(DocEvent& ev) override;
@@ -328,6 +335,10 @@ namespace app {
     // routine.
     void drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& rc, int dx, int dy);
 
+    // Returns true if the onionskin is enabled in this editor, and
+    // fills "opts" with the current onionskin preferences.
+    bool getOnionskinOptions(render::OnionskinOptions& opts) const;
+
     gfx::Point calcExtraPadding(const render::Projection& proj);
 
     void invalidateIfActive();
@@ -396,6 +407,10 @@ namespace app {
     double m_aniSpeed;
     bool m_isPlaying;
 
+    // Pre-rendered frames for the animation playback (owned by the
+    // PlayState).
+    PlaybackCache* m_playbackCache;
+
     // The Cel that is above the mouse if the Ctrl (or Cmd) key is
     // pressed (move key).
     Cel* m_showGuidesThisCel;
@@ -10,13 +10,11 @@
 
 #include "app/ui/editor/moving_selection_state.h"
 
-#include "app/cmd/set_mask_position.h"
-#include "app/context_access.h"
-#include "app/transaction.h"
 #include "app/ui/editor/editor.h"
 #include "app/ui/skin/skin_theme.h"
 #include "app/ui/status_bar.h"
 #include "app/ui_context.h"
+#include "app/util/selection_edges_mover.h"
 #include "doc/mask.h"
 #include "ui/message.h"
 
@@ -26,7 +24,6 @@ using namespace ui;
 
 MovingSelectionState::MovingSelectionState(Editor* editor, MouseMessage* msg)
   : m_cursorStart(editor->screenToEditor(msg->position()))
-  , m_selOrigin(editor->document()->mask()->bounds().origin())
 {
   editor->captureMouse();
 }
@@ -38,29 +35,16 @@ MovingSelectionState::~MovingSelectionState()
 void MovingSelectionState::onEnterState(Editor* editor)
 {
   StandbyState::onEnterState(editor);
-  editor->document()->mask()->freeze();
+  m_mover.reset(new SelectionEdgesMover(UIContext::instance(),
+                                        editor->document()));
 }
 
 EditorState::LeaveAction MovingSelectionState::onLeaveState(Editor* editor, EditorState* newState)
 {
   Doc* doc = editor->document();
-  Mask* mask = doc->mask();
-  gfx::Point newOrigin = mask->bounds().origin();
-
-  // Restore the mask to the original state so we can transform it
-  // with the a undoable transaction.
-  mask->setOrigin(m_selOrigin.x,
-                  m_selOrigin.y);
-  mask->unfreeze();
-
-  {
-    ContextWriter writer(UIContext::instance(), 1000);
-    Transaction transaction(writer.context(), "Move Selection Edges", DoesntModifyDocument);
-    transaction.execute(new cmd::SetMaskPosition(doc, newOrigin));
-    transaction.commit();
-  }
-
-  doc->resetTransformation();
+  m_mover->commit();
+  m_mover.reset();
+
   doc->notifyGeneralUpdate();
   return StandbyState::onLeaveState(editor, newState);
 }
@@ -83,21 +67,8 @@ bool MovingSelectionState::onMouseMove(Editor* editor, MouseMessage* msg)
   const gfx::Point mousePos = editor->autoScroll(msg, AutoScroll::MouseDir);
   const gfx::Point newCursorPos = editor->screenToEditor(mousePos);
   m_delta = newCursorPos - m_cursorStart;
-  const gfx::Point newMaskOrigin = m_selOrigin + m_delta;
-  const gfx::Point oldMaskOrigin = editor->document()->mask()->bounds().origin();
-
-  if (oldMaskOrigin != newMaskOrigin) {
-    editor->document()->mask()->setOrigin(newMaskOrigin.x,
-                                          newMaskOrigin.y);
-
-    MaskBoundaries* boundaries =
-      const_cast<MaskBoundaries*>(editor->document()->getMaskBoundaries());
-    const gfx::Point boundariesDelta = newMaskOrigin - oldMaskOrigin;
-    boundaries->offset(boundariesDelta.x,
-                       boundariesDelta.y);
-
+  if (m_mover->moveTo(m_mover->origin() + m_delta))
     editor->invalidate();
-  }
 
   // Use StandbyState implementation
   return StandbyState::onMouseMove(editor, msg);
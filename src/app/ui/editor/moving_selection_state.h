@@ -10,7 +10,11 @@
 
 #include "app/ui/editor/standby_state.h"
 
+#include <memory>
+
 namespace app {
+  class SelectionEdgesMover;
+
   class MovingSelectionState : public StandbyState {
   public:
     MovingSelectionState(Editor* editor, ui::MouseMessage* msg);
@@ -28,8 +32,8 @@ namespace app {
 
   private:
     gfx::Point m_cursorStart;
-    gfx::Point m_selOrigin;
     gfx::Point m_delta;
+    std::unique_ptr<SelectionEdgesMover> m_mover;
   };
 
 } // namespace app
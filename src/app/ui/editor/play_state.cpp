@@ -17,6 +17,7 @@
 #include "app/tools/ink.h"
 #include "app/ui/editor/editor.h"
 #include "app/ui/editor/editor_customization_delegate.h"
+#include "app/ui/editor/playback_cache.h"
 #include "app/ui/editor/scrolling_state.h"
 #include "app/ui/skin/skin_theme.h"
 #include "app/ui_context.h"
@@ -26,10 +27,15 @@
 #include "ui/message.h"
 #include "ui/system.h"
 
+#include <algorithm>
+
 namespace app {
 
 using namespace ui;
 
+// Maximum number of frames that are rendered ahead
+static const int kUpcomingFrames = 32;
+
 PlayState::PlayState(const bool playOnce,
                      const bool playAll)
   : m_editor(nullptr)
@@ -50,6 +56,12 @@ PlayState::PlayState(const bool playOnce,
     &PlayState::onBeforeCommandExecution, this);
 }
 
+PlayState::~PlayState()
+{
+  if (m_editor && m_playbackCache)
+    m_editor->setPlaybackCache(nullptr);
+}
+
 void PlayState::onEnterState(Editor* editor)
 {
   StateWithWheelBehavior::onEnterState(editor);
@@ -84,6 +96,12 @@ void PlayState::onEnterState(Editor* editor)
   m_curFrameTick = base::current_tick();
   m_pingPongForward = true;
 
+  if (!m_playbackCache) {
+    m_playbackCache.reset(new PlaybackCache(m_editor->document()));
+    m_editor->setPlaybackCache(m_playbackCache.get());
+  }
+  updateUpcomingFrames();
+
   // Maybe we came from ScrollingState and the timer is already
   // running.
   if (!m_playTimer.isRunning())
@@ -97,6 +115,9 @@ EditorState::LeaveAction PlayState::onLeaveState(Editor* editor, EditorState* ne
   if (!m_toScroll) {
     m_playTimer.stop();
 
+    m_editor->setPlaybackCache(nullptr);
+    m_playbackCache.reset();
+
     if (m_playOnce || Preferences::instance().general.rewindOnStop())
       m_editor->setFrame(m_refFrame);
   }
@@ -214,6 +235,7 @@ void PlayState::onPlaybackTick()
     m_nextFrameTime += getNextFrameTime();
   }
 
+  updateUpcomingFrames();
   m_curFrameTick = base::current_tick();
 }
 
@@ -254,4 +276,31 @@ double PlayState::getNextFrameTime()
     / m_editor->getAnimationSpeedMultiplier(); // The "speed multiplier" is a "duration divider"
 }
 
+void PlayState::updateUpcomingFrames()
+{
+  if (!m_playbackCache)
+    return;
+
+  doc::Sprite* sprite = m_editor->sprite();
+  doc::frame_t frame = m_editor->frame();
+  bool pingPongForward = m_pingPongForward;
+  const int n = std::min(kUpcomingFrames, int(sprite->totalFrames()));
+
+  std::vector<doc::frame_t> frames;
+  frames.reserve(n);
+  frames.push_back(frame);
+  for (int i=0; i<2*n && int(frames.size()) < n; ++i) {
+    frame = calculate_next_frame(
+      sprite, frame, frame_t(1), m_tag,
+      pingPongForward);
+
+    // Ping-pong/tag loops repeat frames, we don't need to render them
+    // twice
+    if (std::find(frames.begin(), frames.end(), frame) == frames.end())
+      frames.push_back(frame);
+  }
+
+  m_playbackCache->setUpcomingFrames(frames);
+}
+
 } // namespace app
@@ -14,6 +14,8 @@
 #include "obs/connection.h"
 #include "ui/timer.h"
 
+#include <memory>
+
 namespace doc {
   class FrameTag;
 }
@@ -21,11 +23,13 @@ namespace doc {
 namespace app {
 
   class CommandExecutionEvent;
+  class PlaybackCache;
 
   class PlayState : public StateWithWheelBehavior {
   public:
     PlayState(const bool playOnce,
               const bool playAll);
+    ~PlayState();
 
     void onEnterState(Editor* editor) override;
     LeaveAction onLeaveState(Editor* editor, EditorState* newState) override;
@@ -44,6 +48,9 @@ namespace app {
 
     double getNextFrameTime();
 
+    // Tells to the playback cache which frames will be shown next
+    void updateUpcomingFrames();
+
     Editor* m_editor;
     bool m_playOnce;
     bool m_playAll;
@@ -59,6 +66,9 @@ namespace app {
     doc::frame_t m_refFrame;
     doc::FrameTag* m_tag;
 
+    // Frames pre-rendered in a background thread
+    std::unique_ptr<PlaybackCache> m_playbackCache;
+
     obs::scoped_connection m_ctxConn;
   };
 
@@ -0,0 +1,325 @@
+// Aseprite
+// Copyright (C) 2018  David Capello
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/ui/editor/playback_cache.h"
+
+#include "app/doc.h"
+#include "app/doc_access.h"
+#include "app/ui/editor/editor_render.h"
+#include "doc/frame_tag.h"
+#include "doc/frame_tags.h"
+#include "doc/image.h"
+#include "doc/layer.h"
+#include "doc/palette.h"
+#include "doc/sprite.h"
+#include "gfx/clip.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace app {
+
+// Maximum number of frames and memory used to store rendered frames
+static const int kMaxFrames = 32;
+static const std::size_t kMaxMemSize = 256*1024*1024;
+
+// Milliseconds to wait for the document read lock before trying again
+static const int kLockTimeout = 50;
+
+bool PlaybackCache::Config::operator==(const Config& other) const
+{
+  return (proj.zoom() == other.proj.zoom() &&
+          proj.pixelRatio() == other.proj.pixelRatio() &&
+          selectedLayer == other.selectedLayer &&
+          nonactiveLayersOpacity == other.nonactiveLayersOpacity &&
+          onionskin == other.onionskin &&
+          (!onionskin ||
+           (onionskinOpts.type() == other.onionskinOpts.type() &&
+            onionskinOpts.position() == other.onionskinOpts.position() &&
+            onionskinOpts.prevFrames() == other.onionskinOpts.prevFrames() &&
+            onionskinOpts.nextFrames() == other.onionskinOpts.nextFrames() &&
+            onionskinOpts.opacityBase() == other.onionskinOpts.opacityBase() &&
+            onionskinOpts.opacityStep() == other.onionskinOpts.opacityStep() &&
+            onionskinOpts.layer() == other.onionskinOpts.layer() &&
+            onionskinLoopTag == other.onionskinLoopTag)));
+}
+
+PlaybackCache::Key::Key()
+  : palette(doc::NullId)
+  , paletteVersion(0)
+  , paletteModifications(0)
+{
+}
+
+PlaybackCache::Key::Key(const doc::Sprite* sprite, doc::frame_t frame)
+{
+  const doc::Palette* pal = sprite->palette(frame);
+  palette = pal->id();
+  paletteVersion = pal->version();
+  paletteModifications = pal->getModifications();
+
+  for (const doc::Layer* layer : sprite->allVisibleLayers())
+    visibleLayers.push_back(layer->id());
+}
+
+bool PlaybackCache::Key::operator==(const Key& other) const
+{
+  return (palette == other.palette &&
+          paletteVersion == other.paletteVersion &&
+          paletteModifications == other.paletteModifications &&
+          visibleLayers == other.visibleLayers);
+}
+
+PlaybackCache::PlaybackCache(Doc* doc)
+  : m_doc(doc)
+  , m_validConfig(false)
+  , m_capacity(0)
+  , m_generation(0)
+  , m_killing(false)
+{
+  m_doc->add_observer(this);
+  m_renderingThread = std::thread([this]{ renderingProc(); });
+}
+
+PlaybackCache::~PlaybackCache()
+{
+  m_doc->remove_observer(this);
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_killing = true;
+    m_renderCV.notify_one();
+  }
+  m_renderingThread.join();
+}
+
+void PlaybackCache::setConfig(const Config& config)
+{
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_validConfig && m_config == config)
+      return;
+  }
+
+  // The render engine is configured here (in the UI thread) because
+  // the background options are read from the preferences.
+  std::shared_ptr<EditorRender> render(new EditorRender);
+  render->setRefLayersVisiblity(true);
+  render->setSelectedLayer(config.selectedLayer);
+  render->setNonactiveLayersOpacity(config.nonactiveLayersOpacity);
+  render->setProjection(config.proj);
+  setupBackground(render.get());
+  render->disableOnionskin();
+
+  const gfx::Rect bounds = config.proj.apply(m_doc->sprite()->bounds());
+  const std::size_t frameBytes = std::size_t(bounds.w) * std::size_t(bounds.h) * 4;
+  int capacity = 0;
+  if (frameBytes > 0)
+    capacity = int(std::min<std::size_t>(kMaxFrames, kMaxMemSize / frameBytes));
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_config = config;
+  m_validConfig = true;
+  m_render = render;
+  // With less than two frames we cannot pre-render anything ahead of
+  // the current frame.
+  m_capacity = (capacity >= 2 ? capacity: 0);
+  discardFrames(lock);
+}
+
+void PlaybackCache::setUpcomingFrames(const std::vector<doc::frame_t>& frames)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_upcoming = frames;
+  evictFrames(lock);
+  m_renderCV.notify_one();
+}
+
+doc::ImageRef PlaybackCache::frameImage(doc::frame_t frame)
+{
+  const Key key(m_doc->sprite(), frame);
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if (m_validConfig) {
+    for (const Entry& entry : m_entries) {
+      if (entry.frame == frame) {
+        if (entry.key == key)
+          return entry.image;
+
+        // The palette or the visible layers were modified after
+        // rendering the frame, so all frames must be rendered again
+        discardFrames(lock);
+        break;
+      }
+    }
+  }
+  return doc::ImageRef(nullptr);
+}
+
+void PlaybackCache::invalidate()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  // The render engine is re-created in the next setConfig() call
+  // (e.g. because the background preferences were changed)
+  m_validConfig = false;
+  m_render.reset();
+  m_entries.clear();
+  ++m_generation;
+}
+
+void PlaybackCache::setupBackground(EditorRender* render)
+{
+  render->setupBackground(m_doc, doc::IMAGE_RGB);
+}
+
+void PlaybackCache::onGeneralUpdate(DocEvent& ev) { invalidate(); }
+void PlaybackCache::onPixelFormatChanged(DocEvent& ev) { invalidate(); }
+void PlaybackCache::onAddLayer(DocEvent& ev) { invalidate(); }
+void PlaybackCache::onAddFrame(DocEvent& ev) { invalidate(); }
+void PlaybackCache::onAddCel(DocEvent& ev) { invalidate(); }
+void PlaybackCache::onAfterRemoveLayer(DocEvent& ev) { invalidate(); }
+void PlaybackCache::onRemoveFrame(DocEvent& ev) { invalidate(); }
+void PlaybackCache::onRemoveCel(DocEvent& ev) { invalidate(); }
+void PlaybackCache::onSpriteSizeChanged(DocEvent& ev) { invalidate(); }
+void PlaybackCache::onSpriteTransparentColorChanged(DocEvent& ev) { invalidate(); }
+void PlaybackCache::onLayerOpacityChange(DocEvent& ev) { invalidate(); }
+void PlaybackCache::onLayerBlendModeChange(DocEvent& ev) { invalidate(); }
+void PlaybackCache::onLayerRestacked(DocEvent& ev) { invalidate(); }
+void PlaybackCache::onLayerMergedDown(DocEvent& ev) { invalidate(); }
+void PlaybackCache::onCelMoved(DocEvent& ev) { invalidate(); }
+void PlaybackCache::onCelCopied(DocEvent& ev) { invalidate(); }
+void PlaybackCache::onCelFrameChanged(DocEvent& ev) { invalidate(); }
+void PlaybackCache::onCelPositionChanged(DocEvent& ev) { invalidate(); }
+void PlaybackCache::onCelOpacityChange(DocEvent& ev) { invalidate(); }
+void PlaybackCache::onImagePixelsModified(DocEvent& ev) { invalidate(); }
+void PlaybackCache::onSpritePixelsModified(DocEvent& ev) { invalidate(); }
+void PlaybackCache::onTotalFramesChanged(DocEvent& ev) { invalidate(); }
+
+void PlaybackCache::renderingProc()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (!m_killing) {
+    // Search the first upcoming frame that isn't rendered yet
+    doc::frame_t frame = -1;
+    if (m_render) {
+      const int n = std::min(m_capacity, int(m_upcoming.size()));
+      for (int i=0; i<n; ++i) {
+        if (!isCached(m_upcoming[i])) {
+          frame = m_upcoming[i];
+          break;
+        }
+      }
+    }
+    if (frame < 0) {
+      m_renderCV.wait(lock);
+      continue;
+    }
+
+    const int generation = m_generation;
+    const Config config = m_config;
+    std::shared_ptr<EditorRender> render = m_render;
+    doc::ImageRef image;
+    Key key;
+    bool locked = false;
+
+    lock.unlock();
+    try {
+      DocReader reader(m_doc, kLockTimeout);
+      const doc::Sprite* sprite = m_doc->sprite();
+
+      if (frame < sprite->totalFrames()) {
+        const gfx::Rect bounds = config.proj.apply(sprite->bounds());
+        image.reset(doc::Image::create(doc::IMAGE_RGB, bounds.w, bounds.h));
+
+        if (config.onionskin) {
+          render::OnionskinOptions opts = config.onionskinOpts;
+          if (config.onionskinLoopTag)
+            opts.loopTag(sprite->frameTags().innerTag(frame));
+          render->setOnionskin(opts);
+        }
+
+        render->renderSprite(image.get(), sprite, frame,
+                             gfx::Clip(0, 0, bounds));
+        key = Key(sprite, frame);
+      }
+    }
+    catch (const LockedDocException&) {
+      // The document is being modified, we'll try again later
+      locked = true;
+    }
+    catch (const std::exception&) {
+      image.reset();
+    }
+    lock.lock();
+
+    if (locked) {
+      m_renderCV.wait_for(lock, std::chrono::milliseconds(kLockTimeout));
+      continue;
+    }
+
+    if (generation != m_generation)
+      continue;
+
+    if (image) {
+      Entry entry;
+      entry.frame = frame;
+      entry.image = image;
+      entry.key = key;
+      m_entries.push_back(entry);
+      evictFrames(lock);
+    }
+    else {
+      // Invalid frame, it cannot be rendered
+      m_upcoming.erase(
+        std::remove(m_upcoming.begin(), m_upcoming.end(), frame),
+        m_upcoming.end());
+    }
+  }
+}
+
+// Removes the rendered frames that will not be shown in the next
+// m_capacity ticks. Must be called with m_mutex locked.
+void PlaybackCache::evictFrames(std::unique_lock<std::mutex>& lock)
+{
+  ASSERT(lock.owns_lock());
+
+  const auto upcomingEnd =
+    m_upcoming.begin() + std::min(m_capacity, int(m_upcoming.size()));
+
+  m_entries.erase(
+    std::remove_if(
+      m_entries.begin(), m_entries.end(),
+      [this, upcomingEnd](const Entry& entry){
+        return (std::find(m_upcoming.begin(), upcomingEnd, entry.frame) == upcomingEnd);
+      }),
+    m_entries.end());
+}
+
+// Removes all rendered frames (and the frame being rendered) so they
+// are rendered again. Must be called with m_mutex locked.
+void PlaybackCache::discardFrames(std::unique_lock<std::mutex>& lock)
+{
+  ASSERT(lock.owns_lock());
+
+  m_entries.clear();
+  ++m_generation;
+  m_renderCV.notify_one();
+}
+
+bool PlaybackCache::isCached(doc::frame_t frame) const
+{
+  for (const Entry& entry : m_entries) {
+    if (entry.frame == frame)
+      return true;
+  }
+  return false;
+}
+
+} // namespace app
@@ -0,0 +1,171 @@
+// Aseprite
+// Copyright (C) 2018  David Capello
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_UI_EDITOR_PLAYBACK_CACHE_H_INCLUDED
+#define APP_UI_EDITOR_PLAYBACK_CACHE_H_INCLUDED
+#pragma once
+
+#include "app/doc_observer.h"
+#include "doc/frame.h"
+#include "doc/image_ref.h"
+#include "doc/object.h"
+#include "render/onionskin_options.h"
+#include "render/projection.h"
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace doc {
+  class Layer;
+  class Sprite;
+}
+
+namespace app {
+  class Doc;
+  class EditorRender;
+
+  // Renders the upcoming frames of an animation in a background
+  // thread, so the Editor can show each frame during the playback
+  // (PlayState) without rendering the whole sprite in each tick.
+  class PlaybackCache : public DocObserver {
+  public:
+    // Render configuration of the Editor. The cached frames are
+    // discarded each time the configuration changes.
+    struct Config {
+      render::Projection proj;
+      const doc::Layer* selectedLayer;
+      int nonactiveLayersOpacity;
+      bool onionskin;
+      render::OnionskinOptions onionskinOpts;
+      // True if the onionskin loop tag must be calculated for each
+      // frame (OnionskinOptions::loopTag() is ignored).
+      bool onionskinLoopTag;
+
+      Config()
+        : selectedLayer(nullptr)
+        , nonactiveLayersOpacity(255)
+        , onionskin(false)
+        , onionskinOpts(render::OnionskinType::NONE)
+        , onionskinLoopTag(false) {
+      }
+
+      bool operator==(const Config& other) const;
+      bool operator!=(const Config& other) const {
+        return !operator==(other);
+      }
+    };
+
+    PlaybackCache(Doc* doc);
+    virtual ~PlaybackCache();
+
+    // Sets the configuration used to render the frames. Must be
+    // called from the UI thread before frameImage().
+    void setConfig(const Config& config);
+
+    // Sets the sequence of frames that will be shown next (the first
+    // one is the current frame). Frames not included in this list are
+    // removed from the cache.
+    void setUpcomingFrames(const std::vector<doc::frame_t>& frames);
+
+    // Returns the rendered frame (an RGB image of the whole sprite
+    // with the projection applied) or nullptr if the frame is not yet
+    // available. Must be called from the UI thread (the palette and
+    // layers visibility of the frame are compared with the ones used
+    // to render it).
+    doc::ImageRef frameImage(doc::frame_t frame);
+
+    // Discards all rendered frames (e.g. when the document or some
+    // editor preference is modified).
+    void invalidate();
+
+  protected:
+    // Configures the background of the render engine, by default from
+    // the document preferences.
+    virtual void setupBackground(EditorRender* render);
+
+  private:
+    // State of the sprite used to render a frame that is not notified
+    // to the DocObservers (the palette can be modified in the
+    // ColorBar, and the layers visibility in the Timeline).
+    struct Key {
+      doc::ObjectId palette;
+      doc::ObjectVersion paletteVersion;
+      int paletteModifications;
+      std::vector<doc::ObjectId> visibleLayers;
+
+      Key();
+      Key(const doc::Sprite* sprite, doc::frame_t frame);
+
+      bool operator==(const Key& other) const;
+      bool operator!=(const Key& other) const {
+        return !operator==(other);
+      }
+    };
+
+    struct Entry {
+      doc::frame_t frame;
+      doc::ImageRef image;
+      Key key;
+    };
+
+    // DocObserver impl
+    void onGeneralUpdate(DocEvent& ev) override;
+    void onPixelFormatChanged(DocEvent& ev) override;
+    void onAddLayer(DocEvent& ev) override;
+    void onAddFrame(DocEvent& ev) override;
+    void onAddCel(DocEvent& ev) override;
+    void onAfterRemoveLayer(DocEvent& ev) override;
+    void onRemoveFrame(DocEvent& ev) override;
+    void onRemoveCel(DocEvent& ev) override;
+    void onSpriteSizeChanged(DocEvent& ev) override;
+    void onSpriteTransparentColorChanged(DocEvent& ev) override;
+    void onLayerOpacityChange(DocEvent& ev) override;
+    void onLayerBlendModeChange(DocEvent& ev) override;
+    void onLayerRestacked(DocEvent& ev) override;
+    void onLayerMergedDown(DocEvent& ev) override;
+    void onCelMoved(DocEvent& ev) override;
+    void onCelCopied(DocEvent& ev) override;
+    void onCelFrameChanged(DocEvent& ev) override;
+    void onCelPositionChanged(DocEvent& ev) override;
+    void onCelOpacityChange(DocEvent& ev) override;
+    void onImagePixelsModified(DocEvent& ev) override;
+    void onSpritePixelsModified(DocEvent& ev) override;
+    void onTotalFramesChanged(DocEvent& ev) override;
+
+    void renderingProc();
+    void evictFrames(std::unique_lock<std::mutex>& lock);
+    void discardFrames(std::unique_lock<std::mutex>& lock);
+    bool isCached(doc::frame_t frame) const;
+
+    Doc* m_doc;
+
+    // All the following fields are protected by m_mutex
+    std::mutex m_mutex;
+    Config m_config;
+    bool m_validConfig;
+
+    // Maximum number of frames that can be stored in the cache
+    // (depends on the size of each rendered frame).
+    int m_capacity;
+
+    std::condition_variable m_renderCV;
+    std::vector<Entry> m_entries;
+    std::vector<doc::frame_t> m_upcoming;
+    std::shared_ptr<EditorRender> m_render;
+
+    // Incremented each time the cache is invalidated, so frames that
+    // were being rendered with an old configuration are discarded.
+    int m_generation;
+    bool m_killing;
+    std::thread m_renderingThread;
+  };
+
+} // namespace app
+
+#endif
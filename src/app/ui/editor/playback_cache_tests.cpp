@@ -0,0 +1,138 @@
+// Aseprite
+// Copyright (C) 2018  David Capello
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#include "tests/test.h"
+
+#include "app/doc.h"
+#include "app/doc_access.h"
+#include "app/doc_event.h"
+#include "app/ui/editor/editor_render.h"
+#include "app/ui/editor/playback_cache.h"
+#include "doc/cel.h"
+#include "doc/image.h"
+#include "doc/layer.h"
+#include "doc/palette.h"
+#include "doc/primitives.h"
+#include "doc/sprite.h"
+
+#include <chrono>
+#include <memory>
+#include <thread>
+
+using namespace app;
+using namespace doc;
+
+namespace {
+
+  // The background is not read from the preferences
+  class TestPlaybackCache : public PlaybackCache {
+  public:
+    TestPlaybackCache(Doc* doc) : PlaybackCache(doc) { }
+  protected:
+    void setupBackground(EditorRender* render) override {
+      render->setTransparentBackground();
+    }
+  };
+
+  // Sprite with one layer and one frame filled with the given color.
+  Doc* create_doc(PixelFormat format, color_t color) {
+    Sprite* sprite = new Sprite(format, 4, 4, 256);
+    LayerImage* layer = new LayerImage(sprite);
+    sprite->root()->addLayer(layer);
+
+    ImageRef image(Image::create(format, 4, 4));
+    clear_image(image.get(), color);
+    layer->addCel(new Cel(frame_t(0), image));
+    return new Doc(sprite);
+  }
+
+  Image* cel_image(Doc* doc) {
+    return doc->sprite()->root()->firstLayer()->cel(frame_t(0))->image();
+  }
+
+  // Waits the background thread to render the given frame.
+  ImageRef wait_frame(PlaybackCache& cache, frame_t frame) {
+    cache.setConfig(PlaybackCache::Config());
+    cache.setUpcomingFrames({ frame });
+    for (int i=0; i<500; ++i) {
+      ImageRef image = cache.frameImage(frame);
+      if (image)
+        return image;
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return ImageRef(nullptr);
+  }
+
+}
+
+TEST(PlaybackCache, PixelsModified)
+{
+  std::unique_ptr<Doc> doc(create_doc(IMAGE_RGB, rgba(255, 0, 0, 255)));
+  TestPlaybackCache cache(doc.get());
+
+  ImageRef image = wait_frame(cache, 0);
+  ASSERT_TRUE(image != nullptr);
+  EXPECT_EQ(rgba(255, 0, 0, 255), get_pixel(image.get(), 0, 0));
+
+  {
+    DocWriter writer(doc.get(), 500);
+    clear_image(cel_image(doc.get()), rgba(0, 0, 255, 255));
+
+    DocEvent ev(doc.get());
+    ev.sprite(doc->sprite());
+    doc->notify_observers<DocEvent&>(&DocObserver::onImagePixelsModified, ev);
+  }
+  EXPECT_TRUE(cache.frameImage(0) == nullptr);
+
+  image = wait_frame(cache, 0);
+  ASSERT_TRUE(image != nullptr);
+  EXPECT_EQ(rgba(0, 0, 255, 255), get_pixel(image.get(), 0, 0));
+}
+
+TEST(PlaybackCache, PaletteModified)
+{
+  std::unique_ptr<Doc> doc(create_doc(IMAGE_INDEXED, 1));
+  doc->sprite()->palette(0)->setEntry(1, rgba(255, 0, 0, 255));
+  TestPlaybackCache cache(doc.get());
+
+  ImageRef image = wait_frame(cache, 0);
+  ASSERT_TRUE(image != nullptr);
+  EXPECT_EQ(rgba(255, 0, 0, 255), get_pixel(image.get(), 0, 0));
+
+  // The palette is modified without notifying the observers (e.g. in
+  // the ColorBar)
+  {
+    DocWriter writer(doc.get(), 500);
+    doc->sprite()->palette(0)->setEntry(1, rgba(0, 255, 0, 255));
+  }
+  EXPECT_TRUE(cache.frameImage(0) == nullptr);
+
+  image = wait_frame(cache, 0);
+  ASSERT_TRUE(image != nullptr);
+  EXPECT_EQ(rgba(0, 255, 0, 255), get_pixel(image.get(), 0, 0));
+}
+
+TEST(PlaybackCache, LayerVisibilityModified)
+{
+  std::unique_ptr<Doc> doc(create_doc(IMAGE_RGB, rgba(255, 0, 0, 255)));
+  TestPlaybackCache cache(doc.get());
+
+  ImageRef image = wait_frame(cache, 0);
+  ASSERT_TRUE(image != nullptr);
+  EXPECT_EQ(rgba(255, 0, 0, 255), get_pixel(image.get(), 0, 0));
+
+  // The layer is hidden without notifying the observers (e.g. in the
+  // Timeline)
+  {
+    DocWriter writer(doc.get(), 500);
+    doc->sprite()->root()->firstLayer()->setVisible(false);
+  }
+  EXPECT_TRUE(cache.frameImage(0) == nullptr);
+
+  image = wait_frame(cache, 0);
+  ASSERT_TRUE(image != nullptr);
+  EXPECT_EQ(0, rgba_geta(get_pixel(image.get(), 0, 0)));
+}
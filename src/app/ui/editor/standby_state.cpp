@@ -52,6 +52,7 @@
 #include "base/pi.h"
 #include "doc/layer.h"
 #include "doc/mask.h"
+#include "doc/mask_boundaries.h"
 #include "doc/slice.h"
 #include "doc/sprite.h"
 #include "fixmath/fixmath.h"
@@ -795,21 +796,32 @@ bool StandbyState::overSelectionEdges(Editor* editor,
       !dynamic_cast<MovingPixelsState*>(editor->getState().get())) {
     gfx::Point mainOffset(editor->mainTilePosition());
 
+    // Only the selection edges near the mouse position are checked
+    gfx::Rect mouseArea =
+      editor->screenToEditor(gfx::Rect(mouseScreenPos, gfx::Size(1, 1))
+                             .enlarge(2*guiscale()));
+    mouseArea.offset(-mainOffset);
+    mouseArea.enlarge(1);
+
     // For each selection edge
-    for (const auto& seg : *editor->document()->getMaskBoundaries()) {
-      gfx::Rect segBounds = seg.bounds();
-      segBounds.offset(mainOffset);
-      segBounds = editor->editorToScreen(segBounds);
-      if (seg.vertical())
-        segBounds.w = 1;
-      else
-        segBounds.h = 1;
+    bool result = false;
+    editor->document()->getMaskBoundaries()->forEachSegment(
+      mouseArea,
+      [editor, &mainOffset, &mouseScreenPos, &result](const doc::MaskBoundaries::Segment& seg) {
+        gfx::Rect segBounds = seg.bounds();
+        segBounds.offset(mainOffset);
+        segBounds = editor->editorToScreen(segBounds);
+        if (seg.vertical())
+          segBounds.w = 1;
+        else
+          segBounds.h = 1;
 
-      if (gfx::Rect(segBounds).enlarge(2*guiscale()).contains(mouseScreenPos) &&
-          !gfx::Rect(segBounds).shrink(2*guiscale()).contains(mouseScreenPos)) {
-        return true;
-      }
-    }
+        if (gfx::Rect(segBounds).enlarge(2*guiscale()).contains(mouseScreenPos) &&
+            !gfx::Rect(segBounds).shrink(2*guiscale()).contains(mouseScreenPos)) {
+          result = true;
+        }
+      });
+    return result;
   }
   return false;
 }
@@ -310,6 +310,8 @@ class ToolLoopImpl : public ToolLoopBase {
   ExpandCelCanvas* m_expandCelCanvas;
   Image* m_floodfillSrcImage;
   bool m_saveLastPoint;
+  bool m_partialMaskBoundaries;
+  gfx::Rect m_modifiedMaskArea;
 
 public:
   ToolLoopImpl(Editor* editor,
@@ -345,6 +347,7 @@ public:
     , m_expandCelCanvas(nullptr)
     , m_floodfillSrcImage(nullptr)
     , m_saveLastPoint(saveLastPoint)
+    , m_partialMaskBoundaries(false)
   {
     ASSERT(m_context->activeDocument() == m_editor->document());
 
@@ -422,6 +425,11 @@ public:
       Mask emptyMask;
       m_transaction.execute(new cmd::SetMask(m_document, &emptyMask));
     }
+    // When the visible mask is modified, only the modified area is
+    // compared to regenerate its boundaries.
+    else if (getInk()->isSelection()) {
+      m_partialMaskBoundaries = true;
+    }
 
     m_celOrigin = m_expandCelCanvas->getCel()->position();
     m_mask = m_document->mask();
@@ -462,7 +470,10 @@ public:
       }
       // Selection ink
       else if (getInk()->isSelection()) {
-        m_document->generateMaskBoundaries();
+        if (m_partialMaskBoundaries)
+          m_document->generateMaskBoundaries(nullptr, m_modifiedMaskArea);
+        else
+          m_document->generateMaskBoundaries();
         redraw = true;
 
         // Show selection edges
@@ -517,8 +528,9 @@ public:
 
   bool useMask() override { return m_useMask; }
   Mask* getMask() override { return m_mask; }
-  void setMask(Mask* newMask) override {
+  void setMask(Mask* newMask, const gfx::Rect& modifiedArea) override {
     m_transaction.execute(new cmd::SetMask(m_document, newMask));
+    m_modifiedMaskArea |= modifiedArea;
   }
   void addSlice(Slice* newSlice) override {
     auto color = Preferences::instance().slices.defaultColor();
@@ -691,7 +703,7 @@ public:
 
   bool useMask() override { return false; }
   Mask* getMask() override { return nullptr; }
-  void setMask(Mask* newMask) override { }
+  void setMask(Mask* newMask, const gfx::Rect& modifiedArea) override { }
   void addSlice(Slice* newSlice) override { }
   gfx::Point getMaskOrigin() override { return gfx::Point(0, 0); }
   bool getFilled() override { return false; }
@@ -22,6 +22,7 @@
 #include <algorithm>
 #include <cctype>
 #include <cstring>
+#include <unordered_set>
 
 #define ISEARCH_KEYPRESS_INTERVAL_MSECS 500
 
@@ -42,6 +43,7 @@ FileList::FileList()
   , m_itemToGenerateThumbnail(nullptr)
   , m_thumbnail(nullptr)
   , m_multiselect(false)
+  , m_loadingFolder(false)
 {
   setFocusStop(true);
   setDoubleBuffered(true);
@@ -524,6 +526,24 @@ void FileList::onMonitoringTick()
 {
   if (ThumbnailGenerator::instance()->checkWorkers())
     invalidate();
+
+  // Add the new items found in the current folder
+  if (m_loadingFolder) {
+    bool done;
+    FileItemList newItems;
+    m_currentFolder->childrenAsync(done, newItems);
+
+    // Removed items are deleted when the folder is completely loaded,
+    // in that case the whole list is updated
+    if (done)
+      regenerateList();
+    else
+      insertNewItems(newItems);
+
+    m_req_valid = false;
+    invalidate();
+    View::getView(this)->updateView();
+  }
 }
 
 void FileList::onGenerateThumbnailTick()
@@ -578,35 +598,118 @@ void FileList::makeSelectedFileitemVisible()
 
 void FileList::regenerateList()
 {
-  // get the children of the current folder
-  m_list = m_currentFolder->children();
+  // Keep the selected items if the list is being updated while the
+  // folder is loaded
+  std::unordered_set<IFileItem*> oldSelectedItems;
+  if (m_multiselect && m_selectedItems.size() == m_list.size()) {
+    for (IFileItem* fi : selectedFileItems())
+      oldSelectedItems.insert(fi);
+  }
+
+  // get the children of the current folder (the folder is read in
+  // background, so we could receive just the first items)
+  bool done;
+  FileItemList newItems;
+  m_list = m_currentFolder->childrenAsync(done, newItems);
+  m_loadingFolder = !done;
 
   // filter the list by the available extensions
-  if (!m_exts.empty()) {
-    for (FileItemList::iterator
-           it=m_list.begin();
-         it!=m_list.end(); ) {
-      IFileItem* fileitem = *it;
-
-      if (fileitem->isHidden())
-        it = m_list.erase(it);
-      else if (!fileitem->isFolder() &&
-               !fileitem->hasExtension(m_exts)) {
-        it = m_list.erase(it);
-      }
-      else
-        ++it;
-    }
-  }
+  m_list.erase(
+    std::remove_if(m_list.begin(), m_list.end(),
+                   [this](IFileItem* fileitem){
+                     return isFilteredItem(fileitem);
+                   }),
+    m_list.end());
+
+  // Items that were removed from the folder
+  if (m_selected &&
+      std::find(m_list.begin(), m_list.end(), m_selected) == m_list.end())
+    m_selected = nullptr;
+  if (m_itemToGenerateThumbnail &&
+      std::find(m_list.begin(), m_list.end(), m_itemToGenerateThumbnail) == m_list.end())
+    m_itemToGenerateThumbnail = nullptr;
 
   if (m_multiselect && !m_list.empty()) {
     m_selectedItems.resize(m_list.size());
     deselectedFileItems();
+
+    if (!oldSelectedItems.empty()) {
+      for (int i=0; i<int(m_list.size()); ++i)
+        if (oldSelectedItems.find(m_list[i]) != oldSelectedItems.end())
+          m_selectedItems[i] = true;
+    }
   }
   else
     m_selectedItems.clear();
 }
 
+// Merges the new items (sorted) found in the current folder while it
+// is being loaded. Only the new items are compared with the list.
+void FileList::insertNewItems(FileItemList& newItems)
+{
+  newItems.erase(
+    std::remove_if(newItems.begin(), newItems.end(),
+                   [this](IFileItem* fileitem){
+                     return isFilteredItem(fileitem);
+                   }),
+    newItems.end());
+  if (newItems.empty())
+    return;
+
+  // Same order as the children of the folder (folders first)
+  auto lessThan = [](IFileItem* a, IFileItem* b) {
+    if (a->isFolder() != b->isFolder())
+      return a->isFolder();
+    return (base::compare_filenames(a->displayName(), b->displayName()) < 0);
+  };
+
+  const bool withSelection =
+    (m_multiselect && m_selectedItems.size() == m_list.size());
+
+  FileItemList list;
+  std::vector<bool> selectedItems;
+  list.reserve(m_list.size() + newItems.size());
+  if (withSelection)
+    selectedItems.reserve(list.capacity());
+
+  auto begin = m_list.begin();
+  auto it = begin;
+  for (IFileItem* fileitem : newItems) {
+    auto next = std::upper_bound(it, m_list.end(), fileitem, lessThan);
+    list.insert(list.end(), it, next);
+    list.push_back(fileitem);
+    if (withSelection) {
+      selectedItems.insert(selectedItems.end(),
+                           m_selectedItems.begin() + (it - begin),
+                           m_selectedItems.begin() + (next - begin));
+      selectedItems.push_back(false);
+    }
+    it = next;
+  }
+  list.insert(list.end(), it, m_list.end());
+  if (withSelection)
+    selectedItems.insert(selectedItems.end(),
+                         m_selectedItems.begin() + (it - begin),
+                         m_selectedItems.end());
+
+  m_list = std::move(list);
+  if (withSelection)
+    m_selectedItems = std::move(selectedItems);
+  else if (m_multiselect)
+    m_selectedItems.assign(m_list.size(), false);
+}
+
+bool FileList::isFilteredItem(IFileItem* fileitem) const
+{
+  // filter the list by the available extensions
+  if (m_exts.empty())
+    return false;
+
+  return (fileitem->isHidden() ||
+          (!fileitem->isFolder() &&
+           !fileitem->hasExtension(m_exts)));
+}
+
 int FileList::selectedIndex() const
 {
   for (auto it = m_list.begin(), end = m_list.end();
@@ -65,6 +65,8 @@ namespace app {
     gfx::Size getFileItemSize(IFileItem* fi) const;
     void makeSelectedFileitemVisible();
     void regenerateList();
+    void insertNewItems(FileItemList& newItems);
+    bool isFilteredItem(IFileItem* fileitem) const;
     int selectedIndex() const;
     void selectIndex(int index);
     void generatePreviewOfSelectedItem();
@@ -99,6 +101,10 @@ namespace app {
     // True if this listbox accepts selecting multiple items at the
     // same time.
     bool m_multiselect;
+
+    // True if the current folder is still being read (the list is
+    // updated in each m_monitoringTimer tick).
+    bool m_loadingFolder;
   };
 
 } // namespace app
@@ -81,8 +81,13 @@ ExpandCelCanvas::ExpandCelCanvas(
 
   if (m_layer && m_layer->isImage()) {
     m_cel = m_layer->cel(site.frame());
-    if (m_cel)
+    if (m_cel) {
       m_celImage = m_cel->imageRef();
+
+      // Keep the cel image in memory while the user is drawing
+      // (it cannot be moved to the swap file in the middle).
+      m_celImage->pin();
+    }
   }
 
   // Create a new cel
@@ -137,6 +142,9 @@ ExpandCelCanvas::~ExpandCelCanvas()
   catch (...) {
     // Do nothing
   }
+
+  if (m_celImage)
+    m_celImage->unpin();
 }
 
 void ExpandCelCanvas::commit()
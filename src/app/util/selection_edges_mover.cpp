@@ -0,0 +1,76 @@
+// Aseprite
+// Copyright (C) 2018  David Capello
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/util/selection_edges_mover.h"
+
+#include "app/cmd/set_mask_position.h"
+#include "app/context_access.h"
+#include "app/doc.h"
+#include "app/transaction.h"
+#include "doc/mask.h"
+
+namespace app {
+
+SelectionEdgesMover::SelectionEdgesMover(Context* context, Doc* doc)
+  : m_context(context)
+  , m_doc(doc)
+  , m_origin(doc->mask()->bounds().origin())
+  , m_committed(false)
+{
+  m_doc->mask()->freeze();
+}
+
+SelectionEdgesMover::~SelectionEdgesMover()
+{
+  if (!m_committed) {
+    Mask* mask = m_doc->mask();
+    const gfx::Point delta = m_origin - mask->bounds().origin();
+    mask->setOrigin(m_origin.x, m_origin.y);
+    mask->unfreeze();
+    m_doc->offsetMaskBoundaries(delta);
+  }
+}
+
+bool SelectionEdgesMover::moveTo(const gfx::Point& newOrigin)
+{
+  Mask* mask = m_doc->mask();
+  const gfx::Point oldOrigin = mask->bounds().origin();
+  if (newOrigin == oldOrigin)
+    return false;
+
+  mask->setOrigin(newOrigin.x, newOrigin.y);
+  m_doc->offsetMaskBoundaries(newOrigin - oldOrigin);
+  return true;
+}
+
+void SelectionEdgesMover::commit()
+{
+  ASSERT(!m_committed);
+
+  Mask* mask = m_doc->mask();
+  const gfx::Point newOrigin = mask->bounds().origin();
+
+  // Restore the mask to the original state so we can transform it
+  // with the a undoable transaction.
+  mask->setOrigin(m_origin.x, m_origin.y);
+  mask->unfreeze();
+  m_committed = true;
+
+  {
+    ContextWriter writer(m_context, 1000);
+    Transaction transaction(writer.context(), "Move Selection Edges", DoesntModifyDocument);
+    transaction.execute(new cmd::SetMaskPosition(m_doc, newOrigin));
+    transaction.commit();
+  }
+
+  m_doc->resetTransformation();
+}
+
+} // namespace app
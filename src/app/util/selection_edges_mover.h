@@ -0,0 +1,49 @@
+// Aseprite
+// Copyright (C) 2018  David Capello
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_UTIL_SELECTION_EDGES_MOVER_H_INCLUDED
+#define APP_UTIL_SELECTION_EDGES_MOVER_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+#include "gfx/point.h"
+
+namespace app {
+  class Context;
+  class Doc;
+
+  // Moves the selection edges (the mask without its pixels) of a
+  // document while the user drags them. The mask is frozen and moved
+  // directly (without undo information) until commit() adds the
+  // final position to the undo history.
+  class SelectionEdgesMover {
+  public:
+    SelectionEdgesMover(Context* context, Doc* doc);
+    ~SelectionEdgesMover();
+
+    // Original position of the mask.
+    const gfx::Point& origin() const { return m_origin; }
+
+    // Moves the mask and its boundaries to the given position,
+    // returns true if the mask was moved.
+    bool moveTo(const gfx::Point& newOrigin);
+
+    // Restores the original position and moves the mask to the last
+    // position with an undoable transaction.
+    void commit();
+
+  private:
+    Context* m_context;
+    Doc* m_doc;
+    gfx::Point m_origin;
+    bool m_committed;
+
+    DISABLE_COPYING(SelectionEdgesMover);
+  };
+
+} // namespace app
+
+#endif
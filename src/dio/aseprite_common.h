@@ -25,6 +25,7 @@
 #define ASE_FILE_CHUNK_USER_DATA            0x2020
 #define ASE_FILE_CHUNK_SLICES               0x2021 // Deprecated chunk (used on dev versions only between v1.2-beta7 and v1.2-beta8)
 #define ASE_FILE_CHUNK_SLICE                0x2022
+#define ASE_FILE_CHUNK_THUMBNAIL            0x2030
 
 #define ASE_FILE_LAYER_IMAGE                0
 #define ASE_FILE_LAYER_GROUP                1
@@ -43,6 +44,8 @@
 #define ASE_SLICE_FLAG_HAS_CENTER_BOUNDS    1
 #define ASE_SLICE_FLAG_HAS_PIVOT_POINT      2
 
+#define ASE_FILE_THUMBNAIL_MAX_SIZE         128
+
 namespace dio {
 
 struct AsepriteHeader {
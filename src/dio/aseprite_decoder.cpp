@@ -23,7 +23,9 @@
 #include "fmt/format.h"
 #include "zlib.h"
 
+#include <algorithm>
 #include <cstdio>
+#include <memory>
 
 namespace dio {
 
@@ -70,6 +72,10 @@ bool AsepriteDecoder::decode()
 
   // Read frame by frame to end-of-file
   for (doc::frame_t frame=0; frame<nframes; ++frame) {
+    // Move the least recently used cels to the swap file (if there
+    // is a memory budget) so we can load sprites bigger than the RAM.
+    doc::ImageSwap::instance()->trim(sprite.get());
+
     // Start frame position
     size_t frame_pos = f()->tell();
     delegate()->progress((float)frame_pos / (float)header.size);
@@ -189,6 +195,10 @@ bool AsepriteDecoder::decode()
             break;
           }
 
+          case ASE_FILE_CHUNK_THUMBNAIL:
+            // Ignore (it's only used by decodeThumbnail())
+            break;
+
           default:
             delegate()->error(
               fmt::format("Warning: Unsupported chunk type {0} (skipping)", chunk_type));
@@ -288,6 +298,9 @@ std::string AsepriteDecoder::readString()
   if (length == EOF)
     return "";
 
+  if (const uint8_t* view = f()->readView(length))
+    return std::string((const char*)view, length);
+
   std::string string;
   string.reserve(length+1);
 
@@ -470,10 +483,20 @@ void read_raw_image(FileInterface* f,
   int x, y;
   int w = image->width();
   int h = image->height();
+  const size_t rowBytes = ImageTraits::getRowStrideBytes(w);
 
   for (y=0; y<h; ++y) {
-    for (x=0; x<w; ++x) {
-      doc::put_pixel_fast<ImageTraits>(image, x, y, pixel_io.read_pixel(f));
+    // Memory-mapped files can be converted directly without reading
+    // pixel by pixel.
+    if (const uint8_t* view = f->readView(rowBytes)) {
+      pixel_io.read_scanline(
+        (typename ImageTraits::address_t)image->getPixelAddress(0, y),
+        w, view);
+    }
+    else {
+      for (x=0; x<w; ++x) {
+        doc::put_pixel_fast<ImageTraits>(image, x, y, pixel_io.read_pixel(f));
+      }
     }
     delegate->progress((float)f->tell() / (float)header->size);
   }
@@ -497,64 +520,88 @@ void read_compressed_image(FileInterface* f,
   zstream.zalloc = (alloc_func)0;
   zstream.zfree  = (free_func)0;
   zstream.opaque = (voidpf)0;
+  zstream.next_in = (Bytef*)nullptr;
+  zstream.avail_in = 0;
 
   err = inflateInit(&zstream);
   if (err != Z_OK)
     throw base::Exception("ZLib error %d in inflateInit().", err);
 
-  std::vector<uint8_t> scanline(ImageTraits::getRowStrideBytes(image->width()));
-  std::vector<uint8_t> uncompressed(image->height() * ImageTraits::getRowStrideBytes(image->width()));
-  std::vector<uint8_t> compressed(4096);
-  int uncompressed_offset = 0;
-
-  while (true) {
-    size_t input_bytes;
-
-    if (f->tell()+compressed.size() > chunk_end) {
-      input_bytes = chunk_end - f->tell(); // Remaining bytes
-      ASSERT(input_bytes < compressed.size());
-
-      if (input_bytes == 0)
-        break;                  // Done, we consumed all chunk
-    }
-    else
-      input_bytes = compressed.size();
+  const size_t chunk_start = f->tell();
+  const size_t rowBytes = ImageTraits::getRowStrideBytes(image->width());
+  std::vector<uint8_t> compressed;
+
+  // If the file is memory-mapped we can inflate the whole chunk
+  // directly from the mapped memory, in other case we read it in
+  // small blocks.
+  const uint8_t* view =
+    (chunk_start < chunk_end ? f->readView(chunk_end - chunk_start): nullptr);
+  if (view) {
+    zstream.next_in = (Bytef*)view;
+    zstream.avail_in = chunk_end - chunk_start;
+  }
+  else
+    compressed.resize(4096);
+
+  // Inflates up to "n" bytes in "out", returns the number of
+  // inflated bytes (less than "n" if we consumed all the chunk).
+  bool eof = false;
+  auto inflate_bytes = [&](Bytef* out, size_t n) -> size_t {
+    zstream.next_out = out;
+    zstream.avail_out = n;
+
+    while (!eof && zstream.avail_out > 0) {
+      if (zstream.avail_in == 0) {
+        size_t pos = f->tell();
+        if (view || pos >= chunk_end) {
+          eof = true;           // Done, we consumed all chunk
+          break;
+        }
 
-    size_t bytes_read = f->readBytes(&compressed[0], input_bytes);
-    zstream.next_in = (Bytef*)&compressed[0];
-    zstream.avail_in = bytes_read;
+        size_t input_bytes = std::min(compressed.size(), chunk_end - pos);
+        size_t bytes_read = f->readBytes(&compressed[0], input_bytes);
+        if (bytes_read == 0) {
+          eof = true;
+          break;
+        }
 
-    do {
-      zstream.next_out = (Bytef*)&scanline[0];
-      zstream.avail_out = scanline.size();
+        zstream.next_in = (Bytef*)&compressed[0];
+        zstream.avail_in = bytes_read;
+      }
 
       err = inflate(&zstream, Z_NO_FLUSH);
-      if (err != Z_OK && err != Z_STREAM_END && err != Z_BUF_ERROR)
+      if (err == Z_STREAM_END)
+        eof = true;
+      else if (err != Z_OK && err != Z_BUF_ERROR) {
+        inflateEnd(&zstream);
         throw base::Exception("ZLib error %d in inflate().", err);
-
-      size_t uncompressed_bytes = scanline.size() - zstream.avail_out;
-      if (uncompressed_bytes > 0) {
-        if (uncompressed_offset+uncompressed_bytes > uncompressed.size())
-          throw base::Exception("Bad compressed image.");
-
-        std::copy(scanline.begin(), scanline.begin()+uncompressed_bytes,
-                  uncompressed.begin()+uncompressed_offset);
-
-        uncompressed_offset += uncompressed_bytes;
       }
-    } while (zstream.avail_out == 0);
-
-    delegate->progress((float)f->tell() / (float)header->size);
-  }
+    }
+    return n - zstream.avail_out;
+  };
 
-  uncompressed_offset = 0;
-  for (y=0; y<image->height(); y++) {
+  // Each row is inflated directly into the image and then converted
+  // in-place to the in-memory pixel format.
+  for (y=0; y<image->height(); ++y) {
     typename ImageTraits::address_t address =
       (typename ImageTraits::address_t)image->getPixelAddress(0, y);
 
-    pixel_io.read_scanline(address, image->width(), &uncompressed[uncompressed_offset]);
+    // Truncated data, the rest of the image is filled with zeros
+    // (transparent pixels).
+    size_t bytes = inflate_bytes((Bytef*)address, rowBytes);
+    if (bytes < rowBytes)
+      std::fill(((uint8_t*)address)+bytes, ((uint8_t*)address)+rowBytes, 0);
 
-    uncompressed_offset += ImageTraits::getRowStrideBytes(image->width());
+    pixel_io.read_scanline_in_place(address, image->width());
+
+    delegate->progress((float)(chunk_start + zstream.total_in) / (float)header->size);
+  }
+
+  // The chunk cannot contain more pixels than the image size
+  uint8_t extra;
+  if (inflate_bytes((Bytef*)&extra, 1) > 0) {
+    inflateEnd(&zstream);
+    throw base::Exception("Bad compressed image.");
   }
 
   err = inflateEnd(&zstream);
@@ -866,4 +913,45 @@ doc::Slice* AsepriteDecoder::readSliceChunk(doc::Slices& slices)
   return slice.release();
 }
 
+doc::Image* AsepriteDecoder::decodeThumbnail()
+{
+  AsepriteHeader header;
+  if (!readHeader(&header) ||
+      header.magic != ASE_FILE_MAGIC ||
+      header.frames == 0)
+    return nullptr;
+
+  AsepriteFrameHeader frame_header;
+  readFrameHeader(&frame_header);
+  if (frame_header.magic != ASE_FILE_FRAME_MAGIC)
+    return nullptr;
+
+  // The thumbnail is saved as the first chunk, but we look for it in
+  // the whole frame just in case.
+  for (int c=0; c<frame_header.chunks; c++) {
+    size_t chunk_pos = f()->tell();
+    int chunk_size = read32();
+    int chunk_type = read16();
+
+    if (chunk_type == ASE_FILE_CHUNK_THUMBNAIL) {
+      int w = read16();
+      int h = read16();
+      if (w < 1 || h < 1 ||
+          w > ASE_FILE_THUMBNAIL_MAX_SIZE ||
+          h > ASE_FILE_THUMBNAIL_MAX_SIZE)
+        return nullptr;
+
+      std::unique_ptr<doc::Image> image(doc::Image::create(doc::IMAGE_RGB, w, h));
+      read_compressed_image<doc::RgbTraits>(
+        f(), delegate(), image.get(), chunk_pos+chunk_size, &header);
+      return image.release();
+    }
+
+    if (chunk_size < 6)       // Broken chunk
+      break;
+    f()->seek(chunk_pos+chunk_size);
+  }
+  return nullptr;
+}
+
 } // namespace dio
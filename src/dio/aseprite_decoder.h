@@ -19,6 +19,7 @@
 
 namespace doc {
   class Cel;
+  class Image;
   class Layer;
   class Layer;
   class Mask;
@@ -36,6 +37,11 @@ class AsepriteDecoder : public Decoder {
 public:
   bool decode() override;
 
+  // Reads only the thumbnail chunk of the first frame (without
+  // decoding layers/cels). Returns nullptr if the file doesn't have
+  // a thumbnail. The returned image is RGB.
+  doc::Image* decodeThumbnail();
+
 private:
   bool readHeader(AsepriteHeader* header);
   void readFrameHeader(AsepriteFrameHeader* frame_header);
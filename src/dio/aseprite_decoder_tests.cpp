@@ -0,0 +1,337 @@
+// Aseprite Document IO Library
+// Copyright (c) 2018 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "dio/aseprite_common.h"
+#include "dio/aseprite_decoder.h"
+#include "dio/decode_delegate.h"
+#include "dio/file_interface.h"
+#include "doc/doc.h"
+#include "zlib.h"
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+  #include <unistd.h>
+#endif
+
+using namespace dio;
+using namespace doc;
+
+namespace {
+
+  const int kSize = 128;
+
+  class TestDelegate : public DecodeDelegate {
+  public:
+    void error(const std::string& msg) override {
+      errors.push_back(msg);
+    }
+    void onSprite(Sprite* sprite) override {
+      this->sprite.reset(sprite);
+    }
+
+    std::vector<std::string> errors;
+    std::unique_ptr<Sprite> sprite;
+  };
+
+  // Creates the content of an .aseprite file with one RGB layer and
+  // one cel with the given compressed data.
+  class AseFile {
+  public:
+    AseFile(const std::vector<uint8_t>& compressed) {
+      // Header
+      write32(0);               // File size (filled at the end)
+      write16(ASE_FILE_MAGIC);
+      write16(1);               // Frames
+      write16(kSize);           // Width
+      write16(kSize);           // Height
+      write16(32);              // Depth
+      write32(ASE_FILE_FLAG_LAYER_WITH_OPACITY);
+      write16(100);             // Speed
+      write32(0);
+      write32(0);
+      bytes.resize(128, 0);
+
+      // Frame header
+      const size_t framePos = bytes.size();
+      write32(0);               // Frame size (filled at the end)
+      write16(ASE_FILE_FRAME_MAGIC);
+      write16(2);               // Chunks
+      write16(100);             // Duration
+      write16(0);
+      write32(0);
+
+      // Layer chunk
+      size_t chunkPos = beginChunk(ASE_FILE_CHUNK_LAYER);
+      write16(int(LayerFlags::Visible) | int(LayerFlags::Editable));
+      write16(ASE_FILE_LAYER_IMAGE);
+      write16(0);               // Child level
+      write16(0);
+      write16(0);
+      write16(int(BlendMode::NORMAL));
+      write8(255);              // Opacity
+      write8(0); write8(0); write8(0);
+      write16(5);
+      for (char chr : std::string("Layer"))
+        write8(chr);
+      endChunk(chunkPos);
+
+      // Cel chunk
+      chunkPos = beginChunk(ASE_FILE_CHUNK_CEL);
+      write16(0);               // Layer index
+      write16(0);               // X
+      write16(0);               // Y
+      write8(255);              // Opacity
+      write16(ASE_FILE_COMPRESSED_CEL);
+      for (int i=0; i<7; ++i)
+        write8(0);
+      write16(kSize);
+      write16(kSize);
+      celDataPos = bytes.size();
+      bytes.insert(bytes.end(), compressed.begin(), compressed.end());
+      endChunk(chunkPos);
+
+      set32(framePos, bytes.size() - framePos);
+      set32(0, bytes.size());
+    }
+
+    std::vector<uint8_t> bytes;
+    size_t celDataPos;
+
+  private:
+    void write8(int v) { bytes.push_back(uint8_t(v)); }
+    void write16(int v) { write8(v); write8(v >> 8); }
+    void write32(uint32_t v) { write16(v & 0xffff); write16(v >> 16); }
+    void set32(size_t pos, uint32_t v) {
+      for (int i=0; i<4; ++i)
+        bytes[pos+i] = uint8_t(v >> (8*i));
+    }
+    size_t beginChunk(int type) {
+      const size_t pos = bytes.size();
+      write32(0);
+      write16(type);
+      return pos;
+    }
+    void endChunk(size_t pos) {
+      set32(pos, bytes.size() - pos);
+    }
+  };
+
+  // Noisy pixels, so the compressed cel uses several memory pages
+  color_t test_pixel(int x, int y) {
+    uint32_t v = uint32_t(y*kSize + x) * 2654435761u;
+    v ^= (v >> 15);
+    return rgba(v & 255, (v >> 8) & 255, (v >> 16) & 255, 255);
+  }
+
+  // RGBA bytes of the test image (with an optional extra number of
+  // bytes at the end).
+  std::vector<uint8_t> compressed_pixels(int extraBytes = 0) {
+    std::vector<uint8_t> pixels;
+    for (int y=0; y<kSize; ++y) {
+      for (int x=0; x<kSize; ++x) {
+        const color_t c = test_pixel(x, y);
+        pixels.push_back(rgba_getr(c));
+        pixels.push_back(rgba_getg(c));
+        pixels.push_back(rgba_getb(c));
+        pixels.push_back(rgba_geta(c));
+      }
+    }
+    pixels.resize(pixels.size() + extraBytes, 255);
+
+    uLongf size = compressBound(pixels.size());
+    std::vector<uint8_t> compressed(size);
+    EXPECT_EQ(Z_OK, compress(&compressed[0], &size, &pixels[0], pixels.size()));
+    compressed.resize(size);
+    return compressed;
+  }
+
+  // Temporary file with the given content
+  class TempFile {
+  public:
+    TempFile(const std::vector<uint8_t>& bytes) : m_file(std::tmpfile()) {
+      EXPECT_TRUE(m_file != nullptr);
+      EXPECT_EQ(bytes.size(), std::fwrite(&bytes[0], 1, bytes.size(), m_file));
+      std::fflush(m_file);
+      std::rewind(m_file);
+    }
+    ~TempFile() { std::fclose(m_file); }
+    FILE* get() const { return m_file; }
+  private:
+    FILE* m_file;
+  };
+
+  // Decodes the file with the memory-mapped or the stdio
+  // implementation of FileInterface.
+  bool decode(FILE* file, bool mmap, TestDelegate& delegate) {
+    std::rewind(file);
+    MmapFileInterface mmapFile(file);
+    StdioFileInterface stdioFile(file);
+
+    AsepriteDecoder decoder;
+    if (mmap) {
+      EXPECT_TRUE(mmapFile.isMapped());
+      decoder.initialize(&delegate, &mmapFile);
+    }
+    else
+      decoder.initialize(&delegate, &stdioFile);
+    return decoder.decode();
+  }
+
+  const Image* cel_image(TestDelegate& delegate) {
+    EXPECT_TRUE(delegate.sprite != nullptr);
+    if (!delegate.sprite)
+      return nullptr;
+    const Cel* cel = delegate.sprite->root()->firstLayer()->cel(0);
+    EXPECT_TRUE(cel != nullptr);
+    return (cel ? cel->image(): nullptr);
+  }
+
+  bool has_error(const TestDelegate& delegate, const std::string& text) {
+    for (const std::string& msg : delegate.errors)
+      if (msg.find(text) != std::string::npos)
+        return true;
+    return false;
+  }
+
+}
+
+TEST(AsepriteDecoder, CompressedCel)
+{
+  AseFile ase(compressed_pixels());
+  TempFile file(ase.bytes);
+
+  for (bool mmap : { true, false }) {
+    TestDelegate delegate;
+    EXPECT_TRUE(decode(file.get(), mmap, delegate));
+    EXPECT_TRUE(delegate.errors.empty());
+
+    const Image* image = cel_image(delegate);
+    ASSERT_TRUE(image != nullptr);
+    ASSERT_EQ(kSize, image->width());
+    ASSERT_EQ(kSize, image->height());
+    for (int y=0; y<kSize; ++y)
+      for (int x=0; x<kSize; ++x)
+        ASSERT_EQ(test_pixel(x, y), get_pixel(image, x, y)) << x << "," << y;
+  }
+}
+
+TEST(AsepriteDecoder, TruncatedCel)
+{
+  // The file ends in the middle of the compressed cel
+  AseFile ase(compressed_pixels());
+  const size_t celDataSize = ase.bytes.size() - ase.celDataPos;
+  ase.bytes.resize(ase.celDataPos + celDataSize/2);
+  TempFile file(ase.bytes);
+
+  for (bool mmap : { true, false }) {
+    TestDelegate delegate;
+    EXPECT_TRUE(decode(file.get(), mmap, delegate));
+
+    // The first rows are decoded and the rest is transparent
+    const Image* image = cel_image(delegate);
+    ASSERT_TRUE(image != nullptr);
+    EXPECT_EQ(test_pixel(0, 0), get_pixel(image, 0, 0));
+    EXPECT_EQ(0, get_pixel(image, kSize-1, kSize-1));
+  }
+}
+
+TEST(AsepriteDecoder, CorruptCel)
+{
+  std::vector<uint8_t> compressed = compressed_pixels();
+  compressed[0] = 0xff;         // Invalid zlib header
+  AseFile ase(compressed);
+  TempFile file(ase.bytes);
+
+  for (bool mmap : { true, false }) {
+    TestDelegate delegate;
+    EXPECT_TRUE(decode(file.get(), mmap, delegate));
+    EXPECT_TRUE(has_error(delegate, "ZLib error"));
+
+    // The cel is created anyway (loading continues with other cels)
+    EXPECT_TRUE(cel_image(delegate) != nullptr);
+  }
+}
+
+TEST(AsepriteDecoder, OversizedCel)
+{
+  // The compressed data has more pixels than the cel size
+  AseFile ase(compressed_pixels(kSize*4));
+  TempFile file(ase.bytes);
+
+  for (bool mmap : { true, false }) {
+    TestDelegate delegate;
+    EXPECT_TRUE(decode(file.get(), mmap, delegate));
+    EXPECT_TRUE(has_error(delegate, "Bad compressed image"));
+  }
+}
+
+#ifndef _WIN32
+
+// Other process truncates the file while it's mapped, we cannot
+// touch the mapped pages past the new end of the file (SIGBUS). The
+// file is truncated in the first page of the compressed cel.
+TEST(MmapFileInterface, TruncatedWhileMapped)
+{
+  AseFile ase(compressed_pixels());
+  TempFile file(ase.bytes);
+  const size_t pageSize = sysconf(_SC_PAGESIZE);
+  ASSERT_LT(ase.celDataPos, pageSize);
+  ASSERT_LT(2*pageSize, ase.bytes.size());
+
+  MmapFileInterface f(file.get());
+  ASSERT_TRUE(f.isMapped());
+  EXPECT_TRUE(f.readView(ase.bytes.size()) != nullptr);
+
+  ASSERT_EQ(0, ftruncate(fileno(file.get()), pageSize));
+
+  f.seek(0);
+  EXPECT_TRUE(f.readView(ase.bytes.size()) == nullptr);
+
+  std::vector<uint8_t> buf(ase.bytes.size());
+  EXPECT_EQ(pageSize, f.readBytes(&buf[0], buf.size()));
+  EXPECT_FALSE(f.ok());
+  EXPECT_TRUE(std::equal(buf.begin(), buf.begin()+pageSize, ase.bytes.begin()));
+}
+
+TEST(AsepriteDecoder, TruncatedWhileMapped)
+{
+  AseFile ase(compressed_pixels());
+  TempFile file(ase.bytes);
+  const size_t pageSize = sysconf(_SC_PAGESIZE);
+  ASSERT_LT(ase.celDataPos, pageSize);
+  ASSERT_LT(2*pageSize, ase.bytes.size());
+
+  TestDelegate delegate;
+  MmapFileInterface f(file.get());
+  ASSERT_TRUE(f.isMapped());
+  ASSERT_EQ(0, ftruncate(fileno(file.get()), pageSize));
+
+  AsepriteDecoder decoder;
+  decoder.initialize(&delegate, &f);
+  EXPECT_TRUE(decoder.decode());
+
+  const Image* image = cel_image(delegate);
+  ASSERT_TRUE(image != nullptr);
+  EXPECT_EQ(0, get_pixel(image, kSize-1, kSize-1));
+}
+
+#endif
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -34,6 +34,10 @@ uint8_t Decoder::read8()
 
 uint16_t Decoder::read16()
 {
+  // Fast path for memory-mapped files
+  if (const uint8_t* p = m_f->readView(2))
+    return ((p[1] << 8) | p[0]);
+
   int b1 = m_f->read8();
   int b2 = m_f->read8();
 
@@ -46,6 +50,11 @@ uint16_t Decoder::read16()
 
 uint32_t Decoder::read32()
 {
+  if (const uint8_t* p = m_f->readView(4)) {
+    return ((uint32_t(p[3]) << 24) | (uint32_t(p[2]) << 16) |
+            (uint32_t(p[1]) << 8) | uint32_t(p[0]));
+  }
+
   int b1 = m_f->read8();
   int b2 = m_f->read8();
   int b3 = m_f->read8();
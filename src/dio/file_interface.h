@@ -31,6 +31,13 @@ public:
   virtual uint8_t read8() = 0;
   virtual size_t readBytes(uint8_t* buf, size_t n) = 0;
 
+  // Returns a pointer to the next "n" bytes of the file (without
+  // copying them) and moves the position after those bytes. Returns
+  // nullptr if this file cannot be accessed directly (e.g. it's not
+  // memory-mapped) or there are less than "n" bytes available, in
+  // that case the position is not modified.
+  virtual const uint8_t* readView(size_t n) { return nullptr; }
+
   // Writes one byte in the file (or do nothing if ok() = false)
   virtual void write8(uint8_t value) = 0;
 
@@ -50,6 +57,45 @@ private:
   bool m_ok;
 };
 
+// Read-only access to a file mapping the whole file content in
+// memory, so readView() doesn't need to copy bytes. If the file size
+// changes while it's mapped (e.g. it's truncated by other process),
+// the rest of the file is read with a StdioFileInterface (accessing
+// the mapped memory past the end of the file would crash).
+class MmapFileInterface : public FileInterface {
+public:
+  MmapFileInterface(FILE* file);
+  ~MmapFileInterface();
+
+  // Returns false if the file couldn't be mapped (e.g. it's empty or
+  // the platform doesn't support it), in that case the
+  // StdioFileInterface should be used.
+  bool isMapped() const { return m_data != nullptr; }
+
+  bool ok() const override;
+  size_t tell() override;
+  void seek(size_t absPos) override;
+  uint8_t read8() override;
+  size_t readBytes(uint8_t* buf, size_t n) override;
+  const uint8_t* readView(size_t n) override;
+  void write8(uint8_t value) override;
+private:
+  // Returns false if the file size is not the mapped size anymore,
+  // in that case we switch to buffered reads.
+  bool checkSize();
+
+  FILE* m_file;
+  StdioFileInterface m_stdio;
+  bool m_buffered;
+  const uint8_t* m_data;
+  size_t m_size;
+  size_t m_pos;
+  bool m_ok;
+#ifdef _WIN32
+  void* m_mapping;
+#endif
+};
+
 } // namespace dio
 
 #endif
@@ -0,0 +1,192 @@
+// Aseprite Document IO Library
+// Copyright (c) 2018 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include "dio/file_interface.h"
+
+#include <cstring>
+
+#ifdef _WIN32
+  #include <windows.h>
+  #include <io.h>
+#else
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+#endif
+
+namespace dio {
+
+// Reads of at least this number of bytes check if the file was
+// truncated (smaller reads are checked only when we seek, i.e. once
+// per chunk).
+static const size_t kCheckSizeBytes = 256;
+
+MmapFileInterface::MmapFileInterface(FILE* file)
+  : m_file(file)
+  , m_stdio(file)
+  , m_buffered(false)
+  , m_data(nullptr)
+  , m_size(0)
+  , m_pos(0)
+  , m_ok(true)
+#ifdef _WIN32
+  , m_mapping(nullptr)
+#endif
+{
+#ifdef _WIN32
+  HANDLE handle = (HANDLE)_get_osfhandle(_fileno(file));
+  if (handle == INVALID_HANDLE_VALUE)
+    return;
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(handle, &size) ||
+      size.QuadPart <= 0 ||
+      uint64_t(size.QuadPart) > uint64_t(SIZE_MAX))
+    return;
+
+  HANDLE mapping = CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!mapping)
+    return;
+
+  void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (!data) {
+    CloseHandle(mapping);
+    return;
+  }
+
+  m_mapping = mapping;
+  m_data = (const uint8_t*)data;
+  m_size = size_t(size.QuadPart);
+#else
+  int fd = fileno(file);
+  struct stat sts;
+  if (fd < 0 ||
+      fstat(fd, &sts) != 0 ||
+      !S_ISREG(sts.st_mode) ||
+      sts.st_size <= 0 ||
+      uint64_t(sts.st_size) > uint64_t(SIZE_MAX))
+    return;
+
+  void* data = mmap(nullptr, size_t(sts.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED)
+    return;
+
+  // The decoder goes through the file from the beginning to the end
+  madvise(data, size_t(sts.st_size), MADV_SEQUENTIAL);
+
+  m_data = (const uint8_t*)data;
+  m_size = size_t(sts.st_size);
+#endif
+}
+
+MmapFileInterface::~MmapFileInterface()
+{
+  if (!m_data)
+    return;
+
+#ifdef _WIN32
+  UnmapViewOfFile(m_data);
+  CloseHandle((HANDLE)m_mapping);
+#else
+  munmap((void*)m_data, m_size);
+#endif
+}
+
+bool MmapFileInterface::ok() const
+{
+  if (m_buffered)
+    return m_ok && m_stdio.ok();
+  else
+    return m_ok && m_data;
+}
+
+size_t MmapFileInterface::tell()
+{
+  if (m_buffered)
+    return m_stdio.tell();
+  else
+    return m_pos;
+}
+
+void MmapFileInterface::seek(size_t absPos)
+{
+  // Like fseek(), we can seek past the end of the file, the error
+  // will be reported in the next read operation.
+  if (m_buffered || !checkSize())
+    m_stdio.seek(absPos);
+  else
+    m_pos = absPos;
+}
+
+uint8_t MmapFileInterface::read8()
+{
+  if (m_buffered)
+    return m_stdio.read8();
+
+  if (m_pos < m_size)
+    return m_data[m_pos++];
+
+  m_ok = false;
+  return 0;
+}
+
+size_t MmapFileInterface::readBytes(uint8_t* buf, size_t n)
+{
+  if (m_buffered || (n >= kCheckSizeBytes && !checkSize()))
+    return m_stdio.readBytes(buf, n);
+
+  size_t n2 = (m_pos < m_size ? m_size - m_pos: 0);
+  if (n2 > n)
+    n2 = n;
+  if (n2 > 0) {
+    std::memcpy(buf, m_data+m_pos, n2);
+    m_pos += n2;
+  }
+  if (n2 != n)
+    m_ok = false;
+  return n2;
+}
+
+const uint8_t* MmapFileInterface::readView(size_t n)
+{
+  if (m_buffered || (n >= kCheckSizeBytes && !checkSize()))
+    return nullptr;
+
+  if (m_pos >= m_size || n > m_size - m_pos)
+    return nullptr;
+
+  const uint8_t* view = m_data+m_pos;
+  m_pos += n;
+  return view;
+}
+
+void MmapFileInterface::write8(uint8_t value)
+{
+  // Read-only mapping, we cannot write in the file
+  m_ok = false;
+}
+
+bool MmapFileInterface::checkSize()
+{
+  if (!m_data)
+    return true;
+
+#ifdef _WIN32
+  // Windows doesn't allow to truncate a mapped file
+  return true;
+#else
+  struct stat sts;
+  if (fstat(fileno(m_file), &sts) == 0 &&
+      uint64_t(sts.st_size) == uint64_t(m_size))
+    return true;
+
+  // Continue reading from the current position with stdio
+  m_buffered = true;
+  m_stdio.seek(m_pos);
+  return false;
+#endif
+}
+
+} // namespace dio
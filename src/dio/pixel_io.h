@@ -20,7 +20,11 @@ public:
   typename ImageTraits::pixel_t read_pixel(FileInterface* fi);
   void write_pixel(FileInterface* fi, typename ImageTraits::pixel_t c);
   void read_scanline(typename ImageTraits::address_t address,
-                     int w, uint8_t* buffer);
+                     int w, const uint8_t* buffer);
+  // Converts a scanline that was stored with the file format in the
+  // same "address" into the in-memory pixel format.
+  void read_scanline_in_place(typename ImageTraits::address_t address,
+                              int w);
   void write_scanline(typename ImageTraits::address_t address,
                       int w, uint8_t* buffer);
 };
@@ -44,7 +48,7 @@ public:
     f->write8(doc::rgba_geta(c));
   }
   void read_scanline(doc::RgbTraits::address_t address,
-                     int w, uint8_t* buffer) {
+                     int w, const uint8_t* buffer) {
     for (int x=0; x<w; ++x) {
       r = *(buffer++);
       g = *(buffer++);
@@ -53,6 +57,11 @@ public:
       *(address++) = doc::rgba(r, g, b, a);
     }
   }
+  void read_scanline_in_place(doc::RgbTraits::address_t address,
+                              int w) {
+    // Each pixel is read completely before it's overwritten
+    read_scanline(address, w, (const uint8_t*)address);
+  }
   void write_scanline(doc::RgbTraits::address_t address,
                       int w, uint8_t* buffer) {
     for (int x=0; x<w; ++x) {
@@ -79,7 +88,7 @@ public:
     f->write8(doc::graya_geta(c));
   }
   void read_scanline(doc::GrayscaleTraits::address_t address,
-                     int w, uint8_t* buffer)
+                     int w, const uint8_t* buffer)
   {
     for (int x=0; x<w; ++x) {
       k = *(buffer++);
@@ -87,6 +96,11 @@ public:
       *(address++) = doc::graya(k, a);
     }
   }
+  void read_scanline_in_place(doc::GrayscaleTraits::address_t address,
+                              int w)
+  {
+    read_scanline(address, w, (const uint8_t*)address);
+  }
   void write_scanline(doc::GrayscaleTraits::address_t address,
                       int w, uint8_t* buffer)
   {
@@ -108,9 +122,13 @@ public:
     f->write8(c);
   }
   void read_scanline(doc::IndexedTraits::address_t address,
-                     int w, uint8_t* buffer) {
+                     int w, const uint8_t* buffer) {
     std::memcpy(address, buffer, w);
   }
+  void read_scanline_in_place(doc::IndexedTraits::address_t address,
+                              int w) {
+    // Indexed pixels are stored in the file as they are in memory
+  }
   void write_scanline(doc::IndexedTraits::address_t address,
                       int w, uint8_t* buffer) {
     std::memcpy(buffer, address, w);
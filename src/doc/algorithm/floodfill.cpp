@@ -1,344 +1,600 @@
-// The floodfill routine.
-// By Shawn Hargreaves.
-//
-// Changes by David Capello:
-// - Adapted to Aseprite
-// - Added non-contiguous mode
-// - Added mask parameter
+// Aseprite Document Library
+// Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
 //
-// TODO rewrite this algorithm from scratch
+// Scanline (span) flood fill. Previous versions of this file were
+// based on the floodfill routine by Shawn Hargreaves.
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
 
+#include "doc/algorithm/floodfill.h"
+
 #include "base/base.h"
-#include "doc/algo.h"
 #include "doc/image.h"
+#include "doc/image_impl.h"
 #include "doc/mask.h"
-#include "doc/primitives.h"
 #include "doc/primitives_fast.h"
 
-#include <climits>
-#include <cmath>
+#include <algorithm>
+#include <thread>
 #include <vector>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define DOC_FLOODFILL_SSE2 1
+  #include <emmintrin.h>
+#endif
+
 namespace doc {
 namespace algorithm {
 
-struct FLOODED_LINE {   // store segments which have been flooded
-  short flags;          // status of the segment
-  short lpos, rpos;     // left and right ends of segment
-  short y;              // y coordinate of the segment
-  int next;             // linked list if several per line
-};
+namespace {
 
-/* Note: a 'short' is not sufficient for 'next' above in some corner cases. */
+// Minimum number of pixels to split the non-contiguous mode in
+// several threads.
+const int kMinParallelArea = 256*256;
 
+// Minimum number of rows processed by each thread.
+const int kMinRowsPerThread = 32;
 
-static std::vector<FLOODED_LINE> flood_buf;
-static int flood_count;          /* number of flooded segments */
+//////////////////////////////////////////////////////////////////////
+// Color matchers
+//
+// A matcher compares the pixels of the current row (setRow()) with
+// the color of the starting point. match(x) compares one pixel, and
+// matchBlock(x) compares kBlockSize pixels starting at x returning
+// one bit for each pixel (the bit 0 for the pixel x).
 
-#define FLOOD_IN_USE             1
-#define FLOOD_TODO_ABOVE         2
-#define FLOOD_TODO_BELOW         4
+// Exact comparison used for bitmaps.
+template<typename ImageTraits>
+class ColorMatcher {
+public:
+  enum { kBlockSize = 1 };
 
-#define FLOOD_LINE(c)            (&flood_buf[c])
+  ColorMatcher(const Image* image, color_t color, int tolerance)
+    : m_image(image), m_color(color), m_y(0) { }
 
-static inline bool color_equal_32(color_t c1, color_t c2, int tolerance)
-{
-  if (tolerance == 0)
-    return (c1 == c2) || (rgba_geta(c1) == 0 && rgba_geta(c2) == 0);
-  else {
-    int r1 = rgba_getr(c1);
-    int g1 = rgba_getg(c1);
-    int b1 = rgba_getb(c1);
-    int a1 = rgba_geta(c1);
-    int r2 = rgba_getr(c2);
-    int g2 = rgba_getg(c2);
-    int b2 = rgba_getb(c2);
-    int a2 = rgba_geta(c2);
-
-    if (a1 == 0 && a2 == 0)
-      return true;
+  void setRow(int y) { m_y = y; }
 
-    return ((ABS(r1-r2) <= tolerance) &&
-            (ABS(g1-g2) <= tolerance) &&
-            (ABS(b1-b2) <= tolerance) &&
-            (ABS(a1-a2) <= tolerance));
+  bool match(int x) const {
+    return (color_t(get_pixel_fast<ImageTraits>(m_image, x, m_y)) == m_color);
   }
-}
 
-static inline bool color_equal_16(color_t c1, color_t c2, int tolerance)
-{
-  if (tolerance == 0)
-    return (c1 == c2) || (graya_geta(c1) == 0 && graya_geta(c2) == 0);
-  else {
-    int k1 = graya_getv(c1);
-    int a1 = graya_geta(c1);
-    int k2 = graya_getv(c2);
-    int a2 = graya_geta(c2);
-
-    if (a1 == 0 && a2 == 0)
-      return true;
+  unsigned matchBlock(int x) const {
+    return (match(x) ? 1: 0);
+  }
+
+private:
+  const Image* m_image;
+  color_t m_color;
+  int m_y;
+};
 
-    return ((ABS(k1-k2) <= tolerance) &&
-            (ABS(a1-a2) <= tolerance));
+// Two RGB pixels are similar if the difference of each component
+// (including alpha) is less than or equal to the tolerance, or if
+// both are transparent.
+template<>
+class ColorMatcher<RgbTraits> {
+public:
+  typedef RgbTraits::pixel_t pixel_t;
+  enum { kBlockSize = 4 };
+
+  ColorMatcher(const Image* image, color_t color, int tolerance)
+    : m_image(image)
+    , m_row(nullptr)
+    , m_color(color)
+    , m_tolerance(MID(0, tolerance, 255))
+    , m_transparent(rgba_geta(color) == 0) {
   }
-}
 
-static inline bool color_equal_8(color_t c1, color_t c2, int tolerance)
-{
-  if (tolerance == 0)
-    return (c1 == c2);
-  else
-    return ABS((int)c1 - (int)c2) <= tolerance;
-}
+  void setRow(int y) {
+    m_row = (const pixel_t*)m_image->getPixelAddress(0, y);
+  }
 
-template<typename ImageTraits>
-static inline bool color_equal(color_t c1, color_t c2, int tolerance)
-{
-  static_assert(false && sizeof(ImageTraits), "Invalid color comparison");
-  return false;
-}
+  bool match(int x) const {
+    const pixel_t c = m_row[x];
+    if (m_transparent && rgba_geta(c) == 0)
+      return true;
+    return (ABS(int(rgba_getr(c)) - int(rgba_getr(m_color))) <= m_tolerance &&
+            ABS(int(rgba_getg(c)) - int(rgba_getg(m_color))) <= m_tolerance &&
+            ABS(int(rgba_getb(c)) - int(rgba_getb(m_color))) <= m_tolerance &&
+            ABS(int(rgba_geta(c)) - int(rgba_geta(m_color))) <= m_tolerance);
+  }
 
-template<>
-inline bool color_equal<RgbTraits>(color_t c1, color_t c2, int tolerance)
-{
-  return color_equal_32(c1, c2, tolerance);
-}
+  unsigned matchBlock(int x) const {
+#if DOC_FLOODFILL_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i color = _mm_set1_epi32(int(m_color));
+    const __m128i v = _mm_loadu_si128((const __m128i*)(m_row + x));
+    // Absolute difference of each component
+    const __m128i d = _mm_or_si128(_mm_subs_epu8(v, color),
+                                   _mm_subs_epu8(color, v));
+    // Components with a difference greater than the tolerance are != 0
+    __m128i eq = _mm_cmpeq_epi32(
+      _mm_subs_epu8(d, _mm_set1_epi8(char(m_tolerance))), zero);
+    if (m_transparent)
+      eq = _mm_or_si128(
+        eq, _mm_cmpeq_epi32(
+          _mm_and_si128(v, _mm_set1_epi32(int(rgba_a_mask))), zero));
+    return unsigned(_mm_movemask_ps(_mm_castsi128_ps(eq)));
+#else
+    unsigned bits = 0;
+    for (int i=0; i<kBlockSize; ++i)
+      if (match(x+i))
+        bits |= (1 << i);
+    return bits;
+#endif
+  }
 
-template<>
-inline bool color_equal<GrayscaleTraits>(color_t c1, color_t c2, int tolerance)
-{
-  return color_equal_16(c1, c2, tolerance);
-}
+private:
+  const Image* m_image;
+  const pixel_t* m_row;
+  color_t m_color;
+  int m_tolerance;
+  bool m_transparent;
+};
 
 template<>
-inline bool color_equal<IndexedTraits>(color_t c1, color_t c2, int tolerance)
-{
-  return color_equal_8(c1, c2, tolerance);
-}
+class ColorMatcher<GrayscaleTraits> {
+public:
+  typedef GrayscaleTraits::pixel_t pixel_t;
+  enum { kBlockSize = 8 };
+
+  ColorMatcher(const Image* image, color_t color, int tolerance)
+    : m_image(image)
+    , m_row(nullptr)
+    , m_color(color)
+    , m_tolerance(MID(0, tolerance, 255))
+    , m_transparent(graya_geta(color) == 0) {
+  }
 
+  void setRow(int y) {
+    m_row = (const pixel_t*)m_image->getPixelAddress(0, y);
+  }
 
+  bool match(int x) const {
+    const pixel_t c = m_row[x];
+    if (m_transparent && graya_geta(c) == 0)
+      return true;
+    return (ABS(int(graya_getv(c)) - int(graya_getv(m_color))) <= m_tolerance &&
+            ABS(int(graya_geta(c)) - int(graya_geta(m_color))) <= m_tolerance);
+  }
 
-/* flooder:
- *  Fills a horizontal line around the specified position, and adds it
- *  to the list of drawn segments. Returns the first x coordinate after
- *  the part of the line which it has dealt with.
- */
-static int flooder(const Image* image,
-                   const Mask* mask,
-                   int x, int y,
-                   const gfx::Rect& bounds,
-                   color_t src_color, int tolerance, void *data, AlgoHLine proc)
-{
-#define MASKED(u, v)                                                    \
-        (mask &&                                                        \
-         (!mask->bounds().contains(u, v) ||                             \
-          (mask->bitmap() &&                                            \
-           !get_pixel_fast<BitmapTraits>(mask->bitmap(),                \
-                                         (u)-mask->bounds().x,          \
-                                         (v)-mask->bounds().y))))
-
-  FLOODED_LINE *p;
-  int left = 0, right = 0;
-  int c;
+  unsigned matchBlock(int x) const {
+#if DOC_FLOODFILL_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i color = _mm_set1_epi16(short(m_color));
+    const __m128i v = _mm_loadu_si128((const __m128i*)(m_row + x));
+    const __m128i d = _mm_or_si128(_mm_subs_epu8(v, color),
+                                   _mm_subs_epu8(color, v));
+    __m128i eq = _mm_cmpeq_epi16(
+      _mm_subs_epu8(d, _mm_set1_epi8(char(m_tolerance))), zero);
+    if (m_transparent)
+      eq = _mm_or_si128(
+        eq, _mm_cmpeq_epi16(
+          _mm_and_si128(v, _mm_set1_epi16(short(graya_a_mask))), zero));
+    // Convert each 16-bit result to one byte to get one bit per pixel
+    return unsigned(_mm_movemask_epi8(_mm_packs_epi16(eq, zero)));
+#else
+    unsigned bits = 0;
+    for (int i=0; i<kBlockSize; ++i)
+      if (match(x+i))
+        bits |= (1 << i);
+    return bits;
+#endif
+  }
 
-  switch (image->pixelFormat()) {
+private:
+  const Image* m_image;
+  const pixel_t* m_row;
+  color_t m_color;
+  int m_tolerance;
+  bool m_transparent;
+};
 
-    case IMAGE_RGB:
-      {
-        uint32_t* address = reinterpret_cast<uint32_t*>(image->getPixelAddress(0, y));
+template<>
+class ColorMatcher<IndexedTraits> {
+public:
+  typedef IndexedTraits::pixel_t pixel_t;
+  enum { kBlockSize = 16 };
+
+  ColorMatcher(const Image* image, color_t color, int tolerance)
+    : m_image(image)
+    , m_row(nullptr)
+    , m_color(color)
+    , m_tolerance(MID(0, tolerance, 255)) {
+  }
 
-        // Check start pixel
-        if (!color_equal_32((int)*(address+x), src_color, tolerance) || MASKED(x, y))
-          return x+1;
+  void setRow(int y) {
+    m_row = (const pixel_t*)m_image->getPixelAddress(0, y);
+  }
 
-        // Work left from starting point
-        for (left=x-1; left>=bounds.x; left--) {
-          if (!color_equal_32((int)*(address+left), src_color, tolerance) || MASKED(left, y))
-            break;
-        }
+  bool match(int x) const {
+    return (ABS(int(m_row[x]) - int(m_color)) <= m_tolerance);
+  }
 
-        // Work right from starting point
-        for (right=x+1; right<bounds.x2(); right++) {
-          if (!color_equal_32((int)*(address+right), src_color, tolerance) || MASKED(right, y))
-            break;
-        }
-      }
-      break;
+  unsigned matchBlock(int x) const {
+#if DOC_FLOODFILL_SSE2
+    const __m128i color = _mm_set1_epi8(char(m_color));
+    const __m128i v = _mm_loadu_si128((const __m128i*)(m_row + x));
+    const __m128i d = _mm_or_si128(_mm_subs_epu8(v, color),
+                                   _mm_subs_epu8(color, v));
+    const __m128i eq = _mm_cmpeq_epi8(
+      _mm_subs_epu8(d, _mm_set1_epi8(char(m_tolerance))),
+      _mm_setzero_si128());
+    return unsigned(_mm_movemask_epi8(eq));
+#else
+    unsigned bits = 0;
+    for (int i=0; i<kBlockSize; ++i)
+      if (match(x+i))
+        bits |= (1 << i);
+    return bits;
+#endif
+  }
 
-    case IMAGE_GRAYSCALE:
-      {
-        uint16_t* address = reinterpret_cast<uint16_t*>(image->getPixelAddress(0, y));
+private:
+  const Image* m_image;
+  const pixel_t* m_row;
+  color_t m_color;
+  int m_tolerance;
+};
 
-        // Check start pixel
-        if (!color_equal_16((int)*(address+x), src_color, tolerance) || MASKED(x, y))
-          return x+1;
+// Restricts the pixels of other matcher to the selected area.
+template<typename Matcher>
+class MaskedMatcher {
+public:
+  enum { kBlockSize = Matcher::kBlockSize };
+
+  MaskedMatcher(const Matcher& matcher, const Mask* mask)
+    : m_matcher(matcher)
+    , m_bitmap(mask->bitmap())
+    , m_bounds(mask->bounds())
+    , m_row(nullptr) {
+  }
 
-        // Work left from starting point
-        for (left=x-1; left>=bounds.x; left--) {
-          if (!color_equal_16((int)*(address+left), src_color, tolerance) || MASKED(left, y))
-            break;
-        }
+  void setRow(int y) {
+    m_matcher.setRow(y);
+    if (m_bitmap && y >= m_bounds.y && y < m_bounds.y2())
+      m_row = m_bitmap->getPixelAddress(0, y - m_bounds.y);
+    else
+      m_row = nullptr;
+  }
 
-        // Work right from starting point
-        for (right=x+1; right<bounds.x2(); right++) {
-          if (!color_equal_16((int)*(address+right), src_color, tolerance) || MASKED(right, y))
-            break;
-        }
-      }
-      break;
+  bool match(int x) const {
+    return (isSelected(x) && m_matcher.match(x));
+  }
 
-    case IMAGE_INDEXED:
-      {
-        uint8_t* address = image->getPixelAddress(0, y);
+  unsigned matchBlock(int x) const {
+    if (!m_row)
+      return 0;
+
+    unsigned bits = m_matcher.matchBlock(x);
+    if (!bits)
+      return 0;
+
+    const int u = x - m_bounds.x;
+    if (u >= 0 && u+kBlockSize <= m_bounds.w) {
+      // Read the (up to 3) bytes of the bitmap that contain the
+      // kBlockSize bits of this block.
+      const int stride = BitmapTraits::getRowStrideBytes(m_bounds.w);
+      const int i = (u >> 3);
+      uint32_t maskBits = m_row[i];
+      if (i+1 < stride) maskBits |= (uint32_t(m_row[i+1]) << 8);
+      if (i+2 < stride) maskBits |= (uint32_t(m_row[i+2]) << 16);
+      return bits & (maskBits >> (u & 7));
+    }
 
-        // Check start pixel
-        if (!color_equal_8((int)*(address+x), src_color, tolerance) || MASKED(x, y))
-          return x+1;
+    for (int i=0; i<kBlockSize; ++i)
+      if (!isSelected(x+i))
+        bits &= ~(1 << i);
+    return bits;
+  }
 
-        // Work left from starting point
-        for (left=x-1; left>=bounds.x; left--) {
-          if (!color_equal_8((int)*(address+left), src_color, tolerance) || MASKED(left, y))
-            break;
-        }
+private:
+  bool isSelected(int x) const {
+    const int u = x - m_bounds.x;
+    return (m_row && u >= 0 && u < m_bounds.w &&
+            (m_row[u >> 3] & (1 << (u & 7))));
+  }
 
-        // Work right from starting point
-        for (right=x+1; right<bounds.x2(); right++) {
-          if (!color_equal_8((int)*(address+right), src_color, tolerance) || MASKED(right, y))
-            break;
-        }
-      }
-      break;
+  Matcher m_matcher;
+  const Image* m_bitmap;
+  gfx::Rect m_bounds;
+  const uint8_t* m_row;
+};
 
-    default:
-      // Check start pixel
-      if (get_pixel(image, x, y) != src_color || MASKED(x, y))
-        return x+1;
+//////////////////////////////////////////////////////////////////////
+// Span scanning
 
-      // Work left from starting point
-      for (left=x-1; left>=bounds.x; left--) {
-        if (get_pixel(image, left, y) != src_color || MASKED(left, y))
-          break;
+// Returns the first pixel in [x, x2) where match() != state, or x2
+// if all pixels in the range have the given state.
+template<typename Matcher>
+int scan_right(const Matcher& m, int x, const int x2, const bool state)
+{
+  const unsigned expected = (state ? (1 << Matcher::kBlockSize) - 1: 0);
+
+  for (; x+Matcher::kBlockSize <= x2; x += Matcher::kBlockSize) {
+    unsigned bits = m.matchBlock(x) ^ expected;
+    if (bits) {
+      while (!(bits & 1)) {
+        bits >>= 1;
+        ++x;
       }
+      return x;
+    }
+  }
 
-      // Work right from starting point
-      for (right=x+1; right<bounds.x2(); right++) {
-        if (get_pixel(image, right, y) != src_color || MASKED(right, y))
-          break;
-      }
+  for (; x<x2; ++x)
+    if (m.match(x) != state)
       break;
+  return x;
+}
+
+// Returns the first pixel l in [x1, x] where all pixels in [l, x]
+// have the given state.
+template<typename Matcher>
+int scan_left(const Matcher& m, int x, const int x1, const bool state)
+{
+  const unsigned expected = (state ? (1 << Matcher::kBlockSize) - 1: 0);
+
+  for (; x-Matcher::kBlockSize+1 >= x1; x -= Matcher::kBlockSize) {
+    const int start = x-Matcher::kBlockSize+1;
+    const unsigned bits = m.matchBlock(start) ^ expected;
+    if (bits) {
+      int i = Matcher::kBlockSize-1;
+      while (!(bits & (1 << i)))
+        --i;
+      return start+i+1;
+    }
   }
 
-  left++;
-  right--;
+  for (; x>=x1; --x)
+    if (m.match(x) != state)
+      return x+1;
+  return x1;
+}
 
-  /* draw the line */
-  (*proc)(left, y, right, data);
+// One bit for each pixel in the bounds to know which pixels were
+// already included in a span.
+class VisitedPixels {
+public:
+  VisitedPixels(const gfx::Rect& bounds)
+    : m_bounds(bounds)
+    , m_wordsPerRow((bounds.w+31) / 32)
+    , m_words(std::size_t(m_wordsPerRow) * bounds.h, 0) {
+  }
 
-  /* store it in the list of flooded segments */
-  c = y;
-  p = FLOOD_LINE(c);
+  bool get(int x, int y) const {
+    x -= m_bounds.x;
+    return (row(y)[x >> 5] & (1 << (x & 31))) ? true: false;
+  }
 
-  if (p->flags) {
-    while (p->next) {
-      c = p->next;
-      p = FLOOD_LINE(c);
+  // Returns the first pixel in [x, x2) that wasn't visited, or x2.
+  int nextUnvisited(int x, int y, const int x2) const {
+    const uint32_t* words = row(y);
+    for (int u=x-m_bounds.x, u2=x2-m_bounds.x; u<u2; ) {
+      const uint32_t word = words[u >> 5];
+      if (word == 0xffffffff && (u & 31) == 0) {
+        u += 32;
+        continue;
+      }
+      if (!(word & (1 << (u & 31))))
+        return std::min(u+m_bounds.x, x2);
+      ++u;
     }
+    return x2;
+  }
 
-    p->next = c = flood_count++;
-    flood_buf.resize(flood_count);
-    p = FLOOD_LINE(c);
+  void add(int x1, int y, int x2) {
+    uint32_t* words = row(y);
+    for (int u=x1-m_bounds.x, u2=x2-m_bounds.x; u<=u2; ) {
+      if ((u & 31) == 0 && u+31 <= u2) {
+        words[u >> 5] = 0xffffffff;
+        u += 32;
+      }
+      else {
+        words[u >> 5] |= (1 << (u & 31));
+        ++u;
+      }
+    }
   }
 
-  p->flags = FLOOD_IN_USE;
-  p->lpos = left;
-  p->rpos = right;
-  p->y = y;
-  p->next = 0;
+private:
+  const uint32_t* row(int y) const {
+    return &m_words[std::size_t(y-m_bounds.y) * m_wordsPerRow];
+  }
+  uint32_t* row(int y) {
+    return &m_words[std::size_t(y-m_bounds.y) * m_wordsPerRow];
+  }
 
-  if (y > bounds.y)
-    p->flags |= FLOOD_TODO_ABOVE;
+  gfx::Rect m_bounds;
+  int m_wordsPerRow;
+  std::vector<uint32_t> m_words;
+};
 
-  if (y+1 < bounds.y2())
-    p->flags |= FLOOD_TODO_BELOW;
+// Contiguous mode: each span is filled completely when it's found,
+// and then the rows above and below it are checked to find new spans.
+template<typename Matcher>
+void flood_spans(Matcher m,
+                 const int x, const int y,
+                 const gfx::Rect& bounds,
+                 std::vector<FloodSpan>& spans)
+{
+  m.setRow(y);
+  if (!m.match(x))
+    return;
 
-  return right+2;
-}
+  VisitedPixels visited(bounds);
+  std::vector<FloodSpan> pending;
 
+  const FloodSpan first(scan_left(m, x, bounds.x, true), y,
+                        scan_right(m, x+1, bounds.x2(), true)-1);
+  visited.add(first.x1, first.y, first.x2);
+  spans.push_back(first);
+  pending.push_back(first);
 
+  while (!pending.empty()) {
+    const FloodSpan span = pending.back();
+    pending.pop_back();
 
-/* check_flood_line:
- *  Checks a line segment, using the scratch buffer is to store a list of
- *  segments which have already been drawn in order to minimise the required
- *  number of tests.
- */
-static int check_flood_line(const Image* image,
-                            const Mask* mask,
-                            int y, int left, int right,
-                            const gfx::Rect& bounds,
-                            int src_color, int tolerance, void *data, AlgoHLine proc)
-{
-  int c;
-  FLOODED_LINE *p;
-  int ret = false;
+    for (int v=span.y-1; v<=span.y+1; v+=2) {
+      if (v < bounds.y || v >= bounds.y2())
+        continue;
 
-  while (left <= right) {
-    c = y;
+      m.setRow(v);
+      for (int u=span.x1; u<=span.x2; ) {
+        if (visited.get(u, v)) {
+          u = visited.nextUnvisited(u+1, v, span.x2+1);
+          continue;
+        }
+        if (!m.match(u)) {
+          u = scan_right(m, u+1, span.x2+1, false);
+          continue;
+        }
 
-    for (;;) {
-      p = FLOOD_LINE(c);
+        // As spans are maximal runs of similar pixels, only a span
+        // that starts at the first pixel can continue to the left.
+        const FloodSpan newSpan(
+          (u == span.x1 ? scan_left(m, u, bounds.x, true): u), v,
+          scan_right(m, u+1, bounds.x2(), true)-1);
+        visited.add(newSpan.x1, newSpan.y, newSpan.x2);
+        spans.push_back(newSpan);
+        pending.push_back(newSpan);
 
-      if ((left >= p->lpos) && (left <= p->rpos)) {
-        left = p->rpos+2;
-        break;
+        u = newSpan.x2+2;
       }
+    }
+  }
 
-      c = p->next;
+  std::sort(spans.begin(), spans.end(),
+            [](const FloodSpan& a, const FloodSpan& b) {
+              return (a.y < b.y || (a.y == b.y && a.x1 < b.x1));
+            });
+}
 
-      if (!c) {
-        left = flooder(image, mask, left, y, bounds, src_color, tolerance, data, proc);
-        ret = true;
+// Non-contiguous mode: finds all similar pixels in the given rows.
+template<typename Matcher>
+void replace_color_rows(Matcher m,
+                        const int y1, const int y2,
+                        const gfx::Rect& bounds,
+                        std::vector<FloodSpan>& spans)
+{
+  const int x2 = bounds.x2();
+  for (int y=y1; y<y2; ++y) {
+    m.setRow(y);
+    for (int x=bounds.x; x<x2; ) {
+      x = scan_right(m, x, x2, false);
+      if (x == x2)
         break;
-      }
+
+      const int right = scan_right(m, x+1, x2, true);
+      spans.push_back(FloodSpan(x, y, right-1));
+      x = right+1;
     }
   }
+}
+
+template<typename Matcher>
+void replace_color(const Matcher& m,
+                   const gfx::Rect& bounds,
+                   std::vector<FloodSpan>& spans)
+{
+  int nthreads = 1;
+  if (bounds.w*bounds.h >= kMinParallelArea)
+    nthreads = MID(1, int(std::thread::hardware_concurrency()),
+                   bounds.h / kMinRowsPerThread);
+
+  if (nthreads == 1) {
+    replace_color_rows(m, bounds.y, bounds.y2(), bounds, spans);
+    return;
+  }
+
+  // Each thread processes a band of rows, then the spans are joined
+  // in the same order (top to bottom).
+  std::vector<std::vector<FloodSpan>> bands(nthreads);
+  std::vector<std::thread> threads;
+  for (int i=0; i<nthreads; ++i) {
+    const int y1 = bounds.y + bounds.h*i/nthreads;
+    const int y2 = bounds.y + bounds.h*(i+1)/nthreads;
+    threads.push_back(
+      std::thread([&m, &bounds, &bands, i, y1, y2]{
+          replace_color_rows(m, y1, y2, bounds, bands[i]);
+        }));
+  }
+
+  std::size_t n = spans.size();
+  for (int i=0; i<nthreads; ++i) {
+    threads[i].join();
+    n += bands[i].size();
+  }
 
-  return ret;
+  spans.reserve(n);
+  for (const auto& band : bands)
+    spans.insert(spans.end(), band.begin(), band.end());
 }
 
 template<typename ImageTraits>
-static void replace_color(const Image* image, const gfx::Rect& bounds, int src_color, int tolerance, void* data, AlgoHLine proc)
+void floodfill_spans_templ(const Image* image,
+                           const Mask* mask,
+                           const int x, const int y,
+                           const gfx::Rect& bounds,
+                           const color_t srcColor,
+                           const int tolerance,
+                           const bool contiguous,
+                           std::vector<FloodSpan>& spans)
 {
-  typename ImageTraits::address_t address;
+  const ColorMatcher<ImageTraits> matcher(image, srcColor, tolerance);
+
+  // The non-contiguous mode doesn't use the mask
+  if (!contiguous)
+    replace_color(matcher, bounds, spans);
+  else if (mask)
+    flood_spans(MaskedMatcher<ColorMatcher<ImageTraits>>(matcher, mask),
+                x, y, bounds, spans);
+  else
+    flood_spans(matcher, x, y, bounds, spans);
+}
 
-  for (int y=bounds.y; y<bounds.y2(); ++y) {
-    address = reinterpret_cast<typename ImageTraits::address_t>(image->getPixelAddress(bounds.x, y));
+} // anonymous namespace
 
-    for (int x=bounds.x; x<bounds.x2(); ++x, ++address) {
-      int right = -1;
+void floodfill_spans(const Image* image,
+                     const Mask* mask,
+                     const int x, const int y,
+                     const gfx::Rect& _bounds,
+                     const doc::color_t src_color,
+                     const int tolerance,
+                     const bool contiguous,
+                     std::vector<FloodSpan>& spans)
+{
+  const gfx::Rect bounds = (_bounds & image->bounds());
 
-      if (color_equal<ImageTraits>((int)(*address), src_color, tolerance)) {
-        ++address;
-        for (right=x+1; right<bounds.x2(); ++right, ++address) {
-          if (!color_equal<ImageTraits>((int)(*address), src_color, tolerance))
-            break;
-        }
-        (*proc)(x, y, right-1, data);
-        x = right;
-      }
-    }
+  // Make sure we have a valid starting point
+  if (!bounds.contains(gfx::Point(x, y)))
+    return;
+
+  switch (image->pixelFormat()) {
+    case IMAGE_RGB:
+      floodfill_spans_templ<RgbTraits>(image, mask, x, y, bounds, src_color,
+                                       tolerance, contiguous, spans);
+      break;
+    case IMAGE_GRAYSCALE:
+      floodfill_spans_templ<GrayscaleTraits>(image, mask, x, y, bounds, src_color,
+                                             tolerance, contiguous, spans);
+      break;
+    case IMAGE_INDEXED:
+      floodfill_spans_templ<IndexedTraits>(image, mask, x, y, bounds, src_color,
+                                           tolerance, contiguous, spans);
+      break;
+    case IMAGE_BITMAP:
+      floodfill_spans_templ<BitmapTraits>(image, mask, x, y, bounds, src_color,
+                                          tolerance, contiguous, spans);
+      break;
   }
 }
 
-/* floodfill:
- *  Fills an enclosed area (starting at point x, y) with the specified color.
- */
 void floodfill(const Image* image,
                const Mask* mask,
                const int x, const int y,
@@ -349,75 +605,14 @@ void floodfill(const Image* image,
                void* data,
                AlgoHLine proc)
 {
-  // Make sure we have a valid starting point
-  if ((x < 0) || (x >= image->width()) ||
-      (y < 0) || (y >= image->height()))
-    return;
-
-  // Non-contiguous case, we replace colors in the whole image.
-  if (!contiguous) {
-    switch (image->pixelFormat()) {
-      case IMAGE_RGB:
-        replace_color<RgbTraits>(image, bounds, src_color, tolerance, data, proc);
-        break;
-      case IMAGE_GRAYSCALE:
-        replace_color<GrayscaleTraits>(image, bounds, src_color, tolerance, data, proc);
-        break;
-      case IMAGE_INDEXED:
-        replace_color<IndexedTraits>(image, bounds, src_color, tolerance, data, proc);
-        break;
-    }
-    return;
-  }
-
-  /* set up the list of flooded segments */
-  flood_buf.resize(image->height());
-  flood_count = image->height();
-  FLOODED_LINE* p = (FLOODED_LINE*)&flood_buf[0];
-  for (int c=0; c<flood_count; c++) {
-    p[c].flags = 0;
-    p[c].lpos = SHRT_MAX;
-    p[c].rpos = SHRT_MIN;
-    p[c].y = y;
-    p[c].next = 0;
-  }
-
-  // Start up the flood algorithm
-  flooder(image, mask, x, y, bounds, src_color, tolerance, data, proc);
-
-  // Continue as long as there are some segments still to test
-  bool done;
-  do {
-    done = true;
-
-    // For each line on the screen
-    for (int c=0; c<flood_count; c++) {
-
-      p = FLOOD_LINE(c);
-
-      // Check below the segment?
-      if (p->flags & FLOOD_TODO_BELOW) {
-        p->flags &= ~FLOOD_TODO_BELOW;
-        if (check_flood_line(image, mask, p->y+1, p->lpos, p->rpos, bounds,
-            src_color, tolerance, data, proc)) {
-          done = false;
-          p = FLOOD_LINE(c);
-        }
-      }
-
-      // Check above the segment?
-      if (p->flags & FLOOD_TODO_ABOVE) {
-        p->flags &= ~FLOOD_TODO_ABOVE;
-        if (check_flood_line(image, mask, p->y-1, p->lpos, p->rpos, bounds,
-                             src_color, tolerance, data, proc)) {
-          done = false;
-          // Special case shortcut for going backwards
-          if ((c > bounds.y) && (c < bounds.y2()))
-            c -= 2;
-        }
-      }
-    }
-  } while (!done);
+  std::vector<FloodSpan> spans;
+  floodfill_spans(image, mask, x, y, bounds, src_color,
+                  tolerance, contiguous, spans);
+
+  // The callback is called from this thread once the whole area is
+  // calculated (so proc can modify the source image).
+  for (const FloodSpan& span : spans)
+    (*proc)(span.x1, span.y, span.x2, data);
 }
 
 } // namespace algorithm
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2001-2017 David Capello
+// Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -12,6 +12,8 @@
 #include "doc/color.h"
 #include "gfx/fwd.h"
 
+#include <vector>
+
 namespace doc {
 
   class Image;
@@ -19,6 +21,28 @@ namespace doc {
 
   namespace algorithm {
 
+    // Horizontal segment of pixels from x1 to x2 (both inclusive) in
+    // the row y.
+    struct FloodSpan {
+      int x1, y, x2;
+      FloodSpan() { }
+      FloodSpan(int x1, int y, int x2) : x1(x1), y(y), x2(x2) { }
+    };
+
+    // Calculates the area that should be filled starting from the
+    // given point (or all the pixels similar to srcColor if
+    // contiguous is false). The result is a list of spans sorted by
+    // row and column.
+    void floodfill_spans(const Image* image,
+                         const Mask* mask,
+                         const int x, const int y,
+                         const gfx::Rect& bounds,
+                         const doc::color_t srcColor,
+                         const int tolerance,
+                         const bool contiguous,
+                         std::vector<FloodSpan>& spans);
+
+    // Same as floodfill_spans() but calling proc for each span.
     void floodfill(const Image* image,
                    const Mask* mask,
                    const int x, const int y,
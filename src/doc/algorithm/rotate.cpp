@@ -227,6 +227,12 @@ static void draw_scanline(
 template<class Traits>
 class GenericDelegate {
 public:
+  // Unlocks (unpins) the image if the scanline wasn't completed
+  // (e.g. an exception loading a swapped image)
+  ~GenericDelegate() {
+    m_bits.unlock();
+  }
+
   void lockBits(Image* bmp, const gfx::Rect& bounds) {
     m_bits = bmp->lockBits<Traits>(Image::ReadWriteLock, bounds);
     m_it = m_bits.begin();
@@ -0,0 +1,310 @@
+// Aseprite Document Library
+// Copyright (c) 2018 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/bitmap_ops.h"
+
+#include "base/base.h"
+#include "base/debug.h"
+#include "doc/image.h"
+#include "doc/image_traits.h"
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(_MSC_VER)
+  #include <intrin.h>
+#endif
+
+namespace doc {
+
+namespace {
+
+// Pixel "x" of a bitmap row is the bit (x & 7) of the byte (x >> 3),
+// so loading 8 bytes as a little-endian 64-bit word gives us the
+// pixel x+i in the bit i of the word.
+class BitmapRow {
+public:
+  BitmapRow(const Image* image, int y)
+    : m_bytes(const_cast<uint8_t*>(image->getPixelAddress(0, y)))
+    , m_size(BitmapTraits::getRowStrideBytes(image->width())) {
+  }
+
+  // Returns the 64 pixels starting at "x" (pixels outside the row
+  // are zero).
+  uint64_t get(int x) const {
+    const int i = (x >> 3);
+    const int s = (x & 7);
+    uint64_t bits = load(i, MIN(8, m_size-i));
+    if (s) {
+      bits >>= s;
+      if (i+8 < m_size)
+        bits |= (uint64_t(m_bytes[i+8]) << (64-s));
+    }
+    return bits;
+  }
+
+  // Replaces the "n" pixels (1 <= n <= 64) starting at "x" with the
+  // first "n" bits of "bits".
+  void set(int x, int n, uint64_t bits) {
+    ASSERT(n >= 1 && n <= 64);
+    const int i = (x >> 3);
+    const int s = (x & 7);
+    const uint64_t mask = lowBits(n);
+    const int nbytes = MIN(8, ((x+n-1) >> 3) - i + 1);
+
+    uint64_t word = load(i, nbytes);
+    word = (word & ~(mask << s)) | ((bits & mask) << s);
+    store(i, nbytes, word);
+
+    // Pixels that don't fit in the first 8 bytes
+    if (s && n > 64-s) {
+      const uint8_t hiMask = uint8_t(mask >> (64-s));
+      m_bytes[i+8] = uint8_t((m_bytes[i+8] & ~hiMask) |
+                             ((bits >> (64-s)) & hiMask));
+    }
+  }
+
+  static uint64_t lowBits(int n) {
+    return (n >= 64 ? ~uint64_t(0): (uint64_t(1) << n) - 1);
+  }
+
+private:
+  uint64_t load(int i, int n) const {
+    uint64_t word = 0;
+    if (n == 8) {
+      std::memcpy(&word, m_bytes+i, 8);
+      return fromLittleEndian(word);
+    }
+    for (int j=0; j<n; ++j)
+      word |= (uint64_t(m_bytes[i+j]) << (8*j));
+    return word;
+  }
+
+  void store(int i, int n, uint64_t word) {
+    if (n == 8) {
+      word = fromLittleEndian(word);
+      std::memcpy(m_bytes+i, &word, 8);
+      return;
+    }
+    for (int j=0; j<n; ++j)
+      m_bytes[i+j] = uint8_t(word >> (8*j));
+  }
+
+  // Converts a word loaded with memcpy() to the little-endian order
+  // (and vice versa)
+  static uint64_t fromLittleEndian(uint64_t word) {
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    return __builtin_bswap64(word);
+#else
+    return word;
+#endif
+  }
+
+  uint8_t* m_bytes;
+  int m_size;
+};
+
+inline int count_bits(uint64_t v)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_popcountll(v);
+#else
+  int n = 0;
+  for (; v; v &= v-1)
+    ++n;
+  return n;
+#endif
+}
+
+template<typename Op>
+void combine_rows(Image* dst, const Image* src, const gfx::Clip& area, Op op)
+{
+  dst->unshare();
+  for (int v=0; v<area.size.h; ++v) {
+    BitmapRow dstRow(dst, area.dst.y+v);
+    const BitmapRow srcRow(src, area.src.y+v);
+
+    for (int u=0; u<area.size.w; u+=64) {
+      const int n = MIN(64, area.size.w-u);
+      dstRow.set(area.dst.x+u, n,
+                 op(dstRow.get(area.dst.x+u),
+                    srcRow.get(area.src.x+u)));
+    }
+  }
+}
+
+} // anonymous namespace
+
+int lowest_bit(uint64_t v)
+{
+  ASSERT(v);
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_ctzll(v);
+#elif defined(_MSC_VER) && defined(_M_X64)
+  unsigned long i;
+  _BitScanForward64(&i, v);
+  return int(i);
+#else
+  int i = 0;
+  for (; !(v & 1); v >>= 1)
+    ++i;
+  return i;
+#endif
+}
+
+int highest_bit(uint64_t v)
+{
+  ASSERT(v);
+#if defined(__GNUC__) || defined(__clang__)
+  return 63 - __builtin_clzll(v);
+#elif defined(_MSC_VER) && defined(_M_X64)
+  unsigned long i;
+  _BitScanReverse64(&i, v);
+  return int(i);
+#else
+  int i = 0;
+  for (v >>= 1; v; v >>= 1)
+    ++i;
+  return i;
+#endif
+}
+
+void bitmap_combine(Image* dst, const Image* src, gfx::Clip area, BitmapOp op)
+{
+  ASSERT(dst->pixelFormat() == IMAGE_BITMAP);
+  ASSERT(src->pixelFormat() == IMAGE_BITMAP);
+
+  if (!area.clip(dst->width(), dst->height(), src->width(), src->height()))
+    return;
+
+  switch (op) {
+    case BitmapOp::Copy:
+      combine_rows(dst, src, area, [](uint64_t a, uint64_t b) { return b; });
+      break;
+    case BitmapOp::Or:
+      combine_rows(dst, src, area, [](uint64_t a, uint64_t b) { return a | b; });
+      break;
+    case BitmapOp::And:
+      combine_rows(dst, src, area, [](uint64_t a, uint64_t b) { return a & b; });
+      break;
+    case BitmapOp::AndNot:
+      combine_rows(dst, src, area, [](uint64_t a, uint64_t b) { return a & ~b; });
+      break;
+  }
+}
+
+void bitmap_fill_rect(Image* dst, gfx::Rect rc, bool value)
+{
+  ASSERT(dst->pixelFormat() == IMAGE_BITMAP);
+
+  rc &= dst->bounds();
+  const uint64_t bits = (value ? ~uint64_t(0): 0);
+  dst->unshare();
+
+  for (int y=rc.y; y<rc.y2(); ++y) {
+    BitmapRow row(dst, y);
+    for (int x=rc.x; x<rc.x2(); x+=64)
+      row.set(x, MIN(64, rc.x2()-x), bits);
+  }
+}
+
+void bitmap_invert(Image* dst)
+{
+  ASSERT(dst->pixelFormat() == IMAGE_BITMAP);
+  dst->unshare();
+
+  const int w = dst->width();
+  for (int y=0; y<dst->height(); ++y) {
+    BitmapRow row(dst, y);
+    for (int x=0; x<w; x+=64)
+      row.set(x, MIN(64, w-x), ~row.get(x));
+  }
+}
+
+bool is_full_bitmap(const Image* bitmap)
+{
+  ASSERT(bitmap->pixelFormat() == IMAGE_BITMAP);
+
+  const int w = bitmap->width();
+  for (int y=0; y<bitmap->height(); ++y) {
+    const BitmapRow row(bitmap, y);
+    for (int x=0; x<w; x+=64) {
+      const uint64_t mask = BitmapRow::lowBits(w-x);
+      if ((row.get(x) & mask) != mask)
+        return false;
+    }
+  }
+  return true;
+}
+
+int count_bitmap_pixels(const Image* bitmap)
+{
+  ASSERT(bitmap->pixelFormat() == IMAGE_BITMAP);
+
+  const int w = bitmap->width();
+  int count = 0;
+  for (int y=0; y<bitmap->height(); ++y) {
+    const BitmapRow row(bitmap, y);
+    for (int x=0; x<w; x+=64)
+      count += count_bits(row.get(x) & BitmapRow::lowBits(w-x));
+  }
+  return count;
+}
+
+uint64_t get_bitmap_bits(const Image* bitmap, int x, int y)
+{
+  ASSERT(bitmap->pixelFormat() == IMAGE_BITMAP);
+
+  const int w = bitmap->width();
+  if (y < 0 || y >= bitmap->height() || x >= w || x <= -64)
+    return 0;
+
+  const BitmapRow row(bitmap, y);
+  if (x < 0)
+    return ((row.get(0) & BitmapRow::lowBits(w)) << (-x));
+  else
+    return (row.get(x) & BitmapRow::lowBits(w-x));
+}
+
+gfx::Rect bitmap_bounds(const Image* bitmap)
+{
+  ASSERT(bitmap->pixelFormat() == IMAGE_BITMAP);
+
+  const int w = bitmap->width();
+  int x1 = w, y1 = -1, x2 = -1, y2 = -1;
+
+  for (int y=0; y<bitmap->height(); ++y) {
+    const BitmapRow row(bitmap, y);
+    bool empty = true;
+
+    for (int x=0; x<w; x+=64) {
+      const uint64_t bits = (row.get(x) & BitmapRow::lowBits(w-x));
+      if (!bits)
+        continue;
+
+      empty = false;
+      x1 = MIN(x1, x+lowest_bit(bits));
+      x2 = MAX(x2, x+highest_bit(bits));
+    }
+
+    if (!empty) {
+      if (y1 < 0)
+        y1 = y;
+      y2 = y;
+    }
+  }
+
+  if (y1 < 0)
+    return gfx::Rect();
+  else
+    return gfx::Rect(x1, y1, x2-x1+1, y2-y1+1);
+}
+
+} // namespace doc
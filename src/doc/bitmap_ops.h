@@ -0,0 +1,105 @@
+// Aseprite Document Library
+// Copyright (c) 2018 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_BITMAP_OPS_H_INCLUDED
+#define DOC_BITMAP_OPS_H_INCLUDED
+#pragma once
+
+#include "gfx/clip.h"
+#include "gfx/rect.h"
+
+#include <cstdint>
+
+namespace doc {
+
+  class Image;
+
+  // Operations for IMAGE_BITMAP images (e.g. Mask bitmaps). These
+  // functions process 64 pixels at the same time, so the bits of
+  // each row are read/written as 64-bit words.
+
+  enum class BitmapOp {
+    Copy,                       // dst = src
+    Or,                         // dst = dst | src
+    And,                        // dst = dst & src
+    AndNot,                     // dst = dst & ~src
+  };
+
+  // Combines the pixels of "src" with the pixels of "dst" in the
+  // given area (the area is clipped to the bounds of both images).
+  void bitmap_combine(Image* dst, const Image* src, gfx::Clip area, BitmapOp op);
+
+  // Sets (value=true) or clears all pixels in the given rectangle.
+  void bitmap_fill_rect(Image* dst, gfx::Rect rc, bool value);
+
+  // Inverts all pixels of the bitmap.
+  void bitmap_invert(Image* dst);
+
+  // Returns true if all pixels of the bitmap are set.
+  bool is_full_bitmap(const Image* bitmap);
+
+  // Returns the number of pixels that are set.
+  int count_bitmap_pixels(const Image* bitmap);
+
+  // Returns the 64 pixels of the row "y" starting at "x" (the pixel
+  // x+i in the bit i). Pixels outside the bitmap are zero, so "x" and
+  // "y" can be outside the bitmap bounds.
+  uint64_t get_bitmap_bits(const Image* bitmap, int x, int y);
+
+  // Returns the smallest rectangle that contains all pixels that
+  // are set, or an empty rectangle if the bitmap is empty.
+  gfx::Rect bitmap_bounds(const Image* bitmap);
+
+  // Index of the lowest/highest bit set in the given word (v != 0).
+  int lowest_bit(uint64_t v);
+  int highest_bit(uint64_t v);
+
+  // Calls func(u1, u2) for each run of consecutive pixels that are
+  // set in the row "y" between "x1" and "x2" (u1 and u2 are the
+  // first and last pixel of each run, inclusive). The row is read
+  // 64 pixels at the same time, so long runs (or long gaps) are
+  // found without checking each pixel.
+  template<typename Func>
+  void for_each_bitmap_span(const Image* bitmap, int x1, int y, int x2, Func&& func) {
+    int start = -1;             // Start of the current run (or -1)
+    for (int x=x1; x<=x2; x+=64) {
+      const int n = x2-x+1;
+      uint64_t bits = get_bitmap_bits(bitmap, x, y);
+      if (n < 64)
+        bits &= (uint64_t(1) << n) - 1;
+
+      // Fast paths for words that continue the current run/gap
+      if (start >= 0 ? bits == ~uint64_t(0): bits == 0)
+        continue;
+
+      // Bits after the row end are zero, so the last run is closed
+      // in this word (if n < 64)
+      int i = 0;
+      while (i < 64) {
+        if (start < 0) {
+          const uint64_t set = bits >> i;
+          if (!set)
+            break;
+          i += lowest_bit(set);
+          start = x+i;
+        }
+        else {
+          const uint64_t clear = (~bits) >> i;
+          if (!clear)
+            break;
+          i += lowest_bit(clear);
+          func(start, x+i-1);
+          start = -1;
+        }
+      }
+    }
+    if (start >= 0)
+      func(start, x2);
+  }
+
+} // namespace doc
+
+#endif
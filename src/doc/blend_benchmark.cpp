@@ -12,6 +12,8 @@
 
 #include <benchmark/benchmark.h>
 
+#include <vector>
+
 using namespace doc;
 
 static void CustomArguments(benchmark::internal::Benchmark* b) {
@@ -53,4 +55,32 @@ BENCHMARK_TEMPLATE(BM_Rgba, rgba_blender_hsl_saturation)->Apply(CustomArguments)
 BENCHMARK_TEMPLATE(BM_Rgba, rgba_blender_hsl_color)->Apply(CustomArguments);
 BENCHMARK_TEMPLATE(BM_Rgba, rgba_blender_hsl_luminosity)->Apply(CustomArguments);
 
+typedef void (*BlendRowFunc)(color_t* dst, const color_t* backdrop, int n, color_t src, int opacity);
+
+template<BlendFunc F>
+void BM_RgbaPixels(benchmark::State& state) {
+  std::vector<color_t> row(1024, color_t(state.range(0)));
+  color_t b = color_t(state.range(1));
+  int opacity = state.range(2);
+  BlendFunc func = F;
+  while (state.KeepRunning()) {
+    for (color_t& c : row)
+      c = func(c, b, opacity);
+  }
+}
+
+template<BlendRowFunc F>
+void BM_RgbaRow(benchmark::State& state) {
+  std::vector<color_t> row(1024, color_t(state.range(0)));
+  color_t b = color_t(state.range(1));
+  int opacity = state.range(2);
+  while (state.KeepRunning())
+    F(&row[0], &row[0], int(row.size()), b, opacity);
+}
+
+BENCHMARK_TEMPLATE(BM_RgbaPixels, rgba_blender_normal)->Apply(CustomArguments);
+BENCHMARK_TEMPLATE(BM_RgbaRow, rgba_blender_normal_row)->Apply(CustomArguments);
+BENCHMARK_TEMPLATE(BM_RgbaPixels, rgba_blender_merge)->Apply(CustomArguments);
+BENCHMARK_TEMPLATE(BM_RgbaRow, rgba_blender_merge_row)->Apply(CustomArguments);
+
 BENCHMARK_MAIN();
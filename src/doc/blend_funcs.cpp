@@ -24,6 +24,11 @@
 
 #include <cmath>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define DOC_BLEND_FUNCS_SSE2 1
+  #include <emmintrin.h>
+#endif
+
 namespace  {
 
 #define blend_multiply(b, s, t)   (MUL_UN8((b), (s), (t)))
@@ -657,6 +662,171 @@ color_t indexed_blender_src(color_t dst, color_t src, int opacity)
   return src;
 }
 
+//////////////////////////////////////////////////////////////////////
+// Row blenders
+
+namespace {
+
+#if DOC_BLEND_FUNCS_SSE2
+
+// Each channel of 4 RGBA pixels in the 32-bit lanes of a register
+struct RgbaLanes {
+  __m128i r, g, b, a;
+
+  explicit RgbaLanes(__m128i v) {
+    const __m128i m = _mm_set1_epi32(0xff);
+    r = _mm_and_si128(v, m);
+    g = _mm_and_si128(_mm_srli_epi32(v, rgba_g_shift), m);
+    b = _mm_and_si128(_mm_srli_epi32(v, rgba_b_shift), m);
+    a = _mm_srli_epi32(v, rgba_a_shift);
+  }
+};
+
+inline __m128i pack_rgba(__m128i r, __m128i g, __m128i b, __m128i a)
+{
+  return _mm_or_si128(
+    _mm_or_si128(_mm_slli_epi32(r, rgba_r_shift), _mm_slli_epi32(g, rgba_g_shift)),
+    _mm_or_si128(_mm_slli_epi32(b, rgba_b_shift), _mm_slli_epi32(a, rgba_a_shift)));
+}
+
+// Returns "a" where "mask" is set, and "b" in other lanes
+inline __m128i select_lanes(__m128i mask, __m128i a, __m128i b)
+{
+  return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+// MUL_UN8(a, b) of each lane where "a" can be negative. The product
+// is calculated with floats, which is exact because |a*b| <= 255*255.
+inline __m128i mul_un8(__m128i a, __m128 b)
+{
+  __m128i t = _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(a), b));
+  t = _mm_add_epi32(t, _mm_set1_epi32(ONE_HALF));
+  return _mm_srai_epi32(_mm_add_epi32(_mm_srai_epi32(t, G_SHIFT), t), G_SHIFT);
+}
+
+// (Sc-Bc)*Sa/Ra of rgba_blender_normal() with an integer division.
+// The float division is correctly rounded and the result is
+// truncated, so we get the same integer (a non-integer quotient
+// q<=255 is at least 1/255 away from the next integer).
+inline __m128i normal_delta(__m128i Sc, __m128i Bc, __m128 Sa, __m128 Ra)
+{
+  return _mm_cvttps_epi32(
+    _mm_div_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(Sc, Bc)), Sa), Ra));
+}
+
+#endif // DOC_BLEND_FUNCS_SSE2
+
+template<bool LockAlpha>
+void blend_normal_row(color_t* dst, const color_t* backdrop, int n, color_t src, int opacity)
+{
+  int i = 0;
+
+#if DOC_BLEND_FUNCS_SSE2
+  // Fully transparent colors don't need the general case
+  if ((src & rgba_a_mask) != 0) {
+    int t;
+    const int Sa = MUL_UN8(rgba_geta(src), opacity, t);
+
+    // Result for transparent backdrop pixels
+    const color_t c0 = (LockAlpha ? (src & rgba_rgb_mask):
+                                    (src & rgba_rgb_mask) | (Sa << rgba_a_shift));
+
+    const __m128i vSr = _mm_set1_epi32(rgba_getr(src));
+    const __m128i vSg = _mm_set1_epi32(rgba_getg(src));
+    const __m128i vSb = _mm_set1_epi32(rgba_getb(src));
+    const __m128i vSa = _mm_set1_epi32(Sa);
+    const __m128 fSa = _mm_set1_ps(float(Sa));
+    const __m128i vC0 = _mm_set1_epi32(int(c0));
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; i+4 <= n; i += 4) {
+      const RgbaLanes B(_mm_loadu_si128((const __m128i*)(backdrop+i)));
+
+      // Ra = Sa + Ba - MUL_UN8(Ba, Sa), where Ba*Sa fits in the low
+      // 16 bits of each lane
+      __m128i u = _mm_add_epi32(_mm_mullo_epi16(B.a, vSa), _mm_set1_epi32(ONE_HALF));
+      u = _mm_srli_epi32(_mm_add_epi32(_mm_srli_epi32(u, G_SHIFT), u), G_SHIFT);
+      const __m128i Ra = _mm_sub_epi32(_mm_add_epi32(vSa, B.a), u);
+      const __m128 fRa = _mm_cvtepi32_ps(Ra);
+
+      // Lanes with Ra=0 (transparent backdrop) are replaced with c0
+      const __m128i Rr = _mm_add_epi32(B.r, normal_delta(vSr, B.r, fSa, fRa));
+      const __m128i Rg = _mm_add_epi32(B.g, normal_delta(vSg, B.g, fSa, fRa));
+      const __m128i Rb = _mm_add_epi32(B.b, normal_delta(vSb, B.b, fSa, fRa));
+
+      const __m128i result = pack_rgba(Rr, Rg, Rb, LockAlpha ? B.a: Ra);
+      _mm_storeu_si128((__m128i*)(dst+i),
+                       select_lanes(_mm_cmpeq_epi32(B.a, zero), vC0, result));
+    }
+  }
+#endif
+
+  for (; i<n; ++i) {
+    const color_t b = backdrop[i];
+    const color_t c = rgba_blender_normal(b, src, opacity);
+    dst[i] = (LockAlpha ? (c & rgba_rgb_mask) | (b & rgba_a_mask): c);
+  }
+}
+
+} // anonymous namespace
+
+void rgba_blender_normal_row(color_t* dst, const color_t* backdrop, int n, color_t src, int opacity)
+{
+  blend_normal_row<false>(dst, backdrop, n, src, opacity);
+}
+
+void rgba_blender_lock_alpha_row(color_t* dst, const color_t* backdrop, int n, color_t src, int opacity)
+{
+  blend_normal_row<true>(dst, backdrop, n, src, opacity);
+}
+
+void rgba_blender_merge_row(color_t* dst, const color_t* backdrop, int n, color_t src, int opacity)
+{
+  int i = 0;
+
+#if DOC_BLEND_FUNCS_SSE2
+  const __m128i vSr = _mm_set1_epi32(rgba_getr(src));
+  const __m128i vSg = _mm_set1_epi32(rgba_getg(src));
+  const __m128i vSb = _mm_set1_epi32(rgba_getb(src));
+  const __m128i vSa = _mm_set1_epi32(rgba_geta(src));
+  const __m128 fOpacity = _mm_set1_ps(float(opacity));
+  const __m128i zero = _mm_setzero_si128();
+  const bool transparentSrc = ((src & rgba_a_mask) == 0);
+
+  for (; i+4 <= n; i += 4) {
+    const RgbaLanes B(_mm_loadu_si128((const __m128i*)(backdrop+i)));
+    __m128i Rr, Rg, Rb;
+
+    if (transparentSrc) {
+      Rr = B.r;
+      Rg = B.g;
+      Rb = B.b;
+    }
+    else {
+      Rr = _mm_add_epi32(B.r, mul_un8(_mm_sub_epi32(vSr, B.r), fOpacity));
+      Rg = _mm_add_epi32(B.g, mul_un8(_mm_sub_epi32(vSg, B.g), fOpacity));
+      Rb = _mm_add_epi32(B.b, mul_un8(_mm_sub_epi32(vSb, B.b), fOpacity));
+    }
+
+    // Transparent backdrop pixels take the RGB values of "src"
+    const __m128i transparentB = _mm_cmpeq_epi32(B.a, zero);
+    Rr = select_lanes(transparentB, vSr, Rr);
+    Rg = select_lanes(transparentB, vSg, Rg);
+    Rb = select_lanes(transparentB, vSb, Rb);
+
+    const __m128i Ra = _mm_add_epi32(B.a, mul_un8(_mm_sub_epi32(vSa, B.a), fOpacity));
+
+    // The whole pixel is zero if Ra=0
+    _mm_storeu_si128((__m128i*)(dst+i),
+                     _mm_andnot_si128(_mm_cmpeq_epi32(Ra, zero),
+                                      pack_rgba(Rr, Rg, Rb, Ra)));
+  }
+#endif
+
+  for (; i<n; ++i)
+    dst[i] = rgba_blender_merge(backdrop[i], src, opacity);
+}
+
 //////////////////////////////////////////////////////////////////////
 // getters
 
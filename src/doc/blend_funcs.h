@@ -58,6 +58,18 @@ namespace doc {
 
   color_t indexed_blender_src(color_t dst, color_t src, int opacity);
 
+  // Row versions of the RGBA blenders to paint the same "src" color
+  // over "n" pixels (e.g. the spans painted by inks). dst[i] is the
+  // result of blending backdrop[i] with "src", exactly the same
+  // value returned by the per-pixel function ("dst" can be equal to
+  // "backdrop"). Pixels are processed in groups of 4 with SSE2.
+  void rgba_blender_normal_row(color_t* dst, const color_t* backdrop, int n, color_t src, int opacity);
+  void rgba_blender_merge_row(color_t* dst, const color_t* backdrop, int n, color_t src, int opacity);
+
+  // Like rgba_blender_normal_row() but keeping the alpha of each
+  // backdrop pixel (used by the "Lock Alpha" ink).
+  void rgba_blender_lock_alpha_row(color_t* dst, const color_t* backdrop, int n, color_t src, int opacity);
+
   BlendFunc get_rgba_blender(BlendMode blendmode);
   BlendFunc get_graya_blender(BlendMode blendmode);
   BlendFunc get_indexed_blender(BlendMode blendmode);
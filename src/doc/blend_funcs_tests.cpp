@@ -0,0 +1,85 @@
+// Aseprite Document Library
+// Copyright (c) 2018 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/blend_funcs.h"
+
+#include <cstdlib>
+#include <vector>
+
+using namespace doc;
+
+typedef void (*BlendRowFunc)(color_t* dst, const color_t* backdrop, int n, color_t src, int opacity);
+
+static color_t lock_alpha(color_t backdrop, color_t src, int opacity)
+{
+  color_t c = rgba_blender_normal(backdrop, src, opacity);
+  return rgba(rgba_getr(c), rgba_getg(c), rgba_getb(c), rgba_geta(backdrop));
+}
+
+static color_t random_color()
+{
+  // Use special alpha values frequently
+  static const int alphas[] = { 0, 1, 128, 254, 255 };
+  const int a = (std::rand() & 1 ? alphas[std::rand() % 5]: std::rand() & 0xff);
+  return rgba(std::rand() & 0xff,
+              std::rand() & 0xff,
+              std::rand() & 0xff, a);
+}
+
+static void test_row_blender(BlendRowFunc rowFunc, BlendFunc func)
+{
+  std::srand(1);
+
+  // Odd sizes to test the last pixels that don't fill a SSE2 register
+  for (int n : { 1, 3, 4, 17, 64 }) {
+    std::vector<color_t> backdrop(n), dst(n);
+    for (int j=0; j<200; ++j) {
+      const color_t src = random_color();
+      const int opacity = (j & 1 ? 255: std::rand() & 0xff);
+      for (color_t& c : backdrop)
+        c = random_color();
+
+      rowFunc(&dst[0], &backdrop[0], n, src, opacity);
+      for (int i=0; i<n; ++i)
+        ASSERT_EQ(func(backdrop[i], src, opacity), dst[i])
+          << "backdrop=" << std::hex << backdrop[i] << " src=" << src
+          << std::dec << " opacity=" << opacity;
+
+      // In place
+      dst = backdrop;
+      rowFunc(&dst[0], &dst[0], n, src, opacity);
+      for (int i=0; i<n; ++i)
+        ASSERT_EQ(func(backdrop[i], src, opacity), dst[i]);
+    }
+  }
+}
+
+TEST(BlendFuncs, NormalRow)
+{
+  test_row_blender(rgba_blender_normal_row, rgba_blender_normal);
+}
+
+TEST(BlendFuncs, MergeRow)
+{
+  test_row_blender(rgba_blender_merge_row, rgba_blender_merge);
+}
+
+TEST(BlendFuncs, LockAlphaRow)
+{
+  test_row_blender(rgba_blender_lock_alpha_row, lock_alpha);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
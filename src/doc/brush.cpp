@@ -14,16 +14,70 @@
 #include "doc/algo.h"
 #include "doc/algorithm/polygon.h"
 #include "doc/blend_internals.h"
+#include "doc/compressed_image.h"
 #include "doc/image.h"
 #include "doc/image_impl.h"
 #include "doc/primitives.h"
 
+#include <algorithm>
 #include <cmath>
+#include <mutex>
+#include <vector>
 
 namespace doc {
 
 static int generation = 0;
 
+namespace {
+
+// Images of the last generated brushes, so we don't need to
+// regenerate them (and calculate their scanlines) each time the
+// user goes back to a previous size/angle, or a brush is copied.
+// These images are never modified after they are generated.
+struct GeneratedBrush {
+  BrushType type;
+  int size;
+  int angle;
+  ImageRef image;
+  std::shared_ptr<CompressedImage> scanlines;
+};
+
+const int kMaxGeneratedBrushes = 32;
+std::mutex generated_mutex;
+std::vector<GeneratedBrush> generated; // Most recently used first
+
+bool get_generated_brush(BrushType type, int size, int angle,
+                         ImageRef& image,
+                         std::shared_ptr<CompressedImage>& scanlines)
+{
+  std::lock_guard<std::mutex> lock(generated_mutex);
+  auto it = std::find_if(
+    generated.begin(), generated.end(),
+    [type, size, angle](const GeneratedBrush& g){
+      return (g.type == type && g.size == size && g.angle == angle);
+    });
+  if (it == generated.end())
+    return false;
+
+  image = it->image;
+  scanlines = it->scanlines;
+  std::rotate(generated.begin(), it, it+1);
+  return true;
+}
+
+void add_generated_brush(BrushType type, int size, int angle,
+                         const ImageRef& image,
+                         const std::shared_ptr<CompressedImage>& scanlines)
+{
+  std::lock_guard<std::mutex> lock(generated_mutex);
+  if (generated.size() >= kMaxGeneratedBrushes)
+    generated.pop_back();
+  generated.insert(generated.begin(),
+                   GeneratedBrush{ type, size, angle, image, scanlines });
+}
+
+} // anonymous namespace
+
 Brush::Brush()
 {
   m_type = kCircleBrushType;
@@ -91,6 +145,7 @@ void Brush::setImage(const Image* image,
 {
   m_type = kImageBrushType;
   m_image.reset(Image::createCopy(image));
+  m_scanlines.reset();
   if (maskBitmap)
     m_maskBitmap.reset(Image::createCopy(maskBitmap));
   else {
@@ -242,6 +297,7 @@ void Brush::setImageColor(ImageColor imageColor, color_t color)
     m_backupImage.reset(Image::createCopy(m_image.get()));
   else
     m_image.reset(Image::createCopy(m_backupImage.get()));
+  m_scanlines.reset();
 
   ASSERT(m_maskBitmap);
 
@@ -286,6 +342,14 @@ void Brush::clean()
   m_image.reset();
   m_maskBitmap.reset();
   m_backupImage.reset();
+  m_scanlines.reset();
+}
+
+const CompressedImage& Brush::scanlines() const
+{
+  if (!m_scanlines)
+    m_scanlines.reset(new CompressedImage(m_image.get(), m_maskBitmap.get(), false));
+  return *m_scanlines;
 }
 
 static void algo_hline(int x1, int y, int x2, void *data)
@@ -300,6 +364,13 @@ void Brush::regenerate()
 
   ASSERT(m_size > 0);
 
+  const bool cacheable = (m_type != kImageBrushType);
+  if (cacheable &&
+      get_generated_brush(m_type, m_size, m_angle, m_image, m_scanlines)) {
+    resetBounds();
+    return;
+  }
+
   int size = m_size;
   if (m_type == kSquareBrushType && m_angle != 0 && m_size > 2)
     size = (int)std::sqrt((double)2*m_size*m_size)+2;
@@ -357,6 +428,11 @@ void Brush::regenerate()
     }
   }
 
+  if (cacheable) {
+    scanlines();                // Calculate scanlines to share them
+    add_generated_brush(m_type, m_size, m_angle, m_image, m_scanlines);
+  }
+
   resetBounds();
 }
 
@@ -20,6 +20,8 @@
 
 namespace doc {
 
+  class CompressedImage;
+
   class Brush {
   public:
     static const int kMinBrushSize = 1;
@@ -39,6 +41,12 @@ namespace doc {
     Image* maskBitmap() const { return m_maskBitmap.get(); }
     int gen() const { return m_gen; }
 
+    // Runs of pixels that are painted by the brush in each row of
+    // its image (calculated only one time for each brush
+    // image). Generated brushes with the same type/size/angle share
+    // the same image and scanlines.
+    const CompressedImage& scanlines() const;
+
     BrushPattern pattern() const { return m_pattern; }
     gfx::Point patternOrigin() const { return m_patternOrigin; }
 
@@ -73,6 +81,7 @@ namespace doc {
     BrushPattern m_pattern;               // How the image should be replicated
     gfx::Point m_patternOrigin;           // From what position the brush was taken
     int m_gen;
+    mutable std::shared_ptr<CompressedImage> m_scanlines;
 
     // Extra data used for setImageColor()
     ImageRef m_backupImage; // Backup image to avoid losing original brush colors/pattern
@@ -0,0 +1,90 @@
+// Aseprite Document Library
+// Copyright (c) 2018 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/brush.h"
+#include "doc/compressed_image.h"
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/primitives.h"
+
+using namespace doc;
+
+static void expect_scanlines(const Brush& brush)
+{
+  const Image* image = brush.image();
+  ImageRef painted(Image::create(IMAGE_BITMAP, image->width(), image->height()));
+  clear_image(painted.get(), 0);
+  for (const auto& scanline : brush.scanlines()) {
+    for (int x=scanline.x; x<scanline.x+scanline.w; ++x) {
+      EXPECT_EQ(0, get_pixel(painted.get(), x, scanline.y));
+      put_pixel(painted.get(), x, scanline.y, 1);
+    }
+  }
+  EXPECT_EQ(0, count_diff_between_images(image, painted.get()));
+}
+
+TEST(Brush, Scanlines)
+{
+  for (BrushType type : { kCircleBrushType, kSquareBrushType, kLineBrushType }) {
+    for (int size : { 1, 2, 7, 32 }) {
+      for (int angle : { 0, 30, 45 }) {
+        Brush brush(type, size, angle);
+        expect_scanlines(brush);
+      }
+    }
+  }
+}
+
+TEST(Brush, ShareGeneratedImages)
+{
+  Brush a(kCircleBrushType, 13, 0);
+  Brush b(kSquareBrushType, 13, 20);
+  b.setType(kCircleBrushType);
+  b.setSize(13);
+  b.setAngle(0);
+
+  EXPECT_EQ(a.image(), b.image());
+  EXPECT_EQ(&a.scanlines(), &b.scanlines());
+  EXPECT_NE(a.gen(), b.gen());
+
+  Brush c(a);
+  EXPECT_EQ(a.image(), c.image());
+  c.setSize(14);
+  EXPECT_NE(a.image(), c.image());
+  expect_scanlines(c);
+}
+
+TEST(Brush, ImageBrushScanlines)
+{
+  ImageRef image(Image::create(IMAGE_RGB, 5, 3));
+  clear_image(image.get(), rgba(0, 0, 0, 0));
+  put_pixel(image.get(), 1, 0, rgba(255, 0, 0, 255));
+  put_pixel(image.get(), 2, 0, rgba(0, 255, 0, 255));
+  put_pixel(image.get(), 4, 2, rgba(0, 0, 255, 255));
+
+  Brush brush;
+  brush.setImage(image.get(), nullptr);
+
+  int n = 0, pixels = 0;
+  for (const auto& scanline : brush.scanlines()) {
+    ++n;
+    pixels += scanline.w;
+  }
+  EXPECT_EQ(2, n);
+  EXPECT_EQ(3, pixels);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -22,6 +22,7 @@
 #include "doc/image.h"
 #include "doc/image_impl.h"
 #include "doc/image_ref.h"
+#include "doc/image_swap.h"
 #include "doc/layer.h"
 #include "doc/mask.h"
 #include "doc/object.h"
@@ -0,0 +1,227 @@
+// Aseprite Document Library
+// Copyright (c) 2018 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/algorithm/floodfill.h"
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/mask.h"
+#include "doc/primitives.h"
+#include "gfx/border.h"
+
+#include <cstdlib>
+#include <vector>
+
+using namespace doc;
+using namespace doc::algorithm;
+
+static void fill_hline(int x1, int y, int x2, void* data)
+{
+  Image* image = (Image*)data;
+  for (int x=x1; x<=x2; ++x) {
+    // Each pixel must be filled just one time
+    EXPECT_EQ(0, get_pixel(image, x, y));
+    put_pixel(image, x, y, 1);
+  }
+}
+
+// Returns a bitmap with the pixels that floodfill() has filled.
+static ImageRef filled_area(const Image* image, const Mask* mask,
+                            int x, int y, const gfx::Rect& bounds,
+                            int tolerance, bool contiguous)
+{
+  ImageRef result(Image::create(IMAGE_BITMAP, image->width(), image->height()));
+  clear_image(result.get(), 0);
+  floodfill(image, mask, x, y, bounds,
+            get_pixel(image, x, y), tolerance, contiguous,
+            result.get(), fill_hline);
+  return result;
+}
+
+// Slow flood fill (4-connected) used to check the results.
+template<typename Similar>
+static ImageRef expected_area(const Image* image, const Mask* mask,
+                              int x, int y, const gfx::Rect& bounds,
+                              bool contiguous, Similar similar)
+{
+  ImageRef result(Image::create(IMAGE_BITMAP, image->width(), image->height()));
+  clear_image(result.get(), 0);
+
+  const color_t src = get_pixel(image, x, y);
+  auto canFill = [&](int u, int v) -> bool {
+    return (bounds.contains(gfx::Point(u, v)) &&
+            !get_pixel(result.get(), u, v) &&
+            (!mask || !contiguous || mask->containsPoint(u, v)) &&
+            similar(get_pixel(image, u, v), src));
+  };
+
+  if (!contiguous) {
+    for (int v=bounds.y; v<bounds.y2(); ++v)
+      for (int u=bounds.x; u<bounds.x2(); ++u)
+        if (canFill(u, v))
+          put_pixel(result.get(), u, v, 1);
+    return result;
+  }
+
+  std::vector<gfx::Point> stack;
+  if (canFill(x, y)) {
+    put_pixel(result.get(), x, y, 1);
+    stack.push_back(gfx::Point(x, y));
+  }
+  while (!stack.empty()) {
+    gfx::Point pt = stack.back();
+    stack.pop_back();
+
+    const gfx::Point neighbors[4] = {
+      gfx::Point(pt.x-1, pt.y), gfx::Point(pt.x+1, pt.y),
+      gfx::Point(pt.x, pt.y-1), gfx::Point(pt.x, pt.y+1) };
+    for (const auto& n : neighbors) {
+      if (canFill(n.x, n.y)) {
+        put_pixel(result.get(), n.x, n.y, 1);
+        stack.push_back(n);
+      }
+    }
+  }
+  return result;
+}
+
+static bool similar_rgb(color_t a, color_t b, int tolerance)
+{
+  if (rgba_geta(a) == 0 && rgba_geta(b) == 0)
+    return true;
+  return (std::abs(rgba_getr(a) - rgba_getr(b)) <= tolerance &&
+          std::abs(rgba_getg(a) - rgba_getg(b)) <= tolerance &&
+          std::abs(rgba_getb(a) - rgba_getb(b)) <= tolerance &&
+          std::abs(rgba_geta(a) - rgba_geta(b)) <= tolerance);
+}
+
+static bool similar_gray(color_t a, color_t b, int tolerance)
+{
+  if (graya_geta(a) == 0 && graya_geta(b) == 0)
+    return true;
+  return (std::abs(graya_getv(a) - graya_getv(b)) <= tolerance &&
+          std::abs(graya_geta(a) - graya_geta(b)) <= tolerance);
+}
+
+static bool similar_indexed(color_t a, color_t b, int tolerance)
+{
+  return (std::abs(int(a) - int(b)) <= tolerance);
+}
+
+TEST(FloodFill, ContiguousIndexed)
+{
+  ImageRef image(Image::create(IMAGE_INDEXED, 5, 5));
+  clear_image(image.get(), 0);
+  // Vertical wall in the x=2 column with a hole in y=4
+  for (int y=0; y<4; ++y)
+    put_pixel(image.get(), 2, y, 1);
+
+  ImageRef area = filled_area(image.get(), nullptr, 0, 0,
+                              image->bounds(), 0, true);
+  for (int y=0; y<5; ++y)
+    for (int x=0; x<5; ++x)
+      EXPECT_EQ(x == 2 && y < 4 ? 0: 1, get_pixel(area.get(), x, y))
+        << "x=" << x << " y=" << y;
+
+  // Close the hole
+  put_pixel(image.get(), 2, 4, 1);
+  area = filled_area(image.get(), nullptr, 0, 0,
+                     image->bounds(), 0, true);
+  for (int y=0; y<5; ++y)
+    for (int x=0; x<5; ++x)
+      EXPECT_EQ(x < 2 ? 1: 0, get_pixel(area.get(), x, y))
+        << "x=" << x << " y=" << y;
+}
+
+TEST(FloodFill, TransparentPixelsAreEqual)
+{
+  ImageRef image(Image::create(IMAGE_RGB, 3, 1));
+  put_pixel(image.get(), 0, 0, rgba(255, 0, 0, 0));
+  put_pixel(image.get(), 1, 0, rgba(0, 255, 0, 0));
+  put_pixel(image.get(), 2, 0, rgba(0, 0, 255, 1));
+
+  ImageRef area = filled_area(image.get(), nullptr, 0, 0,
+                              image->bounds(), 0, true);
+  EXPECT_EQ(1, get_pixel(area.get(), 0, 0));
+  EXPECT_EQ(1, get_pixel(area.get(), 1, 0));
+  EXPECT_EQ(0, get_pixel(area.get(), 2, 0));
+}
+
+TEST(FloodFill, RandomImages)
+{
+  std::srand(1);
+
+  for (int i=0; i<300; ++i) {
+    const int w = 1 + std::rand() % 70;
+    const int h = 1 + std::rand() % 40;
+    const int tolerance = (i % 4 == 0 ? 0: std::rand() % 64);
+    const bool contiguous = ((i/3) % 3 != 0);
+
+    const PixelFormat format = (i % 3 == 0 ? IMAGE_RGB:
+                                i % 3 == 1 ? IMAGE_GRAYSCALE:
+                                             IMAGE_INDEXED);
+
+    // Few colors so there are big regions to fill
+    ImageRef image(Image::create(format, w, h));
+    for (int y=0; y<h; ++y) {
+      for (int x=0; x<w; ++x) {
+        const int a = ((std::rand()%4) ? 255: 0);
+        color_t c = 0;
+        switch (format) {
+          case IMAGE_RGB: c = rgba(32*(std::rand()%3), 0, 32*(std::rand()%2), a); break;
+          case IMAGE_GRAYSCALE: c = graya(32*(std::rand()%3), a); break;
+          case IMAGE_INDEXED: c = 16*(std::rand()%3); break;
+          default: break;
+        }
+        put_pixel(image.get(), x, y, c);
+      }
+    }
+
+    const int x = std::rand() % w;
+    const int y = std::rand() % h;
+    gfx::Rect bounds = image->bounds();
+    if (i % 2)
+      bounds.shrink(gfx::Border(std::rand()%3, std::rand()%3,
+                                std::rand()%3, std::rand()%3));
+    if (!bounds.contains(gfx::Point(x, y)))
+      bounds = image->bounds();
+
+    Mask mask;
+    Mask* maskPtr = nullptr;
+    if (i % 5 == 1) {
+      mask.replace(gfx::Rect(std::rand() % w, std::rand() % h, w, h));
+      mask.add(gfx::Rect(x, y, 1, 1));
+      maskPtr = &mask;
+    }
+
+    ImageRef area = filled_area(image.get(), maskPtr, x, y, bounds,
+                                tolerance, contiguous);
+    ImageRef expected = expected_area(
+      image.get(), maskPtr, x, y, bounds, contiguous,
+      [format, tolerance](color_t a, color_t b) {
+        switch (format) {
+          case IMAGE_RGB: return similar_rgb(a, b, tolerance);
+          case IMAGE_GRAYSCALE: return similar_gray(a, b, tolerance);
+          default: return similar_indexed(a, b, tolerance);
+        }
+      });
+
+    ASSERT_EQ(0, count_diff_between_images(area.get(), expected.get()))
+      << "i=" << i << " w=" << w << " h=" << h
+      << " format=" << format << " tolerance=" << tolerance << " contiguous=" << contiguous;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -13,20 +13,94 @@
 #include "doc/algo.h"
 #include "doc/brush.h"
 #include "doc/image_impl.h"
+#include "doc/image_swap.h"
 #include "doc/palette.h"
 #include "doc/primitives.h"
 #include "doc/rgbmap.h"
 
+#include <mutex>
+
 namespace doc {
 
+// Used to share the pixels of the same image from several threads
+// (e.g. two snapshots of the same document created with the
+// document locked for reading).
+static std::mutex g_sharedPixelsMutex;
+
 Image::Image(PixelFormat format, int width, int height)
   : Object(ObjectType::Image)
   , m_spec((ColorMode)format, width, height, 0)
+  , m_pins(0)
+  , m_swapEntry(nullptr)
 {
 }
 
 Image::~Image()
 {
+  if (m_sharedPixels)
+    stopSharingPixels();
+  if (m_swapEntry)
+    ImageSwap::instance()->removeImage(this);
+}
+
+void Image::pin() const
+{
+  ++m_pins;
+  if (m_swapEntry) {
+    try {
+      ImageSwap::instance()->pageIn(this);
+    }
+    catch (...) {
+      --m_pins;
+      throw;
+    }
+  }
+}
+
+void Image::unpin() const
+{
+  ASSERT(m_pins > 0);
+  --m_pins;
+}
+
+bool Image::isSwapped() const
+{
+  return (m_swapEntry && ImageSwap::instance()->isSwapped(this));
+}
+
+void Image::touchSwapEntry() const
+{
+  ImageSwap::instance()->touch(this);
+}
+
+void Image::sharePixelsWith(const Image* other)
+{
+  std::lock_guard<std::mutex> lock(g_sharedPixelsMutex);
+  if (!other->m_sharedPixels)
+    other->m_sharedPixels = std::make_shared<int>(0);
+  m_sharedPixels = other->m_sharedPixels;
+}
+
+void Image::unsharePixels()
+{
+  // If this is the last image using the pixels (the others were
+  // destroyed or have their own copy), we can modify them. Other
+  // images stop sharing the pixels only after copying them (with
+  // the mutex locked, so we see all their accesses to the pixels).
+  bool copy;
+  {
+    std::lock_guard<std::mutex> lock(g_sharedPixelsMutex);
+    copy = (m_sharedPixels.use_count() > 1);
+  }
+  if (copy)
+    copySharedPixels();
+  stopSharingPixels();
+}
+
+void Image::stopSharingPixels()
+{
+  std::lock_guard<std::mutex> lock(g_sharedPixelsMutex);
+  m_sharedPixels.reset();
 }
 
 int Image::getMemSize() const
@@ -65,4 +139,24 @@ Image* Image::createCopy(const Image* image, const ImageBufferPtr& buffer)
     image->maskColor(), buffer);
 }
 
+// static
+Image* Image::createSharedCopy(const Image* image)
+{
+  ASSERT(image);
+
+  // Loads the pixels from the swap file (if it's needed)
+  PinImage pin(image);
+
+  Image* copy = nullptr;
+  switch (image->pixelFormat()) {
+    case IMAGE_RGB:       copy = new ImageImpl<RgbTraits>(static_cast<const ImageImpl<RgbTraits>*>(image)); break;
+    case IMAGE_GRAYSCALE: copy = new ImageImpl<GrayscaleTraits>(static_cast<const ImageImpl<GrayscaleTraits>*>(image)); break;
+    case IMAGE_INDEXED:   copy = new ImageImpl<IndexedTraits>(static_cast<const ImageImpl<IndexedTraits>*>(image)); break;
+    case IMAGE_BITMAP:    copy = new ImageImpl<BitmapTraits>(static_cast<const ImageImpl<BitmapTraits>*>(image)); break;
+  }
+  if (copy)
+    copy->setVersion(image->version());
+  return copy;
+}
+
 } // namespace doc
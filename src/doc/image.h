@@ -8,6 +8,7 @@
 #define DOC_IMAGE_H_INCLUDED
 #pragma once
 
+#include "base/disable_copying.h"
 #include "doc/color.h"
 #include "doc/color_mode.h"
 #include "doc/image_buffer.h"
@@ -18,9 +19,15 @@
 #include "gfx/rect.h"
 #include "gfx/size.h"
 
+#include <atomic>
+#include <functional>
+#include <memory>
+
 namespace doc {
 
   template<typename ImageTraits> class ImageBits;
+  class ImageSwap;
+  struct ImageSwapEntry;
   class Palette;
   class Pen;
   class RgbMap;
@@ -40,6 +47,13 @@ namespace doc {
     static Image* createCopy(const Image* image,
                              const ImageBufferPtr& buffer = ImageBufferPtr());
 
+    // Creates an image that shares the pixels with the given one. The
+    // pixels are copied when one of the images is going to be
+    // modified (copy-on-write), so the new image can be read from
+    // other thread while the original one is modified (e.g. to save
+    // a snapshot of a document, see app::DocSnapshot).
+    static Image* createSharedCopy(const Image* image);
+
     virtual ~Image();
 
     const ImageSpec& spec() const { return m_spec; }
@@ -56,25 +70,69 @@ namespace doc {
     int getRowStrideSize() const;
     int getRowStrideSize(int pixels_per_row) const;
 
+    // Locked bits keep the image pinned in memory (see pin()). Shared
+    // pixels are copied before they are locked to write them.
     template<typename ImageTraits>
     ImageBits<ImageTraits> lockBits(LockType lockType, const gfx::Rect& bounds) {
+      if (lockType != ReadLock)
+        unshare();
+      pin();
       return ImageBits<ImageTraits>(this, bounds);
     }
 
     template<typename ImageTraits>
     ImageBits<ImageTraits> lockBits(LockType lockType, const gfx::Rect& bounds) const {
+      pin();
       return ImageBits<ImageTraits>(const_cast<Image*>(this), bounds);
     }
 
     template<typename ImageTraits>
     void unlockBits(ImageBits<ImageTraits>& imageBits) {
-      // Do nothing
+      unpin();
+    }
+
+    // A pinned image cannot be moved to the swap file by ImageSwap,
+    // so pointers to its pixels are valid until it's unpinned.
+    // Pinning an image marks it as used, and loads its pixels from
+    // the swap file (throwing an exception if they cannot be read).
+    //
+    // An image that isn't pinned can be moved to the swap file by
+    // ImageSwap::trim() at any moment, so its pixels must be
+    // accessed from other threads only with its document locked or
+    // keeping it pinned (e.g. with PinImage or LockImageBits).
+    void pin() const;
+    void unpin() const;
+    bool isPinned() const { return m_pins > 0; }
+
+    // Returns true if the pixels of this image are in the swap file
+    // (they are loaded automatically when they are accessed).
+    bool isSwapped() const;
+
+    // Returns true if the pixels are shared with other image (see
+    // createSharedCopy()).
+    bool hasSharedPixels() const {
+      return (m_sharedPixels && m_sharedPixels.use_count() > 1);
+    }
+
+    // Copies the pixels if they are shared with other image. It's
+    // called automatically before the pixels are modified (from
+    // functions of this class or write locks).
+    void unshare() {
+      if (m_sharedPixels)
+        unsharePixels();
     }
 
     // Warning: These functions doesn't have (and shouldn't have)
     // bounds checks. Use the primitives defined in doc/primitives.h
     // in case that you need bounds check.
     virtual uint8_t* getPixelAddress(int x, int y) const = 0;
+
+    // The address of a pixel to modify it (the pixels are unshared).
+    uint8_t* getPixelAddress(int x, int y) {
+      unshare();
+      return static_cast<const Image*>(this)->getPixelAddress(x, y);
+    }
+
     virtual color_t getPixel(int x, int y) const = 0;
     virtual void putPixel(int x, int y, color_t color) = 0;
     virtual void clear(color_t color) = 0;
@@ -86,8 +144,64 @@ namespace doc {
   protected:
     Image(PixelFormat format, int width, int height);
 
+    // Marks the image as recently used, loading its pixels from the
+    // swap file if it's needed. It's called once per operation
+    // (e.g. clear() or copy()), never for each pixel, and it doesn't
+    // throw (errors reading the swap file are reported by pin()).
+    void touch() const {
+      if (m_swapEntry.load(std::memory_order_relaxed))
+        touchSwapEntry();
+    }
+
+    // Used by ImageSwap to free the memory of the pixels when they
+    // are moved to the swap file (only if "save" returns true), and
+    // to load them again (the "fill" function receives the new
+    // pixels to be filled, and they are published in the image only
+    // when they are ready).
+    virtual void releasePixels(const std::function<bool(const uint8_t*)>& save) = 0;
+    virtual void restorePixels(const std::function<void(uint8_t*)>& fill) = 0;
+
+    // Replaces the shared pixels with a copy of them.
+    virtual void copySharedPixels() = 0;
+
+    // Used by the copy-on-write implementation: sharePixelsWith()
+    // marks the pixels of both images as shared, and
+    // stopSharingPixels() is called when the image has its own
+    // pixels again.
+    void sharePixelsWith(const Image* other);
+    void stopSharingPixels();
+
   private:
+    void touchSwapEntry() const;
+    void unsharePixels();
+
     ImageSpec m_spec;
+    mutable std::atomic<int> m_pins;
+    // Set by ImageSwap::trim() (it can be read from other threads)
+    std::atomic<ImageSwapEntry*> m_swapEntry;
+    // Shared by all images that are sharing the same pixels (they
+    // can be used from different threads, so the pointer is
+    // modified only with a mutex locked, see image.cpp)
+    mutable std::shared_ptr<int> m_sharedPixels;
+
+    friend class ImageSwap;
+  };
+
+  // Keeps an image pinned in memory while this object is alive.
+  class PinImage {
+  public:
+    explicit PinImage(const Image* image) : m_image(image) {
+      if (m_image)
+        m_image->pin();
+    }
+    ~PinImage() {
+      if (m_image)
+        m_image->unpin();
+    }
+  private:
+    const Image* m_image;
+
+    DISABLE_COPYING(PinImage);
   };
 
 } // namespace doc
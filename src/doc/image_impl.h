@@ -9,6 +9,7 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
 #include <cstdlib>
 #include <cstring>
 
@@ -30,55 +31,97 @@ namespace doc {
 
     ImageBufferPtr m_buffer;
     address_t m_bits;
-    address_t* m_rows;
+    // nullptr only when the pixels are in the swap file (it's atomic
+    // because it can be restored by other thread, see ImageSwap).
+    std::atomic<address_t*> m_rows;
 
     inline address_t getBitsAddress() {
+      unshare();
+      rows();
       return m_bits;
     }
 
     inline const_address_t getBitsAddress() const {
+      rows();
       return m_bits;
     }
 
     inline address_t getLineAddress(int y) {
       ASSERT(y >= 0 && y < height());
-      return m_rows[y];
+      return rows()[y];
     }
 
     inline const_address_t getLineAddress(int y) const {
       ASSERT(y >= 0 && y < height());
-      return m_rows[y];
+      return rows()[y];
+    }
+
+    // Returns the rows of pixels. They are loaded from the swap file
+    // only if the image was swapped and it's accessed without
+    // locking/pinning it (see Image::touch()).
+    inline address_t* rows() const {
+      address_t* rows = m_rows.load(std::memory_order_acquire);
+      if (!rows) {
+        touch();
+        rows = m_rows.load(std::memory_order_acquire);
+      }
+      return rows;
+    }
+
+    void setupBuffer(const ImageBufferPtr& buffer) {
+      std::size_t for_rows = sizeof(address_t) * height();
+      std::size_t rowstride_bytes = Traits::getRowStrideBytes(width());
+      std::size_t required_size = for_rows + rowstride_bytes*height();
+
+      ImageBufferPtr newBuffer(buffer);
+      if (!newBuffer)
+        newBuffer.reset(new ImageBuffer(required_size));
+      else
+        newBuffer->resizeIfNecessary(required_size);
+
+      address_t* rows = (address_t*)newBuffer->buffer();
+      address_t bits = (address_t)(newBuffer->buffer() + for_rows);
+
+      address_t addr = bits;
+      for (int y=0; y<height(); ++y) {
+        rows[y] = addr;
+        addr = (address_t)(((uint8_t*)addr) + rowstride_bytes);
+      }
+
+      m_buffer = newBuffer;
+      m_bits = bits;
+      m_rows.store(rows, std::memory_order_release);
     }
 
   public:
     inline address_t address(int x, int y) const {
-      return (address_t)(m_rows[y] + x / (Traits::pixels_per_byte == 0 ? 1 : Traits::pixels_per_byte));
+      return (address_t)(rows()[y] + x / (Traits::pixels_per_byte == 0 ? 1 : Traits::pixels_per_byte));
     }
 
     ImageImpl(int width, int height,
               const ImageBufferPtr& buffer)
       : Image(static_cast<PixelFormat>(Traits::pixel_format), width, height)
-      , m_buffer(buffer)
+      , m_bits(nullptr)
+      , m_rows(nullptr)
     {
-      std::size_t for_rows = sizeof(address_t) * height;
-      std::size_t rowstride_bytes = Traits::getRowStrideBytes(width);
-      std::size_t required_size = for_rows + rowstride_bytes*height;
-
-      if (!m_buffer)
-        m_buffer.reset(new ImageBuffer(required_size));
-      else
-        m_buffer->resizeIfNecessary(required_size);
-
-      m_rows = (address_t*)m_buffer->buffer();
-      m_bits = (address_t)(m_buffer->buffer() + for_rows);
+      setupBuffer(buffer);
+    }
 
-      address_t addr = m_bits;
-      for (int y=0; y<height; ++y) {
-        m_rows[y] = addr;
-        addr = (address_t)(((uint8_t*)addr) + rowstride_bytes);
-      }
+    // Shares the pixels of the given image (see Image::createSharedCopy()).
+    explicit ImageImpl(const ImageImpl* shared)
+      : Image(static_cast<PixelFormat>(Traits::pixel_format),
+              shared->width(), shared->height())
+      , m_buffer(shared->m_buffer)
+      , m_bits(shared->m_bits)
+      , m_rows(shared->m_rows.load(std::memory_order_acquire))
+    {
+      ASSERT(m_rows);
+      setMaskColor(shared->maskColor());
+      sharePixelsWith(shared);
     }
 
+    using Image::getPixelAddress;
+
     uint8_t* getPixelAddress(int x, int y) const override {
       ASSERT(x >= 0 && x < width());
       ASSERT(y >= 0 && y < height());
@@ -97,10 +140,13 @@ namespace doc {
       ASSERT(x >= 0 && x < width());
       ASSERT(y >= 0 && y < height());
 
+      unshare();
       *address(x, y) = color;
     }
 
     void clear(color_t color) override {
+      unshare();
+      touch();
       int w = width();
       int h = height();
 
@@ -121,6 +167,10 @@ namespace doc {
       if (!area.clip(width(), height(), src->width(), src->height()))
         return;
 
+      unshare();
+      src->touch();
+      touch();
+
       for (int end_y=area.dst.y+area.size.h;
            area.dst.y<end_y;
            ++area.dst.y, ++area.src.y) {
@@ -134,6 +184,7 @@ namespace doc {
     }
 
     void drawHLine(int x1, int y, int x2, color_t color) override {
+      unshare();
       LockImageBits<Traits> bits(this, gfx::Rect(x1, y, x2 - x1 + 1, 1));
       typename LockImageBits<Traits>::iterator it(bits.begin());
       typename LockImageBits<Traits>::iterator end(bits.end());
@@ -143,6 +194,9 @@ namespace doc {
     }
 
     void fillRect(int x1, int y1, int x2, int y2, color_t color) override {
+      unshare();
+      touch();
+
       // Fill the first line
       ImageImpl<Traits>::drawHLine(x1, y1, x2, color);
 
@@ -157,6 +211,39 @@ namespace doc {
       fillRect(x1, y1, x2, y2, color);
     }
 
+  protected:
+    void releasePixels(const std::function<bool(const uint8_t*)>& save) override {
+      if (!save((const uint8_t*)m_bits))
+        return;
+
+      m_rows.store(nullptr, std::memory_order_release);
+      m_bits = nullptr;
+      m_buffer.reset();
+      stopSharingPixels();
+    }
+
+    void restorePixels(const std::function<void(uint8_t*)>& fill) override {
+      // Pixels are filled in a new buffer before they are published
+      // in m_rows (with release order in setupBuffer()), so other
+      // threads don't see half-loaded pixels.
+      std::size_t for_rows = sizeof(address_t) * height();
+      ImageBufferPtr buffer(
+        new ImageBuffer(for_rows + Traits::getRowStrideBytes(width())*height()));
+      fill(buffer->buffer() + for_rows);
+      setupBuffer(buffer);
+      stopSharingPixels();
+    }
+
+    void copySharedPixels() override {
+      // The old buffer is kept alive until its pixels are copied
+      ImageBufferPtr oldBuffer(m_buffer);
+      const uint8_t* oldBits = (const uint8_t*)m_bits;
+      ASSERT(oldBits);
+
+      setupBuffer(ImageBufferPtr());
+      std::memcpy(m_bits, oldBits, Traits::getRowStrideBytes(width())*height());
+    }
+
   private:
     bool clip_rects(const Image* src, int& dst_x, int& dst_y, int& src_x, int& src_y, int& w, int& h) const {
       // Clip with destionation image
@@ -219,15 +306,17 @@ namespace doc {
 
   template<>
   inline void ImageImpl<IndexedTraits>::clear(color_t color) {
-    std::fill(m_bits,
-              m_bits + width()*height(),
+    address_t bits = getBitsAddress();
+    std::fill(bits,
+              bits + width()*height(),
               color);
   }
 
   template<>
   inline void ImageImpl<BitmapTraits>::clear(color_t color) {
-    std::fill(m_bits,
-              m_bits + BitmapTraits::getRowStrideBytes(width()) * height(),
+    address_t bits = getBitsAddress();
+    std::fill(bits,
+              bits + BitmapTraits::getRowStrideBytes(width()) * height(),
               (color ? 0xff: 0x00));
   }
 
@@ -237,7 +326,7 @@ namespace doc {
     ASSERT(y >= 0 && y < height());
 
     std::div_t d = std::div(x, 8);
-    return ((*(m_rows[y] + d.quot)) & (1<<d.rem)) ? 1: 0;
+    return ((*(rows()[y] + d.quot)) & (1<<d.rem)) ? 1: 0;
   }
 
   template<>
@@ -245,11 +334,12 @@ namespace doc {
     ASSERT(x >= 0 && x < width());
     ASSERT(y >= 0 && y < height());
 
+    unshare();
     std::div_t d = std::div(x, 8);
     if (color)
-      (*(m_rows[y] + d.quot)) |= (1 << d.rem);
+      (*(rows()[y] + d.quot)) |= (1 << d.rem);
     else
-      (*(m_rows[y] + d.quot)) &= ~(1 << d.rem);
+      (*(rows()[y] + d.quot)) &= ~(1 << d.rem);
   }
 
   template<>
@@ -275,6 +365,7 @@ namespace doc {
   void copy_bitmaps(Image* dst, const Image* src, gfx::Clip area);
   template<>
   inline void ImageImpl<BitmapTraits>::copy(const Image* src, gfx::Clip area) {
+    unshare();
     copy_bitmaps(this, src, area);
   }
 
@@ -0,0 +1,383 @@
+// Aseprite Document Library
+// Copyright (c) 2018 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/image_swap.h"
+
+#include "base/exception.h"
+#include "base/fs.h"
+#include "base/fstream_path.h"
+#include "base/log.h"
+#include "doc/cel.h"
+#include "doc/cels_range.h"
+#include "doc/image.h"
+#include "doc/sprite.h"
+#include "zlib.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace doc {
+
+// static
+ImageSwap* ImageSwap::instance()
+{
+  static ImageSwap swap;
+  return &swap;
+}
+
+ImageSwap::ImageSwap()
+  : m_budget(0)
+  , m_fileSize(0)
+  , m_residentSize(0)
+  , m_swappedSize(0)
+  , m_tick(0)
+{
+}
+
+ImageSwap::~ImageSwap()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (ImageSwapEntry* entry : m_entries) {
+    entry->image->m_swapEntry = nullptr;
+    delete entry;
+  }
+  m_entries.clear();
+  closeFile();
+}
+
+void ImageSwap::setBudget(std::size_t budget)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_budget = budget;
+}
+
+void ImageSwap::setFilename(const std::string& filename)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_filename == filename)
+    return;
+
+  // We cannot change the file if it contains pixels
+  if (m_swappedSize > 0) {
+    LOG(ERROR) << "SWAP: Cannot use " << filename
+               << " as swap file, " << m_filename << " is in use\n";
+    return;
+  }
+
+  closeFile();
+  m_filename = filename;
+}
+
+std::size_t ImageSwap::residentSize() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_residentSize;
+}
+
+std::size_t ImageSwap::swappedSize() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_swappedSize;
+}
+
+void ImageSwap::trim(const Sprite* sprite)
+{
+  ASSERT(sprite);
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_budget == 0 || m_filename.empty())
+    return;
+
+  for (Cel* cel : sprite->uniqueCels()) {
+    Image* image = cel->image();
+    if (image && !image->m_swapEntry)
+      addImage(image, sprite->id());
+  }
+
+  if (m_residentSize > m_budget) {
+    // Images that weren't accessed since the previous trim() (from
+    // the least recently used to the most recently used one)
+    const uint64_t tick = m_tick;
+    std::vector<ImageSwapEntry*> entries;
+    for (ImageSwapEntry* entry : m_entries) {
+      if (entry->owner == sprite->id() &&
+          entry->resident &&
+          entry->lastUse < tick &&
+          !entry->image->isPinned()) {
+        entries.push_back(entry);
+      }
+    }
+    std::sort(entries.begin(), entries.end(),
+              [](const ImageSwapEntry* a, const ImageSwapEntry* b) {
+                return a->lastUse < b->lastUse;
+              });
+
+    for (ImageSwapEntry* entry : entries) {
+      if (m_residentSize <= m_budget ||
+          !pageOutEntry(entry))
+        break;
+    }
+  }
+
+  ++m_tick;
+}
+
+void ImageSwap::addImage(Image* image, ObjectId owner)
+{
+  ImageSwapEntry* entry = new ImageSwapEntry;
+  entry->image = image;
+  entry->owner = owner;
+  entry->size = std::size_t(image->getRowStrideSize()) * image->height();
+  entry->resident = true;
+  entry->lastUse = m_tick.load();
+  entry->readError = false;
+  entry->offset = 0;
+  entry->compressedSize = 0;
+
+  m_entries.push_back(entry);
+  m_residentSize += entry->size;
+  image->m_swapEntry = entry;
+}
+
+void ImageSwap::removeImage(Image* image)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  ImageSwapEntry* entry = image->m_swapEntry;
+  ASSERT(entry);
+
+  if (entry->resident)
+    m_residentSize -= entry->size;
+  else {
+    m_swappedSize -= entry->compressedSize;
+    freeSpace(entry->offset, entry->compressedSize);
+  }
+
+  auto it = std::find(m_entries.begin(), m_entries.end(), entry);
+  ASSERT(it != m_entries.end());
+  *it = m_entries.back();
+  m_entries.pop_back();
+
+  image->m_swapEntry = nullptr;
+  delete entry;
+}
+
+void ImageSwap::touch(const Image* image)
+{
+  ImageSwapEntry* entry = image->m_swapEntry;
+  ASSERT(entry);
+
+  // Avoid writing the entry if it was already used in this period
+  const uint64_t tick = m_tick.load(std::memory_order_relaxed);
+  if (entry->lastUse.load(std::memory_order_relaxed) != tick)
+    entry->lastUse.store(tick, std::memory_order_relaxed);
+
+  // Errors are reported by the next pageIn() (pin) of the image
+  if (!entry->resident.load(std::memory_order_acquire)) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!entry->resident)
+      pageInEntry(entry);
+  }
+}
+
+void ImageSwap::pageIn(const Image* image)
+{
+  // We always lock the mutex here (even if the image is already in
+  // memory) so a pinned image cannot be moved to the swap file by a
+  // trim() in the middle.
+  std::lock_guard<std::mutex> lock(m_mutex);
+  ImageSwapEntry* entry = image->m_swapEntry;
+  ASSERT(entry);
+
+  entry->lastUse.store(m_tick, std::memory_order_relaxed);
+  if (!entry->resident)
+    pageInEntry(entry);
+
+  // Report the error to the code that locks the pixels (also when
+  // they were loaded accessing the image without locking it)
+  if (entry->readError) {
+    entry->readError = false;
+    throw base::Exception("Cannot read image pixels from the swap file %s",
+                          m_filename.c_str());
+  }
+}
+
+bool ImageSwap::isSwapped(const Image* image) const
+{
+  ImageSwapEntry* entry = image->m_swapEntry;
+  return (entry && !entry->resident);
+}
+
+bool ImageSwap::pageOutEntry(ImageSwapEntry* entry)
+{
+  if (!m_file.is_open()) {
+    m_file.open(FSTREAM_PATH(m_filename),
+                std::ios::in | std::ios::out |
+                std::ios::trunc | std::ios::binary);
+    if (!m_file) {
+      LOG(ERROR) << "SWAP: Cannot create swap file " << m_filename << "\n";
+      m_file.close();
+      m_file.clear();
+      return false;
+    }
+    m_fileSize = 0;
+    m_holes.clear();
+  }
+
+  entry->image->releasePixels(
+    [this, entry](const uint8_t* pixels) -> bool {
+      uLongf compressedSize = compressBound(uLong(entry->size));
+      if (m_buffer.size() < compressedSize)
+        m_buffer.resize(compressedSize);
+
+      int err = compress2(&m_buffer[0], &compressedSize,
+                          pixels, uLong(entry->size), Z_BEST_SPEED);
+      if (err != Z_OK) {
+        LOG(ERROR) << "SWAP: ZLib error " << err << " in compress2()\n";
+        return false;
+      }
+
+      std::size_t offset = allocSpace(compressedSize);
+      m_file.seekp(offset);
+      m_file.write((const char*)&m_buffer[0], compressedSize);
+      m_file.flush();
+      if (!m_file) {
+        LOG(ERROR) << "SWAP: Cannot write " << compressedSize
+                   << " bytes in the swap file\n";
+        m_file.clear();
+        freeSpace(offset, compressedSize);
+        return false;
+      }
+
+      entry->offset = offset;
+      entry->compressedSize = compressedSize;
+      entry->resident = false;
+      return true;
+    });
+
+  if (entry->resident)
+    return false;
+
+  m_residentSize -= entry->size;
+  m_swappedSize += entry->compressedSize;
+  return true;
+}
+
+// Loads the pixels of the entry. If they cannot be read, the image is
+// restored with transparent pixels (so accessors never see an image
+// without pixels) and the error is kept in the entry to be reported
+// by pageIn().
+void ImageSwap::pageInEntry(ImageSwapEntry* entry)
+{
+  ASSERT(!entry->resident);
+  ASSERT(m_file.is_open());
+
+  bool ok = true;
+  m_buffer.resize(std::max(m_buffer.size(), entry->compressedSize));
+  m_file.seekg(entry->offset);
+  m_file.read((char*)&m_buffer[0], entry->compressedSize);
+  if (!m_file) {
+    LOG(ERROR) << "SWAP: Cannot read " << entry->compressedSize
+               << " bytes from the swap file\n";
+    m_file.clear();
+    ok = false;
+  }
+
+  entry->image->restorePixels(
+    [this, entry, &ok](uint8_t* pixels) {
+      if (ok) {
+        uLongf size = uLongf(entry->size);
+        int err = uncompress(pixels, &size,
+                             &m_buffer[0], uLong(entry->compressedSize));
+        if (err != Z_OK || size != entry->size) {
+          LOG(ERROR) << "SWAP: ZLib error " << err << " in uncompress()\n";
+          ok = false;
+        }
+      }
+      if (!ok)
+        std::memset(pixels, 0, entry->size);
+    });
+
+  if (!ok)
+    entry->readError = true;
+  entry->resident = true;
+  m_residentSize += entry->size;
+  m_swappedSize -= entry->compressedSize;
+  freeSpace(entry->offset, entry->compressedSize);
+}
+
+std::size_t ImageSwap::allocSpace(std::size_t size)
+{
+  // First fit
+  for (auto it=m_holes.begin(); it!=m_holes.end(); ++it) {
+    if (it->second >= size) {
+      std::size_t offset = it->first;
+      std::size_t remaining = it->second - size;
+      m_holes.erase(it);
+      if (remaining > 0)
+        m_holes[offset+size] = remaining;
+      return offset;
+    }
+  }
+
+  std::size_t offset = m_fileSize;
+  m_fileSize += size;
+  return offset;
+}
+
+void ImageSwap::freeSpace(std::size_t offset, std::size_t size)
+{
+  // Start using the file from the beginning when it's empty
+  if (m_swappedSize == 0) {
+    m_holes.clear();
+    m_fileSize = 0;
+    return;
+  }
+
+  auto it = m_holes.emplace(offset, size).first;
+
+  // Merge with the next hole
+  auto next = std::next(it);
+  if (next != m_holes.end() && it->first+it->second == next->first) {
+    it->second += next->second;
+    m_holes.erase(next);
+  }
+
+  // Merge with the previous hole
+  if (it != m_holes.begin()) {
+    auto prev = std::prev(it);
+    if (prev->first+prev->second == it->first) {
+      prev->second += it->second;
+      m_holes.erase(it);
+      it = prev;
+    }
+  }
+
+  // Remove the hole at the end of the file
+  if (it->first+it->second == m_fileSize) {
+    m_fileSize = it->first;
+    m_holes.erase(it);
+  }
+}
+
+void ImageSwap::closeFile()
+{
+  if (!m_file.is_open())
+    return;
+
+  m_file.close();
+  m_file.clear();
+  m_fileSize = 0;
+  m_holes.clear();
+
+  if (base::is_file(m_filename))
+    base::delete_file(m_filename);
+}
+
+} // namespace doc
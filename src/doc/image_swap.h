@@ -0,0 +1,115 @@
+// Aseprite Document Library
+// Copyright (c) 2018 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_IMAGE_SWAP_H_INCLUDED
+#define DOC_IMAGE_SWAP_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+#include "base/ints.h"
+#include "doc/object_id.h"
+
+#include <atomic>
+#include <cstddef>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace doc {
+
+  class Image;
+  class Sprite;
+
+  struct ImageSwapEntry {
+    Image* image;
+    ObjectId owner;               // Sprite ID
+    std::size_t size;             // Uncompressed size of the pixels
+    std::atomic<bool> resident;   // True if the pixels are in memory
+    std::atomic<uint64_t> lastUse; // Value of ImageSwap::m_tick when it was used
+    bool readError;               // True if the pixels couldn't be read
+    std::size_t offset;           // Position/size of the compressed
+    std::size_t compressedSize;   // pixels in the swap file
+  };
+
+  // Keeps the pixels of cel images inside a memory budget. When the
+  // cel images use more memory than the budget, the least recently
+  // used ones are compressed and moved to a swap file, and they are
+  // loaded again automatically when their pixels are accessed
+  // (e.g. from LockImageBits or Image::getPixelAddress()).
+  //
+  // Images are marked as used when they are locked/pinned (or in
+  // operations of the whole image like Image::copy()), not in each
+  // access to a pixel. The time of use is the number of trim()
+  // calls, so images that are used at the same time don't need to
+  // modify a shared counter.
+  //
+  // Pixels are moved to the swap file only from trim(), so it must
+  // be called when nobody is keeping pointers to the pixels of the
+  // sprite images (except pinned images) and no other thread is
+  // using the sprite (e.g. with its document locked for writing).
+  class ImageSwap {
+  public:
+    static ImageSwap* instance();
+
+    ImageSwap();
+    ~ImageSwap();
+
+    // Maximum number of bytes used by the pixels of cel images. Zero
+    // means "no limit" (images are never moved to the swap file).
+    std::size_t budget() const { return m_budget; }
+    void setBudget(std::size_t budget);
+
+    // File used to save the compressed pixels. It's created when
+    // it's needed and deleted when the ImageSwap is destroyed.
+    const std::string& filename() const { return m_filename; }
+    void setFilename(const std::string& filename);
+
+    // Bytes of pixels in memory/in the swap file (only from images
+    // managed by the ImageSwap).
+    std::size_t residentSize() const;
+    std::size_t swappedSize() const;
+
+    // Starts managing the cel images of the given sprite, and moves
+    // to the swap file the least recently used ones (which weren't
+    // used since the previous trim() and aren't pinned) until the
+    // memory is inside the budget.
+    void trim(const Sprite* sprite);
+
+  private:
+    void addImage(Image* image, ObjectId owner);
+    void removeImage(Image* image);
+    void touch(const Image* image);
+    void pageIn(const Image* image);
+    bool isSwapped(const Image* image) const;
+
+    bool pageOutEntry(ImageSwapEntry* entry);
+    void pageInEntry(ImageSwapEntry* entry);
+    std::size_t allocSpace(std::size_t size);
+    void freeSpace(std::size_t offset, std::size_t size);
+    void closeFile();
+
+    mutable std::mutex m_mutex;
+    std::size_t m_budget;
+    std::string m_filename;
+    std::fstream m_file;
+    std::size_t m_fileSize;
+    std::map<std::size_t, std::size_t> m_holes; // Free space (offset -> size) in the file
+    std::vector<ImageSwapEntry*> m_entries;
+    std::vector<uint8_t> m_buffer;    // To compress/uncompress pixels
+    std::size_t m_residentSize;
+    std::size_t m_swappedSize;
+    std::atomic<uint64_t> m_tick;     // Incremented in each trim()
+
+    friend class Image;
+
+    DISABLE_COPYING(ImageSwap);
+  };
+
+} // namespace doc
+
+#endif
@@ -0,0 +1,173 @@
+// Aseprite Document Library
+// Copyright (c) 2018 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "base/exception.h"
+#include "doc/cel.h"
+#include "doc/image.h"
+#include "doc/image_bits.h"
+#include "doc/image_impl.h"
+#include "doc/image_ref.h"
+#include "doc/image_swap.h"
+#include "doc/layer.h"
+#include "doc/primitives.h"
+#include "doc/sprite.h"
+
+#include <fstream>
+#include <memory>
+#include <vector>
+
+using namespace doc;
+
+static const int kSize = 64;
+static const int kFrames = 8;
+static const std::size_t kImageSize = kSize*kSize*4;
+
+class ImageSwapTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    swap = ImageSwap::instance();
+    swap->setFilename("_image_swap_tests.tmp");
+    swap->setBudget(2*kImageSize);
+
+    sprite.reset(new Sprite(IMAGE_RGB, kSize, kSize, 256));
+    sprite->setTotalFrames(kFrames);
+
+    LayerImage* layer = new LayerImage(sprite.get());
+    sprite->root()->addLayer(layer);
+
+    for (frame_t frame=0; frame<kFrames; ++frame) {
+      ImageRef image(Image::create(IMAGE_RGB, kSize, kSize));
+      for (int y=0; y<kSize; ++y)
+        for (int x=0; x<kSize; ++x)
+          put_pixel(image.get(), x, y, rgba(x*4, y*4, frame*16, 255));
+      copies.push_back(ImageRef(Image::createCopy(image.get())));
+
+      Cel* cel = new Cel(frame, image);
+      layer->addCel(cel);
+      images.push_back(cel->image());
+    }
+  }
+
+  void TearDown() override {
+    sprite.reset();
+    swap->setBudget(0);
+    EXPECT_EQ(0, swap->residentSize());
+    EXPECT_EQ(0, swap->swappedSize());
+  }
+
+  int swappedImages() const {
+    int n = 0;
+    for (const Image* image : images)
+      if (image->isSwapped())
+        ++n;
+    return n;
+  }
+
+  ImageSwap* swap;
+  std::unique_ptr<Sprite> sprite;
+  std::vector<Image*> images;
+  std::vector<ImageRef> copies;
+};
+
+TEST_F(ImageSwapTest, SwapAndRestore)
+{
+  // The first trim() only registers the images (all of them are
+  // recently created)
+  swap->trim(sprite.get());
+  EXPECT_EQ(0, swappedImages());
+  EXPECT_EQ(kFrames*kImageSize, swap->residentSize());
+
+  swap->trim(sprite.get());
+  EXPECT_EQ(kFrames-2, swappedImages());
+  EXPECT_EQ(2*kImageSize, swap->residentSize());
+  EXPECT_LT(0, swap->swappedSize());
+
+  // Pixels are loaded again when they are accessed
+  for (int i=0; i<kFrames; ++i)
+    EXPECT_EQ(0, count_diff_between_images(images[i], copies[i].get()));
+  EXPECT_EQ(0, swappedImages());
+  EXPECT_EQ(0, swap->swappedSize());
+}
+
+TEST_F(ImageSwapTest, RecentlyUsedAndPinnedImages)
+{
+  swap->trim(sprite.get());
+
+  // Used after the previous trim() (accessing pixels without locking
+  // the image doesn't mark it as used)
+  get_pixel(images[2], 0, 0);
+  {
+    const LockImageBits<RgbTraits> bits(images[0]);
+  }
+
+  // Pinned
+  {
+    const LockImageBits<RgbTraits> bits(images[1]);
+    swap->trim(sprite.get());
+    EXPECT_FALSE(images[0]->isSwapped());
+    EXPECT_FALSE(images[1]->isSwapped());
+    EXPECT_TRUE(images[2]->isSwapped());
+  }
+
+  // Now they aren't pinned and weren't used since the previous trim
+  swap->setBudget(1);
+  swap->trim(sprite.get());
+  EXPECT_EQ(kFrames, swappedImages());
+  EXPECT_EQ(0, swap->residentSize());
+
+  // Modify a swapped image
+  {
+    LockImageBits<RgbTraits> bits(images[3], Image::WriteLock);
+    EXPECT_FALSE(images[3]->isSwapped());
+    for (auto it=bits.begin(), end=bits.end(); it!=end; ++it)
+      *it = rgba(255, 0, 0, 255);
+  }
+  swap->trim(sprite.get());
+  swap->trim(sprite.get());
+  EXPECT_TRUE(images[3]->isSwapped());
+  EXPECT_EQ(rgba(255, 0, 0, 255), get_pixel(images[3], 5, 5));
+  EXPECT_EQ(0, count_diff_between_images(images[4], copies[4].get()));
+}
+
+TEST_F(ImageSwapTest, ReadErrorsAreReportedByLocks)
+{
+  swap->trim(sprite.get());
+  swap->trim(sprite.get());
+  ASSERT_TRUE(images[0]->isSwapped());
+  ASSERT_TRUE(images[1]->isSwapped());
+
+  // Corrupt the swap file
+  {
+    std::ofstream f(swap->filename(), std::ios::in | std::ios::out | std::ios::binary);
+    std::vector<char> zeros(swap->swappedSize(), 0);
+    f.write(&zeros[0], zeros.size());
+  }
+
+  // Accessors don't throw (the lost pixels are transparent)
+  EXPECT_EQ(0, get_pixel(images[0], 5, 5));
+  EXPECT_FALSE(images[0]->isSwapped());
+
+  // The error is reported by the next lock
+  EXPECT_THROW(LockImageBits<RgbTraits>(images[0]).begin(), base::Exception);
+  EXPECT_FALSE(images[0]->isPinned());
+  EXPECT_NO_THROW(LockImageBits<RgbTraits>(images[0]).begin());
+
+  EXPECT_THROW(LockImageBits<RgbTraits>(images[1]).begin(), base::Exception);
+  EXPECT_FALSE(images[1]->isSwapped());
+  EXPECT_EQ(0, get_pixel(images[1], 5, 5));
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
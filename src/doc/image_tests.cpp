@@ -13,7 +13,9 @@
 #include "doc/image_impl.h"
 #include "doc/primitives.h"
 
+#include <functional>
 #include <memory>
+#include <vector>
 
 using namespace base;
 using namespace doc;
@@ -216,6 +218,104 @@ TYPED_TEST(ImageAllTypes, FillRect)
   }
 }
 
+TYPED_TEST(ImageAllTypes, ClearCopyAndCompare)
+{
+  typedef TypeParam ImageTraits;
+
+  for (int w=1; w<40; ++w) {
+    const int h = 3;
+    std::unique_ptr<Image> a(Image::create(ImageTraits::pixel_format, w, h));
+    std::unique_ptr<Image> b(Image::create(ImageTraits::pixel_format, w, h));
+
+    color_t color = (rand() % ImageTraits::max_value);
+    if (!color)
+      color = 1;
+
+    clear_image(a.get(), color);
+    for (int v=0; v<h; ++v)
+      for (int u=0; u<w; ++u)
+        EXPECT_EQ(color, get_pixel_fast<ImageTraits>(a.get(), u, v));
+
+    copy_image(b.get(), a.get());
+    EXPECT_TRUE(is_same_image(a.get(), b.get()));
+    EXPECT_EQ(0, count_diff_between_images(a.get(), b.get()));
+
+    // Change the last pixel of each row
+    for (int v=0; v<h; ++v)
+      put_pixel_fast<ImageTraits>(b.get(), w-1, v, 0);
+    EXPECT_FALSE(is_same_image(a.get(), b.get()));
+    EXPECT_EQ(h, count_diff_between_images(a.get(), b.get()));
+
+    put_pixel_fast<ImageTraits>(b.get(), 0, 0, 0);
+    EXPECT_EQ(w == 1 ? h: h+1, count_diff_between_images(a.get(), b.get()));
+  }
+
+  std::unique_ptr<Image> a(Image::create(ImageTraits::pixel_format, 8, 8));
+  std::unique_ptr<Image> b(Image::create(ImageTraits::pixel_format, 8, 9));
+  EXPECT_FALSE(is_same_image(a.get(), b.get()));
+  EXPECT_EQ(-1, count_diff_between_images(a.get(), b.get()));
+}
+
+TYPED_TEST(ImageAllTypes, SharedCopyIsCopiedOnWrite)
+{
+  typedef TypeParam ImageTraits;
+  const int w = 16, h = 16;
+
+  // Each function receives the original image or the shared copy
+  // to modify it.
+  std::vector<std::function<void(Image*)> > modifiers = {
+    [](Image* image) { image->putPixel(1, 1, 1); },
+    [](Image* image) { put_pixel(image, 1, 1, 1); },
+    [](Image* image) { image->clear(1); },
+    [](Image* image) { image->drawHLine(0, 1, 4, 1); },
+    [](Image* image) { fill_rect(image, 0, 0, 4, 4, 1); },
+    [](Image* image) {
+      std::unique_ptr<Image> src(Image::create(ImageTraits::pixel_format, 4, 4));
+      clear_image(src.get(), 1);
+      copy_image(image, src.get(), 0, 0);
+    },
+    [](Image* image) {
+      LockImageBits<ImageTraits> bits(image, Image::WriteLock);
+      for (auto it=bits.begin(), end=bits.end(); it != end; ++it)
+        *it = 1;
+    },
+  };
+
+  for (bool modifyCopy : { false, true }) {
+    for (int i=0; i<int(modifiers.size()); ++i) {
+      SCOPED_TRACE(i);
+      std::unique_ptr<Image> a(Image::create(ImageTraits::pixel_format, w, h));
+      clear_image(a.get(), 0);
+
+      std::unique_ptr<Image> b(Image::createSharedCopy(a.get()));
+      EXPECT_TRUE(a->hasSharedPixels());
+      EXPECT_TRUE(b->hasSharedPixels());
+      EXPECT_EQ(static_cast<const Image*>(a.get())->getPixelAddress(0, 0),
+                static_cast<const Image*>(b.get())->getPixelAddress(0, 0));
+
+      Image* modified = (modifyCopy ? b.get(): a.get());
+      Image* other = (modifyCopy ? a.get(): b.get());
+      modifiers[i](modified);
+
+      EXPECT_FALSE(a->hasSharedPixels());
+      EXPECT_FALSE(b->hasSharedPixels());
+      EXPECT_EQ(1, get_pixel(modified, 1, 1));
+      for (int y=0; y<h; ++y)
+        for (int x=0; x<w; ++x)
+          ASSERT_EQ(0, get_pixel(other, x, y));
+    }
+  }
+
+  // The last image can modify the pixels without copying them
+  std::unique_ptr<Image> a(Image::create(ImageTraits::pixel_format, w, h));
+  std::unique_ptr<Image> b(Image::createSharedCopy(a.get()));
+  const uint8_t* bits = static_cast<const Image*>(b.get())->getPixelAddress(0, 0);
+  a.reset();
+  EXPECT_FALSE(b->hasSharedPixels());
+  put_pixel(b.get(), 0, 0, 1);
+  EXPECT_EQ(bits, static_cast<const Image*>(b.get())->getPixelAddress(0, 0));
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
@@ -12,35 +12,217 @@
 
 #include "base/base.h"
 #include "base/memory.h"
+#include "doc/bitmap_ops.h"
 #include "doc/image_impl.h"
 
+#include <atomic>
 #include <cstdlib>
 #include <cstring>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define DOC_MASK_SSE2 1
+  #include <emmintrin.h>
+#endif
 
 namespace doc {
 
 namespace {
 
-  template<typename Func>
-  void for_each_mask_pixel(Mask& a, const Mask& b, Func f) {
-    a.reserve(b.bounds());
-
-    {
-      LockImageBits<BitmapTraits> aBits(a.bitmap());
-      auto aIt = aBits.begin();
-
-      auto bounds = a.bounds();
-      for (int y=0; y<bounds.h; ++y) {
-        for (int x=0; x<bounds.w; ++x, ++aIt) {
-          color_t aColor = *aIt;
-          color_t bColor = (b.containsPoint(bounds.x+x,
-                                            bounds.y+y) ? 1: 0);
-          *aIt = f(aColor, bColor);
-        }
+  // Minimum number of pixels to split Mask::byColor() in several
+  // threads, and minimum number of rows for each thread.
+  const int kMinParallelArea = 256*256;
+  const int kMinRowsPerThread = 32;
+
+  // Range of colors selected by Mask::byColor(). match8() returns
+  // one bit for each of the 8 pixels starting at the given address
+  // (the same layout of a byte in a bitmap).
+  template<typename ImageTraits>
+  class ColorRange;
+
+  template<>
+  class ColorRange<RgbTraits> {
+  public:
+    typedef RgbTraits::pixel_t pixel_t;
+
+    ColorRange(color_t color, int fuzziness) {
+      m_min = rgba(MID(0, int(rgba_getr(color))-fuzziness, 255),
+                   MID(0, int(rgba_getg(color))-fuzziness, 255),
+                   MID(0, int(rgba_getb(color))-fuzziness, 255),
+                   MID(0, int(rgba_geta(color))-fuzziness, 255));
+      m_max = rgba(MID(0, int(rgba_getr(color))+fuzziness, 255),
+                   MID(0, int(rgba_getg(color))+fuzziness, 255),
+                   MID(0, int(rgba_getb(color))+fuzziness, 255),
+                   MID(0, int(rgba_geta(color))+fuzziness, 255));
+    }
+
+    bool match(pixel_t c) const {
+      return (rgba_getr(c) >= rgba_getr(m_min) && rgba_getr(c) <= rgba_getr(m_max) &&
+              rgba_getg(c) >= rgba_getg(m_min) && rgba_getg(c) <= rgba_getg(m_max) &&
+              rgba_getb(c) >= rgba_getb(m_min) && rgba_getb(c) <= rgba_getb(m_max) &&
+              rgba_geta(c) >= rgba_geta(m_min) && rgba_geta(c) <= rgba_geta(m_max));
+    }
+
+    uint8_t match8(const pixel_t* p) const {
+#if DOC_MASK_SSE2
+      const __m128i min = _mm_set1_epi32(int(m_min));
+      const __m128i max = _mm_set1_epi32(int(m_max));
+      return uint8_t(match4(_mm_loadu_si128((const __m128i*)p), min, max) |
+                     (match4(_mm_loadu_si128((const __m128i*)(p+4)), min, max) << 4));
+#else
+      uint8_t bits = 0;
+      for (int i=0; i<8; ++i)
+        if (match(p[i]))
+          bits |= (1 << i);
+      return bits;
+#endif
+    }
+
+  private:
+#if DOC_MASK_SSE2
+    static int match4(__m128i v, __m128i min, __m128i max) {
+      // Components out of range are != 0
+      const __m128i out = _mm_or_si128(_mm_subs_epu8(min, v),
+                                       _mm_subs_epu8(v, max));
+      return _mm_movemask_ps(
+        _mm_castsi128_ps(_mm_cmpeq_epi32(out, _mm_setzero_si128())));
+    }
+#endif
+
+    color_t m_min, m_max;
+  };
+
+  template<>
+  class ColorRange<GrayscaleTraits> {
+  public:
+    typedef GrayscaleTraits::pixel_t pixel_t;
+
+    ColorRange(color_t color, int fuzziness) {
+      m_min = graya(MID(0, int(graya_getv(color))-fuzziness, 255),
+                    MID(0, int(graya_geta(color))-fuzziness, 255));
+      m_max = graya(MID(0, int(graya_getv(color))+fuzziness, 255),
+                    MID(0, int(graya_geta(color))+fuzziness, 255));
+    }
+
+    bool match(pixel_t c) const {
+      return (graya_getv(c) >= graya_getv(m_min) && graya_getv(c) <= graya_getv(m_max) &&
+              graya_geta(c) >= graya_geta(m_min) && graya_geta(c) <= graya_geta(m_max));
+    }
+
+    uint8_t match8(const pixel_t* p) const {
+#if DOC_MASK_SSE2
+      const __m128i v = _mm_loadu_si128((const __m128i*)p);
+      const __m128i out = _mm_or_si128(
+        _mm_subs_epu8(_mm_set1_epi16(short(m_min)), v),
+        _mm_subs_epu8(v, _mm_set1_epi16(short(m_max))));
+      const __m128i eq = _mm_cmpeq_epi16(out, _mm_setzero_si128());
+      return uint8_t(_mm_movemask_epi8(_mm_packs_epi16(eq, eq)));
+#else
+      uint8_t bits = 0;
+      for (int i=0; i<8; ++i)
+        if (match(p[i]))
+          bits |= (1 << i);
+      return bits;
+#endif
+    }
+
+  private:
+    color_t m_min, m_max;
+  };
+
+  template<>
+  class ColorRange<IndexedTraits> {
+  public:
+    typedef IndexedTraits::pixel_t pixel_t;
+
+    ColorRange(color_t color, int fuzziness)
+      : m_min(MID(0, int(color)-fuzziness, 255))
+      , m_max(MID(0, int(color)+fuzziness, 255))
+      , m_empty(int(color)-fuzziness > 255) {
+    }
+
+    bool match(pixel_t c) const {
+      return (!m_empty && c >= m_min && c <= m_max);
+    }
+
+    uint8_t match8(const pixel_t* p) const {
+#if DOC_MASK_SSE2
+      if (m_empty)
+        return 0;
+      const __m128i v = _mm_loadl_epi64((const __m128i*)p);
+      const __m128i out = _mm_or_si128(
+        _mm_subs_epu8(_mm_set1_epi8(char(m_min)), v),
+        _mm_subs_epu8(v, _mm_set1_epi8(char(m_max))));
+      return uint8_t(_mm_movemask_epi8(
+                       _mm_cmpeq_epi8(out, _mm_setzero_si128())));
+#else
+      uint8_t bits = 0;
+      for (int i=0; i<8; ++i)
+        if (match(p[i]))
+          bits |= (1 << i);
+      return bits;
+#endif
+    }
+
+  private:
+    int m_min, m_max;
+    bool m_empty;
+  };
+
+  // Writes the bitmap bytes of the given rows directly (8 pixels
+  // each time).
+  template<typename ImageTraits>
+  void by_color_rows(const Image* src, Image* dst,
+                     const ColorRange<ImageTraits>& range,
+                     const int y1, const int y2)
+  {
+    typedef typename ImageTraits::pixel_t pixel_t;
+    const int w = src->width();
+
+    for (int y=y1; y<y2; ++y) {
+      const pixel_t* s = (const pixel_t*)src->getPixelAddress(0, y);
+      uint8_t* d = dst->getPixelAddress(0, y);
+      int x = 0;
+
+      for (; x+8<=w; x+=8, s+=8)
+        *(d++) = range.match8(s);
+
+      if (x < w) {
+        uint8_t bits = 0;
+        for (int i=0; x<w; ++x, ++i, ++s)
+          if (range.match(*s))
+            bits |= (1 << i);
+        *d = bits;
       }
     }
+  }
 
-    a.shrink();
+  template<typename ImageTraits>
+  void by_color_templ(const Image* src, Image* dst,
+                      const ColorRange<ImageTraits>& range,
+                      const bool parallel)
+  {
+    const int h = src->height();
+    int nthreads = 1;
+    if (parallel && src->width()*h >= kMinParallelArea)
+      nthreads = MID(1, int(std::thread::hardware_concurrency()),
+                     h / kMinRowsPerThread);
+
+    // Bands of rows are independent, each one is written in
+    // different bytes of the bitmap.
+    std::vector<std::thread> threads;
+    for (int i=1; i<nthreads; ++i) {
+      const int y1 = h*i/nthreads;
+      const int y2 = h*(i+1)/nthreads;
+      threads.push_back(
+        std::thread([src, dst, &range, y1, y2]{
+            by_color_rows(src, dst, range, y1, y2);
+          }));
+    }
+    by_color_rows(src, dst, range, 0, h/nthreads);
+    for (auto& thread : threads)
+      thread.join();
   }
 
 } // namespace namespace
@@ -100,15 +282,7 @@ bool Mask::isRectangular() const
   if (!m_bitmap)
     return false;
 
-  LockImageBits<BitmapTraits> bits(m_bitmap.get());
-  LockImageBits<BitmapTraits>::iterator it = bits.begin(), end = bits.end();
-
-  for (; it != end; ++it) {
-    if (*it == 0)
-      return false;
-  }
-
-  return true;
+  return is_full_bitmap(m_bitmap.get());
 }
 
 void Mask::copyFrom(const Mask* sourceMask)
@@ -141,12 +315,7 @@ void Mask::invert()
   if (!m_bitmap)
     return;
 
-  LockImageBits<BitmapTraits> bits(m_bitmap.get());
-  LockImageBits<BitmapTraits>::iterator it = bits.begin(), end = bits.end();
-
-  for (; it != end; ++it)
-    *it = (*it ? 0: 1);
-
+  bitmap_invert(m_bitmap.get());
   shrink();
 }
 
@@ -160,32 +329,54 @@ void Mask::replace(const gfx::Rect& bounds)
 
 void Mask::add(const doc::Mask& mask)
 {
-  for_each_mask_pixel(
-    *this, mask,
-    [](color_t a, color_t b) -> color_t {
-      return a | b;
-    });
+  if (mask.isEmpty())
+    return;
+
+  reserve(mask.bounds());
+  bitmap_combine(m_bitmap.get(), mask.bitmap(),
+                 gfx::Clip(mask.bounds().x-m_bounds.x,
+                           mask.bounds().y-m_bounds.y,
+                           0, 0, mask.bounds().w, mask.bounds().h),
+                 BitmapOp::Or);
+  shrink();
 }
 
 void Mask::subtract(const doc::Mask& mask)
 {
-  for_each_mask_pixel(
-    *this, mask,
-    [](color_t a, color_t b) -> color_t {
-      if (a)
-        return a - b;
-      else
-        return 0;
-    });
+  if (!m_bitmap || mask.isEmpty())
+    return;
+
+  bitmap_combine(m_bitmap.get(), mask.bitmap(),
+                 gfx::Clip(mask.bounds().x-m_bounds.x,
+                           mask.bounds().y-m_bounds.y,
+                           0, 0, mask.bounds().w, mask.bounds().h),
+                 BitmapOp::AndNot);
+  shrink();
 }
 
 void Mask::intersect(const doc::Mask& mask)
 {
-  for_each_mask_pixel(
-    *this, mask,
-    [](color_t a, color_t b) -> color_t {
-      return a & b;
-    });
+  if (!m_bitmap)
+    return;
+
+  if (mask.isEmpty()) {
+    clear();
+    return;
+  }
+
+  // Crop the bitmap to the intersection area (pixels outside "mask"
+  // bounds are removed) and then remove the unselected pixels inside.
+  intersect(mask.bounds());
+  if (!m_bitmap)
+    return;
+
+  bitmap_combine(m_bitmap.get(), mask.bitmap(),
+                 gfx::Clip(0, 0,
+                           m_bounds.x-mask.bounds().x,
+                           m_bounds.y-mask.bounds().y,
+                           m_bounds.w, m_bounds.h),
+                 BitmapOp::And);
+  shrink();
 }
 
 void Mask::add(const gfx::Rect& bounds)
@@ -193,11 +384,9 @@ void Mask::add(const gfx::Rect& bounds)
   if (m_freeze_count == 0)
     reserve(bounds);
 
-  fill_rect(m_bitmap.get(),
-    bounds.x-m_bounds.x,
-    bounds.y-m_bounds.y,
-    bounds.x-m_bounds.x+bounds.w-1,
-    bounds.y-m_bounds.y+bounds.h-1, 1);
+  bitmap_fill_rect(m_bitmap.get(),
+                   gfx::Rect(bounds).offset(-m_bounds.x, -m_bounds.y),
+                   true);
 }
 
 void Mask::subtract(const gfx::Rect& bounds)
@@ -205,12 +394,9 @@ void Mask::subtract(const gfx::Rect& bounds)
   if (!m_bitmap)
     return;
 
-  fill_rect(m_bitmap.get(),
-    bounds.x-m_bounds.x,
-    bounds.y-m_bounds.y,
-    bounds.x-m_bounds.x+bounds.w-1,
-    bounds.y-m_bounds.y+bounds.h-1, 0);
-
+  bitmap_fill_rect(m_bitmap.get(),
+                   gfx::Rect(bounds).offset(-m_bounds.x, -m_bounds.y),
+                   false);
   shrink();
 }
 
@@ -237,106 +423,55 @@ void Mask::intersect(const gfx::Rect& bounds)
   shrink();
 }
 
-void Mask::byColor(const Image *src, int color, int fuzziness)
+void Mask::byColor(const Image* src, int color, int fuzziness)
 {
-  replace(src->bounds());
+  byColor(src, color, fuzziness, true);
+}
+
+// static
+void Mask::byColor(const std::vector<Mask*>& masks,
+                   const std::vector<const Image*>& images,
+                   int color, int fuzziness)
+{
+  ASSERT(masks.size() == images.size());
+
+  const int n = int(MIN(masks.size(), images.size()));
+  const int nthreads = MID(1, int(std::thread::hardware_concurrency()), n);
+
+  // Each thread calculates whole masks (one after the other) so we
+  // don't need to split the rows of each image.
+  std::atomic<int> next(0);
+  auto proc =
+    [&masks, &images, &next, n, color, fuzziness]{
+      for (int i=next++; i<n; i=next++)
+        masks[i]->byColor(images[i], color, fuzziness, false);
+    };
+
+  std::vector<std::thread> threads;
+  for (int i=1; i<nthreads; ++i)
+    threads.push_back(std::thread(proc));
+  proc();
+  for (auto& thread : threads)
+    thread.join();
+}
 
-  Image* dst = m_bitmap.get();
+void Mask::byColor(const Image* src, int color, int fuzziness, bool parallel)
+{
+  replace(src->bounds());
 
   switch (src->pixelFormat()) {
-
-    case IMAGE_RGB: {
-      const LockImageBits<RgbTraits> srcBits(src);
-      LockImageBits<BitmapTraits> dstBits(dst, Image::WriteLock);
-      LockImageBits<RgbTraits>::const_iterator src_it = srcBits.begin(), src_end = srcBits.end();
-      LockImageBits<BitmapTraits>::iterator dst_it = dstBits.begin();
-#ifdef _DEBUG
-      LockImageBits<BitmapTraits>::iterator dst_end = dstBits.end();
-#endif
-      int src_r, src_g, src_b, src_a;
-      int dst_r, dst_g, dst_b, dst_a;
-      color_t c;
-
-      dst_r = rgba_getr(color);
-      dst_g = rgba_getg(color);
-      dst_b = rgba_getb(color);
-      dst_a = rgba_geta(color);
-
-      for (; src_it != src_end; ++src_it, ++dst_it) {
-        ASSERT(dst_it != dst_end);
-        c = *src_it;
-
-        src_r = rgba_getr(c);
-        src_g = rgba_getg(c);
-        src_b = rgba_getb(c);
-        src_a = rgba_geta(c);
-
-        if (!((src_r >= dst_r-fuzziness) && (src_r <= dst_r+fuzziness) &&
-              (src_g >= dst_g-fuzziness) && (src_g <= dst_g+fuzziness) &&
-              (src_b >= dst_b-fuzziness) && (src_b <= dst_b+fuzziness) &&
-              (src_a >= dst_a-fuzziness) && (src_a <= dst_a+fuzziness)))
-          *dst_it = 0;
-      }
-      ASSERT(dst_it == dst_end);
+    case IMAGE_RGB:
+      by_color_templ(src, m_bitmap.get(),
+                     ColorRange<RgbTraits>(color, fuzziness), parallel);
       break;
-    }
-
-    case IMAGE_GRAYSCALE: {
-      const LockImageBits<GrayscaleTraits> srcBits(src);
-      LockImageBits<BitmapTraits> dstBits(dst, Image::WriteLock);
-      LockImageBits<GrayscaleTraits>::const_iterator src_it = srcBits.begin(), src_end = srcBits.end();
-      LockImageBits<BitmapTraits>::iterator dst_it = dstBits.begin();
-#ifdef _DEBUG
-      LockImageBits<BitmapTraits>::iterator dst_end = dstBits.end();
-#endif
-      int src_k, src_a;
-      int dst_k, dst_a;
-      color_t c;
-
-      dst_k = graya_getv(color);
-      dst_a = graya_geta(color);
-
-      for (; src_it != src_end; ++src_it, ++dst_it) {
-        ASSERT(dst_it != dst_end);
-        c = *src_it;
-
-        src_k = graya_getv(c);
-        src_a = graya_geta(c);
-
-        if (!((src_k >= dst_k-fuzziness) && (src_k <= dst_k+fuzziness) &&
-              (src_a >= dst_a-fuzziness) && (src_a <= dst_a+fuzziness)))
-          *dst_it = 0;
-      }
-      ASSERT(dst_it == dst_end);
+    case IMAGE_GRAYSCALE:
+      by_color_templ(src, m_bitmap.get(),
+                     ColorRange<GrayscaleTraits>(color, fuzziness), parallel);
       break;
-    }
-
-    case IMAGE_INDEXED: {
-      const LockImageBits<IndexedTraits> srcBits(src);
-      LockImageBits<BitmapTraits> dstBits(dst, Image::WriteLock);
-      LockImageBits<IndexedTraits>::const_iterator src_it = srcBits.begin(), src_end = srcBits.end();
-      LockImageBits<BitmapTraits>::iterator dst_it = dstBits.begin();
-#ifdef _DEBUG
-      LockImageBits<BitmapTraits>::iterator dst_end = dstBits.end();
-#endif
-      color_t c, min, max;
-
-      for (; src_it != src_end; ++src_it, ++dst_it) {
-        ASSERT(dst_it != dst_end);
-        c = *src_it;
-
-        if (color > fuzziness)
-          min = color-fuzziness;
-        else
-          min = 0;
-        max = color + fuzziness;
-
-        if (!((c >= min) && (c <= max)))
-          *dst_it = 0;
-      }
-      ASSERT(dst_it == dst_end);
+    case IMAGE_INDEXED:
+      by_color_templ(src, m_bitmap.get(),
+                     ColorRange<IndexedTraits>(color, fuzziness), parallel);
       break;
-    }
   }
 
   shrink();
@@ -437,58 +572,18 @@ void Mask::shrink()
   if (m_freeze_count > 0)
     return;
 
-#define SHRINK_SIDE(u_begin, u_op, u_final, u_add,                      \
-                    v_begin, v_op, v_final, v_add, U, V, var)           \
-  {                                                                     \
-    for (u = u_begin; u u_op u_final; u u_add) {                        \
-      for (v = v_begin; v v_op v_final; v v_add) {                      \
-        if (get_pixel_fast<BitmapTraits>(m_bitmap.get(), U, V))         \
-          break;                                                        \
-      }                                                                 \
-      if (v == v_final)                                                 \
-        var;                                                            \
-      else                                                              \
-        break;                                                          \
-    }                                                                   \
-  }
-
-  int u, v, x1, y1, x2, y2;
-
-  x1 = m_bounds.x;
-  y1 = m_bounds.y;
-  x2 = m_bounds.x+m_bounds.w-1;
-  y2 = m_bounds.y+m_bounds.h-1;
-
-  SHRINK_SIDE(0, <, m_bounds.w, ++,
-              0, <, m_bounds.h, ++, u, v, x1++);
-
-  SHRINK_SIDE(0, <, m_bounds.h, ++,
-              0, <, m_bounds.w, ++, v, u, y1++);
-
-  SHRINK_SIDE(m_bounds.w-1, >, 0, --,
-              0, <, m_bounds.h, ++, u, v, x2--);
-
-  SHRINK_SIDE(m_bounds.h-1, >, 0, --,
-              0, <, m_bounds.w, ++, v, u, y2--);
+  if (!m_bitmap)
+    return;
 
-  if ((x1 > x2) || (y1 > y2)) {
+  const gfx::Rect bounds = bitmap_bounds(m_bitmap.get());
+  if (bounds.isEmpty()) {
     clear();
   }
-  else if ((x1 != m_bounds.x) || (x2 != m_bounds.x+m_bounds.w-1) ||
-           (y1 != m_bounds.y) || (y2 != m_bounds.y+m_bounds.h-1)) {
-    u = m_bounds.x;
-    v = m_bounds.y;
-
-    m_bounds.x = x1;
-    m_bounds.y = y1;
-    m_bounds.w = x2 - x1 + 1;
-    m_bounds.h = y2 - y1 + 1;
-
-    Image* image = crop_image(m_bitmap.get(), m_bounds.x-u, m_bounds.y-v, m_bounds.w, m_bounds.h, 0);
+  else if (bounds != m_bitmap->bounds()) {
+    Image* image = crop_image(m_bitmap.get(), bounds, 0);
     m_bitmap.reset(image);
+    m_bounds = gfx::Rect(bounds).offset(m_bounds.origin());
   }
-
-#undef SHRINK_SIDE
 }
 
 } // namespace doc
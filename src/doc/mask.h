@@ -16,6 +16,7 @@
 #include "gfx/rect.h"
 
 #include <string>
+#include <vector>
 
 namespace doc {
 
@@ -89,7 +90,15 @@ namespace doc {
     void subtract(const gfx::Rect& bounds);
     void intersect(const gfx::Rect& bounds);
 
+    // Selects the pixels of the image similar to the given color
+    // (each component can be different by "fuzziness" at most).
     void byColor(const Image* image, int color, int fuzziness);
+
+    // Calls byColor() for each mask/image pair (masks[i] is
+    // calculated from images[i]) using several threads.
+    static void byColor(const std::vector<Mask*>& masks,
+                        const std::vector<const Image*>& images,
+                        int color, int fuzziness);
     void crop(const Image* image);
 
     // Reserves a rectangle to draw onto the bitmap (you should call
@@ -105,6 +114,7 @@ namespace doc {
 
   private:
     void initialize();
+    void byColor(const Image* image, int color, int fuzziness, bool parallel);
 
     int m_freeze_count;
     std::string m_name;           // Mask name
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2001-2015 David Capello
+// Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -10,330 +10,216 @@
 
 #include "doc/mask_boundaries.h"
 
-#include "doc/image_impl.h"
+#include "base/debug.h"
+#include "doc/bitmap_ops.h"
+#include "doc/image.h"
+
+#include <cstdint>
 
 namespace doc {
 
-MaskBoundaries::MaskBoundaries(const Image* bitmap)
-{
-  int x, y, w = bitmap->width(), h = bitmap->height();
+static_assert(MaskBoundaries::kTileSize == 64,
+              "Tiles are processed as 64-bit words");
 
-  const LockImageBits<BitmapTraits> bits(bitmap);
-  auto it = bits.begin();       // Current pixel iterator
-#if _DEBUG
-  auto prevIt = bits.begin();   // Previous row iterator (same X pos)
-#endif
+namespace {
 
-  // Vertical segments being expanded from the previous row.
-  std::vector<int> vertSegs(w+1, -1);
+// Pixels of a bitmap located at "origin" (pixels outside the bitmap
+// are zero).
+class OriginBitmap {
+public:
+  OriginBitmap(const Image* bitmap, const gfx::Point& origin)
+    : m_bitmap(bitmap), m_origin(origin) { }
 
-  // Horizontal segment being expanded from the previous column.
-  int horzSeg;
-
-#define new_hseg(open) {                                        \
-    m_segs.push_back(Segment(open, gfx::Rect(x, y, 1, 0)));     \
-    horzSeg = int(m_segs.size()-1);                             \
-  }
-#define new_vseg(open) {                                        \
-    m_segs.push_back(Segment(open, gfx::Rect(x, y, 0, 1)));     \
-    vertSegs[x] = int(m_segs.size()-1);                         \
-  }
-#define expand_hseg() { \
-    ASSERT(hseg);       \
-    ++hseg->m_bounds.w; \
-  }
-#define expand_vseg() { \
-    ASSERT(vseg);       \
-    ++vseg->m_bounds.h; \
-  }
-#define stop_expanding_hseg() {                 \
-    horzSeg = -1;                               \
-  }
-#define stop_expanding_vseg() {                 \
-    vertSegs[x] = -1;                           \
+  // Returns the pixels from x to x+63 of the row y.
+  uint64_t bits(int x, int y) const {
+    return get_bitmap_bits(m_bitmap, x-m_origin.x, y-m_origin.y);
   }
 
-  for (y=0; y<=h; ++y) {
-    bool prevColor = false;         // Previous color (X-1) same Y row
-    horzSeg = -1;
+private:
+  const Image* m_bitmap;
+  gfx::Point m_origin;
+};
 
-    for (x=0; x<=w; ++x) {
-      bool color = (x < w && y < h && *it ? true: false);
-#if _DEBUG
-      bool prevRowColor = (x < w && y > 0 && *prevIt ? true: false);
-#endif
-      Segment* hseg = (horzSeg >= 0 ? &m_segs[horzSeg]: nullptr);
-      Segment* vseg = (vertSegs[x] >= 0 ? &m_segs[vertSegs[x]]: nullptr);
-
-      //
-      // -   -
-      //
-      // -   1
-      //
-      if (color) {
-        //
-        // - | -
-        //   o
-        // -   1
-        //
-        if (vseg) {
-          //
-          // 0 | 1
-          //   o
-          // -   1
-          //
-          if (vseg->open()) {
-            ASSERT(prevRowColor);
-
-            //
-            // 0 | 1
-            // --x
-            // 1   1
-            //
-            if (hseg) {
-              ASSERT(hseg->open());
-              ASSERT(prevColor);
-              stop_expanding_hseg();
-              stop_expanding_vseg();
-            }
-            //
-            // 0 | 1
-            //   |
-            // 0 | 1
-            //   o
-            else {
-              ASSERT(!prevColor);
-              expand_vseg();
-            }
-          }
-          //
-          // 1 | 0
-          //   x--o
-          // -   1
-          //
-          else {
-            ASSERT(!prevRowColor);
-
-            //
-            // 1 | 0
-            // --x--o
-            // 0 | 1
-            //   o
-            if (hseg) {
-              ASSERT(!prevColor);
-              ASSERT(!hseg->open());
-              new_hseg(true);
-              new_vseg(true);
-            }
-            //
-            // 1 | 0
-            //   x--o
-            // 1   1
-            //
-            else {
-              ASSERT(prevColor);
-              new_hseg(true);
-              stop_expanding_vseg();
-            }
-          }
-        }
-        //
-        // -   -  (there is no vertical segment in this row, both colors are equal)
-        //
-        // -   1
-        //
-        else {
-          //
-          // -   -
-          // --o
-          // -   1
-          //
-          if (hseg) {
-            //
-            // 0   0
-            // -----o
-            // 1   1
-            //
-            if (hseg->open()) {
-              ASSERT(prevColor);
-              expand_hseg();
-            }
-            //
-            // 1   1
-            // --x
-            // 0 | 1
-            //   o
-            else {
-              ASSERT(!prevColor);
-              stop_expanding_hseg();
-              new_vseg(true);
-            }
-          }
-          else {
-            //
-            // 1   1
-            //
-            // 1   1
-            //
-            if (prevColor) {
-              // Do nothing, we are inside boundaries
-            }
-            //
-            // 0   0
-            //    --o
-            // 0 | 1
-            //   o
-            else {
-              // First two segments of a corner
-              new_hseg(true);
-              new_vseg(true);
-            }
-          }
-        }
-      }
-      //
-      // -   -
-      //
-      // -   0
-      //
-      else {
-        //
-        // - | -
-        //   o
-        // -   0
-        //
-        if (vseg) {
-          //
-          // 0 | 1
-          //   o
-          // -   0
-          //
-          if (vseg->open()) {
-            ASSERT(prevRowColor);
-
-            //
-            // 0 | 1
-            // --x--o
-            // 1 | 0
-            //   o
-            if (hseg) {
-              ASSERT(hseg->open());
-              ASSERT(prevColor);
-              new_hseg(false);
-              new_vseg(false);
-            }
-            //
-            // 0 | 1
-            //   x--o
-            // 0   0
-            //
-            else {
-              ASSERT(!prevColor);
-              new_hseg(false);
-              stop_expanding_vseg();
-            }
-          }
-          //
-          // 1 | 0
-          //   o
-          // -   0
-          //
-          else {
-            ASSERT(!prevRowColor);
-
-            //
-            // 1 | 0
-            // --x
-            // 0   0
-            //
-            if (hseg) {
-              ASSERT(!prevColor);
-              stop_expanding_hseg();
-              stop_expanding_vseg();
-            }
-            //
-            // 1 | 0
-            //   |
-            // 1 | 0
-            //   o
-            else {
-              ASSERT(prevColor);
-              expand_vseg();
-            }
-          }
+// Returns the number of consecutive bits set starting from the bit i
+inline int run_length(uint64_t bits, int i)
+{
+  bits = ~(bits >> i);
+  return (bits ? lowest_bit(bits): 64-i);
+}
+
+// Calculates the segments of the tile that starts at x0/y0. A tile
+// contains the horizontal lines between rows y-1 and y, and vertical
+// lines between columns x-1 and x, for x in [x0,x0+64) and y in
+// [y0,y0+64).
+void calculate_tile(const OriginBitmap& bitmap, const int x0, const int y0,
+                    MaskBoundaries::list_type& segs)
+{
+  typedef MaskBoundaries::Segment Segment;
+
+  // Horizontal segments: pixels that are different from the pixel
+  // above.
+  uint64_t prev = bitmap.bits(x0, y0-1);
+  for (int y=y0; y<y0+64; ++y) {
+    const uint64_t cur = bitmap.bits(x0, y);
+    uint64_t edges = (prev ^ cur);
+
+    while (edges) {
+      const int i = lowest_bit(edges);
+      const bool open = ((cur >> i) & 1 ? true: false);
+      const int n = run_length(edges & (open ? cur: ~cur), i);
+      segs.push_back(Segment(open, gfx::Rect(x0+i, y, n, 0)));
+      edges &= ~(n == 64 ? ~uint64_t(0): ((uint64_t(1) << n) - 1) << i);
+    }
+    prev = cur;
+  }
+
+  // Vertical segments: pixels that are different from the pixel at
+  // the left. These segments are expanded row by row, "active"
+  // contains the columns of segments that can be expanded (the
+  // index of each one is in column[]).
+  int column[64];
+  uint64_t active = 0;
+
+  for (int y=y0; y<y0+64; ++y) {
+    const uint64_t cur = bitmap.bits(x0, y);
+    const uint64_t left = bitmap.bits(x0-1, y);
+    const uint64_t edges = (left ^ cur);
+    uint64_t bits = (edges | active);
+
+    while (bits) {
+      const int i = lowest_bit(bits);
+      const uint64_t bit = (uint64_t(1) << i);
+      bits &= ~bit;
+
+      if (edges & bit) {
+        const bool open = (cur & bit ? true: false);
+        if ((active & bit) && segs[column[i]].open() == open) {
+          const gfx::Rect& rc = segs[column[i]].bounds();
+          segs[column[i]] = Segment(open, gfx::Rect(rc.x, rc.y, 0, rc.h+1));
         }
-        //
-        // -   -  (there is no vertical segment in this row, both colors are equal)
-        //
-        // -   0
-        //
         else {
-          //
-          // -   -
-          // --o
-          // -   0
-          //
-          if (hseg) {
-            //
-            // 0   0
-            // --x
-            // 1 | 0
-            //   o
-            if (hseg->open()) {
-              ASSERT(prevColor);
-              stop_expanding_hseg();
-              new_vseg(false);
-            }
-            //
-            // 1   1
-            // -----o
-            // 0   0
-            //
-            else {
-              ASSERT(!prevColor);
-              expand_hseg();
-            }
-          }
-          else {
-            //
-            // 1   1
-            //    --o
-            // 1 | 0
-            //   o
-            if (prevColor) {
-              new_hseg(false);
-              new_vseg(false);
-            }
-            //
-            // 0   0
-            //
-            // 0   0
-            //
-            else {
-              // Do nothing, we are inside boundaries
-            }
-          }
+          segs.push_back(Segment(open, gfx::Rect(x0+i, y, 0, 1)));
+          column[i] = int(segs.size()-1);
+          active |= bit;
         }
       }
+      else
+        active &= ~bit;
+    }
+  }
+}
 
-      prevColor = color;
-      if (x < w) {
-#if _DEBUG
-        if (y > 0) ++prevIt;
-#endif
-        if (y < h) ++it;
+// Returns true if the pixels that affect the segments of the tile at
+// x0/y0 are different in the two bitmaps.
+bool is_tile_modified(const OriginBitmap& a, const OriginBitmap& b,
+                      const int x0, const int y0)
+{
+  for (int y=y0-1; y<y0+64; ++y) {
+    if (a.bits(x0-1, y) != b.bits(x0-1, y) ||
+        (a.bits(x0, y) >> 63) != (b.bits(x0, y) >> 63))
+      return true;
+  }
+  return false;
+}
+
+} // anonymous namespace
+
+MaskBoundaries::MaskBoundaries()
+{
+}
+
+MaskBoundaries::MaskBoundaries(const Image* bitmap)
+{
+  regenerate(bitmap, gfx::Point(0, 0));
+}
+
+void MaskBoundaries::regenerate(const Image* bitmap, const gfx::Point& origin)
+{
+  // Any pixel of the new or the old bitmap could be modified
+  gfx::Rect modifiedArea(origin, bitmap->size());
+  if (m_bitmap)
+    modifiedArea |= gfx::Rect(m_origin, m_bitmap->size());
+
+  regenerate(bitmap, origin, modifiedArea);
+}
+
+void MaskBoundaries::regenerate(const Image* bitmap, const gfx::Point& origin,
+                                const gfx::Rect& modifiedArea)
+{
+  ASSERT(bitmap->pixelFormat() == IMAGE_BITMAP);
+
+  // Tiles that can contain lines (the last line is in the bottom/right
+  // edge of the last pixel)
+  const gfx::Rect tiles =
+    tileBounds(gfx::Rect(origin.x-m_grid.x, origin.y-m_grid.y,
+                         bitmap->width()+1, bitmap->height()+1));
+
+  // A modified pixel changes the lines at its left/top edges (in its
+  // own tile) and the lines at its right/bottom edges (that can be
+  // in the next tile).
+  gfx::Rect modifiedTiles;
+  if (m_bitmap && !modifiedArea.isEmpty()) {
+    modifiedTiles =
+      tileBounds(gfx::Rect(modifiedArea.x-m_grid.x, modifiedArea.y-m_grid.y,
+                           modifiedArea.w+1, modifiedArea.h+1));
+  }
+
+  const OriginBitmap oldBitmap(m_bitmap.get(), m_origin);
+  const OriginBitmap newBitmap(bitmap, origin);
+
+  list_type segs;
+  std::vector<int> tileStart;
+  tileStart.reserve(tiles.w*tiles.h + 1);
+
+  for (int ty=tiles.y; ty<tiles.y2(); ++ty) {
+    for (int tx=tiles.x; tx<tiles.x2(); ++tx) {
+      const int x0 = m_grid.x + tx*kTileSize;
+      const int y0 = m_grid.y + ty*kTileSize;
+      tileStart.push_back(int(segs.size()));
+
+      if (m_bitmap &&
+          m_tiles.contains(gfx::Point(tx, ty)) &&
+          (!modifiedTiles.contains(gfx::Point(tx, ty)) ||
+           !is_tile_modified(oldBitmap, newBitmap, x0, y0))) {
+        const int i = (ty-m_tiles.y)*m_tiles.w + (tx-m_tiles.x);
+        segs.insert(segs.end(),
+                    m_segs.begin()+m_tileStart[i],
+                    m_segs.begin()+m_tileStart[i+1]);
+      }
+      else {
+        calculate_tile(newBitmap, x0, y0, segs);
       }
     }
   }
-
-  ASSERT(it == bits.end());
-  ASSERT(prevIt == bits.end());
+  tileStart.push_back(int(segs.size()));
+
+  m_segs.swap(segs);
+  m_tileStart.swap(tileStart);
+  m_tiles = tiles;
+
+  // Copy only the modified pixels if the bitmap has the same bounds
+  if (m_bitmap &&
+      m_origin == origin &&
+      m_bitmap->size() == bitmap->size()) {
+    const gfx::Rect rc =
+      (gfx::Rect(modifiedArea).offset(-origin) & bitmap->bounds());
+    if (!rc.isEmpty())
+      m_bitmap->copy(bitmap, gfx::Clip(rc));
+  }
+  else {
+    m_bitmap.reset(Image::createCopy(bitmap));
+    m_origin = origin;
+  }
 }
 
 void MaskBoundaries::offset(int x, int y)
 {
   for (Segment& seg : m_segs)
     seg.offset(x, y);
+
+  // The tiles are moved with the segments
+  m_origin += gfx::Point(x, y);
+  m_grid += gfx::Point(x, y);
 }
 
 } // namespace doc
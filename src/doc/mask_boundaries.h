@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2001-2015 David Capello
+// Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -8,6 +8,8 @@
 #define DOC_MASK_BOUNDARIES_H_INCLUDED
 #pragma once
 
+#include "doc/image_ref.h"
+#include "gfx/point.h"
 #include "gfx/rect.h"
 
 #include <vector>
@@ -41,8 +43,25 @@ namespace doc {
     typedef list_type::iterator iterator;
     typedef list_type::const_iterator const_iterator;
 
+    // Segments are grouped in tiles of kTileSize x kTileSize pixels
+    // (long segments are split in several tiles).
+    static const int kTileSize = 64;
+
+    MaskBoundaries();
     MaskBoundaries(const Image* bitmap);
 
+    // Calculates the segments of the given bitmap located at the
+    // given origin. Only tiles with modified pixels (compared with
+    // the previous regenerate() call) are calculated again.
+    void regenerate(const Image* bitmap, const gfx::Point& origin);
+
+    // Same as regenerate() but the pixels outside the "modifiedArea"
+    // (in the same coordinates as "origin") must be the same as in
+    // the previous call, so only the tiles in that area are compared
+    // and calculated again.
+    void regenerate(const Image* bitmap, const gfx::Point& origin,
+                    const gfx::Rect& modifiedArea);
+
     const_iterator begin() const { return m_segs.begin(); }
     const_iterator end() const { return m_segs.end(); }
     iterator begin() { return m_segs.begin(); }
@@ -50,8 +69,56 @@ namespace doc {
 
     void offset(int x, int y);
 
+    // Calls f(segment) for the segments of each tile that intersects
+    // the given area, so segments outside the area are skipped.
+    template<typename Func>
+    void forEachSegment(gfx::Rect area, Func f) const {
+      // Include the segments in the edges of the area
+      area.offset(-m_grid).enlarge(1);
+
+      const gfx::Rect tiles = (tileBounds(area) & m_tiles);
+      for (int ty=tiles.y; ty<tiles.y2(); ++ty) {
+        for (int tx=tiles.x; tx<tiles.x2(); ++tx) {
+          const int i = (ty-m_tiles.y)*m_tiles.w + (tx-m_tiles.x);
+          for (int j=m_tileStart[i]; j<m_tileStart[i+1]; ++j)
+            f(m_segs[j]);
+        }
+      }
+    }
+
   private:
+    static int tileCoord(int u) {
+      return (u >= 0 ? u / kTileSize: -((-u-1) / kTileSize) - 1);
+    }
+
+    // Returns the tiles (in tile units) of the given rectangle (in
+    // tile grid coordinates, i.e. relative to m_grid).
+    static gfx::Rect tileBounds(const gfx::Rect& rc) {
+      if (rc.isEmpty())
+        return gfx::Rect();
+
+      const int tx = tileCoord(rc.x);
+      const int ty = tileCoord(rc.y);
+      return gfx::Rect(tx, ty,
+                       tileCoord(rc.x2()-1) - tx + 1,
+                       tileCoord(rc.y2()-1) - ty + 1);
+    }
+
     list_type m_segs;
+
+    // Tiles with segments (in tile units) and the index of the first
+    // segment of each tile in m_segs (plus m_segs.size() at the end).
+    gfx::Rect m_tiles;
+    std::vector<int> m_tileStart;
+
+    // Copy of the bitmap used in the last regenerate() call to know
+    // which tiles were modified (displaced with offset()).
+    ImageRef m_bitmap;
+    gfx::Point m_origin;
+
+    // Origin of the tiles grid. It's moved with offset(), so the
+    // segments of each tile can be re-used after moving them.
+    gfx::Point m_grid;
   };
 
 } // namespace doc
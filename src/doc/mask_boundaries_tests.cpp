@@ -0,0 +1,216 @@
+// Aseprite Document Library
+// Copyright (c) 2018 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/mask_boundaries.h"
+#include "doc/primitives.h"
+
+#include <cstdlib>
+#include <set>
+#include <tuple>
+
+using namespace doc;
+
+// Edge of one pixel: x, y, vertical, open
+typedef std::tuple<int, int, bool, bool> Edge;
+typedef std::set<Edge> Edges;
+
+static Edges segments_to_edges(const MaskBoundaries& boundaries)
+{
+  Edges edges;
+  for (const auto& seg : boundaries) {
+    const gfx::Rect& rc = seg.bounds();
+    if (seg.vertical()) {
+      for (int y=rc.y; y<rc.y2(); ++y)
+        EXPECT_TRUE(edges.insert(Edge(rc.x, y, true, seg.open())).second);
+    }
+    else {
+      for (int x=rc.x; x<rc.x2(); ++x)
+        EXPECT_TRUE(edges.insert(Edge(x, rc.y, false, seg.open())).second);
+    }
+  }
+  return edges;
+}
+
+static Edges expected_edges(const Image* bitmap, const gfx::Point& origin)
+{
+  auto pixel = [bitmap](int x, int y) -> bool {
+    return (x >= 0 && y >= 0 && x < bitmap->width() && y < bitmap->height() &&
+            get_pixel(bitmap, x, y));
+  };
+
+  Edges edges;
+  for (int y=0; y<=bitmap->height(); ++y) {
+    for (int x=0; x<=bitmap->width(); ++x) {
+      if (pixel(x, y) != pixel(x, y-1))
+        edges.insert(Edge(origin.x+x, origin.y+y, false, pixel(x, y)));
+      if (pixel(x, y) != pixel(x-1, y))
+        edges.insert(Edge(origin.x+x, origin.y+y, true, pixel(x, y)));
+    }
+  }
+  return edges;
+}
+
+static ImageRef random_bitmap(int w, int h)
+{
+  ImageRef bitmap(Image::create(IMAGE_BITMAP, w, h));
+  clear_image(bitmap.get(), 0);
+  for (int i=0; i<10; ++i) {
+    const int x = std::rand() % w;
+    const int y = std::rand() % h;
+    fill_rect(bitmap.get(), x, y,
+              x + std::rand() % (w-x), y + std::rand() % (h-y),
+              std::rand() % 3 ? 1: 0);
+  }
+  for (int i=0; i<w*h/10; ++i)
+    put_pixel(bitmap.get(), std::rand() % w, std::rand() % h, std::rand() % 2);
+  return bitmap;
+}
+
+TEST(MaskBoundaries, Rectangle)
+{
+  ImageRef bitmap(Image::create(IMAGE_BITMAP, 3, 2));
+  clear_image(bitmap.get(), 1);
+
+  MaskBoundaries boundaries(bitmap.get());
+  EXPECT_EQ(expected_edges(bitmap.get(), gfx::Point(0, 0)),
+            segments_to_edges(boundaries));
+  EXPECT_EQ(4, boundaries.end() - boundaries.begin());
+}
+
+TEST(MaskBoundaries, RandomBitmaps)
+{
+  std::srand(1);
+
+  for (int i=0; i<40; ++i) {
+    ImageRef bitmap = random_bitmap(1 + std::rand() % 200,
+                                    1 + std::rand() % 150);
+    MaskBoundaries boundaries(bitmap.get());
+    ASSERT_EQ(expected_edges(bitmap.get(), gfx::Point(0, 0)),
+              segments_to_edges(boundaries));
+  }
+}
+
+TEST(MaskBoundaries, Regenerate)
+{
+  std::srand(2);
+
+  MaskBoundaries boundaries;
+  ImageRef bitmap = random_bitmap(300, 200);
+  gfx::Point origin(-70, 10);
+
+  for (int i=0; i<30; ++i) {
+    if (i % 10 == 9) {
+      bitmap = random_bitmap(1 + std::rand() % 300, 1 + std::rand() % 200);
+      origin = gfx::Point(std::rand() % 200 - 100, std::rand() % 200 - 100);
+    }
+    else {
+      // Modify a small part of the bitmap
+      const int x = std::rand() % bitmap->width();
+      const int y = std::rand() % bitmap->height();
+      fill_rect(bitmap.get(), x, y, x+5, y+3, std::rand() % 2);
+    }
+
+    boundaries.regenerate(bitmap.get(), origin);
+    ASSERT_EQ(expected_edges(bitmap.get(), origin),
+              segments_to_edges(boundaries));
+
+    if (i % 5 == 4) {
+      boundaries.offset(3, -2);
+      boundaries.offset(-3, 2);
+    }
+  }
+}
+
+TEST(MaskBoundaries, RegenerateModifiedArea)
+{
+  std::srand(4);
+
+  MaskBoundaries boundaries;
+  ImageRef bitmap = random_bitmap(300, 200);
+  gfx::Point origin(-70, 10);
+  boundaries.regenerate(bitmap.get(), origin);
+
+  for (int i=0; i<30; ++i) {
+    if (i % 3 == 2) {
+      // Move the selection (tiles are displaced with the segments)
+      const gfx::Point delta(std::rand() % 100 - 50, std::rand() % 100 - 50);
+      boundaries.offset(delta.x, delta.y);
+      origin += delta;
+      boundaries.regenerate(bitmap.get(), origin, gfx::Rect());
+    }
+    else {
+      const int x = std::rand() % bitmap->width();
+      const int y = std::rand() % bitmap->height();
+      fill_rect(bitmap.get(), x, y, x+5, y+3, std::rand() % 2);
+      boundaries.regenerate(bitmap.get(), origin,
+                            gfx::Rect(origin.x+x, origin.y+y, 6, 4));
+    }
+    ASSERT_EQ(expected_edges(bitmap.get(), origin),
+              segments_to_edges(boundaries));
+  }
+
+  // Pixels outside the modified area are not compared
+  const Edges oldEdges = segments_to_edges(boundaries);
+  clear_image(bitmap.get(), 0);
+  put_pixel(bitmap.get(), 0, 0, 1);
+  boundaries.regenerate(bitmap.get(), origin, gfx::Rect());
+  EXPECT_EQ(oldEdges, segments_to_edges(boundaries));
+
+  boundaries.regenerate(bitmap.get(), origin);
+  EXPECT_EQ(expected_edges(bitmap.get(), origin),
+            segments_to_edges(boundaries));
+  EXPECT_EQ(4, boundaries.end() - boundaries.begin());
+}
+
+TEST(MaskBoundaries, ForEachSegment)
+{
+  std::srand(3);
+
+  ImageRef bitmap = random_bitmap(400, 300);
+  MaskBoundaries boundaries;
+  boundaries.regenerate(bitmap.get(), gfx::Point(-10, -20));
+  boundaries.offset(5, 5);
+
+  const gfx::Rect area(100, 80, 50, 30);
+  int total = 0, inArea = 0;
+  for (const auto& seg : boundaries) {
+    ++total;
+    gfx::Rect rc = seg.bounds();
+    rc.w = std::max(1, rc.w);
+    rc.h = std::max(1, rc.h);
+    if (area.intersects(rc))
+      ++inArea;
+  }
+
+  int visited = 0, visitedInArea = 0;
+  boundaries.forEachSegment(
+    area,
+    [&](const MaskBoundaries::Segment& seg) {
+      ++visited;
+      gfx::Rect rc = seg.bounds();
+      rc.w = std::max(1, rc.w);
+      rc.h = std::max(1, rc.h);
+      if (area.intersects(rc))
+        ++visitedInArea;
+    });
+
+  EXPECT_EQ(inArea, visitedInArea);
+  EXPECT_LT(visited, total);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
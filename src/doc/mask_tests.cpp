@@ -0,0 +1,287 @@
+// Aseprite Document Library
+// Copyright (c) 2018 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/bitmap_ops.h"
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/mask.h"
+#include "doc/primitives.h"
+#include "gfx/rect_io.h"
+
+#include <cstdlib>
+#include <memory>
+#include <utility>
+#include <vector>
+
+using namespace doc;
+
+static bool in_range(int a, int b, int fuzziness)
+{
+  return (a >= b-fuzziness && a <= b+fuzziness);
+}
+
+static bool similar(PixelFormat format, color_t a, color_t b, int fuzziness)
+{
+  switch (format) {
+    case IMAGE_RGB:
+      return (in_range(rgba_getr(a), rgba_getr(b), fuzziness) &&
+              in_range(rgba_getg(a), rgba_getg(b), fuzziness) &&
+              in_range(rgba_getb(a), rgba_getb(b), fuzziness) &&
+              in_range(rgba_geta(a), rgba_geta(b), fuzziness));
+    case IMAGE_GRAYSCALE:
+      return (in_range(graya_getv(a), graya_getv(b), fuzziness) &&
+              in_range(graya_geta(a), graya_geta(b), fuzziness));
+    default:
+      return in_range(a, b, fuzziness);
+  }
+}
+
+static ImageRef random_image(PixelFormat format, int w, int h)
+{
+  ImageRef image(Image::create(format, w, h));
+  for (int y=0; y<h; ++y) {
+    for (int x=0; x<w; ++x) {
+      color_t c = 0;
+      switch (format) {
+        case IMAGE_RGB: c = rgba(8*(std::rand()%4), 255, 8*(std::rand()%3), 255); break;
+        case IMAGE_GRAYSCALE: c = graya(8*(std::rand()%4), 255-8*(std::rand()%2)); break;
+        case IMAGE_INDEXED: c = 250 + std::rand()%6; break;
+        default: break;
+      }
+      put_pixel(image.get(), x, y, c);
+    }
+  }
+  return image;
+}
+
+static void expect_mask_by_color(const Mask& mask, const Image* image,
+                                 color_t color, int fuzziness)
+{
+  for (int y=0; y<image->height(); ++y)
+    for (int x=0; x<image->width(); ++x)
+      ASSERT_EQ(similar(image->pixelFormat(), get_pixel(image, x, y), color, fuzziness),
+                mask.containsPoint(x, y))
+        << "x=" << x << " y=" << y << " fuzziness=" << fuzziness;
+}
+
+TEST(Mask, ByColor)
+{
+  std::srand(1);
+
+  const PixelFormat formats[] = { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED };
+  for (PixelFormat format : formats) {
+    for (int i=0; i<20; ++i) {
+      ImageRef image = random_image(format, 1+std::rand()%40, 1+std::rand()%20);
+      const color_t color = get_pixel(image.get(),
+                                      std::rand()%image->width(),
+                                      std::rand()%image->height());
+      const int fuzziness = (i % 3) * 8;
+
+      Mask mask;
+      mask.byColor(image.get(), color, fuzziness);
+      expect_mask_by_color(mask, image.get(), color, fuzziness);
+    }
+  }
+}
+
+TEST(Mask, ByColorBigImage)
+{
+  // Big enough to be split in several threads
+  ImageRef image = random_image(IMAGE_RGB, 600, 500);
+  const color_t color = get_pixel(image.get(), 0, 0);
+
+  Mask mask;
+  mask.byColor(image.get(), color, 8);
+  expect_mask_by_color(mask, image.get(), color, 8);
+}
+
+TEST(Mask, ByColorBatch)
+{
+  std::vector<ImageRef> images;
+  std::vector<const Image*> imagePtrs;
+  std::vector<std::unique_ptr<Mask>> masks;
+  std::vector<Mask*> maskPtrs;
+
+  for (int i=0; i<10; ++i) {
+    images.push_back(random_image(IMAGE_INDEXED, 1+std::rand()%50, 1+std::rand()%50));
+    imagePtrs.push_back(images.back().get());
+    masks.push_back(std::unique_ptr<Mask>(new Mask));
+    maskPtrs.push_back(masks.back().get());
+  }
+
+  Mask::byColor(maskPtrs, imagePtrs, 252, 1);
+
+  for (int i=0; i<10; ++i)
+    expect_mask_by_color(*masks[i], images[i].get(), 252, 1);
+}
+
+// Selected pixels of a mask in a canvas of 160x120 pixels starting
+// at -20,-20 (used to compare Mask operations pixel by pixel).
+struct Canvas {
+  enum { X=-20, Y=-20, W=160, H=120 };
+  std::vector<bool> pixels;
+
+  Canvas() : pixels(W*H, false) { }
+  Canvas(const Mask& mask) : pixels(W*H, false) {
+    for (int y=0; y<H; ++y)
+      for (int x=0; x<W; ++x)
+        pixels[y*W+x] = mask.containsPoint(X+x, Y+y);
+  }
+
+  bool get(int x, int y) const {
+    return pixels[(y-Y)*W + x-X];
+  }
+
+  void fillRect(const gfx::Rect& rc, bool value) {
+    for (int y=rc.y; y<rc.y2(); ++y)
+      for (int x=rc.x; x<rc.x2(); ++x)
+        pixels[(y-Y)*W + x-X] = value;
+  }
+};
+
+static gfx::Rect random_rect()
+{
+  return gfx::Rect(std::rand()%60 - 10,
+                   std::rand()%60 - 10,
+                   1 + std::rand()%80,
+                   1 + std::rand()%25);
+}
+
+static void random_mask(Mask& mask, Canvas& canvas)
+{
+  mask.clear();
+  canvas = Canvas();
+  for (int i=0; i<4; ++i) {
+    const gfx::Rect rc = random_rect();
+    if (i == 0 || std::rand()%3) {
+      mask.add(rc);
+      canvas.fillRect(rc, true);
+    }
+    else {
+      mask.subtract(rc);
+      canvas.fillRect(rc, false);
+    }
+  }
+}
+
+static void expect_mask(const Canvas& expected, const Mask& mask)
+{
+  gfx::Rect bounds;
+  for (int y=0; y<Canvas::H; ++y) {
+    for (int x=0; x<Canvas::W; ++x) {
+      const bool value = expected.get(Canvas::X+x, Canvas::Y+y);
+      ASSERT_EQ(value, mask.containsPoint(Canvas::X+x, Canvas::Y+y))
+        << "x=" << Canvas::X+x << " y=" << Canvas::Y+y;
+      if (value)
+        bounds |= gfx::Rect(Canvas::X+x, Canvas::Y+y, 1, 1);
+    }
+  }
+  // The mask must be shrunk to its minimal bounds
+  EXPECT_EQ(bounds, mask.bounds());
+  EXPECT_EQ(bounds.isEmpty(), mask.isEmpty());
+}
+
+TEST(Mask, BooleanOperations)
+{
+  std::srand(2);
+
+  for (int i=0; i<200; ++i) {
+    Mask a, b;
+    Canvas ca, cb;
+    random_mask(a, ca);
+    random_mask(b, cb);
+    expect_mask(ca, a);
+    expect_mask(cb, b);
+
+    Canvas expected;
+    for (std::size_t j=0; j<expected.pixels.size(); ++j) {
+      switch (i % 3) {
+        case 0: expected.pixels[j] = ca.pixels[j] || cb.pixels[j]; break;
+        case 1: expected.pixels[j] = ca.pixels[j] && !cb.pixels[j]; break;
+        case 2: expected.pixels[j] = ca.pixels[j] && cb.pixels[j]; break;
+      }
+    }
+
+    switch (i % 3) {
+      case 0: a.add(b); break;
+      case 1: a.subtract(b); break;
+      case 2: a.intersect(b); break;
+    }
+    expect_mask(expected, a);
+  }
+}
+
+TEST(Mask, Invert)
+{
+  Mask mask;
+  mask.add(gfx::Rect(3, 2, 100, 7));
+  EXPECT_TRUE(mask.isRectangular());
+
+  mask.subtract(gfx::Rect(3, 2, 100, 3));
+  mask.subtract(gfx::Rect(3, 5, 70, 4));
+  EXPECT_TRUE(mask.isRectangular());
+  EXPECT_EQ(gfx::Rect(73, 5, 30, 4), mask.bounds());
+
+  mask.add(gfx::Rect(0, 0, 1, 1));
+  EXPECT_FALSE(mask.isRectangular());
+
+  // Inverted inside the current bounds
+  mask.invert();
+  Canvas expected;
+  expected.fillRect(gfx::Rect(0, 0, 103, 9), true);
+  expected.fillRect(gfx::Rect(0, 0, 1, 1), false);
+  expected.fillRect(gfx::Rect(73, 5, 30, 4), false);
+  expect_mask(expected, mask);
+}
+
+TEST(Mask, BitmapSpans)
+{
+  std::srand(7);
+  for (int w : { 1, 63, 64, 65, 200 }) {
+    ImageRef bitmap(Image::create(IMAGE_BITMAP, w, 1));
+    for (int fill : { 0, 1, 2 }) {
+      for (int x=0; x<w; ++x)
+        bitmap->putPixel(x, 0, fill == 2 ? (std::rand() & 1): fill);
+
+      for (int x1 : { -70, -1, 0, 5, 64 }) {
+        for (int x2 : { -1, 3, 63, 64, w-1, w+70 }) {
+          std::vector<std::pair<int, int> > expected, spans;
+          int start = -1;
+          for (int x=x1; x<=x2; ++x) {
+            const bool on = (x >= 0 && x < w && bitmap->getPixel(x, 0));
+            if (on && start < 0)
+              start = x;
+            else if (!on && start >= 0) {
+              expected.push_back(std::make_pair(start, x-1));
+              start = -1;
+            }
+          }
+          if (start >= 0)
+            expected.push_back(std::make_pair(start, x2));
+
+          for_each_bitmap_span(
+            bitmap.get(), x1, 0, x2,
+            [&spans](int u1, int u2){
+              spans.push_back(std::make_pair(u1, u2));
+            });
+          EXPECT_EQ(expected, spans) << "w=" << w << " x1=" << x1 << " x2=" << x2;
+        }
+      }
+    }
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
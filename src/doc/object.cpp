@@ -54,8 +54,10 @@ const ObjectId Object::id() const
   // "objects" hash table.
   if (!m_id) {
     base::scoped_unlock hold(mutex);
-    m_id = ++newId;
-    objects.insert(std::make_pair(m_id, const_cast<Object*>(this)));
+    if (!m_id) {
+      m_id = ++newId;
+      objects.insert(std::make_pair(ObjectId(m_id), const_cast<Object*>(this)));
+    }
   }
   return m_id;
 }
@@ -76,7 +78,7 @@ void Object::setId(ObjectId id)
 
   if (m_id) {
     ASSERT(objects.find(m_id) == objects.end());
-    objects.insert(std::make_pair(m_id, this));
+    objects.insert(std::make_pair(ObjectId(m_id), this));
   }
 }
 
@@ -11,6 +11,8 @@
 #include "doc/object_id.h"
 #include "doc/object_type.h"
 
+#include <atomic>
+
 namespace doc {
 
   typedef uint32_t ObjectVersion;
@@ -40,8 +42,10 @@ namespace doc {
     ObjectType m_type;
 
     // Unique identifier for this object (it is assigned by
-    // Objects class).
-    mutable ObjectId m_id;
+    // Objects class). It's atomic because it's assigned lazily by
+    // id(), and objects can be read from several threads (e.g. the
+    // objects of an app::DocSnapshot).
+    mutable std::atomic<ObjectId> m_id;
 
     ObjectVersion m_version;
 
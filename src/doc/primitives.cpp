@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2001-2016 David Capello
+// Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -11,16 +11,168 @@
 #include "doc/primitives.h"
 
 #include "doc/algo.h"
+#include "doc/bitmap_ops.h"
 #include "doc/brush.h"
 #include "doc/image_impl.h"
 #include "doc/palette.h"
 #include "doc/remap.h"
 #include "doc/rgbmap.h"
 
+#include <cstdint>
+#include <cstring>
 #include <stdexcept>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define DOC_PRIMITIVES_SSE2 1
+  #include <emmintrin.h>
+#endif
+
 namespace doc {
 
+namespace {
+
+// Row kernels used by the primitives. Pixels of RGB, grayscale and
+// indexed images are processed 16 bytes at the same time, bitmaps
+// are processed byte by byte (the last byte of each row can contain
+// padding bits).
+
+inline int count_bits16(int v)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_popcount(v);
+#else
+  int n = 0;
+  for (; v; v &= v-1)
+    ++n;
+  return n;
+#endif
+}
+
+template<typename T>
+void fill_pixels(T* p, int n, T value)
+{
+#if DOC_PRIMITIVES_SSE2
+  const int k = 16 / sizeof(T);
+  if (n >= k) {
+    T pattern[16 / sizeof(T)];
+    for (int i=0; i<k; ++i)
+      pattern[i] = value;
+    const __m128i v = _mm_loadu_si128((const __m128i*)pattern);
+    for (; n >= 4*k; n -= 4*k, p += 4*k) {
+      _mm_storeu_si128((__m128i*)p, v);
+      _mm_storeu_si128((__m128i*)(p+k), v);
+      _mm_storeu_si128((__m128i*)(p+2*k), v);
+      _mm_storeu_si128((__m128i*)(p+3*k), v);
+    }
+    for (; n >= k; n -= k, p += k)
+      _mm_storeu_si128((__m128i*)p, v);
+  }
+#endif
+  for (; n > 0; --n)
+    *(p++) = value;
+}
+
+template<>
+void fill_pixels<uint8_t>(uint8_t* p, int n, uint8_t value)
+{
+  std::memset(p, value, n);
+}
+
+template<typename T>
+int count_diff_pixels(const T* a, const T* b, int n)
+{
+  int diff = 0;
+#if DOC_PRIMITIVES_SSE2
+  const int k = 16 / sizeof(T);
+  for (; n >= k; n -= k, a += k, b += k) {
+    const __m128i va = _mm_loadu_si128((const __m128i*)a);
+    const __m128i vb = _mm_loadu_si128((const __m128i*)b);
+    __m128i eq;
+    switch (sizeof(T)) {
+      case 4: eq = _mm_cmpeq_epi32(va, vb); break;
+      case 2: eq = _mm_cmpeq_epi16(va, vb); break;
+      default: eq = _mm_cmpeq_epi8(va, vb); break;
+    }
+    // Each equal pixel sets sizeof(T) bits of the mask
+    const int mask = _mm_movemask_epi8(eq);
+    if (mask != 0xffff)
+      diff += k - count_bits16(mask) / int(sizeof(T));
+  }
+#endif
+  for (; n > 0; --n)
+    if (*(a++) != *(b++))
+      ++diff;
+  return diff;
+}
+
+// Mask of the valid bits of the last byte of a bitmap row
+inline uint8_t last_bitmap_byte_mask(int width)
+{
+  return (width & 7 ? uint8_t((1 << (width & 7)) - 1): 0xff);
+}
+
+template<typename ImageTraits>
+int count_diff_between_images_templ(const Image* i1, const Image* i2)
+{
+  typedef typename ImageTraits::pixel_t pixel_t;
+  const int w = i1->width();
+  int diff = 0;
+  for (int y=0; y<i1->height(); ++y)
+    diff += count_diff_pixels((const pixel_t*)i1->getPixelAddress(0, y),
+                              (const pixel_t*)i2->getPixelAddress(0, y), w);
+  return diff;
+}
+
+template<>
+int count_diff_between_images_templ<BitmapTraits>(const Image* i1, const Image* i2)
+{
+  const int rowBytes = i1->getRowStrideSize();
+  const uint8_t lastMask = last_bitmap_byte_mask(i1->width());
+  int diff = 0;
+  for (int y=0; y<i1->height(); ++y) {
+    const uint8_t* a = i1->getPixelAddress(0, y);
+    const uint8_t* b = i2->getPixelAddress(0, y);
+    int i = 0;
+    for (; i+8 <= rowBytes-1; i += 8) {
+      uint64_t u, v;
+      std::memcpy(&u, a+i, 8);
+      std::memcpy(&v, b+i, 8);
+      if (u != v) {
+        for (int j=i; j<i+8; ++j)
+          diff += count_bits16(a[j] ^ b[j]);
+      }
+    }
+    for (; i<rowBytes-1; ++i)
+      diff += count_bits16(a[i] ^ b[i]);
+    diff += count_bits16((a[rowBytes-1] ^ b[rowBytes-1]) & lastMask);
+  }
+  return diff;
+}
+
+template<typename ImageTraits>
+void fill_rect_templ(Image* image, const gfx::Rect& rc, color_t color)
+{
+  typedef typename ImageTraits::pixel_t pixel_t;
+
+  // Fill the first row, and copy it to the other rows (memcpy() can
+  // use wider instructions than SSE2)
+  const uint8_t* first = image->getPixelAddress(rc.x, rc.y);
+  fill_pixels((pixel_t*)first, rc.w, pixel_t(color));
+  for (int y=rc.y+1; y<rc.y+rc.h; ++y)
+    std::memcpy(image->getPixelAddress(rc.x, y), first, sizeof(pixel_t)*rc.w);
+}
+
+// Pixels of the image (and rows) are contiguous in memory
+template<typename ImageTraits>
+void clear_image_templ(Image* image, color_t color)
+{
+  typedef typename ImageTraits::pixel_t pixel_t;
+  fill_pixels((pixel_t*)image->getPixelAddress(0, 0),
+              image->width()*image->height(), pixel_t(color));
+}
+
+} // anonymous namespace
+
 color_t get_pixel(const Image* image, int x, int y)
 {
   ASSERT(image);
@@ -43,7 +195,14 @@ void clear_image(Image* image, color_t color)
 {
   ASSERT(image);
 
-  image->clear(color);
+  switch (image->pixelFormat()) {
+    case IMAGE_RGB:       clear_image_templ<RgbTraits>(image, color); break;
+    case IMAGE_GRAYSCALE: clear_image_templ<GrayscaleTraits>(image, color); break;
+    case IMAGE_INDEXED:   clear_image_templ<IndexedTraits>(image, color); break;
+    default:
+      image->clear(color);
+      break;
+  }
 }
 
 void copy_image(Image* dst, const Image* src)
@@ -51,6 +210,17 @@ void copy_image(Image* dst, const Image* src)
   ASSERT(dst);
   ASSERT(src);
 
+  // Images of the same size are copied with just one memcpy()
+  if (dst->pixelFormat() == src->pixelFormat() &&
+      dst->width() == src->width() &&
+      dst->height() == src->height()) {
+    if (dst != src)
+      std::memcpy(dst->getPixelAddress(0, 0),
+                  src->getPixelAddress(0, 0),
+                  std::size_t(src->getRowStrideSize()) * src->height());
+    return;
+  }
+
   dst->copy(src, gfx::Clip(0, 0, 0, 0, src->width(), src->height()));
 }
 
@@ -214,12 +384,7 @@ void fill_rect(Image* image, int x1, int y1, int x2, int y2, color_t color)
   if ((x2 < 0) || (x1 >= image->width()) || (y2 < 0) || (y1 >= image->height()))
     return;
 
-  if (x1 < 0) x1 = 0;
-  if (y1 < 0) y1 = 0;
-  if (x2 >= image->width()) x2 = image->width()-1;
-  if (y2 >= image->height()) y2 = image->height()-1;
-
-  image->fillRect(x1, y1, x2, y2, color);
+  fill_rect(image, gfx::Rect(x1, y1, x2-x1+1, y2-y1+1), color);
 }
 
 void fill_rect(Image* image, const gfx::Rect& rc, color_t c)
@@ -227,9 +392,15 @@ void fill_rect(Image* image, const gfx::Rect& rc, color_t c)
   ASSERT(image);
 
   gfx::Rect clip = rc.createIntersection(image->bounds());
-  if (!clip.isEmpty())
-    image->fillRect(clip.x, clip.y,
-      clip.x+clip.w-1, clip.y+clip.h-1, c);
+  if (clip.isEmpty())
+    return;
+
+  switch (image->pixelFormat()) {
+    case IMAGE_RGB:       fill_rect_templ<RgbTraits>(image, clip, c); break;
+    case IMAGE_GRAYSCALE: fill_rect_templ<GrayscaleTraits>(image, clip, c); break;
+    case IMAGE_INDEXED:   fill_rect_templ<IndexedTraits>(image, clip, c); break;
+    case IMAGE_BITMAP:    bitmap_fill_rect(image, clip, c ? true: false); break;
+  }
 }
 
 void blend_rect(Image* image, int x1, int y1, int x2, int y2, color_t color, int opacity)
@@ -293,29 +464,6 @@ void fill_ellipse(Image* image, int x1, int y1, int x2, int y2, color_t color)
   algo_ellipsefill(x1, y1, x2, y2, &data, (AlgoHLine)hline_for_image);
 }
 
-namespace {
-
-template<typename ImageTraits>
-int count_diff_between_images_templ(const Image* i1, const Image* i2)
-{
-  int diff = 0;
-  const LockImageBits<ImageTraits> bits1(i1);
-  const LockImageBits<ImageTraits> bits2(i2);
-  typename LockImageBits<ImageTraits>::const_iterator it1, it2, end1, end2;
-  for (it1 = bits1.begin(), end1 = bits1.end(),
-       it2 = bits2.begin(), end2 = bits2.end();
-       it1 != end1 && it2 != end2; ++it1, ++it2) {
-    if (*it1 != *it2)
-      diff++;
-  }
-
-  ASSERT(it1 == end1);
-  ASSERT(it2 == end2);
-  return diff;
-}
-
-} // anonymous namespace
-
 int count_diff_between_images(const Image* i1, const Image* i2)
 {
   if ((i1->pixelFormat() != i2->pixelFormat()) ||
@@ -334,19 +482,60 @@ int count_diff_between_images(const Image* i1, const Image* i2)
   return -1;
 }
 
+bool is_same_image(const Image* i1, const Image* i2)
+{
+  if ((i1->pixelFormat() != i2->pixelFormat()) ||
+      (i1->width() != i2->width()) ||
+      (i1->height() != i2->height()))
+    return false;
+
+  // Rows are compared with memcmp(), which stops at the first
+  // different byte. The padding bits of bitmaps are ignored.
+  const int h = i1->height();
+  const int rowBytes = i1->getRowStrideSize();
+  if (i1->pixelFormat() == IMAGE_BITMAP) {
+    const uint8_t lastMask = last_bitmap_byte_mask(i1->width());
+    for (int y=0; y<h; ++y) {
+      const uint8_t* a = i1->getPixelAddress(0, y);
+      const uint8_t* b = i2->getPixelAddress(0, y);
+      if (std::memcmp(a, b, rowBytes-1) != 0 ||
+          ((a[rowBytes-1] ^ b[rowBytes-1]) & lastMask) != 0)
+        return false;
+    }
+  }
+  else {
+    for (int y=0; y<h; ++y)
+      if (std::memcmp(i1->getPixelAddress(0, y),
+                      i2->getPixelAddress(0, y), rowBytes) != 0)
+        return false;
+  }
+  return true;
+}
+
 void remap_image(Image* image, const Remap& remap)
 {
   ASSERT(image->pixelFormat() == IMAGE_INDEXED);
   if (image->pixelFormat() != IMAGE_INDEXED)
     return;
 
-  LockImageBits<IndexedTraits> bits(image);
-  LockImageBits<IndexedTraits>::iterator
-    it = bits.begin(),
-    end = bits.end();
-
-  for (; it != end; ++it)
-    *it = remap[*it];
+  // Table with the whole remap for 8-bit indexes (a 256 entries
+  // lookup can't be vectorized with SSE2, but this avoids the range
+  // checks of Remap::operator[] for each pixel)
+  uint8_t table[256];
+  for (int i=0; i<256; ++i)
+    table[i] = uint8_t(remap[i]);
+
+  // Pixels of the image are contiguous in memory
+  uint8_t* p = image->getPixelAddress(0, 0);
+  uint8_t* end = p + image->width()*image->height();
+  for (; p+4 <= end; p += 4) {
+    p[0] = table[p[0]];
+    p[1] = table[p[1]];
+    p[2] = table[p[2]];
+    p[3] = table[p[3]];
+  }
+  for (; p < end; ++p)
+    *p = table[*p];
 }
 
 } // namespace doc
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2001-2016 David Capello
+// Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -39,8 +39,14 @@ namespace doc {
   void draw_ellipse(Image* image, int x1, int y1, int x2, int y2, color_t c);
   void fill_ellipse(Image* image, int x1, int y1, int x2, int y2, color_t c);
 
+  // Returns the number of different pixels, or -1 if the images
+  // have different format or size.
   int count_diff_between_images(const Image* i1, const Image* i2);
 
+  // Faster than count_diff_between_images(i1, i2) == 0, it stops at
+  // the first different pixel.
+  bool is_same_image(const Image* i1, const Image* i2);
+
   void remap_image(Image* image, const Remap& remap);
 
 } // namespace doc
@@ -0,0 +1,97 @@
+// Aseprite Document Library
+// Copyright (c) 2018 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/primitives.h"
+#include "doc/remap.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+
+using namespace doc;
+
+static void CustomArguments(benchmark::internal::Benchmark* b) {
+  for (int format : { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED, IMAGE_BITMAP })
+    for (int size : { 32, 256, 1024 })
+      b->Args({ format, size });
+}
+
+static Image* create_random_image(PixelFormat format, int size) {
+  Image* image = Image::create(format, size, size);
+  for (int y=0; y<size; ++y)
+    for (int x=0; x<size; ++x)
+      put_pixel(image, x, y, color_t(std::rand()));
+  return image;
+}
+
+void BM_ClearImage(benchmark::State& state) {
+  const PixelFormat format = PixelFormat(state.range(0));
+  const int size = state.range(1);
+  ImageRef image(Image::create(format, size, size));
+  while (state.KeepRunning())
+    clear_image(image.get(), 1);
+}
+
+void BM_FillRect(benchmark::State& state) {
+  const PixelFormat format = PixelFormat(state.range(0));
+  const int size = state.range(1);
+  ImageRef image(Image::create(format, size, size));
+  while (state.KeepRunning())
+    fill_rect(image.get(), 1, 1, size-2, size-2, 1);
+}
+
+void BM_CopyImage(benchmark::State& state) {
+  const PixelFormat format = PixelFormat(state.range(0));
+  const int size = state.range(1);
+  ImageRef src(create_random_image(format, size));
+  ImageRef dst(Image::create(format, size, size));
+  while (state.KeepRunning())
+    copy_image(dst.get(), src.get());
+}
+
+void BM_CountDiff(benchmark::State& state) {
+  const PixelFormat format = PixelFormat(state.range(0));
+  const int size = state.range(1);
+  ImageRef a(create_random_image(format, size));
+  ImageRef b(Image::createCopy(a.get()));
+  put_pixel(b.get(), size-1, size-1, 0);
+  while (state.KeepRunning())
+    benchmark::DoNotOptimize(count_diff_between_images(a.get(), b.get()));
+}
+
+void BM_IsSameImage(benchmark::State& state) {
+  const PixelFormat format = PixelFormat(state.range(0));
+  const int size = state.range(1);
+  ImageRef a(create_random_image(format, size));
+  ImageRef b(Image::createCopy(a.get()));
+  while (state.KeepRunning())
+    benchmark::DoNotOptimize(is_same_image(a.get(), b.get()));
+}
+
+void BM_RemapImage(benchmark::State& state) {
+  const int size = state.range(0);
+  ImageRef image(create_random_image(IMAGE_INDEXED, size));
+  Remap remap(256);
+  for (int i=0; i<256; ++i)
+    remap.map(i, 255-i);
+  while (state.KeepRunning())
+    remap_image(image.get(), remap);
+}
+
+BENCHMARK(BM_ClearImage)->Apply(CustomArguments);
+BENCHMARK(BM_FillRect)->Apply(CustomArguments);
+BENCHMARK(BM_CopyImage)->Apply(CustomArguments);
+BENCHMARK(BM_CountDiff)->Apply(CustomArguments);
+BENCHMARK(BM_IsSameImage)->Apply(CustomArguments);
+BENCHMARK(BM_RemapImage)->Arg(32)->Arg(256)->Arg(1024);
+
+BENCHMARK_MAIN();
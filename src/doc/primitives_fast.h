@@ -35,6 +35,7 @@ namespace doc {
     ASSERT(x >= 0 && x < image->width());
     ASSERT(y >= 0 && y < image->height());
 
+    image->unshare();
     *(((ImageImpl<Traits>*)image)->address(x, y)) = color;
   }
 
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2001-2015 David Capello
+// Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -47,6 +47,22 @@ void RgbMap::regenerate(const Palette* palette, int mask_index)
     entry |= INVALID;
 }
 
+void RgbMap::generateEntries(int begin, int end)
+{
+  ASSERT(begin >= 0 && end <= int(m_map.size()));
+
+  for (int i=begin; i<end; ++i) {
+    if (m_map[i] & INVALID) {
+      // Inverse of the index calculated in mapColor()
+      generateEntry(i,
+                    ((i >> 13) & 31) << 3,
+                    ((i >> 8) & 31) << 3,
+                    ((i >> 3) & 31) << 3,
+                    (i & 7) << 5);
+    }
+  }
+}
+
 int RgbMap::generateEntry(int i, int r, int g, int b, int a) const
 {
   return m_map[i] =
@@ -42,6 +42,12 @@ namespace doc {
 
     int maskIndex() const { return m_maskIndex; }
 
+    // Entries are generated lazily by mapColor(). If the map is going
+    // to be used from several threads at the same time, all entries
+    // (from 0 to size()-1) must be generated before with this function.
+    void generateEntries(int begin, int end);
+    int size() const { return int(m_map.size()); }
+
   private:
     int generateEntry(int i, int r, int g, int b, int a) const;
 
@@ -0,0 +1,92 @@
+// Aseprite Document Library
+// Copyright (c) 2018 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/palette.h"
+#include "doc/rgbmap.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+using namespace doc;
+
+static void random_palette(Palette& pal)
+{
+  for (int i=0; i<pal.size(); ++i)
+    pal.setEntry(i, rgba(std::rand() % 256,
+                         std::rand() % 256,
+                         std::rand() % 256,
+                         std::rand() % 256));
+}
+
+// Generates all entries from several threads (like SetPixelFormat)
+static void generate_all_entries(RgbMap& rgbmap)
+{
+  rgbmap.generateEntries(0, 1);
+
+  const int n = rgbmap.size();
+  const int chunk = 4096;
+  std::vector<std::thread> threads;
+  for (int i=1; i<n; i+=chunk)
+    threads.push_back(
+      std::thread([&rgbmap, i, n, chunk]{
+          rgbmap.generateEntries(i, std::min(i+chunk, n));
+        }));
+  for (auto& thread : threads)
+    thread.join();
+}
+
+static void expect_same_entries(const RgbMap& lazy, const RgbMap& full)
+{
+  // Each entry is tested with a different color inside its range
+  for (int r=0; r<256; r+=8)
+    for (int g=0; g<256; g+=8)
+      for (int b=0; b<256; b+=8)
+        for (int a=0; a<256; a+=32) {
+          const int r2 = r + std::rand() % 8;
+          const int g2 = g + std::rand() % 8;
+          const int b2 = b + std::rand() % 8;
+          const int a2 = a + std::rand() % 32;
+          ASSERT_EQ(full.mapColor(r2, g2, b2, a2),
+                    lazy.mapColor(r2, g2, b2, a2))
+            << "rgba(" << r2 << ", " << g2 << ", " << b2 << ", " << a2 << ")";
+        }
+}
+
+TEST(RgbMap, LazyEntriesMatchGeneratedEntries)
+{
+  std::srand(1);
+
+  Palette pal(frame_t(0), 64);
+  random_palette(pal);
+
+  RgbMap lazy, full;
+  lazy.regenerate(&pal, 0);
+  full.regenerate(&pal, 0);
+  generate_all_entries(full);
+  expect_same_entries(lazy, full);
+
+  // All entries are invalidated when the palette is modified
+  random_palette(pal);
+  EXPECT_FALSE(lazy.match(&pal));
+  lazy.regenerate(&pal, -1);
+  full.regenerate(&pal, -1);
+  generate_all_entries(full);
+  expect_same_entries(lazy, full);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
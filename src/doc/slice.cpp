@@ -56,6 +56,11 @@ void Slice::insert(const frame_t frame, const SliceKey& key)
   m_keys.insert(frame, new SliceKey(key));
 }
 
+void Slice::insert(const frame_t frame, const SliceKey* key)
+{
+  m_keys.insert(frame, key ? new SliceKey(*key): nullptr);
+}
+
 void Slice::remove(const frame_t frame)
 {
   delete m_keys.remove(frame);
@@ -59,6 +59,9 @@ namespace doc {
     int getMemSize() const override;
 
     void insert(const frame_t frame, const SliceKey& key);
+    // Copies the given key (it can be nullptr, like the keys of
+    // other slice iterated with begin()/end()).
+    void insert(const frame_t frame, const SliceKey* key);
     void remove(const frame_t frame);
 
     const SliceKey* getByFrame(const frame_t frame) const;
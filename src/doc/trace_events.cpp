@@ -0,0 +1,206 @@
+// Aseprite Document Library
+// Copyright (c) 2018 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/trace_events.h"
+
+#include "base/fstream_path.h"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace doc {
+namespace trace {
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+struct Event {
+  const char* category;
+  std::string name;
+  ObjectId docId;
+  long long start;
+  long long duration;
+};
+
+// Events of one thread. The mutex is locked only by its own thread
+// (to add events) and by stop(), so it's almost never contended.
+struct ThreadEvents {
+  int tid;
+  std::string name;
+  std::mutex mutex;
+  std::vector<Event> events;
+};
+
+std::atomic<bool> recording(false);
+Clock::time_point start_time;
+std::string output_filename;
+
+// All threads that have recorded something (they are kept after the
+// thread finishes, so its events are written in the file)
+std::mutex threads_mutex;
+std::vector<std::shared_ptr<ThreadEvents> > threads;
+
+thread_local std::shared_ptr<ThreadEvents> thread_events;
+
+long long now()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+    Clock::now() - start_time).count();
+}
+
+ThreadEvents* current_thread_events()
+{
+  if (!thread_events) {
+    thread_events = std::make_shared<ThreadEvents>();
+
+    std::lock_guard<std::mutex> lock(threads_mutex);
+    thread_events->tid = int(threads.size()+1);
+    threads.push_back(thread_events);
+  }
+  return thread_events.get();
+}
+
+void write_json_string(std::ostream& os, const std::string& s)
+{
+  os << '"';
+  for (char chr : s) {
+    switch (chr) {
+      case '"': os << "\\\""; break;
+      case '\\': os << "\\\\"; break;
+      case '\n': os << "\\n"; break;
+      case '\t': os << "\\t"; break;
+      default:
+        if ((unsigned char)chr >= 32)
+          os << chr;
+        break;
+    }
+  }
+  os << '"';
+}
+
+} // anonymous namespace
+
+void start(const std::string& filename)
+{
+  {
+    std::lock_guard<std::mutex> lock(threads_mutex);
+    for (auto& t : threads) {
+      std::lock_guard<std::mutex> lock2(t->mutex);
+      t->events.clear();
+    }
+    output_filename = filename;
+    start_time = Clock::now();
+  }
+  recording = true;
+}
+
+void stop()
+{
+  if (!recording)
+    return;
+  recording = false;
+
+  std::lock_guard<std::mutex> lock(threads_mutex);
+  std::ofstream f(FSTREAM_PATH(output_filename));
+  if (!f)
+    return;
+
+  bool first = true;
+  auto sep = [&f, &first]{
+    f << (first ? "\n": ",\n");
+    first = false;
+  };
+
+  f << "{\"traceEvents\":[";
+  for (auto& t : threads) {
+    std::lock_guard<std::mutex> lock2(t->mutex);
+
+    if (!t->name.empty()) {
+      sep();
+      f << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << t->tid
+        << ",\"args\":{\"name\":";
+      write_json_string(f, t->name);
+      f << "}}";
+    }
+
+    for (const Event& ev : t->events) {
+      sep();
+      f << "{\"ph\":\"X\",\"cat\":\"" << ev.category << "\",\"name\":";
+      write_json_string(f, ev.name);
+      f << ",\"pid\":1,\"tid\":" << t->tid
+        << ",\"ts\":" << ev.start
+        << ",\"dur\":" << ev.duration;
+      if (ev.docId != NullId)
+        f << ",\"args\":{\"doc\":" << ev.docId << "}";
+      f << "}";
+    }
+    t->events.clear();
+  }
+  f << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
+
+bool is_recording()
+{
+  return recording;
+}
+
+void set_thread_name(const char* name)
+{
+  ThreadEvents* t = current_thread_events();
+  std::lock_guard<std::mutex> lock(t->mutex);
+  t->name = name;
+}
+
+Scope::Scope(const char* category, const char* name, ObjectId docId)
+  : m_category(category)
+  , m_docId(docId)
+  , m_start(-1)
+{
+  if (recording) {
+    m_name = name;
+    m_start = now();
+  }
+}
+
+Scope::Scope(const char* category, const std::string& name, ObjectId docId)
+  : m_category(category)
+  , m_docId(docId)
+  , m_start(-1)
+{
+  if (recording) {
+    m_name = name;
+    m_start = now();
+  }
+}
+
+Scope::~Scope()
+{
+  if (m_start < 0 || !recording)
+    return;
+
+  Event ev;
+  ev.category = m_category;
+  ev.name = std::move(m_name);
+  ev.docId = m_docId;
+  ev.start = m_start;
+  ev.duration = now() - m_start;
+
+  ThreadEvents* t = current_thread_events();
+  std::lock_guard<std::mutex> lock(t->mutex);
+  t->events.push_back(std::move(ev));
+}
+
+} // namespace trace
+} // namespace doc
@@ -0,0 +1,63 @@
+// Aseprite Document Library
+// Copyright (c) 2018 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_TRACE_EVENTS_H_INCLUDED
+#define DOC_TRACE_EVENTS_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+#include "doc/object_id.h"
+
+#include <string>
+
+namespace doc {
+namespace trace {
+
+  // Starts recording events. They are written in the given file
+  // using the Trace Event Format (which can be opened with
+  // chrome://tracing or Perfetto) when stop() is called.
+  void start(const std::string& filename);
+  void stop();
+  bool is_recording();
+
+  // Name of the current thread in the trace viewer.
+  void set_thread_name(const char* name);
+
+  // Records the time between its constructor and destructor as an
+  // event of the current thread. The "category" must be a string
+  // literal. It doesn't record anything if is_recording() is false.
+  class Scope {
+  public:
+    Scope(const char* category, const char* name, ObjectId docId = NullId);
+    Scope(const char* category, const std::string& name, ObjectId docId = NullId);
+    ~Scope();
+
+  private:
+    const char* m_category;
+    std::string m_name;
+    ObjectId m_docId;
+    long long m_start;          // In microseconds (-1 if we aren't recording)
+
+    DISABLE_COPYING(Scope);
+  };
+
+} // namespace trace
+} // namespace doc
+
+// Use TRACE_EVENT() instead of a doc::trace::Scope so the
+// instrumentation (and its arguments) is compiled only with the
+// ENABLE_TRACE_EVENTS option.
+#ifdef ENABLE_TRACE_EVENTS
+  #define TRACE_EVENT_CONCAT2(a, b) a##b
+  #define TRACE_EVENT_CONCAT(a, b) TRACE_EVENT_CONCAT2(a, b)
+  #define TRACE_EVENT(category, ...)                                  \
+    doc::trace::Scope TRACE_EVENT_CONCAT(trace_event_, __LINE__)      \
+      (category, __VA_ARGS__)
+#else
+  #define TRACE_EVENT(category, ...)
+#endif
+
+#endif
@@ -0,0 +1,76 @@
+// Aseprite Document Library
+// Copyright (c) 2018 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/trace_events.h"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+using namespace doc;
+
+static const char* kFilename = "_trace_events_tests.json";
+
+static std::string read_trace_file()
+{
+  std::ifstream f(kFilename);
+  std::stringstream buf;
+  buf << f.rdbuf();
+  return buf.str();
+}
+
+TEST(TraceEvents, NotRecording)
+{
+  EXPECT_FALSE(trace::is_recording());
+  trace::Scope scope("test", "ignored");
+  trace::stop();
+}
+
+TEST(TraceEvents, Threads)
+{
+  trace::start(kFilename);
+  EXPECT_TRUE(trace::is_recording());
+
+  trace::set_thread_name("main");
+  {
+    trace::Scope scope("test", "main \"event\"", ObjectId(7));
+    std::thread thread(
+      []{
+        trace::set_thread_name("worker");
+        trace::Scope scope("test", std::string("worker event"));
+      });
+    thread.join();
+  }
+  trace::stop();
+  EXPECT_FALSE(trace::is_recording());
+
+  // Events after stop() are ignored
+  { trace::Scope scope("test", "ignored"); }
+
+  std::string json = read_trace_file();
+  std::remove(kFilename);
+
+  EXPECT_EQ(0, json.find("{\"traceEvents\":["));
+  EXPECT_NE(std::string::npos, json.find("\"args\":{\"name\":\"main\"}"));
+  EXPECT_NE(std::string::npos, json.find("\"args\":{\"name\":\"worker\"}"));
+  EXPECT_NE(std::string::npos, json.find("\"name\":\"main \\\"event\\\"\""));
+  EXPECT_NE(std::string::npos, json.find("\"args\":{\"doc\":7}"));
+  EXPECT_NE(std::string::npos, json.find("\"name\":\"worker event\""));
+  EXPECT_EQ(std::string::npos, json.find("ignored"));
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
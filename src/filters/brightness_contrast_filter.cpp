@@ -34,6 +34,7 @@ BrightnessContrastFilter::BrightnessContrastFilter()
   , m_contrast(0.0)
   , m_cmap(256)
 {
+  m_transformFilter.addTransform(this);
   updateMap();
 }
 
@@ -56,15 +57,20 @@ void BrightnessContrastFilter::applyToRgba(FilterManager* filterMgr)
   if (filterMgr->isFirstRow()) {
     m_picks = fid->getPalettePicks();
     m_usePalette = (m_picks.picks() > 0);
-    if (m_usePalette)
+    if (m_usePalette) {
       applyToPalette(filterMgr);
+      m_exactMatch.regenerate(fid->getPalette());
+    }
+  }
+
+  if (!m_usePalette) {
+    m_transformFilter.applyToRgba(filterMgr);
+    return;
   }
 
-  const Palette* pal = fid->getPalette();
   const uint32_t* src_address = (uint32_t*)filterMgr->getSourceAddress();
   uint32_t* dst_address = (uint32_t*)filterMgr->getDestinationAddress();
   const int w = filterMgr->getWidth();
-  const Target target = filterMgr->getTarget();
 
   for (int x=0; x<w; x++) {
     if (filterMgr->skipPixel()) {
@@ -74,19 +80,9 @@ void BrightnessContrastFilter::applyToRgba(FilterManager* filterMgr)
     }
 
     color_t c = *(src_address++);
-
-    if (m_usePalette) {
-      int i =
-        pal->findExactMatch(rgba_getr(c),
-                            rgba_getg(c),
-                            rgba_getb(c),
-                            rgba_geta(c), -1);
-      if (i >= 0)
-        c = fid->getNewPalette()->getEntry(i);
-    }
-    else {
-      applyFilterToRgb(target, c);
-    }
+    int i = m_exactMatch.find(c);
+    if (i >= 0)
+      c = fid->getNewPalette()->getEntry(i);
 
     *(dst_address++) = c;
   }
@@ -94,26 +90,7 @@ void BrightnessContrastFilter::applyToRgba(FilterManager* filterMgr)
 
 void BrightnessContrastFilter::applyToGrayscale(FilterManager* filterMgr)
 {
-  const uint16_t* src_address = (uint16_t*)filterMgr->getSourceAddress();
-  uint16_t* dst_address = (uint16_t*)filterMgr->getDestinationAddress();
-  const int w = filterMgr->getWidth();
-  const Target target = filterMgr->getTarget();
-
-  for (int x=0; x<w; x++) {
-    if (filterMgr->skipPixel()) {
-      ++src_address;
-      ++dst_address;
-      continue;
-    }
-
-    color_t c = *(src_address++);
-    int k = graya_getv(c);
-    int a = graya_geta(c);
-
-    if (target & TARGET_GRAY_CHANNEL) k = m_cmap[k];
-
-    *(dst_address++) = graya(k, a);
-  }
+  m_transformFilter.applyToGrayscale(filterMgr);
 }
 
 void BrightnessContrastFilter::applyToIndexed(FilterManager* filterMgr)
@@ -178,6 +155,11 @@ void BrightnessContrastFilter::applyToPalette(FilterManager* filterMgr)
   }
 }
 
+void BrightnessContrastFilter::transformColor(const Target target, doc::color_t& color)
+{
+  applyFilterToRgb(target, color);
+}
+
 void BrightnessContrastFilter::applyFilterToRgb(
   const Target target, doc::color_t& c)
 {
@@ -203,6 +185,7 @@ void BrightnessContrastFilter::updateMap()
     y = MID(0.0, y, 1.0);
     m_cmap[u] = int(255.5 * y);
   }
+  m_transformFilter.invalidate();
 }
 
 } // namespace filters
@@ -8,16 +8,21 @@
 #define FILTERS_BRIGHTNESS_CONTRAST_FILTER_H_INCLUDED
 #pragma once
 
+#include "base/disable_copying.h"
 #include "doc/color.h"
 #include "doc/palette_picks.h"
+#include "filters/color_transform.h"
+#include "filters/color_transform_filter.h"
 #include "filters/filter.h"
+#include "filters/palette_exact_match.h"
 #include "filters/target.h"
 
 #include <vector>
 
 namespace filters {
 
-  class BrightnessContrastFilter : public Filter {
+  class BrightnessContrastFilter : public Filter
+                                 , public ColorTransform {
   public:
     BrightnessContrastFilter();
 
@@ -30,6 +35,10 @@ namespace filters {
     void applyToGrayscale(FilterManager* filterMgr);
     void applyToIndexed(FilterManager* filterMgr);
 
+    // ColorTransform implementation
+    bool isPerChannelTransform() const { return true; }
+    void transformColor(const Target target, doc::color_t& color);
+
   private:
     void applyToPalette(FilterManager* filterMgr);
     void applyFilterToRgb(const Target target, doc::color_t& color);
@@ -38,7 +47,14 @@ namespace filters {
     double m_brightness, m_contrast;
     doc::PalettePicks m_picks;
     bool m_usePalette;
+    PaletteExactMatch m_exactMatch;
     std::vector<int> m_cmap;
+
+    // Used to apply the filter to RGB and grayscale images (the filter is
+    // precalculated in lookup tables).
+    ColorTransformFilter m_transformFilter;
+
+    DISABLE_COPYING(BrightnessContrastFilter);
   };
 
 } // namespace filters
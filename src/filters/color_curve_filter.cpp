@@ -29,6 +29,7 @@ ColorCurveFilter::ColorCurveFilter()
   : m_curve(NULL)
   , m_cmap(256)
 {
+  m_transformFilter.addTransform(this);
 }
 
 void ColorCurveFilter::setCurve(ColorCurve* curve)
@@ -41,6 +42,8 @@ void ColorCurveFilter::setCurve(ColorCurve* curve)
   m_curve->getValues(0, 255, m_cmap);
   for (int c=0; c<256; c++)
     m_cmap[c] = MID(0, m_cmap[c], 255);
+
+  m_transformFilter.invalidate();
 }
 
 const char* ColorCurveFilter::getName()
@@ -50,101 +53,45 @@ const char* ColorCurveFilter::getName()
 
 void ColorCurveFilter::applyToRgba(FilterManager* filterMgr)
 {
-  const uint32_t* src_address = (uint32_t*)filterMgr->getSourceAddress();
-  uint32_t* dst_address = (uint32_t*)filterMgr->getDestinationAddress();
-  int w = filterMgr->getWidth();
-  Target target = filterMgr->getTarget();
-  int x, c, r, g, b, a;
-
-  for (x=0; x<w; x++) {
-    if (filterMgr->skipPixel()) {
-      ++src_address;
-      ++dst_address;
-      continue;
-    }
-
-    c = *(src_address++);
-
-    r = rgba_getr(c);
-    g = rgba_getg(c);
-    b = rgba_getb(c);
-    a = rgba_geta(c);
-
-    if (target & TARGET_RED_CHANNEL) r = m_cmap[r];
-    if (target & TARGET_GREEN_CHANNEL) g = m_cmap[g];
-    if (target & TARGET_BLUE_CHANNEL) b = m_cmap[b];
-    if (target & TARGET_ALPHA_CHANNEL) a = m_cmap[a];
-
-    *(dst_address++) = rgba(r, g, b, a);
-  }
+  m_transformFilter.applyToRgba(filterMgr);
 }
 
 void ColorCurveFilter::applyToGrayscale(FilterManager* filterMgr)
 {
-  const uint16_t* src_address = (uint16_t*)filterMgr->getSourceAddress();
-  uint16_t* dst_address = (uint16_t*)filterMgr->getDestinationAddress();
-  int w = filterMgr->getWidth();
-  Target target = filterMgr->getTarget();
-  int x, c, k, a;
-
-  for (x=0; x<w; x++) {
-    if (filterMgr->skipPixel()) {
-      ++src_address;
-      ++dst_address;
-      continue;
-    }
+  m_transformFilter.applyToGrayscale(filterMgr);
+}
 
-    c = *(src_address++);
+void ColorCurveFilter::applyToIndexed(FilterManager* filterMgr)
+{
+  m_transformFilter.applyToIndexed(filterMgr);
+}
 
-    k = graya_getv(c);
-    a = graya_geta(c);
+void ColorCurveFilter::transformColor(const Target target, doc::color_t& c)
+{
+  int r = rgba_getr(c);
+  int g = rgba_getg(c);
+  int b = rgba_getb(c);
+  int a = rgba_geta(c);
 
-    if (target & TARGET_GRAY_CHANNEL) k = m_cmap[k];
-    if (target & TARGET_ALPHA_CHANNEL) a = m_cmap[a];
+  if (target & TARGET_RED_CHANNEL) r = m_cmap[r];
+  if (target & TARGET_GREEN_CHANNEL) g = m_cmap[g];
+  if (target & TARGET_BLUE_CHANNEL) b = m_cmap[b];
+  if (target & TARGET_ALPHA_CHANNEL) a = m_cmap[a];
 
-    *(dst_address++) = graya(k, a);
-  }
+  c = rgba(r, g, b, a);
 }
 
-void ColorCurveFilter::applyToIndexed(FilterManager* filterMgr)
+int ColorCurveFilter::transformIndex(const Target target,
+                                     const doc::Palette* palette,
+                                     const doc::RgbMap* rgbmap,
+                                     const int index)
 {
-  const uint8_t* src_address = (uint8_t*)filterMgr->getSourceAddress();
-  uint8_t* dst_address = (uint8_t*)filterMgr->getDestinationAddress();
-  int w = filterMgr->getWidth();
-  Target target = filterMgr->getTarget();
-  const Palette* pal = filterMgr->getIndexedData()->getPalette();
-  const RgbMap* rgbmap = filterMgr->getIndexedData()->getRgbMap();
-  int x, c, r, g, b, a;
-
-  for (x=0; x<w; x++) {
-    if (filterMgr->skipPixel()) {
-      ++src_address;
-      ++dst_address;
-      continue;
-    }
-
-    c = *(src_address++);
-
-    if (target & TARGET_INDEX_CHANNEL) {
-      c = m_cmap[c];
-    }
-    else {
-      c = pal->getEntry(c);
-      r = rgba_getr(c);
-      g = rgba_getg(c);
-      b = rgba_getb(c);
-      a = rgba_geta(c);
-
-      if (target & TARGET_RED_CHANNEL  ) r = m_cmap[r];
-      if (target & TARGET_GREEN_CHANNEL) g = m_cmap[g];
-      if (target & TARGET_BLUE_CHANNEL ) b = m_cmap[b];
-      if (target & TARGET_ALPHA_CHANNEL) a = m_cmap[a];
-
-      c = rgbmap->mapColor(r, g, b, a);
-    }
-
-    *(dst_address++) = MID(0, c, pal->size()-1);
-  }
+  int c;
+  if (target & TARGET_INDEX_CHANNEL)
+    c = m_cmap[index];
+  else
+    c = ColorTransform::transformIndex(target, palette, rgbmap, index);
+  return MID(0, c, palette->size()-1);
 }
 
 } // namespace filters
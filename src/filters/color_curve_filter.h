@@ -10,6 +10,9 @@
 
 #include <vector>
 
+#include "base/disable_copying.h"
+#include "filters/color_transform.h"
+#include "filters/color_transform_filter.h"
 #include "filters/filter.h"
 
 namespace filters {
@@ -17,6 +20,7 @@ namespace filters {
   class ColorCurve;
 
   class ColorCurveFilter : public Filter
+                         , public ColorTransform
   {
   public:
     ColorCurveFilter();
@@ -30,9 +34,23 @@ namespace filters {
     void applyToGrayscale(FilterManager* filterMgr);
     void applyToIndexed(FilterManager* filterMgr);
 
+    // ColorTransform implementation
+    bool isPerChannelTransform() const { return true; }
+    void transformColor(const Target target, doc::color_t& color);
+    int transformIndex(const Target target,
+                       const doc::Palette* palette,
+                       const doc::RgbMap* rgbmap,
+                       const int index);
+
   private:
     ColorCurve* m_curve;
     std::vector<int> m_cmap;
+
+    // Used to apply the filter to all images (the filter is
+    // precalculated in lookup tables).
+    ColorTransformFilter m_transformFilter;
+
+    DISABLE_COPYING(ColorCurveFilter);
   };
 
 } // namespace filters
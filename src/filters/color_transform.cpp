@@ -0,0 +1,33 @@
+// Aseprite
+// Copyright (C) 2018  David Capello
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "filters/color_transform.h"
+
+#include "doc/palette.h"
+#include "doc/rgbmap.h"
+
+namespace filters {
+
+using namespace doc;
+
+int ColorTransform::transformIndex(const Target target,
+                                   const Palette* palette,
+                                   const RgbMap* rgbmap,
+                                   const int index)
+{
+  color_t c = palette->getEntry(index);
+  transformColor(target, c);
+  return rgbmap->mapColor(rgba_getr(c),
+                          rgba_getg(c),
+                          rgba_getb(c),
+                          rgba_geta(c));
+}
+
+} // namespace filters
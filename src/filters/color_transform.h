@@ -0,0 +1,51 @@
+// Aseprite
+// Copyright (C) 2018  David Capello
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef FILTERS_COLOR_TRANSFORM_H_INCLUDED
+#define FILTERS_COLOR_TRANSFORM_H_INCLUDED
+#pragma once
+
+#include "doc/color.h"
+#include "filters/target.h"
+
+namespace doc {
+  class Palette;
+  class RgbMap;
+}
+
+namespace filters {
+
+  // Interface implemented by filters that modify each pixel
+  // independently of the others, so several of them can be chained
+  // and precalculated in lookup tables (see ColorTransformFilter).
+  //
+  // The RGB components of the result must depend only on the RGB
+  // components of the source color, and the alpha only on the source
+  // alpha.
+  class ColorTransform {
+  public:
+    virtual ~ColorTransform() { }
+
+    // Returns true if each component of the result depends only on
+    // the same component of the source color (e.g. brightness), false
+    // if components are mixed (e.g. hue).
+    virtual bool isPerChannelTransform() const = 0;
+
+    // Modifies the given RGBA color.
+    virtual void transformColor(const Target target, doc::color_t& color) = 0;
+
+    // Returns the new index for a pixel of an indexed image. By
+    // default the palette entry is modified with transformColor() and
+    // the nearest palette entry is returned.
+    virtual int transformIndex(const Target target,
+                               const doc::Palette* palette,
+                               const doc::RgbMap* rgbmap,
+                               const int index);
+  };
+
+} // namespace filters
+
+#endif
@@ -0,0 +1,209 @@
+// Aseprite
+// Copyright (C) 2018  David Capello
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "filters/color_transform_filter.h"
+
+#include "base/base.h"
+#include "base/debug.h"
+#include "doc/image.h"
+#include "doc/palette.h"
+#include "filters/color_transform.h"
+#include "filters/filter_indexed_data.h"
+#include "filters/filter_manager.h"
+
+namespace filters {
+
+using namespace doc;
+
+ColorTransformFilter::ColorTransformFilter()
+  : m_validTables(false)
+  , m_tablesTarget(0)
+{
+}
+
+void ColorTransformFilter::addTransform(ColorTransform* transform)
+{
+  ASSERT(transform);
+  m_transforms.push_back(transform);
+  m_validTables = false;
+}
+
+const char* ColorTransformFilter::getName()
+{
+  return "Color Transform";
+}
+
+void ColorTransformFilter::applyToRgba(FilterManager* filterMgr)
+{
+  const Target target = filterMgr->getTarget();
+  if (!m_validTables || m_tablesTarget != target)
+    updateTables(target);
+
+  const uint32_t* src_address = (uint32_t*)filterMgr->getSourceAddress();
+  uint32_t* dst_address = (uint32_t*)filterMgr->getDestinationAddress();
+  const int w = filterMgr->getWidth();
+
+  for (int x=0; x<w; x++) {
+    if (filterMgr->skipPixel()) {
+      ++src_address;
+      ++dst_address;
+      continue;
+    }
+
+    const color_t c = *(src_address++);
+    int r = rgba_getr(c);
+    int g = rgba_getg(c);
+    int b = rgba_getb(c);
+
+    for (Stage& stage : m_stages) {
+      if (stage.perChannel) {
+        r = stage.table[0][r];
+        g = stage.table[1][g];
+        b = stage.table[2][b];
+      }
+      else {
+        const color_t rgb = rgba(r, g, b, 255);
+        auto& entry = stage.cache[(rgb ^ (rgb >> 11) ^ (rgb >> 17)) & (kColorCacheSize-1)];
+        if (entry.first != rgb) {
+          entry.first = rgb;
+          entry.second = transformColor(target, rgb, stage.begin, stage.end);
+        }
+        r = rgba_getr(entry.second);
+        g = rgba_getg(entry.second);
+        b = rgba_getb(entry.second);
+      }
+    }
+
+    const int a = m_alphaTable[rgba_geta(c)];
+    *(dst_address++) = rgba(r, g, b, a);
+  }
+}
+
+void ColorTransformFilter::applyToGrayscale(FilterManager* filterMgr)
+{
+  const Target target = filterMgr->getTarget();
+  if (!m_validTables || m_tablesTarget != target)
+    updateTables(target);
+
+  const uint16_t* src_address = (uint16_t*)filterMgr->getSourceAddress();
+  uint16_t* dst_address = (uint16_t*)filterMgr->getDestinationAddress();
+  const int w = filterMgr->getWidth();
+
+  for (int x=0; x<w; x++) {
+    if (filterMgr->skipPixel()) {
+      ++src_address;
+      ++dst_address;
+      continue;
+    }
+
+    const color_t c = *(src_address++);
+    *(dst_address++) = graya(m_grayTable[0][graya_getv(c)],
+                             m_grayTable[1][graya_geta(c)]);
+  }
+}
+
+void ColorTransformFilter::applyToIndexed(FilterManager* filterMgr)
+{
+  // The palette can be different in each image, so we calculate the
+  // new index of each palette entry at the beginning of each image.
+  if (filterMgr->isFirstRow()) {
+    const Target target = filterMgr->getTarget();
+    const FilterIndexedData* fid = filterMgr->getIndexedData();
+    const Palette* pal = fid->getPalette();
+    const RgbMap* rgbmap = fid->getRgbMap();
+
+    for (int i=0; i<256; ++i) {
+      int index = MID(0, i, pal->size()-1);
+      for (ColorTransform* transform : m_transforms) {
+        index = transform->transformIndex(target, pal, rgbmap, index);
+        index = MID(0, index, pal->size()-1);
+      }
+      m_indexTable[i] = index;
+    }
+  }
+
+  const uint8_t* src_address = (uint8_t*)filterMgr->getSourceAddress();
+  uint8_t* dst_address = (uint8_t*)filterMgr->getDestinationAddress();
+  const int w = filterMgr->getWidth();
+
+  for (int x=0; x<w; x++) {
+    if (filterMgr->skipPixel()) {
+      ++src_address;
+      ++dst_address;
+      continue;
+    }
+
+    *(dst_address++) = m_indexTable[*(src_address++)];
+  }
+}
+
+color_t ColorTransformFilter::transformColor(const Target target, color_t color,
+                                             const int begin, const int end) const
+{
+  for (int i=begin; i<end; ++i)
+    m_transforms[i]->transformColor(target, color);
+  return color;
+}
+
+void ColorTransformFilter::updateTables(const Target target)
+{
+  // Split the chain in stages of consecutive transforms that are (or
+  // aren't) per-channel. Per-channel stages are merged in tables, the
+  // other ones use a cache of transformed colors.
+  m_stages.clear();
+  for (int i=0; i<int(m_transforms.size()); ++i) {
+    const bool perChannel = m_transforms[i]->isPerChannelTransform();
+    if (m_stages.empty() || m_stages.back().perChannel != perChannel) {
+      m_stages.push_back(Stage());
+      m_stages.back().begin = i;
+      m_stages.back().perChannel = perChannel;
+    }
+    m_stages.back().end = i+1;
+  }
+
+  for (Stage& stage : m_stages) {
+    if (stage.perChannel) {
+      for (int v=0; v<256; ++v) {
+        const color_t c = transformColor(target, rgba(v, v, v, 255),
+                                         stage.begin, stage.end);
+        stage.table[0][v] = rgba_getr(c);
+        stage.table[1][v] = rgba_getg(c);
+        stage.table[2][v] = rgba_getb(c);
+      }
+    }
+    else {
+      // Invalid entries (an alpha value != 255 never matches a key)
+      stage.cache.assign(kColorCacheSize, std::make_pair(color_t(0), color_t(0)));
+    }
+  }
+
+  // The alpha component doesn't depend on the RGB components
+  const int n = int(m_transforms.size());
+  for (int v=0; v<256; ++v)
+    m_alphaTable[v] = rgba_geta(transformColor(target, rgba(0, 0, 0, v), 0, n));
+
+  // Grayscale images are transformed as gray RGB colors (the result
+  // of all transforms is gray too)
+  const Target grayTarget =
+    ((target & TARGET_GRAY_CHANNEL) ? (TARGET_RED_CHANNEL |
+                                       TARGET_GREEN_CHANNEL |
+                                       TARGET_BLUE_CHANNEL): 0) |
+    (target & TARGET_ALPHA_CHANNEL);
+
+  for (int v=0; v<256; ++v) {
+    m_grayTable[0][v] = rgba_getr(transformColor(grayTarget, rgba(v, v, v, 255), 0, n));
+    m_grayTable[1][v] = rgba_geta(transformColor(grayTarget, rgba(0, 0, 0, v), 0, n));
+  }
+
+  m_tablesTarget = target;
+  m_validTables = true;
+}
+
+} // namespace filters
@@ -0,0 +1,80 @@
+// Aseprite
+// Copyright (C) 2018  David Capello
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef FILTERS_COLOR_TRANSFORM_FILTER_H_INCLUDED
+#define FILTERS_COLOR_TRANSFORM_FILTER_H_INCLUDED
+#pragma once
+
+#include "doc/color.h"
+#include "filters/filter.h"
+#include "filters/target.h"
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace filters {
+
+  class ColorTransform;
+
+  // Applies a chain of ColorTransforms (e.g. hue/saturation, then
+  // brightness/contrast, then a color curve) in just one pass.
+  // Consecutive per-channel transforms are merged in one lookup table
+  // per component, and transforms that mix components are applied
+  // directly to each pixel but the results are cached by color (sprites
+  // usually have few colors). The alpha and grayscale tables are
+  // calculated for the whole chain.
+  //
+  // Indexed images are remapped pixel by pixel (the palette is never
+  // modified), and palette picks are ignored.
+  class ColorTransformFilter : public Filter {
+  public:
+    // Number of cached colors for each stage of transforms that mix
+    // the RGB components (must be a power of two).
+    static const int kColorCacheSize = 4096;
+
+    ColorTransformFilter();
+
+    // Adds a transform at the end of the chain. The filter doesn't
+    // own the transform.
+    void addTransform(ColorTransform* transform);
+
+    // Must be called if the parameters of a transform are modified,
+    // so the tables are calculated again.
+    void invalidate() { m_validTables = false; }
+
+    // Filter implementation
+    const char* getName();
+    void applyToRgba(FilterManager* filterMgr);
+    void applyToGrayscale(FilterManager* filterMgr);
+    void applyToIndexed(FilterManager* filterMgr);
+
+  private:
+    // Consecutive transforms of the chain that are applied with the
+    // same lookup table.
+    struct Stage {
+      int begin, end;           // Range of transforms [begin, end)
+      bool perChannel;
+      uint8_t table[3][256];    // Tables for per-channel transforms
+      std::vector<std::pair<doc::color_t, doc::color_t> > cache;
+    };
+
+    doc::color_t transformColor(const Target target, doc::color_t color,
+                                const int begin, const int end) const;
+    void updateTables(const Target target);
+
+    std::vector<ColorTransform*> m_transforms;
+    std::vector<Stage> m_stages;
+    bool m_validTables;
+    Target m_tablesTarget;
+    uint8_t m_alphaTable[256];
+    uint8_t m_grayTable[2][256];
+    uint8_t m_indexTable[256];
+  };
+
+} // namespace filters
+
+#endif
@@ -0,0 +1,255 @@
+// Aseprite
+// Copyright (C) 2018  David Capello
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/image.h"
+#include "doc/palette.h"
+#include "doc/palette_picks.h"
+#include "doc/primitives.h"
+#include "filters/brightness_contrast_filter.h"
+#include "filters/color_curve.h"
+#include "filters/color_curve_filter.h"
+#include "filters/color_transform_filter.h"
+#include "filters/filter_indexed_data.h"
+#include "filters/filter_manager.h"
+#include "filters/hue_saturation_filter.h"
+#include "filters/invert_color_filter.h"
+
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+using namespace doc;
+using namespace filters;
+
+typedef std::unique_ptr<Image> ImagePtr;
+
+static const int kSize = 64;
+
+namespace {
+
+  // Applies a filter to a whole image row by row, skipping some
+  // pixels (like a selection would do).
+  class TestFilterManager : public FilterManager
+                          , public FilterIndexedData {
+  public:
+    TestFilterManager(const Image* src, Image* dst, Target target)
+      : m_src(src), m_dst(dst), m_target(target)
+      , m_palette(0, 256), m_x(0), m_y(0) {
+    }
+
+    void apply(Filter* filter) {
+      for (m_y=0; m_y<m_src->height(); ++m_y) {
+        m_x = 0;
+        switch (m_src->pixelFormat()) {
+          case IMAGE_RGB: filter->applyToRgba(this); break;
+          case IMAGE_GRAYSCALE: filter->applyToGrayscale(this); break;
+          case IMAGE_INDEXED: filter->applyToIndexed(this); break;
+        }
+      }
+    }
+
+    // FilterManager implementation
+    const void* getSourceAddress() override { return m_src->getPixelAddress(0, m_y); }
+    void* getDestinationAddress() override { return m_dst->getPixelAddress(0, m_y); }
+    int getWidth() override { return m_src->width(); }
+    Target getTarget() override { return m_target; }
+    FilterIndexedData* getIndexedData() override { return this; }
+    bool skipPixel() override { return ((m_x++ + m_y) % 7) == 0; }
+    const Image* getSourceImage() override { return m_src; }
+    int x() const override { return 0; }
+    int y() const override { return m_y; }
+    bool isFirstRow() const override { return m_y == 0; }
+    bool isMaskActive() const override { return true; }
+
+    // FilterIndexedData implementation
+    const Palette* getPalette() const override { return &m_palette; }
+    const RgbMap* getRgbMap() const override { return nullptr; }
+    Palette* getNewPalette() override { return &m_palette; }
+    PalettePicks getPalettePicks() override { return PalettePicks(); }
+
+  private:
+    const Image* m_src;
+    Image* m_dst;
+    Target m_target;
+    Palette m_palette;
+    int m_x, m_y;
+  };
+
+  // Image with a few different colors (like a sprite) and random
+  // alpha values.
+  Image* create_random_image(PixelFormat format)
+  {
+    std::srand(1);
+    Image* image = Image::create(format, kSize, kSize);
+    for (int y=0; y<kSize; ++y) {
+      for (int x=0; x<kSize; ++x) {
+        const int v = (std::rand() % 32) * 8;
+        const int a = (std::rand() % 4 == 0 ? std::rand() % 256: 255);
+        if (format == IMAGE_RGB)
+          put_pixel(image, x, y, rgba(v, 255-v, (v*3) & 255, a));
+        else
+          put_pixel(image, x, y, graya(v, a));
+      }
+    }
+    return image;
+  }
+
+}
+
+class ColorTransformFilterTest : public ::testing::Test {
+public:
+  ColorTransformFilterTest() : curve(ColorCurve::Linear) {
+    hsl.setHue(45.0);
+    hsl.setSaturation(0.5);
+    hsl.setLightness(-0.25);
+    hsl.setAlpha(-0.5);
+
+    hsv.setMode(HueSaturationFilter::Mode::HSV);
+    hsv.setHue(-120.0);
+    hsv.setSaturation(-0.25);
+    hsv.setLightness(0.5);
+
+    brightness.setBrightness(0.25);
+    brightness.setContrast(0.5);
+
+    curve.addPoint(gfx::Point(0, 32));
+    curve.addPoint(gfx::Point(128, 64));
+    curve.addPoint(gfx::Point(255, 200));
+    curveFilter.setCurve(&curve);
+  }
+
+  // Each filter (or transform) applied in one pass, in order
+  std::vector<ColorTransform*> transforms() {
+    return { &hsl, &brightness, &curveFilter, &invert, &hsv };
+  }
+  std::vector<Filter*> filters() {
+    return { &hsl, &brightness, &curveFilter, &invert, &hsv };
+  }
+
+  HueSaturationFilter hsl, hsv;
+  BrightnessContrastFilter brightness;
+  ColorCurve curve;
+  ColorCurveFilter curveFilter;
+  InvertColorFilter invert;
+};
+
+TEST_F(ColorTransformFilterTest, RgbChain)
+{
+  const Target target = TARGET_ALL_CHANNELS;
+  ImagePtr src(create_random_image(IMAGE_RGB));
+  ImagePtr dst(Image::createCopy(src.get()));
+  ImagePtr expected(Image::createCopy(src.get()));
+
+  ColorTransformFilter filter;
+  for (ColorTransform* transform : transforms())
+    filter.addTransform(transform);
+  TestFilterManager(src.get(), dst.get(), target).apply(&filter);
+
+  // Each transform applied to each pixel
+  for (int y=0; y<kSize; ++y) {
+    for (int x=0; x<kSize; ++x) {
+      if (((x + y) % 7) == 0)
+        continue;
+      color_t c = get_pixel(src.get(), x, y);
+      for (ColorTransform* transform : transforms())
+        transform->transformColor(target, c);
+      put_pixel(expected.get(), x, y, c);
+    }
+  }
+
+  EXPECT_EQ(0, count_diff_between_images(expected.get(), dst.get()));
+}
+
+TEST_F(ColorTransformFilterTest, GrayscaleChain)
+{
+  for (Target target : { Target(TARGET_ALL_CHANNELS),
+                         Target(TARGET_GRAY_CHANNEL),
+                         Target(TARGET_ALPHA_CHANNEL) }) {
+    ImagePtr src(create_random_image(IMAGE_GRAYSCALE));
+    ImagePtr dst(Image::createCopy(src.get()));
+
+    ColorTransformFilter filter;
+    for (ColorTransform* transform : transforms())
+      filter.addTransform(transform);
+    TestFilterManager(src.get(), dst.get(), target).apply(&filter);
+
+    // Each filter applied with its own applyToGrayscale()
+    ImagePtr expected(Image::createCopy(src.get()));
+    for (Filter* f : filters()) {
+      ImagePtr tmp(Image::createCopy(expected.get()));
+      TestFilterManager(tmp.get(), expected.get(), target).apply(f);
+    }
+
+    EXPECT_EQ(0, count_diff_between_images(expected.get(), dst.get()));
+  }
+}
+
+TEST_F(ColorTransformFilterTest, HueSaturationFilter)
+{
+  const Target target = TARGET_RED_CHANNEL | TARGET_BLUE_CHANNEL | TARGET_ALPHA_CHANNEL;
+  ImagePtr src(create_random_image(IMAGE_RGB));
+
+  for (double hue : { 45.0, 90.0 }) {
+    // The cache of transformed colors must be invalidated
+    hsl.setHue(hue);
+
+    ImagePtr dst(Image::createCopy(src.get()));
+    TestFilterManager(src.get(), dst.get(), target).apply(&hsl);
+
+    ImagePtr expected(Image::createCopy(src.get()));
+    for (int y=0; y<kSize; ++y) {
+      for (int x=0; x<kSize; ++x) {
+        if (((x + y) % 7) == 0)
+          continue;
+        color_t c = get_pixel(src.get(), x, y);
+        hsl.transformColor(target, c);
+        put_pixel(expected.get(), x, y, c);
+      }
+    }
+
+    EXPECT_EQ(0, count_diff_between_images(expected.get(), dst.get()));
+  }
+}
+
+TEST_F(ColorTransformFilterTest, EachFilter)
+{
+  const Target target = TARGET_ALL_CHANNELS;
+  ImagePtr src(create_random_image(IMAGE_RGB));
+
+  // Each filter applies its own transform to RGB images
+  std::vector<ColorTransform*> transforms = this->transforms();
+  std::vector<Filter*> filters = this->filters();
+  for (int i=0; i<int(filters.size()); ++i) {
+    ImagePtr dst(Image::createCopy(src.get()));
+    TestFilterManager(src.get(), dst.get(), target).apply(filters[i]);
+
+    ImagePtr expected(Image::createCopy(src.get()));
+    for (int y=0; y<kSize; ++y) {
+      for (int x=0; x<kSize; ++x) {
+        if (((x + y) % 7) == 0)
+          continue;
+        color_t c = get_pixel(src.get(), x, y);
+        transforms[i]->transformColor(target, c);
+        put_pixel(expected.get(), x, y, c);
+      }
+    }
+
+    EXPECT_EQ(0, count_diff_between_images(expected.get(), dst.get()))
+      << filters[i]->getName();
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -37,31 +37,37 @@ HueSaturationFilter::HueSaturationFilter()
   , m_l(0.0)
   , m_a(0.0)
 {
+  m_transformFilter.addTransform(this);
 }
 
 void HueSaturationFilter::setMode(Mode mode)
 {
   m_mode = mode;
+  m_transformFilter.invalidate();
 }
 
 void HueSaturationFilter::setHue(double h)
 {
   m_h = h;
+  m_transformFilter.invalidate();
 }
 
 void HueSaturationFilter::setSaturation(double s)
 {
   m_s = s;
+  m_transformFilter.invalidate();
 }
 
 void HueSaturationFilter::setLightness(double l)
 {
   m_l = l;
+  m_transformFilter.invalidate();
 }
 
 void HueSaturationFilter::setAlpha(double a)
 {
   m_a = a;
+  m_transformFilter.invalidate();
 }
 
 void HueSaturationFilter::applyToRgba(FilterManager* filterMgr)
@@ -71,15 +77,20 @@ void HueSaturationFilter::applyToRgba(FilterManager* filterMgr)
   if (filterMgr->isFirstRow()) {
     m_picks = fid->getPalettePicks();
     m_usePalette = (m_picks.picks() > 0);
-    if (m_usePalette)
+    if (m_usePalette) {
       applyToPalette(filterMgr);
+      m_exactMatch.regenerate(fid->getPalette());
+    }
+  }
+
+  if (!m_usePalette) {
+    m_transformFilter.applyToRgba(filterMgr);
+    return;
   }
 
-  const Palette* pal = fid->getPalette();
   const uint32_t* src_address = (uint32_t*)filterMgr->getSourceAddress();
   uint32_t* dst_address = (uint32_t*)filterMgr->getDestinationAddress();
   const int w = filterMgr->getWidth();
-  const Target target = filterMgr->getTarget();
 
   for (int x=0; x<w; x++) {
     if (filterMgr->skipPixel()) {
@@ -89,19 +100,9 @@ void HueSaturationFilter::applyToRgba(FilterManager* filterMgr)
     }
 
     color_t c = *(src_address++);
-
-    if (m_usePalette) {
-      int i =
-        pal->findExactMatch(rgba_getr(c),
-                            rgba_getg(c),
-                            rgba_getb(c),
-                            rgba_geta(c), -1);
-      if (i >= 0)
-        c = fid->getNewPalette()->getEntry(i);
-    }
-    else {
-      applyFilterToRgb(target, c);
-    }
+    int i = m_exactMatch.find(c);
+    if (i >= 0)
+      c = fid->getNewPalette()->getEntry(i);
 
     *(dst_address++) = c;
   }
@@ -246,6 +247,11 @@ void HueSaturationFilter::applyFilterToRgbT(const Target target, doc::color_t& c
   c = rgba(r, g, b, a);
 }
 
+void HueSaturationFilter::transformColor(const Target target, doc::color_t& color)
+{
+  applyFilterToRgb(target, color);
+}
+
 void HueSaturationFilter::applyFilterToRgb(const Target target, doc::color_t& color)
 {
   switch (m_mode) {
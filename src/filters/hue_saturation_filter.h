@@ -8,14 +8,19 @@
 #define FILTERS_HUE_SATURATION_FILTER_H_INCLUDED
 #pragma once
 
+#include "base/disable_copying.h"
 #include "doc/color.h"
 #include "doc/palette_picks.h"
+#include "filters/color_transform.h"
+#include "filters/color_transform_filter.h"
 #include "filters/filter.h"
+#include "filters/palette_exact_match.h"
 #include "filters/target.h"
 
 namespace filters {
 
-  class HueSaturationFilter : public Filter {
+  class HueSaturationFilter : public Filter
+                            , public ColorTransform {
   public:
     enum class Mode { HSL, HSV };
 
@@ -33,6 +38,10 @@ namespace filters {
     void applyToGrayscale(FilterManager* filterMgr);
     void applyToIndexed(FilterManager* filterMgr);
 
+    // ColorTransform implementation
+    bool isPerChannelTransform() const { return false; }
+    void transformColor(const Target target, doc::color_t& color);
+
   private:
     void applyToPalette(FilterManager* filterMgr);
     template<class T,
@@ -45,6 +54,13 @@ namespace filters {
     double m_h, m_s, m_l, m_a;
     doc::PalettePicks m_picks;
     bool m_usePalette;
+    PaletteExactMatch m_exactMatch;
+
+    // Used to apply the filter to RGB images (the transformed colors
+    // are cached, so each different color is transformed just once).
+    ColorTransformFilter m_transformFilter;
+
+    DISABLE_COPYING(HueSaturationFilter);
   };
 
 } // namespace filters
@@ -20,6 +20,11 @@ namespace filters {
 
 using namespace doc;
 
+InvertColorFilter::InvertColorFilter()
+{
+  m_transformFilter.addTransform(this);
+}
+
 const char* InvertColorFilter::getName()
 {
   return "Invert Color";
@@ -27,100 +32,43 @@ const char* InvertColorFilter::getName()
 
 void InvertColorFilter::applyToRgba(FilterManager* filterMgr)
 {
-  const uint32_t* src_address = (uint32_t*)filterMgr->getSourceAddress();
-  uint32_t* dst_address = (uint32_t*)filterMgr->getDestinationAddress();
-  int w = filterMgr->getWidth();
-  Target target = filterMgr->getTarget();
-  int x, c, r, g, b, a;
-
-  for (x=0; x<w; x++) {
-    if (filterMgr->skipPixel()) {
-      ++src_address;
-      ++dst_address;
-      continue;
-    }
-
-    c = *(src_address++);
-
-    r = rgba_getr(c);
-    g = rgba_getg(c);
-    b = rgba_getb(c);
-    a = rgba_geta(c);
-
-    if (target & TARGET_RED_CHANNEL) r ^= 0xff;
-    if (target & TARGET_GREEN_CHANNEL) g ^= 0xff;
-    if (target & TARGET_BLUE_CHANNEL) b ^= 0xff;
-    if (target & TARGET_ALPHA_CHANNEL) a ^= 0xff;
-
-    *(dst_address++) = rgba(r, g, b, a);
-  }
+  m_transformFilter.applyToRgba(filterMgr);
 }
 
 void InvertColorFilter::applyToGrayscale(FilterManager* filterMgr)
 {
-  const uint16_t* src_address = (uint16_t*)filterMgr->getSourceAddress();
-  uint16_t* dst_address = (uint16_t*)filterMgr->getDestinationAddress();
-  int w = filterMgr->getWidth();
-  Target target = filterMgr->getTarget();
-  int x, c, k, a;
-
-  for (x=0; x<w; x++) {
-    if (filterMgr->skipPixel()) {
-      ++src_address;
-      ++dst_address;
-      continue;
-    }
-
-    c = *(src_address++);
-
-    k = graya_getv(c);
-    a = graya_geta(c);
-
-    if (target & TARGET_GRAY_CHANNEL) k ^= 0xff;
-    if (target & TARGET_ALPHA_CHANNEL) a ^= 0xff;
-
-    *(dst_address++) = graya(k, a);
-  }
+  m_transformFilter.applyToGrayscale(filterMgr);
 }
 
 void InvertColorFilter::applyToIndexed(FilterManager* filterMgr)
 {
-  const uint8_t* src_address = (uint8_t*)filterMgr->getSourceAddress();
-  uint8_t* dst_address = (uint8_t*)filterMgr->getDestinationAddress();
-  const Palette* pal = filterMgr->getIndexedData()->getPalette();
-  const RgbMap* rgbmap = filterMgr->getIndexedData()->getRgbMap();
-  int w = filterMgr->getWidth();
-  Target target = filterMgr->getTarget();
-  int x, c, r, g, b, a;
-
-  for (x=0; x<w; x++) {
-    if (filterMgr->skipPixel()) {
-      ++src_address;
-      ++dst_address;
-      continue;
-    }
-
-    c = *(src_address++);
+  m_transformFilter.applyToIndexed(filterMgr);
+}
 
-    if (target & TARGET_INDEX_CHANNEL)
-      c ^= 0xff;
-    else {
-      c = pal->getEntry(c);
-      r = rgba_getr(c);
-      g = rgba_getg(c);
-      b = rgba_getb(c);
-      a = rgba_geta(c);
+void InvertColorFilter::transformColor(const Target target, doc::color_t& c)
+{
+  int r = rgba_getr(c);
+  int g = rgba_getg(c);
+  int b = rgba_getb(c);
+  int a = rgba_geta(c);
 
-      if (target & TARGET_RED_CHANNEL  ) r ^= 0xff;
-      if (target & TARGET_GREEN_CHANNEL) g ^= 0xff;
-      if (target & TARGET_BLUE_CHANNEL ) b ^= 0xff;
-      if (target & TARGET_ALPHA_CHANNEL) a ^= 0xff;
+  if (target & TARGET_RED_CHANNEL) r ^= 0xff;
+  if (target & TARGET_GREEN_CHANNEL) g ^= 0xff;
+  if (target & TARGET_BLUE_CHANNEL) b ^= 0xff;
+  if (target & TARGET_ALPHA_CHANNEL) a ^= 0xff;
 
-      c = rgbmap->mapColor(r, g, b, a);
-    }
+  c = rgba(r, g, b, a);
+}
 
-    *(dst_address++) = c;
-  }
+int InvertColorFilter::transformIndex(const Target target,
+                                      const doc::Palette* palette,
+                                      const doc::RgbMap* rgbmap,
+                                      const int index)
+{
+  if (target & TARGET_INDEX_CHANNEL)
+    return (index ^ 0xff);
+  else
+    return ColorTransform::transformIndex(target, palette, rgbmap, index);
 }
 
 } // namespace filters
@@ -8,17 +8,38 @@
 #define FILTERS_INVERT_COLOR_FILTER_H_INCLUDED
 #pragma once
 
+#include "base/disable_copying.h"
+#include "filters/color_transform.h"
+#include "filters/color_transform_filter.h"
 #include "filters/filter.h"
 
 namespace filters {
 
-  class InvertColorFilter : public Filter {
+  class InvertColorFilter : public Filter
+                          , public ColorTransform {
   public:
+    InvertColorFilter();
+
     // Filter implementation
     const char* getName();
     void applyToRgba(FilterManager* filterMgr);
     void applyToGrayscale(FilterManager* filterMgr);
     void applyToIndexed(FilterManager* filterMgr);
+
+    // ColorTransform implementation
+    bool isPerChannelTransform() const { return true; }
+    void transformColor(const Target target, doc::color_t& color);
+    int transformIndex(const Target target,
+                       const doc::Palette* palette,
+                       const doc::RgbMap* rgbmap,
+                       const int index);
+
+  private:
+    // Used to apply the filter to all images (the filter is
+    // precalculated in lookup tables).
+    ColorTransformFilter m_transformFilter;
+
+    DISABLE_COPYING(InvertColorFilter);
   };
 
 } // namespace filters
@@ -0,0 +1,28 @@
+// Aseprite
+// Copyright (C) 2018  David Capello
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "filters/palette_exact_match.h"
+
+#include "doc/palette.h"
+
+namespace filters {
+
+void PaletteExactMatch::regenerate(const doc::Palette* palette)
+{
+  m_map.clear();
+  m_map.reserve(palette->size());
+
+  // emplace() doesn't replace existent keys, so we keep the first
+  // entry of repeated colors.
+  for (int i=0; i<palette->size(); ++i)
+    m_map.emplace(palette->getEntry(i), i);
+}
+
+} // namespace filters
@@ -0,0 +1,42 @@
+// Aseprite
+// Copyright (C) 2018  David Capello
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef FILTERS_PALETTE_EXACT_MATCH_H_INCLUDED
+#define FILTERS_PALETTE_EXACT_MATCH_H_INCLUDED
+#pragma once
+
+#include "doc/color.h"
+
+#include <unordered_map>
+
+namespace doc {
+  class Palette;
+}
+
+namespace filters {
+
+  // Hash table to find palette entries by color. It returns the same
+  // result as doc::Palette::findExactMatch() (the first entry with
+  // the given RGBA color) without iterating the whole palette for
+  // each pixel.
+  class PaletteExactMatch {
+  public:
+    void regenerate(const doc::Palette* palette);
+
+    // Returns the index of the first entry with the given color, or
+    // -1 if the color is not in the palette.
+    int find(const doc::color_t color) const {
+      auto it = m_map.find(color);
+      return (it != m_map.end() ? it->second: -1);
+    }
+
+  private:
+    std::unordered_map<doc::color_t, int> m_map;
+  };
+
+} // namespace filters
+
+#endif
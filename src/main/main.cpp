@@ -13,6 +13,7 @@
 #include "app/console.h"
 #include "app/resource_finder.h"
 #include "app/send_crash.h"
+#include "app/startup_trace.h"
 #include "base/exception.h"
 #include "base/memory.h"
 #include "base/memory_dump.h"
@@ -43,6 +44,11 @@ namespace {
 #endif
   };
 
+  she::System* create_system() {
+    app::StartupTrace::Scope trace("she::System");
+    return she::create_system();
+  }
+
 }
 
 // Aseprite entry point. (Called from she library.)
@@ -66,7 +72,10 @@ int app_main(int argc, char* argv[])
     MemLeak memleak;
     base::SystemConsole systemConsole;
     app::AppOptions options(argc, const_cast<const char**>(argv));
-    she::ScopedHandle<she::System> system(she::create_system());
+    if (options.startupTrace())
+      app::StartupTrace::enable();
+
+    she::ScopedHandle<she::System> system(create_system());
     app::App app;
 
     // Change the name of the memory dump file
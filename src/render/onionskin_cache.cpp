@@ -0,0 +1,131 @@
+// Aseprite Render Library
+// Copyright (c) 2018 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "render/onionskin_cache.h"
+
+#include "doc/image.h"
+
+#include <limits>
+
+namespace render {
+
+// Default maximum memory used by all flattened frames
+static const std::size_t kDefaultBudget = 128*1024*1024;
+
+// static
+OnionskinCache* OnionskinCache::instance()
+{
+  static OnionskinCache cache;
+  return &cache;
+}
+
+OnionskinCache::OnionskinCache()
+  : m_budget(kDefaultBudget)
+  , m_memSize(0)
+  , m_tick(0)
+{
+}
+
+std::size_t OnionskinCache::budget() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_budget;
+}
+
+void OnionskinCache::setBudget(std::size_t budget)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_budget = budget;
+
+  while (m_memSize > m_budget && !m_entries.empty()) {
+    auto oldest = m_entries.begin();
+    for (auto it=oldest; it!=m_entries.end(); ++it)
+      if (it->second.lastUse < oldest->second.lastUse)
+        oldest = it;
+    removeEntry(oldest);
+  }
+}
+
+std::size_t OnionskinCache::memSize() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_memSize;
+}
+
+doc::ImageRef OnionskinCache::get(const doc::ObjectId spriteId,
+                                  const doc::frame_t frame,
+                                  const bool renderBackground,
+                                  const Key& key)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto it = m_entries.find(EntryId(spriteId, frame, renderBackground));
+  if (it == m_entries.end() || it->second.key != key)
+    return doc::ImageRef(nullptr);
+
+  it->second.lastUse = ++m_tick;
+  return it->second.image;
+}
+
+void OnionskinCache::set(const doc::ObjectId spriteId,
+                         const doc::frame_t frame,
+                         const bool renderBackground,
+                         const Key& key,
+                         const doc::ImageRef& image)
+{
+  const std::size_t size = image->getMemSize();
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  const EntryId id(spriteId, frame, renderBackground);
+  auto it = m_entries.find(id);
+  if (it != m_entries.end())
+    removeEntry(it);
+
+  // The image doesn't fit in the cache
+  if (size > m_budget)
+    return;
+
+  // Discard the least recently used images
+  while (m_memSize + size > m_budget && !m_entries.empty()) {
+    auto oldest = m_entries.begin();
+    for (auto it=oldest; it!=m_entries.end(); ++it)
+      if (it->second.lastUse < oldest->second.lastUse)
+        oldest = it;
+    removeEntry(oldest);
+  }
+
+  // Images that are being composited by other threads are not
+  // modified, a new image is created for each new key
+  Entry& entry = m_entries[id];
+  entry.key = key;
+  entry.image = image;
+  entry.lastUse = ++m_tick;
+  m_memSize += size;
+}
+
+void OnionskinCache::removeSprite(const doc::ObjectId spriteId)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto it = m_entries.lower_bound(EntryId(spriteId, std::numeric_limits<doc::frame_t>::min(), false));
+  while (it != m_entries.end() && std::get<0>(it->first) == spriteId) {
+    auto next = it;
+    ++next;
+    removeEntry(it);
+    it = next;
+  }
+}
+
+// Must be called with m_mutex locked
+void OnionskinCache::removeEntry(std::map<EntryId, Entry>::iterator it)
+{
+  m_memSize -= it->second.image->getMemSize();
+  m_entries.erase(it);
+}
+
+} // namespace render
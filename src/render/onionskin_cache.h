@@ -0,0 +1,88 @@
+// Aseprite Render Library
+// Copyright (c) 2018 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef RENDER_ONIONSKIN_CACHE_H_INCLUDED
+#define RENDER_ONIONSKIN_CACHE_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+#include "doc/frame.h"
+#include "doc/image_ref.h"
+#include "doc/object_id.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+namespace render {
+
+  // Flattened images of sprite frames used for onion skinning. It's
+  // shared by all Render instances (e.g. all editors of a document,
+  // and the threads that render the animation playback), so each
+  // frame is flattened just one time.
+  //
+  // Each image is valid while the key (the layers, cels, images, and
+  // render options used to create it) is the same. The least recently
+  // used images are discarded when the cache uses more memory than
+  // the budget.
+  class OnionskinCache {
+  public:
+    typedef std::vector<uint64_t> Key;
+
+    static OnionskinCache* instance();
+
+    OnionskinCache();
+
+    // Maximum number of bytes used by the cached images.
+    std::size_t budget() const;
+    void setBudget(std::size_t budget);
+    std::size_t memSize() const;
+
+    // Returns the image of the frame if it was flattened with the
+    // same key, or nullptr.
+    doc::ImageRef get(const doc::ObjectId spriteId,
+                      const doc::frame_t frame,
+                      const bool renderBackground,
+                      const Key& key);
+
+    // Stores the flattened image of the frame (replacing the previous
+    // one), and discards the least recently used images.
+    void set(const doc::ObjectId spriteId,
+             const doc::frame_t frame,
+             const bool renderBackground,
+             const Key& key,
+             const doc::ImageRef& image);
+
+    // Discards all images of the given sprite (e.g. when its
+    // document is closed).
+    void removeSprite(const doc::ObjectId spriteId);
+
+  private:
+    typedef std::tuple<doc::ObjectId, doc::frame_t, bool> EntryId;
+
+    struct Entry {
+      Key key;
+      doc::ImageRef image;
+      uint64_t lastUse;
+    };
+
+    void removeEntry(std::map<EntryId, Entry>::iterator it);
+
+    mutable std::mutex m_mutex;
+    std::map<EntryId, Entry> m_entries;
+    std::size_t m_budget;
+    std::size_t m_memSize;
+    uint64_t m_tick;
+
+    DISABLE_COPYING(OnionskinCache);
+  };
+
+} // namespace render
+
+#endif
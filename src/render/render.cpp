@@ -16,8 +16,10 @@
 #include "doc/doc.h"
 #include "doc/handle_anidir.h"
 #include "doc/image_impl.h"
+#include "doc/trace_events.h"
 #include "gfx/clip.h"
 #include "gfx/region.h"
+#include "render/onionskin_cache.h"
 
 #include <cmath>
 
@@ -464,6 +466,40 @@ void composite_image_general(
   }
 }
 
+template<class DstTraits>
+CompositeImageFunc get_scale_down_composition(const PixelFormat srcFormat)
+{
+  switch (srcFormat) {
+    case IMAGE_RGB:       return composite_image_scale_down<DstTraits, RgbTraits>;
+    case IMAGE_GRAYSCALE: return composite_image_scale_down<DstTraits, GrayscaleTraits>;
+    case IMAGE_INDEXED:   return composite_image_scale_down<DstTraits, IndexedTraits>;
+  }
+  return nullptr;
+}
+
+CompositeImageFunc get_scale_down_composition(const PixelFormat dstFormat,
+                                              const PixelFormat srcFormat)
+{
+  switch (dstFormat) {
+    case IMAGE_RGB:       return get_scale_down_composition<RgbTraits>(srcFormat);
+    case IMAGE_GRAYSCALE: return get_scale_down_composition<GrayscaleTraits>(srcFormat);
+    case IMAGE_INDEXED:   return get_scale_down_composition<IndexedTraits>(srcFormat);
+  }
+  return nullptr;
+}
+
+template<class Traits>
+void create_mipmap(Image* dst, const Image* src, const int level)
+{
+  const int step = (1 << level);
+  for (int y=0; y<dst->height(); ++y) {
+    auto srcPtr = get_pixel_address_fast<Traits>(src, 0, y*step);
+    auto dstPtr = get_pixel_address_fast<Traits>(dst, 0, y);
+    for (int x=0; x<dst->width(); ++x, ++dstPtr, srcPtr+=step)
+      *dstPtr = *srcPtr;
+  }
+}
+
 template<class DstTraits, class SrcTraits>
 CompositeImageFunc get_fastest_composition_path(const Projection& proj,
                                                 const bool finegrain)
@@ -523,6 +559,8 @@ Render::Render()
   , m_previewImage(nullptr)
   , m_previewBlendMode(BlendMode::NORMAL)
   , m_onionskin(OnionskinType::NONE)
+  , m_mipmapsMemSize(0)
+  , m_mipmapsTick(0)
 {
 }
 
@@ -670,6 +708,8 @@ void Render::renderSprite(
   frame_t frame,
   const gfx::ClipF& area)
 {
+  TRACE_EVENT("render", "Render::renderSprite",
+              sprite->document() ? sprite->document()->id(): NullId);
   m_sprite = sprite;
 
   CompositeImageFunc compositeImage =
@@ -815,19 +855,159 @@ void Render::renderOnionskin(
         else if (m_onionskin.type() == OnionskinType::RED_BLUE_TINT)
           blendMode = (frameOut < frame ? BlendMode::RED_TINT: BlendMode::BLUE_TINT);
 
-        renderLayer(
-          onionLayer, dstImage,
-          area, frameIn, compositeImage,
-          // Render background only for "in-front" onion skinning and
-          // when opacity is < 255
+        // Render background only for "in-front" onion skinning and
+        // when opacity is < 255
+        const bool renderBackground =
           (m_globalOpacity < 255 &&
-           m_onionskin.position() == OnionskinPosition::INFRONT),
-          true, blendMode, false);
+           m_onionskin.position() == OnionskinPosition::INFRONT);
+
+        // Use the flattened frame from the cache (only for RGB
+        // destinations, as it's an RGB image)
+        ImageRef flatImage;
+        if (dstImage->pixelFormat() == IMAGE_RGB)
+          flatImage = getOnionskinImage(onionLayer, frameIn, renderBackground);
+
+        if (flatImage) {
+          renderImage(
+            dstImage, flatImage.get(), m_sprite->palette(frameIn),
+            gfx::RectF(m_sprite->bounds()), area,
+            getImageComposition(dstImage->pixelFormat(), IMAGE_RGB, nullptr),
+            m_globalOpacity, blendMode);
+        }
+        else {
+          renderLayer(
+            onionLayer, dstImage,
+            area, frameIn, compositeImage,
+            renderBackground,
+            true, blendMode, false);
+        }
       }
     }
   }
 }
 
+ImageRef Render::getOnionskinImage(
+  const Layer* layer,
+  const frame_t frame,
+  const bool render_background)
+{
+  OnionskinCache::Key key;
+  if (!getOnionskinKey(layer, frame, render_background, key))
+    return ImageRef(nullptr);
+
+  OnionskinCache* cache = OnionskinCache::instance();
+  ImageRef image = cache->get(m_sprite->id(), frame, render_background, key);
+  if (image)
+    return image;
+
+  // Flatten the frame with normal blend mode and without the
+  // projection, the onion skin opacity and blend mode are used when
+  // the image is composited in the destination.
+  const Projection proj = m_proj;
+  const int globalOpacity = m_globalOpacity;
+  m_proj = Projection();
+  CompositeImageFunc compositeImage =
+    getImageComposition(IMAGE_RGB, m_sprite->pixelFormat(), layer);
+  if (compositeImage) {
+    image.reset(Image::create(IMAGE_RGB,
+                              m_sprite->width(),
+                              m_sprite->height()));
+    clear_image(image.get(), 0);
+
+    m_globalOpacity = 255;
+    renderLayer(
+      layer, image.get(),
+      gfx::Clip(m_sprite->bounds()), frame, compositeImage,
+      render_background, true, BlendMode::NORMAL, false);
+  }
+  m_globalOpacity = globalOpacity;
+  m_proj = proj;
+
+  if (!image)
+    return ImageRef(nullptr);
+
+  cache->set(m_sprite->id(), frame, render_background, key, image);
+  return image;
+}
+
+// Returns false if the frame cannot be cached (e.g. it contains the
+// image that is being modified by the user).
+bool Render::getOnionskinKey(
+  const Layer* onionLayer,
+  const frame_t frame,
+  const bool render_background,
+  std::vector<uint64_t>& key) const
+{
+  key.push_back(uint64_t(m_sprite->pixelFormat()));
+  key.push_back(uint64_t(m_sprite->width()));
+  key.push_back(uint64_t(m_sprite->height()));
+  key.push_back(uint64_t(m_sprite->transparentColor()));
+  key.push_back(uint64_t(m_nonactiveLayersOpacity));
+  key.push_back(uint64_t(m_selectedLayerForOpacity ? m_selectedLayerForOpacity->id(): 0));
+  key.push_back(uint64_t(render_background));
+
+  // Indexed images are converted to RGB with the palette
+  if (m_sprite->pixelFormat() == IMAGE_INDEXED) {
+    const Palette* pal = m_sprite->palette(frame);
+    for (int i=0; i<pal->size(); ++i)
+      key.push_back(pal->getEntry(i));
+  }
+
+  std::vector<const Layer*> layers(1, onionLayer);
+  while (!layers.empty()) {
+    const Layer* layer = layers.back();
+    layers.pop_back();
+    if (!layer->isVisible())
+      continue;
+
+    key.push_back(uint64_t(layer->id()));
+
+    if (layer->isGroup()) {
+      const LayerList& children = static_cast<const LayerGroup*>(layer)->layers();
+      layers.insert(layers.end(), children.rbegin(), children.rend());
+      continue;
+    }
+
+    if (!layer->isImage() ||
+        (!render_background && layer->isBackground()))
+      continue;
+
+    if (layer->isReference()) {
+      // Reference layers are rendered with sub-pixel precision
+      if (m_flags & Flags::ShowRefLayers)
+        return false;
+      continue;
+    }
+
+    const Cel* cel = layer->cel(frame);
+    if (!cel)
+      continue;
+
+    // The image is being previewed/modified in other frame (linked cels)
+    if (m_previewImage && layer == m_selectedLayer) {
+      const Cel* cel2 = layer->cel(m_selectedFrame);
+      if (cel2 && cel2->data() == cel->data())
+        return false;
+    }
+    if (m_extraCel && m_extraImage && layer == m_currentLayer) {
+      const Cel* cel2 = layer->cel(m_extraCel->frame());
+      if (frame == m_extraCel->frame() ||
+          (cel2 && cel2->data() == cel->data()))
+        return false;
+    }
+
+    const gfx::Rect bounds = cel->bounds();
+    key.push_back(uint64_t(cel->image()->id()));
+    key.push_back(uint64_t(cel->image()->version()));
+    key.push_back((uint64_t(uint32_t(bounds.x)) << 32) | uint32_t(bounds.y));
+    key.push_back((uint64_t(uint32_t(bounds.w)) << 32) | uint32_t(bounds.h));
+    key.push_back((uint64_t(cel->opacity()) << 8) |
+                  uint64_t(static_cast<const LayerImage*>(layer)->opacity()));
+    key.push_back(uint64_t(static_cast<const LayerImage*>(layer)->blendMode()));
+  }
+  return true;
+}
+
 void Render::renderBackground(
   Image* image,
   const gfx::Clip& area)
@@ -1111,6 +1291,26 @@ void Render::renderCel(
   const int opacity,
   const BlendMode blendMode)
 {
+  // The cel image cannot be moved to the swap file while we render it
+  PinImage pin(cel_image);
+
+  // Use a mipmap of the cel image when we are zoomed out (preview
+  // and extra images are temporary, so they don't use mipmaps)
+  if (cel_image != m_previewImage &&
+      cel_image != m_extraImage) {
+    const int level = getMipmapLevel(dst_image, cel_image,
+                                     celBounds, compositeImage);
+    if (level > 0) {
+      const Image* mipmap = getMipmap(cel_image, level);
+      if (mipmap) {
+        renderImage(dst_image, mipmap, pal,
+                    celBounds, area, compositeImage,
+                    opacity, blendMode, level);
+        return;
+      }
+    }
+  }
+
   renderImage(dst_image,
               cel_image,
               pal,
@@ -1129,7 +1329,8 @@ void Render::renderImage(
   const gfx::Clip& area,
   const CompositeImageFunc compositeImage,
   const int opacity,
-  const BlendMode blendMode)
+  const BlendMode blendMode,
+  const int mipmapLevel)
 {
   gfx::RectF scaledBounds = m_proj.apply(celBounds);
   gfx::RectF srcBounds = gfx::RectF(area.srcBounds()).createIntersection(scaledBounds);
@@ -1147,8 +1348,81 @@ void Render::renderImage(
       srcBounds.h),
     opacity,
     blendMode,
-    m_proj.scaleX() * celBounds.w / double(cel_image->width()),
-    m_proj.scaleY() * celBounds.h / double(cel_image->height()));
+    (mipmapLevel > 0 ? m_proj.scaleX() * (1 << mipmapLevel):
+                       m_proj.scaleX() * celBounds.w / double(cel_image->width())),
+    (mipmapLevel > 0 ? m_proj.scaleY() * (1 << mipmapLevel):
+                       m_proj.scaleY() * celBounds.h / double(cel_image->height())));
+}
+
+// Returns the mipmap level that can be used to render the given cel
+// image, or 0 if the original image must be used.
+int Render::getMipmapLevel(
+  const Image* dst_image,
+  const Image* cel_image,
+  const gfx::RectF& celBounds,
+  const CompositeImageFunc compositeImage) const
+{
+  // Only composite_image_scale_down() samples pixels at a regular
+  // step that can be used with mipmaps
+  if (m_proj.scaleX() >= 1.0 || m_proj.scaleY() >= 1.0 ||
+      celBounds.w != cel_image->width() ||
+      celBounds.h != cel_image->height() ||
+      compositeImage != get_scale_down_composition(dst_image->pixelFormat(),
+                                                   cel_image->pixelFormat()))
+    return 0;
+
+  const int stepX = int(1.0 / m_proj.scaleX());
+  const int stepY = int(1.0 / m_proj.scaleY());
+  int level = 0;
+  while (((stepX | stepY) & ((2 << level) - 1)) == 0 &&
+         (cel_image->width() >> (level+1)) > 0 &&
+         (cel_image->height() >> (level+1)) > 0)
+    ++level;
+  return level;
+}
+
+const Image* Render::getMipmap(
+  const Image* cel_image,
+  const int level)
+{
+  Mipmap& mipmap = m_mipmaps[std::make_pair(cel_image->id(), level)];
+  mipmap.lastUse = ++m_mipmapsTick;
+  if (mipmap.image && mipmap.version == cel_image->version())
+    return mipmap.image.get();
+
+  // Each pixel of the mipmap is the pixel (x*2^level, y*2^level) of
+  // the original image (the last incomplete row/column is discarded
+  // as composite_image_scale_down() does)
+  const int w = (cel_image->width() >> level);
+  const int h = (cel_image->height() >> level);
+  if (mipmap.image)
+    m_mipmapsMemSize -= mipmap.image->getMemSize();
+  mipmap.image.reset(Image::create(cel_image->pixelFormat(), w, h));
+  mipmap.image->setMaskColor(cel_image->maskColor());
+  mipmap.version = cel_image->version();
+  m_mipmapsMemSize += mipmap.image->getMemSize();
+
+  switch (cel_image->pixelFormat()) {
+    case IMAGE_RGB:       create_mipmap<RgbTraits>(mipmap.image.get(), cel_image, level); break;
+    case IMAGE_GRAYSCALE: create_mipmap<GrayscaleTraits>(mipmap.image.get(), cel_image, level); break;
+    case IMAGE_INDEXED:   create_mipmap<IndexedTraits>(mipmap.image.get(), cel_image, level); break;
+    default:
+      ASSERT(false);
+      break;
+  }
+
+  // Discard the least recently used mipmaps
+  ImageRef result = mipmap.image;
+  while (m_mipmapsMemSize > kMaxMipmapsMemSize && m_mipmaps.size() > 1) {
+    auto oldest = m_mipmaps.begin();
+    for (auto it=oldest; it!=m_mipmaps.end(); ++it)
+      if (it->second.lastUse < oldest->second.lastUse)
+        oldest = it;
+    if (oldest->second.image)
+      m_mipmapsMemSize -= oldest->second.image->getMemSize();
+    m_mipmaps.erase(oldest);
+  }
+  return (m_mipmapsMemSize <= kMaxMipmapsMemSize ? result.get(): nullptr);
 }
 
 CompositeImageFunc Render::getImageComposition(
@@ -12,6 +12,9 @@
 #include "doc/blend_mode.h"
 #include "doc/color.h"
 #include "doc/frame.h"
+#include "doc/image_ref.h"
+#include "doc/object.h"
+#include "doc/object_id.h"
 #include "doc/pixel_format.h"
 #include "gfx/clip.h"
 #include "gfx/point.h"
@@ -21,6 +24,11 @@
 #include "render/onionskin_options.h"
 #include "render/projection.h"
 
+#include <cstdint>
+#include <map>
+#include <utility>
+#include <vector>
+
 namespace doc {
   class Cel;
   class FrameTag;
@@ -128,12 +136,39 @@ namespace render {
       const BlendMode blendMode);
 
   private:
+    // Cel image scaled down by a power of two (2^level), used when
+    // the projection is zoomed out. Each pixel of the mipmap is the
+    // same pixel that is sampled from the original image, so the
+    // result is the same but we read less memory.
+    struct Mipmap {
+      ObjectVersion version;
+      ImageRef image;
+      int lastUse;
+    };
+
+    // Maximum memory used by all mipmaps
+    static const int kMaxMipmapsMemSize = 128*1024*1024;
+
     void renderOnionskin(
       Image* image,
       const gfx::Clip& area,
       const frame_t frame,
       const CompositeImageFunc compositeImage);
 
+    // Flattened image of a frame (from the OnionskinCache). It's
+    // rendered without the projection, so it can be re-used after
+    // scrolling or zooming.
+    ImageRef getOnionskinImage(
+      const Layer* layer,
+      const frame_t frame,
+      const bool render_background);
+
+    bool getOnionskinKey(
+      const Layer* onionLayer,
+      const frame_t frame,
+      const bool render_background,
+      std::vector<uint64_t>& key) const;
+
     void renderLayer(
       const Layer* layer,
       Image* image,
@@ -163,7 +198,18 @@ namespace render {
       const gfx::Clip& area,
       const CompositeImageFunc compositeImage,
       const int opacity,
-      const BlendMode blendMode);
+      const BlendMode blendMode,
+      const int mipmapLevel = 0);
+
+    int getMipmapLevel(
+      const Image* dst_image,
+      const Image* cel_image,
+      const gfx::RectF& celBounds,
+      const CompositeImageFunc compositeImage) const;
+
+    const Image* getMipmap(
+      const Image* cel_image,
+      const int level);
 
     CompositeImageFunc getImageComposition(
       const PixelFormat dstFormat,
@@ -193,6 +239,9 @@ namespace render {
     gfx::Point m_previewPos;
     BlendMode m_previewBlendMode;
     OnionskinOptions m_onionskin;
+    std::map<std::pair<ObjectId, int>, Mipmap> m_mipmaps;
+    int m_mipmapsMemSize;
+    int m_mipmapsTick;
   };
 
   void composite_image(Image* dst,
@@ -12,13 +12,17 @@
 
 #include "render/render.h"
 
+#include "doc/blend_funcs.h"
 #include "doc/cel.h"
 #include "doc/document.h"
 #include "doc/image.h"
+#include "doc/image_ref.h"
 #include "doc/layer.h"
 #include "doc/palette.h"
 #include "doc/primitives.h"
+#include "render/onionskin_cache.h"
 
+#include <cstdlib>
 #include <memory>
 
 using namespace doc;
@@ -264,6 +268,224 @@ TEST(Render, BugWithMultiplesOf3ZoomFactors)
   }
 }
 
+TEST(Render, OnionskinCache)
+{
+  Document* doc = new Document;
+  doc->sprites().add(2, 2, ColorMode::RGB);
+
+  Sprite* sprite = doc->sprite();
+  LayerImage* layer = static_cast<LayerImage*>(sprite->root()->firstLayer());
+  layer->setBackground(false);
+  sprite->setTotalFrames(frame_t(2));
+
+  Image* src0 = layer->cel(0)->image();
+  ImageRef src1(Image::create(IMAGE_RGB, 2, 2));
+  clear_image(src0, rgba(255, 0, 0, 255));
+  clear_image(src1.get(), 0);
+  put_pixel(src1.get(), 1, 1, rgba(0, 255, 0, 255));
+  layer->addCel(new Cel(frame_t(1), src1));
+
+  OnionskinOptions opts(OnionskinType::MERGE);
+  opts.prevFrames(1);
+  opts.opacityBase(255);
+
+  Render render;
+  render.setOnionskin(opts);
+
+  std::unique_ptr<Image> dst(Image::create(IMAGE_RGB, 2, 2));
+  clear_image(dst.get(), 0);
+  render.renderSprite(dst.get(), sprite, frame_t(1));
+  EXPECT_2X2_PIXELS(dst.get(),
+                    rgba(255, 0, 0, 255), rgba(255, 0, 0, 255),
+                    rgba(255, 0, 0, 255), rgba(0, 255, 0, 255));
+
+  // The cached frame is updated when the image is modified
+  clear_image(src0, rgba(0, 0, 255, 255));
+  src0->incrementVersion();
+  render.renderSprite(dst.get(), sprite, frame_t(1));
+  EXPECT_2X2_PIXELS(dst.get(),
+                    rgba(0, 0, 255, 255), rgba(0, 0, 255, 255),
+                    rgba(0, 0, 255, 255), rgba(0, 255, 0, 255));
+
+  // The cached frame is re-used with a different projection
+  std::unique_ptr<Image> dst2(Image::create(IMAGE_RGB, 4, 4));
+  clear_image(dst2.get(), 0);
+  render.setProjection(Projection(PixelRatio(1, 1), Zoom(2, 1)));
+  render.renderSprite(dst2.get(), sprite, frame_t(1),
+                      gfx::Clip(0, 0, 0, 0, 4, 4));
+  const color_t b = rgba(0, 0, 255, 255);
+  const color_t g = rgba(0, 255, 0, 255);
+  EXPECT_4X4_PIXELS(dst2.get(),
+                    b, b, b, b,
+                    b, b, b, b,
+                    b, b, g, g,
+                    b, b, g, g);
+
+  // Moving the cel invalidates the cached frame
+  layer->cel(0)->setPosition(1, 0);
+  render.setProjection(Projection());
+  clear_image(dst.get(), 0);
+  render.renderSprite(dst.get(), sprite, frame_t(1));
+  EXPECT_2X2_PIXELS(dst.get(),
+                    0, rgba(0, 0, 255, 255),
+                    0, rgba(0, 255, 0, 255));
+}
+
+TEST(Render, OnionskinCacheWithOpacity)
+{
+  Document* doc = new Document;
+  doc->sprites().add(2, 2, ColorMode::RGB);
+
+  Sprite* sprite = doc->sprite();
+  LayerImage* layer = static_cast<LayerImage*>(sprite->root()->firstLayer());
+  layer->setBackground(false);
+  sprite->setTotalFrames(frame_t(2));
+
+  clear_image(layer->cel(0)->image(), rgba(255, 0, 0, 255));
+  ImageRef src1(Image::create(IMAGE_RGB, 2, 2));
+  clear_image(src1.get(), 0);
+  put_pixel(src1.get(), 1, 1, rgba(0, 255, 0, 255));
+  layer->addCel(new Cel(frame_t(1), src1));
+
+  // A visible reference layer disables the cache (when reference
+  // layers are shown), so we can compare with the original result
+  LayerImage* refLayer = new LayerImage(sprite);
+  refLayer->setReference(true);
+  sprite->root()->addLayer(refLayer);
+
+  OnionskinOptions opts(OnionskinType::MERGE);
+  opts.prevFrames(1);
+  opts.opacityBase(128);
+
+  Render uncached;
+  uncached.setRefLayersVisiblity(true);
+  uncached.setOnionskin(opts);
+
+  std::unique_ptr<Image> expected(Image::create(IMAGE_RGB, 2, 2));
+  clear_image(expected.get(), 0);
+  uncached.renderSprite(expected.get(), sprite, frame_t(1));
+
+  const color_t r = rgba_blender_normal(0, rgba(255, 0, 0, 255), 128);
+  EXPECT_2X2_PIXELS(expected.get(),
+                    r, r,
+                    r, rgba(0, 255, 0, 255));
+
+  Render render;
+  render.setOnionskin(opts);
+
+  // Cache miss and cache hit
+  std::unique_ptr<Image> dst(Image::create(IMAGE_RGB, 2, 2));
+  for (int i=0; i<2; ++i) {
+    clear_image(dst.get(), 0);
+    render.renderSprite(dst.get(), sprite, frame_t(1));
+    EXPECT_EQ(0, count_diff_between_images(expected.get(), dst.get()));
+  }
+}
+
+TEST(Render, OnionskinCacheSharedWithBudget)
+{
+  Document* doc = new Document;
+  doc->sprites().add(2, 2, ColorMode::RGB);
+
+  Sprite* sprite = doc->sprite();
+  LayerImage* layer = static_cast<LayerImage*>(sprite->root()->firstLayer());
+  layer->setBackground(false);
+  sprite->setTotalFrames(frame_t(3));
+  clear_image(layer->cel(0)->image(), rgba(255, 0, 0, 255));
+  for (frame_t frame=1; frame<3; ++frame) {
+    ImageRef image(Image::create(IMAGE_RGB, 2, 2));
+    clear_image(image.get(), rgba(0, 0, 255*frame/2, 255));
+    layer->addCel(new Cel(frame, image));
+  }
+
+  OnionskinOptions opts(OnionskinType::MERGE);
+  opts.prevFrames(2);
+  opts.opacityBase(255);
+  opts.opacityStep(0);
+
+  OnionskinCache* cache = OnionskinCache::instance();
+  const std::size_t initialSize = cache->memSize();
+  const std::size_t frameSize = layer->cel(0)->image()->getMemSize();
+
+  // Two flattened frames (0 and 1) are shared by both renders
+  std::unique_ptr<Image> dst1(Image::create(IMAGE_RGB, 2, 2));
+  std::unique_ptr<Image> dst2(Image::create(IMAGE_RGB, 2, 2));
+  clear_image(dst1.get(), 0);
+  clear_image(dst2.get(), 0);
+  Render render1, render2;
+  render1.setOnionskin(opts);
+  render2.setOnionskin(opts);
+  render1.renderSprite(dst1.get(), sprite, frame_t(2));
+  EXPECT_EQ(initialSize + 2*frameSize, cache->memSize());
+  render2.renderSprite(dst2.get(), sprite, frame_t(2));
+  EXPECT_EQ(initialSize + 2*frameSize, cache->memSize());
+  EXPECT_EQ(0, count_diff_between_images(dst1.get(), dst2.get()));
+
+  // The least recently used frames are discarded
+  const std::size_t budget = cache->budget();
+  cache->setBudget(frameSize);
+  EXPECT_GE(frameSize, cache->memSize());
+
+  clear_image(dst2.get(), 0);
+  render2.renderSprite(dst2.get(), sprite, frame_t(2));
+  EXPECT_GE(frameSize, cache->memSize());
+  EXPECT_EQ(0, count_diff_between_images(dst1.get(), dst2.get()));
+  cache->setBudget(budget);
+
+  // Frames of the sprite are discarded when its document is closed
+  render1.renderSprite(dst1.get(), sprite, frame_t(2));
+  cache->removeSprite(sprite->id());
+  EXPECT_GE(initialSize, cache->memSize());
+}
+
+TEST(Render, ZoomOutWithMipmaps)
+{
+  std::srand(1);
+
+  Document* doc = new Document;
+  doc->sprites().add(67, 45, ColorMode::RGB);
+
+  Sprite* sprite = doc->sprite();
+  LayerImage* layer = static_cast<LayerImage*>(sprite->root()->firstLayer());
+  layer->setBackground(false);
+
+  Cel* cel = layer->cel(0);
+  ImageRef src(Image::create(IMAGE_RGB, 61, 39));
+  for (int y=0; y<src->height(); ++y)
+    for (int x=0; x<src->width(); ++x)
+      put_pixel(src.get(), x, y, rgba(std::rand()%256, std::rand()%256,
+                                      std::rand()%256, 255));
+  cel->data()->setImage(src);
+  cel->setPosition(3, 5);
+
+  Render render;
+  for (int i=0; i<2; ++i) {
+    for (int scale : { 2, 4, 6, 8, 16 }) {
+      render.setProjection(Projection(PixelRatio(1, 1), Zoom(1, scale)));
+
+      // The preview image is rendered without mipmaps
+      std::unique_ptr<Image> expected(Image::create(IMAGE_RGB, 67, 45));
+      clear_image(expected.get(), 0);
+      render.setPreviewImage(layer, frame_t(0), src.get(),
+                             cel->position(), BlendMode::NORMAL);
+      render.renderSprite(expected.get(), sprite, frame_t(0));
+      render.removePreviewImage();
+
+      std::unique_ptr<Image> result(Image::create(IMAGE_RGB, 67, 45));
+      clear_image(result.get(), 0);
+      render.renderSprite(result.get(), sprite, frame_t(0));
+
+      EXPECT_EQ(0, count_diff_between_images(expected.get(), result.get()))
+        << "i=" << i << " scale=" << scale;
+    }
+
+    // Modify the image to check that mipmaps are regenerated
+    for (int y=0; y<src->height(); ++y)
+      put_pixel(src.get(), y, y, rgba(255, 255, 255, 255));
+    src->incrementVersion();
+  }
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);